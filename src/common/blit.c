@@ -0,0 +1,564 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "common/blit.h"
+
+#include <guacamole/protocol-types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Mask selecting only the alpha component of an ARGB pixel.
+ */
+#define GUAC_COMMON_BLIT_ALPHA 0xFF000000
+
+/**
+ * Mask selecting only the color components of an ARGB pixel.
+ */
+#define GUAC_COMMON_BLIT_COLOR 0x00FFFFFF
+
+/*
+ * Vector operations on groups of GUAC_COMMON_BLIT_VECTOR_SIZE pixels. The
+ * widest instruction set available at compile time is used, with AVX2 and
+ * SSE2 available on x86 and NEON available on 64-bit ARM. If none are
+ * available, GUAC_COMMON_BLIT_VECTOR_SIZE is left undefined and all rows are
+ * processed one pixel at a time.
+ */
+
+#if defined(__AVX2__)
+
+typedef __m256i guac_common_blit_vector;
+
+#define GUAC_COMMON_BLIT_VECTOR_SIZE 8
+#define GUAC_COMMON_BLIT_LOAD(p)   _mm256_loadu_si256((const __m256i*) (p))
+#define GUAC_COMMON_BLIT_STORE(p, v) _mm256_storeu_si256((__m256i*) (p), v)
+#define GUAC_COMMON_BLIT_SPLAT(c)  _mm256_set1_epi32((int) (c))
+#define GUAC_COMMON_BLIT_AND(a, b) _mm256_and_si256(a, b)
+#define GUAC_COMMON_BLIT_OR(a, b)  _mm256_or_si256(a, b)
+#define GUAC_COMMON_BLIT_XOR(a, b) _mm256_xor_si256(a, b)
+#define GUAC_COMMON_BLIT_EQ(a, b)  _mm256_cmpeq_epi32(a, b)
+#define GUAC_COMMON_BLIT_SELECT(m, a, b) _mm256_blendv_epi8(b, a, m)
+#define GUAC_COMMON_BLIT_MASK(v) \
+    _mm256_movemask_ps(_mm256_castsi256_ps(v))
+
+#elif defined(__SSE2__)
+
+typedef __m128i guac_common_blit_vector;
+
+#define GUAC_COMMON_BLIT_VECTOR_SIZE 4
+#define GUAC_COMMON_BLIT_LOAD(p)   _mm_loadu_si128((const __m128i*) (p))
+#define GUAC_COMMON_BLIT_STORE(p, v) _mm_storeu_si128((__m128i*) (p), v)
+#define GUAC_COMMON_BLIT_SPLAT(c)  _mm_set1_epi32((int) (c))
+#define GUAC_COMMON_BLIT_AND(a, b) _mm_and_si128(a, b)
+#define GUAC_COMMON_BLIT_OR(a, b)  _mm_or_si128(a, b)
+#define GUAC_COMMON_BLIT_XOR(a, b) _mm_xor_si128(a, b)
+#define GUAC_COMMON_BLIT_EQ(a, b)  _mm_cmpeq_epi32(a, b)
+#define GUAC_COMMON_BLIT_SELECT(m, a, b) \
+    _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b))
+#define GUAC_COMMON_BLIT_MASK(v) \
+    _mm_movemask_ps(_mm_castsi128_ps(v))
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+typedef uint32x4_t guac_common_blit_vector;
+
+#define GUAC_COMMON_BLIT_VECTOR_SIZE 4
+#define GUAC_COMMON_BLIT_LOAD(p)   vld1q_u32((const uint32_t*) (p))
+#define GUAC_COMMON_BLIT_STORE(p, v) vst1q_u32((uint32_t*) (p), v)
+#define GUAC_COMMON_BLIT_SPLAT(c)  vdupq_n_u32(c)
+#define GUAC_COMMON_BLIT_AND(a, b) vandq_u32(a, b)
+#define GUAC_COMMON_BLIT_OR(a, b)  vorrq_u32(a, b)
+#define GUAC_COMMON_BLIT_XOR(a, b) veorq_u32(a, b)
+#define GUAC_COMMON_BLIT_EQ(a, b)  vceqq_u32(a, b)
+#define GUAC_COMMON_BLIT_SELECT(m, a, b) vbslq_u32(m, a, b)
+#define GUAC_COMMON_BLIT_MASK(v) guac_common_blit_neon_mask(v)
+
+/**
+ * Returns a bitmask containing the most significant bit of each lane of the
+ * given vector, where bit N of the result corresponds to lane N. This is the
+ * NEON equivalent of the SSE "movemask" instructions.
+ *
+ * @param v
+ *     The vector to convert to a bitmask, where each lane is expected to be
+ *     either all zeroes or all ones.
+ *
+ * @return
+ *     A bitmask with one bit for each lane of the given vector.
+ */
+static inline int guac_common_blit_neon_mask(uint32x4_t v) {
+    static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(v, vld1q_u32(lanes)));
+}
+
+#endif
+
+#ifdef GUAC_COMMON_BLIT_VECTOR_SIZE
+
+/**
+ * Bitmask which would be returned by GUAC_COMMON_BLIT_MASK() if all lanes
+ * of the vector are set.
+ */
+#define GUAC_COMMON_BLIT_ALL_LANES ((1 << GUAC_COMMON_BLIT_VECTOR_SIZE) - 1)
+
+#endif
+
+/**
+ * Records the given bitmask of changed pixels, where bit N corresponds to the
+ * pixel at the given offset plus N, within the given first/last changed
+ * offsets of the row being processed.
+ *
+ * @param changed
+ *     The bitmask of changed pixels. This must be non-zero.
+ *
+ * @param offset
+ *     The offset of the pixel corresponding to the least significant bit of
+ *     the bitmask.
+ *
+ * @param min_x
+ *     The offset of the first changed pixel seen thus far, or -1 if no
+ *     changed pixels have been seen.
+ *
+ * @param max_x
+ *     The offset of the last changed pixel seen thus far, or -1 if no changed
+ *     pixels have been seen.
+ */
+static void guac_common_blit_record_changes(int changed, int offset,
+        int* min_x, int* max_x) {
+
+    int first = offset;
+    int last = offset;
+
+    /* Locate first and last set bits */
+    while (!(changed & 1)) {
+        changed >>= 1;
+        first++;
+    }
+
+    last = first;
+    while (changed >>= 1)
+        last++;
+
+    if (*min_x == -1 || first < *min_x) *min_x = first;
+    if (last > *max_x) *max_x = last;
+
+}
+
+/**
+ * Generates a function which processes a single row of pixels, computing each
+ * destination pixel from the corresponding source pixel, destination pixel
+ * and the given constant arguments. Vector instructions are used for as much
+ * of the row as possible, falling back to processing each pixel individually
+ * for the remainder. Only pixels which change are stored, and the offsets of
+ * the first and last changed pixels are returned via min_x and max_x.
+ *
+ * Within SCALAR, the source and destination pixels are available as "s" and
+ * "d" respectively, while the constant arguments are available as "a" and
+ * "b". Within VECTOR, the same are available as "vs", "vd", "va" and "vb",
+ * and the result must be assigned to "vr".
+ *
+ * @param name
+ *     The name of the function to generate.
+ *
+ * @param SCALAR
+ *     An expression which evaluates to the new value of a single pixel.
+ *
+ * @param VECTOR
+ *     A statement which assigns the new value of a vector of pixels to "vr".
+ */
+#ifdef GUAC_COMMON_BLIT_VECTOR_SIZE
+#define GUAC_COMMON_BLIT_KERNEL(name, SCALAR, VECTOR)                       \
+static int name(uint32_t* dst, const uint32_t* src, int width,              \
+        int backwards, uint32_t a, uint32_t b, int* min_x, int* max_x) {    \
+                                                                            \
+    int x;                                                                  \
+    int vector_width = width - width % GUAC_COMMON_BLIT_VECTOR_SIZE;        \
+                                                                            \
+    guac_common_blit_vector va = GUAC_COMMON_BLIT_SPLAT(a);                 \
+    guac_common_blit_vector vb = GUAC_COMMON_BLIT_SPLAT(b);                 \
+                                                                            \
+    *min_x = *max_x = -1;                                                   \
+    (void) va; (void) vb;                                                   \
+                                                                            \
+    /* Process as many pixels as possible in groups, starting at the end    \
+     * of the row if processing the row backwards */                        \
+    for (x = 0; x < vector_width; x += GUAC_COMMON_BLIT_VECTOR_SIZE) {      \
+                                                                            \
+        int offset = backwards ? width - x                                  \
+                                 - GUAC_COMMON_BLIT_VECTOR_SIZE : x;        \
+                                                                            \
+        guac_common_blit_vector vd = GUAC_COMMON_BLIT_LOAD(dst + offset);   \
+        guac_common_blit_vector vs = vd;                                    \
+        guac_common_blit_vector vr;                                         \
+        if (src != NULL) vs = GUAC_COMMON_BLIT_LOAD(src + offset);          \
+        (void) vs;                                                          \
+                                                                            \
+        VECTOR;                                                             \
+                                                                            \
+        /* Store only if changed */                                         \
+        int changed = ~GUAC_COMMON_BLIT_MASK(GUAC_COMMON_BLIT_EQ(vr, vd))   \
+                    & GUAC_COMMON_BLIT_ALL_LANES;                           \
+        if (changed) {                                                      \
+            GUAC_COMMON_BLIT_STORE(dst + offset, vr);                       \
+            guac_common_blit_record_changes(changed, offset, min_x, max_x); \
+        }                                                                   \
+                                                                            \
+    }                                                                       \
+                                                                            \
+    /* Process remaining pixels individually */                             \
+    for (x = vector_width; x < width; x++) {                                \
+                                                                            \
+        int offset = backwards ? width - 1 - x : x;                         \
+                                                                            \
+        uint32_t d = dst[offset];                                           \
+        uint32_t s = src != NULL ? src[offset] : d;                         \
+        uint32_t r = SCALAR;                                                \
+        (void) s;                                                           \
+                                                                            \
+        if (r != d) {                                                       \
+            dst[offset] = r;                                                \
+            guac_common_blit_record_changes(1, offset, min_x, max_x);       \
+        }                                                                   \
+                                                                            \
+    }                                                                       \
+                                                                            \
+    return *max_x != -1;                                                    \
+                                                                            \
+}
+#else
+#define GUAC_COMMON_BLIT_KERNEL(name, SCALAR, VECTOR)                       \
+static int name(uint32_t* dst, const uint32_t* src, int width,              \
+        int backwards, uint32_t a, uint32_t b, int* min_x, int* max_x) {    \
+                                                                            \
+    int x;                                                                  \
+                                                                            \
+    *min_x = *max_x = -1;                                                   \
+                                                                            \
+    /* Process each pixel individually */                                   \
+    for (x = 0; x < width; x++) {                                           \
+                                                                            \
+        int offset = backwards ? width - 1 - x : x;                         \
+                                                                            \
+        uint32_t d = dst[offset];                                           \
+        uint32_t s = src != NULL ? src[offset] : d;                         \
+        uint32_t r = SCALAR;                                                \
+        (void) s;                                                           \
+                                                                            \
+        if (r != d) {                                                       \
+            dst[offset] = r;                                                \
+            guac_common_blit_record_changes(1, offset, min_x, max_x);       \
+        }                                                                   \
+                                                                            \
+    }                                                                       \
+                                                                            \
+    return *max_x != -1;                                                    \
+                                                                            \
+}
+#endif
+
+/**
+ * Applies the Porter-Duff "over" composite operator, blending the two given
+ * color components using the given alpha value.
+ *
+ * @param dst
+ *     The destination color component.
+ *
+ * @param src
+ *     The source color component.
+ *
+ * @param alpha
+ *     The alpha value which applies to the blending operation.
+ *
+ * @return
+ *     The result of applying the Porter-Duff "over" composite operator to the
+ *     given source and destination components.
+ */
+static int guac_common_blit_blend_component(int dst, int src, int alpha) {
+
+    int blended = src + dst * (0xFF - alpha);
+
+    /* Do not exceed maximum component value */
+    if (blended > 0xFF)
+        return 0xFF;
+
+    return blended;
+
+}
+
+/**
+ * Applies the Porter-Duff "over" composite operator, blending each component
+ * of the two given ARGB colors.
+ *
+ * @param dst
+ *     The destination ARGB color.
+ *
+ * @param src
+ *     The source ARGB color.
+ *
+ * @return
+ *     The result of applying the Porter-Duff "over" composite operator to the
+ *     given source and destination colors.
+ */
+static uint32_t guac_common_blit_argb_blend(uint32_t dst, uint32_t src) {
+
+    /* Separate destination ARGB color into its components */
+    int dst_a = (dst >> 24) & 0xFF;
+    int dst_r = (dst >> 16) & 0xFF;
+    int dst_g = (dst >>  8) & 0xFF;
+    int dst_b =  dst        & 0xFF;
+
+    /* Separate source ARGB color into its components */
+    int src_a = (src >> 24) & 0xFF;
+    int src_r = (src >> 16) & 0xFF;
+    int src_g = (src >>  8) & 0xFF;
+    int src_b =  src        & 0xFF;
+
+    /* If source is fully opaque (or destination is fully transparent), the
+     * blended result is the source */
+    if (src_a == 0xFF || dst_a == 0x00)
+        return src;
+
+    /* If source is fully transparent, the blended result is the destination */
+    if (src_a == 0x00)
+        return dst;
+
+    /* Otherwise, blend each ARGB component, assuming pre-multiplied alpha */
+    uint32_t r = guac_common_blit_blend_component(dst_r, src_r, src_a);
+    uint32_t g = guac_common_blit_blend_component(dst_g, src_g, src_a);
+    uint32_t b = guac_common_blit_blend_component(dst_b, src_b, src_a);
+    uint32_t a = guac_common_blit_blend_component(dst_a, src_a, src_a);
+
+    /* Recombine blended components */
+    return (a << 24) | (r << 16) | (g << 8) | b;
+
+}
+
+#ifdef GUAC_COMMON_BLIT_VECTOR_SIZE
+
+/**
+ * Applies the Porter-Duff "over" composite operator to each pair of ARGB
+ * colors within the given vectors. Groups of pixels in which every source
+ * pixel is fully opaque or fully transparent (the common case for glyphs and
+ * cursors) are blended entirely using vector instructions, while all other
+ * groups are blended one pixel at a time.
+ *
+ * @param vd
+ *     The destination ARGB colors.
+ *
+ * @param vs
+ *     The source ARGB colors.
+ *
+ * @return
+ *     The result of applying the Porter-Duff "over" composite operator to the
+ *     given source and destination colors.
+ */
+static guac_common_blit_vector guac_common_blit_argb_blend_vector(
+        guac_common_blit_vector vd, guac_common_blit_vector vs) {
+
+    guac_common_blit_vector alpha = GUAC_COMMON_BLIT_SPLAT(GUAC_COMMON_BLIT_ALPHA);
+    guac_common_blit_vector zero = GUAC_COMMON_BLIT_SPLAT(0);
+    guac_common_blit_vector src_alpha = GUAC_COMMON_BLIT_AND(vs, alpha);
+
+    /* If all source pixels are fully opaque, the result is the source */
+    if (GUAC_COMMON_BLIT_MASK(GUAC_COMMON_BLIT_EQ(src_alpha, alpha))
+            == GUAC_COMMON_BLIT_ALL_LANES)
+        return vs;
+
+    /* If all source pixels are fully transparent, the result is the
+     * destination, except where the destination is also fully transparent */
+    if (GUAC_COMMON_BLIT_MASK(GUAC_COMMON_BLIT_EQ(src_alpha, zero))
+            == GUAC_COMMON_BLIT_ALL_LANES) {
+        guac_common_blit_vector dst_clear =
+            GUAC_COMMON_BLIT_EQ(GUAC_COMMON_BLIT_AND(vd, alpha), zero);
+        return GUAC_COMMON_BLIT_SELECT(dst_clear, vs, vd);
+    }
+
+    /* Otherwise, blend each pixel individually */
+    int i;
+    uint32_t d[GUAC_COMMON_BLIT_VECTOR_SIZE];
+    uint32_t s[GUAC_COMMON_BLIT_VECTOR_SIZE];
+    GUAC_COMMON_BLIT_STORE(d, vd);
+    GUAC_COMMON_BLIT_STORE(s, vs);
+    for (i = 0; i < GUAC_COMMON_BLIT_VECTOR_SIZE; i++)
+        d[i] = guac_common_blit_argb_blend(d[i], s[i]);
+
+    return GUAC_COMMON_BLIT_LOAD(d);
+
+}
+
+#endif
+
+/* Assigns the constant "a" */
+GUAC_COMMON_BLIT_KERNEL(guac_common_blit_row_const,
+    a,
+    vr = va
+)
+
+/* Assigns the source, with "a" XOR'd and "b" OR'd */
+GUAC_COMMON_BLIT_KERNEL(guac_common_blit_row_src,
+    (s ^ a) | b,
+    vr = GUAC_COMMON_BLIT_OR(GUAC_COMMON_BLIT_XOR(vs, va), vb)
+)
+
+/* XOR's the destination with "b" */
+GUAC_COMMON_BLIT_KERNEL(guac_common_blit_row_dest,
+    d ^ b,
+    vr = GUAC_COMMON_BLIT_XOR(vd, vb)
+)
+
+/* AND's the color components of the destination with the source (after
+ * XOR'ing the source with "a"), XOR'ing the result with "b" */
+GUAC_COMMON_BLIT_KERNEL(guac_common_blit_row_and,
+    (d & ((s ^ a) | GUAC_COMMON_BLIT_ALPHA)) ^ b,
+    vr = GUAC_COMMON_BLIT_XOR(GUAC_COMMON_BLIT_AND(vd,
+            GUAC_COMMON_BLIT_OR(GUAC_COMMON_BLIT_XOR(vs, va),
+                GUAC_COMMON_BLIT_SPLAT(GUAC_COMMON_BLIT_ALPHA))), vb)
+)
+
+/* OR's the color components of the destination with the source (after
+ * XOR'ing the source with "a"), XOR'ing the result with "b" */
+GUAC_COMMON_BLIT_KERNEL(guac_common_blit_row_or,
+    (d | ((s ^ a) & GUAC_COMMON_BLIT_COLOR)) ^ b,
+    vr = GUAC_COMMON_BLIT_XOR(GUAC_COMMON_BLIT_OR(vd,
+            GUAC_COMMON_BLIT_AND(GUAC_COMMON_BLIT_XOR(vs, va),
+                GUAC_COMMON_BLIT_SPLAT(GUAC_COMMON_BLIT_COLOR))), vb)
+)
+
+/* XOR's the color components of the destination with the source (after
+ * XOR'ing the source with "a"), XOR'ing the result with "b" */
+GUAC_COMMON_BLIT_KERNEL(guac_common_blit_row_xor,
+    (d ^ ((s ^ a) & GUAC_COMMON_BLIT_COLOR)) ^ b,
+    vr = GUAC_COMMON_BLIT_XOR(GUAC_COMMON_BLIT_XOR(vd,
+            GUAC_COMMON_BLIT_AND(GUAC_COMMON_BLIT_XOR(vs, va),
+                GUAC_COMMON_BLIT_SPLAT(GUAC_COMMON_BLIT_COLOR))), vb)
+)
+
+/* Blends the source over the destination */
+GUAC_COMMON_BLIT_KERNEL(guac_common_blit_row_blend,
+    guac_common_blit_argb_blend(d, s),
+    vr = guac_common_blit_argb_blend_vector(vd, vs)
+)
+
+int guac_common_blit_put(uint32_t* dst, const uint32_t* src, int width,
+        int opaque, int* min_x, int* max_x) {
+
+    /* Ignore alpha channel if opaque */
+    if (opaque)
+        return guac_common_blit_row_src(dst, src, width, 0,
+                0, GUAC_COMMON_BLIT_ALPHA, min_x, max_x);
+
+    /* Otherwise, perform alpha blending operation */
+    return guac_common_blit_row_blend(dst, src, width, 0,
+            0, 0, min_x, max_x);
+
+}
+
+int guac_common_blit_transfer(uint32_t* dst, const uint32_t* src, int width,
+        guac_transfer_function op, int backwards, int* min_x, int* max_x) {
+
+    switch (op) {
+
+        case GUAC_TRANSFER_BINARY_BLACK:
+            return guac_common_blit_row_const(dst, NULL, width, backwards,
+                    0xFF000000, 0, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_WHITE:
+            return guac_common_blit_row_const(dst, NULL, width, backwards,
+                    0xFFFFFFFF, 0, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_SRC:
+            return guac_common_blit_row_src(dst, src, width, backwards,
+                    0, 0, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_NSRC:
+            return guac_common_blit_row_src(dst, src, width, backwards,
+                    GUAC_COMMON_BLIT_COLOR, 0, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_NDEST:
+            return guac_common_blit_row_dest(dst, NULL, width, backwards,
+                    0, GUAC_COMMON_BLIT_COLOR, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_AND:
+            return guac_common_blit_row_and(dst, src, width, backwards,
+                    0, 0, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_NAND:
+            return guac_common_blit_row_and(dst, src, width, backwards,
+                    0, GUAC_COMMON_BLIT_COLOR, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_OR:
+            return guac_common_blit_row_or(dst, src, width, backwards,
+                    0, 0, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_NOR:
+            return guac_common_blit_row_or(dst, src, width, backwards,
+                    0, GUAC_COMMON_BLIT_COLOR, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_XOR:
+            return guac_common_blit_row_xor(dst, src, width, backwards,
+                    0, 0, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_XNOR:
+            return guac_common_blit_row_xor(dst, src, width, backwards,
+                    0, GUAC_COMMON_BLIT_COLOR, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_NSRC_AND:
+            return guac_common_blit_row_and(dst, src, width, backwards,
+                    GUAC_COMMON_BLIT_COLOR, 0, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_NSRC_NAND:
+            return guac_common_blit_row_and(dst, src, width, backwards,
+                    GUAC_COMMON_BLIT_COLOR, GUAC_COMMON_BLIT_COLOR,
+                    min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_NSRC_OR:
+            return guac_common_blit_row_or(dst, src, width, backwards,
+                    GUAC_COMMON_BLIT_COLOR, 0, min_x, max_x);
+
+        case GUAC_TRANSFER_BINARY_NSRC_NOR:
+            return guac_common_blit_row_or(dst, src, width, backwards,
+                    GUAC_COMMON_BLIT_COLOR, GUAC_COMMON_BLIT_COLOR,
+                    min_x, max_x);
+
+        /* The destination is never changed by GUAC_TRANSFER_BINARY_DEST */
+        case GUAC_TRANSFER_BINARY_DEST:
+            return 0;
+
+    }
+
+    return 0;
+
+}
+
+int guac_common_blit_set(uint32_t* dst, uint32_t color, int width,
+        int* min_x, int* max_x) {
+    return guac_common_blit_row_const(dst, NULL, width, 0, color, 0,
+            min_x, max_x);
+}
+
@@ -0,0 +1,326 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/cache.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/hash.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Removes the given entry from the least-recently-used list of the given
+ * cache.
+ *
+ * @param cache
+ *     The cache containing the entry.
+ *
+ * @param entry
+ *     The entry to remove.
+ */
+static void __guac_common_bitmap_cache_unlink(guac_common_bitmap_cache* cache,
+        guac_common_bitmap_cache_entry* entry) {
+
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+
+}
+
+/**
+ * Adds the given entry to the least-recently-used list of the given cache as
+ * the most recently used entry.
+ *
+ * @param cache
+ *     The cache which should contain the entry.
+ *
+ * @param entry
+ *     The entry to add.
+ */
+static void __guac_common_bitmap_cache_link(guac_common_bitmap_cache* cache,
+        guac_common_bitmap_cache_entry* entry) {
+
+    entry->newer = NULL;
+    entry->older = cache->newest;
+
+    if (cache->newest != NULL)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+
+    cache->newest = entry;
+
+}
+
+/**
+ * Returns the number of bytes of image data that the given entry accounts
+ * for within the size of its cache.
+ *
+ * @param entry
+ *     The entry to measure.
+ *
+ * @return
+ *     The number of bytes of image data within the given entry.
+ */
+static size_t __guac_common_bitmap_cache_entry_size(
+        guac_common_bitmap_cache_entry* entry) {
+    return (size_t) cairo_image_surface_get_width(entry->image)
+         * cairo_image_surface_get_height(entry->image) * 4;
+}
+
+/**
+ * Evicts the least recently used entry from the given cache, disposing of
+ * its buffer on the client side. The buffer itself is retained for reuse by
+ * later entries if possible, and is otherwise returned to the client.
+ *
+ * @param cache
+ *     The cache to evict an entry from. This cache must not be empty.
+ *
+ * @param socket
+ *     The socket over which the buffer should be disposed.
+ */
+static void __guac_common_bitmap_cache_evict(guac_common_bitmap_cache* cache,
+        guac_socket* socket) {
+
+    guac_common_bitmap_cache_entry* entry = cache->oldest;
+
+    /* Remove from hash table */
+    guac_common_bitmap_cache_entry** current =
+        &cache->buckets[entry->hash & (GUAC_COMMON_BITMAP_CACHE_BUCKETS - 1)];
+
+    while (*current != entry)
+        current = &(*current)->bucket_next;
+
+    *current = entry->bucket_next;
+
+    /* Remove from LRU list */
+    __guac_common_bitmap_cache_unlink(cache, entry);
+    cache->size -= __guac_common_bitmap_cache_entry_size(entry);
+
+    /* Release client-side memory */
+    guac_protocol_send_dispose(socket, entry->buffer);
+
+    /* Grow list of spare buffers if full */
+    if (cache->spare_buffer_count == cache->spare_buffers_available) {
+
+        int available = cache->spare_buffers_available * 2 + 8;
+        guac_layer** spare_buffers = realloc(cache->spare_buffers,
+                available * sizeof(guac_layer*));
+
+        if (spare_buffers != NULL) {
+            cache->spare_buffers = spare_buffers;
+            cache->spare_buffers_available = available;
+        }
+
+    }
+
+    /* Keep the buffer for later reuse, returning it to the client only if
+     * there is no room to keep it */
+    if (cache->spare_buffer_count < cache->spare_buffers_available)
+        cache->spare_buffers[cache->spare_buffer_count++] = entry->buffer;
+    else
+        guac_client_free_buffer(cache->client, entry->buffer);
+
+    cairo_surface_destroy(entry->image);
+    free(entry);
+
+}
+
+guac_common_bitmap_cache* guac_common_bitmap_cache_alloc(guac_client* client,
+        size_t max_size) {
+
+    guac_common_bitmap_cache* cache =
+        calloc(1, sizeof(guac_common_bitmap_cache));
+
+    if (cache == NULL)
+        return NULL;
+
+    cache->client = client;
+    cache->max_size = max_size;
+
+    return cache;
+
+}
+
+void guac_common_bitmap_cache_free(guac_common_bitmap_cache* cache,
+        guac_socket* socket) {
+
+    /* Evict everything, disposing of all client-side buffers */
+    while (cache->oldest != NULL)
+        __guac_common_bitmap_cache_evict(cache, socket);
+
+    /* Return all buffers to the client */
+    for (int i = 0; i < cache->spare_buffer_count; i++)
+        guac_client_free_buffer(cache->client, cache->spare_buffers[i]);
+
+    free(cache->spare_buffers);
+    free(cache);
+
+}
+
+void guac_common_bitmap_cache_set_max_size(guac_common_bitmap_cache* cache,
+        guac_socket* socket, size_t max_size) {
+
+    cache->max_size = max_size;
+
+    while (cache->size > cache->max_size)
+        __guac_common_bitmap_cache_evict(cache, socket);
+
+}
+
+const guac_layer* guac_common_bitmap_cache_lookup(
+        guac_common_bitmap_cache* cache, cairo_surface_t* image,
+        unsigned int hash) {
+
+    guac_common_bitmap_cache_entry* entry =
+        cache->buckets[hash & (GUAC_COMMON_BITMAP_CACHE_BUCKETS - 1)];
+
+    /* Search bucket for an identical image */
+    while (entry != NULL) {
+
+        if (entry->hash == hash && guac_surface_cmp(entry->image, image) == 0) {
+
+            /* Mark as most recently used */
+            __guac_common_bitmap_cache_unlink(cache, entry);
+            __guac_common_bitmap_cache_link(cache, entry);
+
+            return entry->buffer;
+
+        }
+
+        entry = entry->bucket_next;
+
+    }
+
+    return NULL;
+
+}
+
+const guac_layer* guac_common_bitmap_cache_add(guac_common_bitmap_cache* cache,
+        guac_socket* socket, cairo_surface_t* image, unsigned int hash) {
+
+    int index = hash & (GUAC_COMMON_BITMAP_CACHE_BUCKETS - 1);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int width = cairo_image_surface_get_width(image);
+    int height = cairo_image_surface_get_height(image);
+    int stride = cairo_image_surface_get_stride(image);
+
+    size_t size = (size_t) width * height * 4;
+
+    /* Do not cache images on first sight, only noting that they were seen */
+    guac_common_bitmap_cache_candidate* candidate = &cache->candidates[index];
+    if (candidate->hash != hash || candidate->width != width
+            || candidate->height != height) {
+        candidate->hash = hash;
+        candidate->width = width;
+        candidate->height = height;
+        return NULL;
+    }
+
+    /* Image is being cached, so it need not remain a candidate */
+    candidate->width = 0;
+
+    /* Never cache images that could not fit */
+    if (size > cache->max_size)
+        return NULL;
+
+    guac_common_bitmap_cache_entry* entry =
+        malloc(sizeof(guac_common_bitmap_cache_entry));
+
+    if (entry == NULL)
+        return NULL;
+
+    /* Keep a server-side copy of the image for comparison and replay */
+    entry->hash = hash;
+    entry->image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            width, height);
+
+    /* Cairo signals failure with an error surface rather than NULL */
+    if (cairo_surface_status(entry->image) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(entry->image);
+        free(entry);
+        return NULL;
+    }
+
+    unsigned char* entry_data = cairo_image_surface_get_data(entry->image);
+    int entry_stride = cairo_image_surface_get_stride(entry->image);
+
+    cairo_surface_flush(entry->image);
+    for (int y = 0; y < height; y++) {
+        memcpy(entry_data, data, width * 4);
+        entry_data += entry_stride;
+        data += stride;
+    }
+    cairo_surface_mark_dirty(entry->image);
+
+    /* Make room for new entry */
+    while (cache->size + size > cache->max_size)
+        __guac_common_bitmap_cache_evict(cache, socket);
+
+    /* Reuse a previously-evicted buffer if possible */
+    if (cache->spare_buffer_count > 0)
+        entry->buffer = cache->spare_buffers[--cache->spare_buffer_count];
+    else
+        entry->buffer = guac_client_alloc_buffer(cache->client);
+
+    /* Add to hash table and LRU list */
+    entry->bucket_next = cache->buckets[index];
+    cache->buckets[index] = entry;
+    __guac_common_bitmap_cache_link(cache, entry);
+    cache->size += size;
+
+    guac_protocol_send_size(socket, entry->buffer, width, height);
+    return entry->buffer;
+
+}
+
+void guac_common_bitmap_cache_dup(guac_common_bitmap_cache* cache,
+        guac_user* user, guac_socket* socket) {
+
+    /* Recreate each buffer, oldest first */
+    guac_common_bitmap_cache_entry* entry = cache->oldest;
+    while (entry != NULL) {
+
+        guac_protocol_send_size(socket, entry->buffer,
+                cairo_image_surface_get_width(entry->image),
+                cairo_image_surface_get_height(entry->image));
+
+        guac_user_stream_png(user, socket, GUAC_COMP_OVER, entry->buffer,
+                0, 0, entry->image);
+
+        entry = entry->newer;
+
+    }
+
+}
+
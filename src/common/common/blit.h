@@ -0,0 +1,132 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef __GUAC_COMMON_BLIT_H
+#define __GUAC_COMMON_BLIT_H
+
+#include "config.h"
+
+#include <guacamole/protocol-types.h>
+
+#include <stdint.h>
+
+/**
+ * Copies a single row of 32-bit ARGB pixels from the given source row to the
+ * given destination row. If the source is opaque, its alpha channel is
+ * ignored. Otherwise, each pixel is drawn using the Porter-Duff "over"
+ * composite operator. Only pixels which actually change are written.
+ *
+ * @param dst
+ *     The first pixel of the destination row.
+ *
+ * @param src
+ *     The first pixel of the source row.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ *
+ * @param opaque
+ *     Non-zero if the source row is opaque (its alpha channel should be
+ *     ignored), zero otherwise.
+ *
+ * @param min_x
+ *     Pointer to an int which will receive the offset of the first changed
+ *     pixel within the row. This value is only set if the row changed.
+ *
+ * @param max_x
+ *     Pointer to an int which will receive the offset of the last changed
+ *     pixel within the row. This value is only set if the row changed.
+ *
+ * @return
+ *     Non-zero if any pixel within the destination row was changed, zero
+ *     otherwise.
+ */
+int guac_common_blit_put(uint32_t* dst, const uint32_t* src, int width,
+        int opaque, int* min_x, int* max_x);
+
+/**
+ * Transfers a single row of 32-bit ARGB pixels from the given source row to
+ * the given destination row using the given transfer function. The source and
+ * destination rows may overlap, in which case the direction of the transfer
+ * must be chosen such that source pixels are read before they are
+ * overwritten. Only pixels which actually change are written.
+ *
+ * @param dst
+ *     The first pixel of the destination row.
+ *
+ * @param src
+ *     The first pixel of the source row.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ *
+ * @param op
+ *     The transfer function to use.
+ *
+ * @param backwards
+ *     Non-zero if the row should be processed from its last pixel to its
+ *     first, zero if the row should be processed from its first pixel to its
+ *     last.
+ *
+ * @param min_x
+ *     Pointer to an int which will receive the offset of the first changed
+ *     pixel within the row. This value is only set if the row changed.
+ *
+ * @param max_x
+ *     Pointer to an int which will receive the offset of the last changed
+ *     pixel within the row. This value is only set if the row changed.
+ *
+ * @return
+ *     Non-zero if any pixel within the destination row was changed, zero
+ *     otherwise.
+ */
+int guac_common_blit_transfer(uint32_t* dst, const uint32_t* src, int width,
+        guac_transfer_function op, int backwards, int* min_x, int* max_x);
+
+/**
+ * Assigns the given 32-bit ARGB color to every pixel within the given row.
+ * Only pixels which actually change are written.
+ *
+ * @param dst
+ *     The first pixel of the destination row.
+ *
+ * @param color
+ *     The ARGB color to assign.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ *
+ * @param min_x
+ *     Pointer to an int which will receive the offset of the first changed
+ *     pixel within the row. This value is only set if the row changed.
+ *
+ * @param max_x
+ *     Pointer to an int which will receive the offset of the last changed
+ *     pixel within the row. This value is only set if the row changed.
+ *
+ * @return
+ *     Non-zero if any pixel within the destination row was changed, zero
+ *     otherwise.
+ */
+int guac_common_blit_set(uint32_t* dst, uint32_t color, int width,
+        int* min_x, int* max_x);
+
+#endif
+
@@ -0,0 +1,304 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_COMMON_CACHE_H
+#define GUAC_COMMON_CACHE_H
+
+#include "config.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+#include <guacamole/user.h>
+
+#include <stddef.h>
+
+/**
+ * The smallest area, in pixels, of any image which will be considered for
+ * caching. Smaller images are cheap enough to send directly that hashing them
+ * would not be worthwhile.
+ */
+#define GUAC_COMMON_BITMAP_CACHE_MIN_AREA 1024
+
+/**
+ * The largest area, in pixels, of any image which will be considered for
+ * caching.
+ */
+#define GUAC_COMMON_BITMAP_CACHE_MAX_AREA 262144
+
+/**
+ * The number of hash buckets within each guac_common_bitmap_cache. This MUST
+ * be a power of two.
+ */
+#define GUAC_COMMON_BITMAP_CACHE_BUCKETS 1024
+
+/**
+ * A single image which has been cached within a client-side buffer.
+ */
+typedef struct guac_common_bitmap_cache_entry guac_common_bitmap_cache_entry;
+
+struct guac_common_bitmap_cache_entry {
+
+    /**
+     * The hash of the cached image, as produced by guac_hash_surface().
+     */
+    unsigned int hash;
+
+    /**
+     * A server-side copy of the cached image, used to confirm that images
+     * having the same hash are truly identical and to replay the contents of
+     * the cache to joining users.
+     */
+    cairo_surface_t* image;
+
+    /**
+     * The client-side buffer containing the cached image at its upper-left
+     * corner.
+     */
+    guac_layer* buffer;
+
+    /**
+     * The next entry within the same hash bucket, or NULL if this is the last
+     * entry in the bucket.
+     */
+    guac_common_bitmap_cache_entry* bucket_next;
+
+    /**
+     * The next most recently used entry, or NULL if this is the most
+     * recently used entry.
+     */
+    guac_common_bitmap_cache_entry* newer;
+
+    /**
+     * The next least recently used entry, or NULL if this is the least
+     * recently used entry.
+     */
+    guac_common_bitmap_cache_entry* older;
+
+};
+
+/**
+ * An image which has been seen once but has not yet been cached. Images are
+ * only cached upon being seen a second time, such that content which is never
+ * repeated does not consume client-side memory.
+ */
+typedef struct guac_common_bitmap_cache_candidate {
+
+    /**
+     * The hash of the image, as produced by guac_hash_surface().
+     */
+    unsigned int hash;
+
+    /**
+     * The width of the image, in pixels. A width of zero indicates that no
+     * image has been seen.
+     */
+    int width;
+
+    /**
+     * The height of the image, in pixels.
+     */
+    int height;
+
+} guac_common_bitmap_cache_candidate;
+
+/**
+ * A least-recently-used cache of images which have already been sent to the
+ * client, each stored within its own client-side buffer and looked up by the
+ * hash of its contents. An image which is found within the cache can be drawn
+ * with a "copy" instruction rather than being encoded and sent again.
+ *
+ * A cache is not threadsafe and writes instructions to the socket provided by
+ * its caller. It is intended to be owned by a single guac_common_surface,
+ * which provides the necessary locking and ordering.
+ */
+typedef struct guac_common_bitmap_cache {
+
+    /**
+     * The client owning all buffers allocated by this cache.
+     */
+    guac_client* client;
+
+    /**
+     * The maximum number of bytes of image data which may be cached.
+     */
+    size_t max_size;
+
+    /**
+     * The number of bytes of image data currently cached.
+     */
+    size_t size;
+
+    /**
+     * Hash table of all cached entries, indexed by the low-order bits of
+     * each entry's hash.
+     */
+    guac_common_bitmap_cache_entry* buckets[GUAC_COMMON_BITMAP_CACHE_BUCKETS];
+
+    /**
+     * Images which have been seen once, indexed in the same manner as
+     * buckets. Each new candidate replaces any older candidate with the same
+     * index.
+     */
+    guac_common_bitmap_cache_candidate
+        candidates[GUAC_COMMON_BITMAP_CACHE_BUCKETS];
+
+    /**
+     * The most recently used entry, or NULL if the cache is empty.
+     */
+    guac_common_bitmap_cache_entry* newest;
+
+    /**
+     * The least recently used entry, or NULL if the cache is empty.
+     */
+    guac_common_bitmap_cache_entry* oldest;
+
+    /**
+     * The number of buffers within the spare_buffers array.
+     */
+    int spare_buffer_count;
+
+    /**
+     * The number of elements allocated for the spare_buffers array.
+     */
+    int spare_buffers_available;
+
+    /**
+     * Buffers which belonged to evicted entries. These buffers have already
+     * been disposed on the client side, but remain allocated such that they
+     * can be reused by future entries. Keeping these buffers allocated
+     * ensures their indices cannot be reused elsewhere while the instruction
+     * disposing of them may not yet have been sent.
+     */
+    guac_layer** spare_buffers;
+
+} guac_common_bitmap_cache;
+
+/**
+ * Allocates a new, empty bitmap cache.
+ *
+ * @param client
+ *     The client for which buffers should be allocated.
+ *
+ * @param max_size
+ *     The maximum number of bytes of image data which may be cached.
+ *
+ * @return
+ *     A newly-allocated bitmap cache, or NULL if allocation fails.
+ */
+guac_common_bitmap_cache* guac_common_bitmap_cache_alloc(guac_client* client,
+        size_t max_size);
+
+/**
+ * Frees the given bitmap cache, disposing of all client-side buffers and
+ * returning them to the client's pool.
+ *
+ * @param cache
+ *     The cache to free.
+ *
+ * @param socket
+ *     The socket over which buffers should be disposed.
+ */
+void guac_common_bitmap_cache_free(guac_common_bitmap_cache* cache,
+        guac_socket* socket);
+
+/**
+ * Changes the maximum amount of image data which may be cached, evicting the
+ * least recently used entries as necessary.
+ *
+ * @param cache
+ *     The cache whose maximum size should be changed.
+ *
+ * @param socket
+ *     The socket over which any evicted buffers should be disposed.
+ *
+ * @param max_size
+ *     The maximum number of bytes of image data which may be cached.
+ */
+void guac_common_bitmap_cache_set_max_size(guac_common_bitmap_cache* cache,
+        guac_socket* socket, size_t max_size);
+
+/**
+ * Searches the cache for an image identical to the given image, marking any
+ * match as the most recently used entry.
+ *
+ * @param cache
+ *     The cache to search.
+ *
+ * @param image
+ *     The image to search for. This must be a 32-bit image surface.
+ *
+ * @param hash
+ *     The hash of the given image, as produced by guac_hash_surface().
+ *
+ * @return
+ *     The client-side buffer containing an identical image at its
+ *     upper-left corner, or NULL if no such image is cached.
+ */
+const guac_layer* guac_common_bitmap_cache_lookup(
+        guac_common_bitmap_cache* cache, cairo_surface_t* image,
+        unsigned int hash);
+
+/**
+ * Notes that the given image has been sent to the client. If the same image
+ * has been sent recently, a new entry is added to the cache and the buffer
+ * which should receive a copy of the image is returned. The caller must then
+ * copy the image into that buffer. Least recently used entries are evicted
+ * as necessary to stay within the maximum size of the cache.
+ *
+ * @param cache
+ *     The cache to add the image to.
+ *
+ * @param socket
+ *     The socket over which any evicted buffers should be disposed.
+ *
+ * @param image
+ *     The image which was sent. This must be a 32-bit image surface. The
+ *     image data is copied and need not remain valid after this function
+ *     returns.
+ *
+ * @param hash
+ *     The hash of the given image, as produced by guac_hash_surface().
+ *
+ * @return
+ *     The buffer into which the image must be copied, or NULL if the image
+ *     has not been cached.
+ */
+const guac_layer* guac_common_bitmap_cache_add(guac_common_bitmap_cache* cache,
+        guac_socket* socket, cairo_surface_t* image, unsigned int hash);
+
+/**
+ * Recreates all cached buffers for the given user, such that cached images
+ * may be copied for that user exactly as for all other users.
+ *
+ * @param cache
+ *     The cache to duplicate.
+ *
+ * @param user
+ *     The user receiving the cache contents.
+ *
+ * @param socket
+ *     The socket over which the cache contents should be sent.
+ */
+void guac_common_bitmap_cache_dup(guac_common_bitmap_cache* cache,
+        guac_user* user, guac_socket* socket);
+
+#endif
+
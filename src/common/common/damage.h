@@ -0,0 +1,195 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __GUAC_COMMON_DAMAGE_H
+#define __GUAC_COMMON_DAMAGE_H
+
+#include "config.h"
+#include "rect.h"
+
+/**
+ * Damage map cell size in pixels. Each side of each damage map cell will
+ * consist of this many pixels.
+ */
+#define GUAC_COMMON_DAMAGE_CELL_SIZE 64
+
+/**
+ * The width or height of the damage map (in cells) given the width or height
+ * of the image (in pixels).
+ */
+#define GUAC_COMMON_DAMAGE_DIMENSION(x) (       \
+        (x + GUAC_COMMON_DAMAGE_CELL_SIZE - 1)  \
+            / GUAC_COMMON_DAMAGE_CELL_SIZE      \
+)
+
+/**
+ * Representation of a cell in the damage map. Each cell tracks the bounding
+ * rectangle of all changes made within the area of the image covered by
+ * that cell since the damage map was last collected, such that unrelated
+ * changes in different areas of the image need not be combined into a single
+ * update.
+ */
+typedef struct guac_common_damage_cell {
+
+    /**
+     * Non-zero if any part of the area covered by this cell has changed since
+     * the damage map was last collected, zero otherwise.
+     */
+    int dirty;
+
+    /**
+     * The bounding rectangle of all changes within the area covered by this
+     * cell. This rectangle is always contained entirely within the cell, and
+     * is only meaningful if dirty is non-zero.
+     */
+    guac_common_rect rect;
+
+    /**
+     * The index of the update which received the horizontal run of dirty
+     * cells beginning at this cell, or -1 if no run begins at this cell. This
+     * is used only while the damage map is being collected.
+     */
+    int group;
+
+    /**
+     * The number of dirty cells in the horizontal run of dirty cells
+     * beginning at this cell. This is used only while the damage map is being
+     * collected, and is only meaningful if group is not -1.
+     */
+    int run_length;
+
+} guac_common_damage_cell;
+
+/**
+ * A map of all areas of an image which have changed, divided into cells of
+ * GUAC_COMMON_DAMAGE_CELL_SIZE pixels on each side.
+ */
+typedef struct guac_common_damage_map {
+
+    /**
+     * The width of the damage map, in cells.
+     */
+    int width;
+
+    /**
+     * The height of the damage map, in cells.
+     */
+    int height;
+
+    /**
+     * The number of cells within the damage map which are currently dirty.
+     * If zero, there are no pending changes.
+     */
+    int dirty_count;
+
+    /**
+     * All cells of the damage map, in row-major order.
+     */
+    guac_common_damage_cell* cells;
+
+} guac_common_damage_map;
+
+/**
+ * Allocates a new, clean damage map covering an image of the given size.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @return
+ *     A newly-allocated damage map, which must eventually be freed with
+ *     guac_common_damage_map_free().
+ */
+guac_common_damage_map* guac_common_damage_map_alloc(int width, int height);
+
+/**
+ * Frees the given damage map.
+ *
+ * @param map
+ *     The damage map to free.
+ */
+void guac_common_damage_map_free(guac_common_damage_map* map);
+
+/**
+ * Records the given rectangle within the given damage map. Only the cells
+ * which intersect the rectangle are affected, thus unrelated changes within
+ * distant areas of the image remain independent. Empty rectangles are
+ * ignored.
+ *
+ * @param map
+ *     The damage map to update.
+ *
+ * @param rect
+ *     The rectangle which has changed. This rectangle must lie entirely
+ *     within the image covered by the damage map.
+ */
+void guac_common_damage_map_mark(guac_common_damage_map* map,
+        const guac_common_rect* rect);
+
+/**
+ * Calculates the number of pixels by which the area of pending damage would
+ * grow if the given rectangle were recorded within the given damage map. The
+ * damage map is not modified.
+ *
+ * @param map
+ *     The damage map to examine.
+ *
+ * @param rect
+ *     The rectangle which would be recorded. This rectangle must lie entirely
+ *     within the image covered by the damage map.
+ *
+ * @return
+ *     The number of pixels which recording the given rectangle would add to
+ *     the pending damage.
+ */
+int guac_common_damage_map_added_area(const guac_common_damage_map* map,
+        const guac_common_rect* rect);
+
+/**
+ * Converts all changes recorded within the given damage map into update
+ * rectangles, clearing the damage map. Horizontal runs of dirty cells are
+ * grouped together, and runs which span the same columns as the run directly
+ * above them are added to the same update, such that each resulting update
+ * covers a roughly rectangular region of changes. If the array of updates
+ * fills, all remaining changes are combined into the final update within the
+ * array.
+ *
+ * @param map
+ *     The damage map to collect.
+ *
+ * @param updates
+ *     The array of update rectangles which should receive the collected
+ *     changes. New updates are appended following any existing updates.
+ *
+ * @param length
+ *     The number of existing updates within the array.
+ *
+ * @param max_length
+ *     The maximum number of updates which the array can hold.
+ *
+ * @return
+ *     The number of updates within the array after collecting the changes.
+ */
+int guac_common_damage_map_collect(guac_common_damage_map* map,
+        guac_common_rect* updates, int length, int max_length);
+
+#endif
+
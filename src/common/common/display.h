@@ -21,6 +21,7 @@
 #define GUAC_COMMON_DISPLAY_H
 
 #include "cursor.h"
+#include "encoder.h"
 #include "surface.h"
 
 #include <guacamole/client.h>
@@ -28,6 +29,13 @@
 
 #include <pthread.h>
 
+/**
+ * The maximum number of bytes of image data which may be cached for the
+ * default surface of each display, such that repeated images may be copied
+ * rather than resent.
+ */
+#define GUAC_COMMON_DISPLAY_CACHE_SIZE 16777216
+
 /**
  * A list element representing a pairing of a Guacamole layer with a
  * corresponding guac_common_surface which wraps that layer. Adjacent layers
@@ -99,6 +107,12 @@ typedef struct guac_common_display {
      */
     guac_common_display_layer* buffers;
 
+    /**
+     * The encoder shared by all surfaces of this display, allowing images to
+     * be encoded in parallel, or NULL if images are encoded directly.
+     */
+    guac_common_encoder* encoder;
+
     /**
      * Mutex which is locked internally when access to the display must be
      * synchronized. All public functions of guac_common_display should be
@@ -155,7 +169,9 @@ void guac_common_display_dup(guac_common_display* display, guac_user* user,
 
 /**
  * Flushes pending changes to the given display. All pending operations will
- * become visible to any connected users.
+ * become visible to any connected users. The images of all layers are encoded
+ * in parallel where possible, but are always sent in the order the layers
+ * would otherwise have been flushed.
  *
  * @param display
  *     The display to flush.
@@ -0,0 +1,372 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_COMMON_ENCODER_H
+#define GUAC_COMMON_ENCODER_H
+
+#include "config.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/image.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol-types.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <pthread.h>
+
+/**
+ * The maximum number of worker threads that a single guac_common_encoder will
+ * use to encode images, regardless of the number of processors available.
+ */
+#define GUAC_COMMON_ENCODER_MAX_THREADS 4
+
+/**
+ * The minimum area, in pixels, that an image must have to be encoded by a
+ * worker thread. Smaller images are encoded immediately by the thread
+ * submitting them, as the overhead of copying the image data and waking a
+ * worker would outweigh any benefit.
+ */
+#define GUAC_COMMON_ENCODER_MIN_AREA 16384
+
+/**
+ * The number of bytes initially allocated for the output buffer of each
+ * guac_common_encoder_job.
+ */
+#define GUAC_COMMON_ENCODER_INITIAL_BUFFER_SIZE 4096
+
+/**
+ * The image formats which may be produced by a guac_common_encoder_job.
+ */
+typedef enum guac_common_encoder_format {
+
+    /**
+     * Lossless PNG.
+     */
+    GUAC_COMMON_ENCODER_PNG,
+
+    /**
+     * Lossy JPEG. Any transparency within the image is lost.
+     */
+    GUAC_COMMON_ENCODER_JPEG,
+
+    /**
+     * WebP, which may be lossy or lossless.
+     */
+    GUAC_COMMON_ENCODER_WEBP
+
+} guac_common_encoder_format;
+
+typedef struct guac_common_encoder_job guac_common_encoder_job;
+
+/**
+ * A pool of worker threads which encode images on behalf of one or more
+ * surfaces. Encoded output is accumulated in memory within each
+ * guac_common_encoder_job and is only written to its final destination when
+ * that job is completed, allowing images to be encoded in parallel while
+ * still being sent in the order they were submitted.
+ */
+typedef struct guac_common_encoder {
+
+    /**
+     * Lock which guards access to the job queue, the completion state of
+     * all queued jobs, and the shutdown flag.
+     */
+    pthread_mutex_t _lock;
+
+    /**
+     * Condition which is signalled when a job is added to the queue or when
+     * the encoder is shutting down.
+     */
+    pthread_cond_t _work_available;
+
+    /**
+     * Condition which is signalled whenever a worker finishes encoding a job.
+     */
+    pthread_cond_t _job_finished;
+
+    /**
+     * The worker threads of this encoder.
+     */
+    pthread_t threads[GUAC_COMMON_ENCODER_MAX_THREADS];
+
+    /**
+     * The number of worker threads actually running.
+     */
+    int thread_count;
+
+    /**
+     * The oldest job which has been submitted but not yet picked up by a
+     * worker, or NULL if the queue is empty.
+     */
+    guac_common_encoder_job* queue_head;
+
+    /**
+     * The most recently submitted job which has not yet been picked up by a
+     * worker, or NULL if the queue is empty.
+     */
+    guac_common_encoder_job* queue_tail;
+
+    /**
+     * Non-zero if the worker threads should exit once the queue is empty,
+     * zero otherwise.
+     */
+    int shutdown;
+
+} guac_common_encoder;
+
+/**
+ * A unit of output which may include the encoding of a single image. Any
+ * instructions written to the job's socket before the job is submitted are
+ * kept in order ahead of the image. Once completed, all accumulated output is
+ * written to the destination socket as a single unit.
+ */
+struct guac_common_encoder_job {
+
+    /**
+     * The client which owns the stream used by this job.
+     */
+    guac_client* client;
+
+    /**
+     * The encoder which will encode this job's image, or NULL if the image
+     * was encoded when the job was submitted.
+     */
+    guac_common_encoder* encoder;
+
+    /**
+     * An in-memory socket which collects all output of this job. Instructions
+     * may be written to this socket freely until the job is submitted.
+     */
+    guac_socket* socket;
+
+    /**
+     * The output accumulated by this job thus far.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of output within the buffer.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for the buffer.
+     */
+    size_t available;
+
+    /**
+     * Non-zero if this job has been submitted, zero otherwise. No further
+     * output may be written to a job once it has been submitted.
+     */
+    int submitted;
+
+    /**
+     * Non-zero if encoding of this job's image (if any) has finished, zero
+     * otherwise.
+     */
+    int finished;
+
+    /**
+     * The stream over which the image is being sent, or NULL if this job has
+     * no image.
+     */
+    guac_stream* stream;
+
+    /**
+     * The image to be encoded, or NULL if this job has no image or the image
+     * has already been encoded.
+     */
+    cairo_surface_t* image;
+
+    /**
+     * The format to encode the image in.
+     */
+    guac_common_encoder_format format;
+
+    /**
+     * The quality to use when encoding with a lossy format, between 0 and
+     * 100 inclusive.
+     */
+    int quality;
+
+    /**
+     * Non-zero if WebP images should be encoded losslessly, zero otherwise.
+     */
+    int lossless;
+
+    /**
+     * The WebP compression method to use, from 0 (fastest) to 6 (smallest
+     * output). This is ignored for formats other than WebP.
+     */
+    int method;
+
+    /**
+     * The analysis of the image to be encoded, valid only if analyzed is
+     * non-zero.
+     */
+    guac_image_analysis analysis;
+
+    /**
+     * Non-zero if the image has already been analyzed with
+     * guac_image_analyze(), zero if the encoder must analyze the image
+     * itself, if necessary.
+     */
+    int analyzed;
+
+    /**
+     * The next job within the encoder's queue, or NULL if this job is the
+     * last job queued.
+     */
+    guac_common_encoder_job* queue_next;
+
+    /**
+     * The next job pending for the owner of this job, such as a surface. This
+     * is not used by the encoder itself.
+     */
+    guac_common_encoder_job* next;
+
+};
+
+/**
+ * Allocates a new encoder having one worker thread per available processor,
+ * up to GUAC_COMMON_ENCODER_MAX_THREADS. If parallel encoding would not be
+ * beneficial, such as on a single-processor system, or the worker threads
+ * cannot be created, NULL is returned and images should be encoded directly.
+ *
+ * @return
+ *     A newly-allocated encoder, or NULL if images should be encoded
+ *     directly.
+ */
+guac_common_encoder* guac_common_encoder_alloc();
+
+/**
+ * Frees the given encoder, waiting for all worker threads to finish any
+ * queued jobs and exit. Any jobs submitted to this encoder must still be
+ * completed with guac_common_encoder_job_complete() before the encoder is
+ * freed.
+ *
+ * @param encoder
+ *     The encoder to free.
+ */
+void guac_common_encoder_free(guac_common_encoder* encoder);
+
+/**
+ * Allocates a new, empty job. Instructions may be written to the socket of
+ * the returned job until it is submitted.
+ *
+ * @param client
+ *     The client which will own any stream allocated for the job's image.
+ *
+ * @return
+ *     A newly-allocated job, or NULL if the job could not be allocated.
+ */
+guac_common_encoder_job* guac_common_encoder_job_alloc(guac_client* client);
+
+/**
+ * Submits the given job for encoding of the given image. A new stream is
+ * allocated and an "img" instruction is written to the job immediately,
+ * followed later by the encoded image data and an "end" instruction. If the
+ * encoder is NULL or the image is small, the image is encoded before this
+ * function returns. Otherwise, the image data is copied and encoded by a
+ * worker thread, and the original data may be modified once this function
+ * returns.
+ *
+ * @param encoder
+ *     The encoder which should encode the image, or NULL to encode the image
+ *     immediately.
+ *
+ * @param job
+ *     The job to submit. This job must not yet have been submitted.
+ *
+ * @param format
+ *     The format to encode the image in.
+ *
+ * @param mode
+ *     The composite mode to use when drawing the image.
+ *
+ * @param layer
+ *     The destination layer.
+ *
+ * @param x
+ *     The X coordinate of the upper-left corner of the destination
+ *     rectangle within the destination layer.
+ *
+ * @param y
+ *     The Y coordinate of the upper-left corner of the destination
+ *     rectangle within the destination layer.
+ *
+ * @param data
+ *     The first pixel of the image data to encode.
+ *
+ * @param image_format
+ *     The Cairo format of the image data. This must be either
+ *     CAIRO_FORMAT_RGB24 or CAIRO_FORMAT_ARGB32.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image data.
+ *
+ * @param quality
+ *     The quality to use when encoding with a lossy format, between 0 and
+ *     100 inclusive. This is ignored for PNG.
+ *
+ * @param lossless
+ *     Non-zero if WebP images should be encoded losslessly, zero otherwise.
+ *     This is ignored for formats other than WebP.
+ *
+ * @param method
+ *     The WebP compression method to use, from 0 (fastest) to 6 (smallest
+ *     output). This is ignored for formats other than WebP.
+ *
+ * @param analysis
+ *     The analysis of the image data, as produced by guac_image_analyze(),
+ *     or NULL if the image has not been analyzed. The analysis is copied, and
+ *     need not remain valid once this function returns.
+ */
+void guac_common_encoder_job_submit(guac_common_encoder* encoder,
+        guac_common_encoder_job* job, guac_common_encoder_format format,
+        guac_composite_mode mode, const guac_layer* layer, int x, int y,
+        unsigned char* data, cairo_format_t image_format, int width,
+        int height, int stride, int quality, int lossless, int method,
+        const guac_image_analysis* analysis);
+
+/**
+ * Completes the given job, waiting for its image (if any) to finish encoding,
+ * writing all accumulated output to the given socket as a single unit, and
+ * freeing the job along with its stream. The job need not have been
+ * submitted.
+ *
+ * @param job
+ *     The job to complete.
+ *
+ * @param socket
+ *     The socket to write all output of the job to.
+ */
+void guac_common_encoder_job_complete(guac_common_encoder_job* job,
+        guac_socket* socket);
+
+#endif
+
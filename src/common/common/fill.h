@@ -0,0 +1,143 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __GUAC_COMMON_FILL_H
+#define __GUAC_COMMON_FILL_H
+
+#include "config.h"
+#include "rect.h"
+
+#include <stdint.h>
+
+/**
+ * The width and height of each tile examined for uniform color, in pixels.
+ * Tiles are aligned relative to the origin of the image, not the region
+ * being examined.
+ */
+#define GUAC_COMMON_FILL_TILE_SIZE 16
+
+/**
+ * The minimum number of horizontally-adjacent tiles which must share the
+ * same color for those tiles to be sent as a fill. Narrower areas of uniform
+ * color are sent as part of the surrounding image data.
+ */
+#define GUAC_COMMON_FILL_MIN_TILES 2
+
+/**
+ * The smallest area, in pixels, of any region which will be examined for
+ * areas of uniform color. Smaller regions are cheap enough to send as
+ * images.
+ */
+#define GUAC_COMMON_FILL_MIN_AREA 4096
+
+/**
+ * The maximum number of fills which a single region may be split into.
+ */
+#define GUAC_COMMON_FILL_MAX_FILLS 64
+
+/**
+ * The maximum number of residual rectangles which a single region may be
+ * split into. Regions which would require more are sent as a single image,
+ * as each additional image carries its own overhead.
+ */
+#define GUAC_COMMON_FILL_MAX_RESIDUAL 32
+
+/**
+ * A rectangle which consists entirely of a single, fully-opaque color.
+ */
+typedef struct guac_common_fill {
+
+    /**
+     * The rectangle covered by this fill.
+     */
+    guac_common_rect rect;
+
+    /**
+     * The color of every pixel within the rectangle, in 32-bit ARGB format.
+     * The alpha component of this color is always 0xFF.
+     */
+    uint32_t color;
+
+} guac_common_fill;
+
+/**
+ * A region of an image which has been divided into rectangles of uniform
+ * color and the residual rectangles containing everything else.
+ */
+typedef struct guac_common_fill_map {
+
+    /**
+     * All rectangles of uniform color within the region.
+     */
+    guac_common_fill fills[GUAC_COMMON_FILL_MAX_FILLS];
+
+    /**
+     * The number of valid entries within fills.
+     */
+    int num_fills;
+
+    /**
+     * All rectangles within the region which are not covered by fills, and
+     * must be sent as image data.
+     */
+    guac_common_rect residual[GUAC_COMMON_FILL_MAX_RESIDUAL];
+
+    /**
+     * The number of valid entries within residual.
+     */
+    int num_residual;
+
+} guac_common_fill_map;
+
+/**
+ * Divides the given region of an image into rectangles of uniform, opaque
+ * color, and the residual rectangles which cover everything else. The region
+ * is examined in tiles of GUAC_COMMON_FILL_TILE_SIZE pixels. Uniform tiles
+ * are merged with neighboring tiles of the same color, first horizontally
+ * and then vertically, while all other tiles are merged into residual
+ * rectangles in the same manner. The fills and residual rectangles together
+ * cover the entire region without overlapping.
+ *
+ * If the region is too small, contains too little uniform color to be worth
+ * splitting, or would need to be split into too many rectangles, no map is
+ * produced and the region should be sent as a single image.
+ *
+ * @param buffer
+ *     The first pixel of the 32-bit ARGB image containing the region.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image.
+ *
+ * @param rect
+ *     The region of the image to examine. This region must lie entirely
+ *     within the image.
+ *
+ * @param map
+ *     Pointer to a guac_common_fill_map which will receive the fills and
+ *     residual rectangles of the region.
+ *
+ * @return
+ *     Non-zero if the region was successfully divided, zero if the region
+ *     should be sent as a single image.
+ */
+int guac_common_fill_extract(const unsigned char* buffer, int stride,
+        const guac_common_rect* rect, guac_common_fill_map* map);
+
+#endif
+
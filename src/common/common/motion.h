@@ -0,0 +1,123 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef __GUAC_COMMON_MOTION_H
+#define __GUAC_COMMON_MOTION_H
+
+#include "config.h"
+#include "rect.h"
+
+/**
+ * The smallest width or height, in pixels, of any region which will be
+ * examined for motion. Smaller regions are cheap enough to send as images.
+ */
+#define GUAC_COMMON_MOTION_MIN_SIZE 64
+
+/**
+ * The minimum number of rows (for vertical motion) or columns (for
+ * horizontal motion) which must have moved for motion to be reported.
+ */
+#define GUAC_COMMON_MOTION_MIN_LINES 16
+
+/**
+ * The number of rows or columns sampled from a region when searching for
+ * candidate motion vectors.
+ */
+#define GUAC_COMMON_MOTION_SAMPLES 32
+
+/**
+ * The maximum number of previous rows or columns which a sampled row or
+ * column may match before that sample is considered too common to vote on
+ * the direction of motion. Blank rows, for example, would otherwise match
+ * nearly every offset.
+ */
+#define GUAC_COMMON_MOTION_MAX_CANDIDATES 4
+
+/**
+ * The minimum number of samples which must agree on a motion vector before
+ * that vector is tested.
+ */
+#define GUAC_COMMON_MOTION_MIN_VOTES 3
+
+/**
+ * A region of an image which is identical to a region of the previous
+ * contents of that image, offset either vertically or horizontally.
+ */
+typedef struct guac_common_motion {
+
+    /**
+     * The destination region, which may be reproduced by copying the region
+     * of the previous image offset by dx and dy.
+     */
+    guac_common_rect rect;
+
+    /**
+     * The horizontal offset of the source region relative to the
+     * destination region. If non-zero, dy is zero.
+     */
+    int dx;
+
+    /**
+     * The vertical offset of the source region relative to the destination
+     * region. If non-zero, dx is zero.
+     */
+    int dy;
+
+} guac_common_motion;
+
+/**
+ * Searches for the largest vertical or horizontal band of the given region
+ * of an image which is identical to a region of the previous contents of that
+ * image, as occurs when content is scrolled. Rows and columns are first
+ * compared by hash to find likely offsets, and any match is then verified
+ * pixel by pixel. Vertical motion is preferred if both are possible. Both
+ * images must be 32-bit and share the same dimensions and stride.
+ *
+ * @param current
+ *     The first pixel of the current image.
+ *
+ * @param previous
+ *     The first pixel of the previous image.
+ *
+ * @param stride
+ *     The number of bytes in each row of both images.
+ *
+ * @param width
+ *     The width of both images, in pixels.
+ *
+ * @param height
+ *     The height of both images, in pixels.
+ *
+ * @param rect
+ *     The region of the current image to search for motion. This region
+ *     must lie entirely within the image.
+ *
+ * @param motion
+ *     Pointer to a guac_common_motion which will receive the destination
+ *     region and offset of any motion found.
+ *
+ * @return
+ *     Non-zero if motion was found, zero otherwise.
+ */
+int guac_common_motion_estimate(const unsigned char* current,
+        const unsigned char* previous, int stride, int width, int height,
+        const guac_common_rect* rect, guac_common_motion* motion);
+
+#endif
+
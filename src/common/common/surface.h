@@ -21,7 +21,11 @@
 #define __GUAC_COMMON_SURFACE_H
 
 #include "config.h"
+#include "cache.h"
+#include "damage.h"
+#include "encoder.h"
 #include "rect.h"
+#include "video.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
@@ -30,6 +34,7 @@
 #include <guacamole/socket.h>
 
 #include <pthread.h>
+#include <stddef.h>
 
 /**
  * The maximum number of updates to allow within the bitmap queue.
@@ -187,15 +192,25 @@ typedef struct guac_common_surface {
     int opacity_dirty;
 
     /**
-     * Non-zero if this surface is dirty and needs to be flushed, 0 otherwise.
+     * Non-zero if the bitmap update currently being assembled while flushing
+     * this surface is non-empty, 0 otherwise.
      */
     int dirty;
 
     /**
-     * The dirty rectangle.
+     * The bitmap update currently being assembled while flushing this
+     * surface. Changes to the surface are tracked via the damage map, and are
+     * only combined into this rectangle during a flush.
      */
     guac_common_rect dirty_rect;
 
+    /**
+     * A map of all areas of this surface which have changed since the surface
+     * was last flushed. If the map has no dirty cells, this surface has no
+     * pending changes.
+     */
+    guac_common_damage_map* damage_map;
+
     /**
      * Whether the surface actually exists on the client.
      */
@@ -228,6 +243,70 @@ typedef struct guac_common_surface {
      */
     guac_common_surface_heat_cell* heat_map;
 
+    /**
+     * The encoder which should be used to encode images in parallel, or NULL
+     * if images should be encoded and sent directly.
+     */
+    guac_common_encoder* encoder;
+
+    /**
+     * Cache of images recently sent for this surface, or NULL if caching is
+     * disabled.
+     */
+    guac_common_bitmap_cache* cache;
+
+    /**
+     * A copy of the surface contents as they were last sent to the client,
+     * having the same stride as buffer, or NULL if motion detection is
+     * disabled. Updates are compared against this copy to detect content
+     * which has merely moved, such as by scrolling.
+     */
+    unsigned char* shadow;
+
+    /**
+     * Non-zero if the shadow copy may not reflect what every user currently
+     * sees, in which case motion detection is skipped until the next flush.
+     */
+    int shadow_stale;
+
+    /**
+     * The oldest unit of output which has been produced by this surface but
+     * not yet written to the socket, or NULL if no output is pending. Output
+     * is pending only while an encoder is in use.
+     */
+    guac_common_encoder_job* pending_head;
+
+    /**
+     * The most recent unit of output which has been produced by this surface
+     * but not yet written to the socket, or NULL if no output is pending.
+     */
+    guac_common_encoder_job* pending_tail;
+
+    /**
+     * The video currently streaming the contents of a rapidly-changing
+     * region of this surface, or NULL if no such video is active.
+     */
+    guac_common_video* video;
+
+    /**
+     * The region of this surface covered by the active video, if any. Updates
+     * within this region are sent as frames of that video rather than as
+     * images.
+     */
+    guac_common_rect video_rect;
+
+    /**
+     * Non-zero if the contents of the video region have changed since the
+     * last frame of the active video was encoded.
+     */
+    int video_dirty;
+
+    /**
+     * The time at which the last frame of the active video was encoded, or
+     * at which the most recent video ended if no video is active.
+     */
+    guac_timestamp video_updated;
+
     /**
      * Mutex which is locked internally when access to the surface must be
      * synchronized. All public functions of guac_common_surface should be
@@ -470,6 +549,77 @@ void guac_common_surface_set_opacity(guac_common_surface* surface, int opacity);
  */
 void guac_common_surface_flush(guac_common_surface* surface);
 
+/**
+ * Sets the encoder which should be used to encode the images produced when
+ * flushing the given surface. Any output still pending for the previous
+ * encoder is written first.
+ *
+ * @param surface
+ *     The surface whose encoder should be set.
+ *
+ * @param encoder
+ *     The encoder to use, or NULL to encode and send images directly.
+ */
+void guac_common_surface_set_encoder(guac_common_surface* surface,
+        guac_common_encoder* encoder);
+
+/**
+ * Sets the maximum number of bytes of image data which may be cached for the
+ * given surface. Images which are sent repeatedly are cached within
+ * client-side buffers up to this limit, such that they may be copied rather
+ * than encoded and sent again. Caching is disabled by default.
+ *
+ * @param surface
+ *     The surface whose cache size should be set.
+ *
+ * @param max_size
+ *     The maximum number of bytes of image data which may be cached, or zero
+ *     to disable caching.
+ */
+void guac_common_surface_set_cache_size(guac_common_surface* surface,
+        size_t max_size);
+
+/**
+ * Enables or disables motion detection for the given surface. While enabled,
+ * content which has only moved since it was last sent, such as content
+ * which has been scrolled, is sent as a "copy" of the content already
+ * present on the client, with only newly-exposed content sent as images.
+ * This requires an additional copy of the surface contents to be kept in
+ * memory. Motion detection is disabled by default.
+ *
+ * @param surface
+ *     The surface to enable or disable motion detection for.
+ *
+ * @param enabled
+ *     Non-zero to enable motion detection, zero to disable it.
+ */
+void guac_common_surface_set_motion_detection(guac_common_surface* surface,
+        int enabled);
+
+/**
+ * Flushes the given surface like guac_common_surface_flush(), except that
+ * the resulting output is not necessarily written before this function
+ * returns. Images may continue to be encoded in the background until
+ * guac_common_surface_flush_complete() is invoked, allowing several surfaces
+ * to be encoded in parallel. If the surface has no encoder, this function is
+ * identical to guac_common_surface_flush().
+ *
+ * @param surface
+ *     The surface to flush.
+ */
+void guac_common_surface_flush_deferred(guac_common_surface* surface);
+
+/**
+ * Writes all output still pending from a previous call to
+ * guac_common_surface_flush_deferred(), waiting for any images still being
+ * encoded. Output is written in the same order it would have been written
+ * by guac_common_surface_flush().
+ *
+ * @param surface
+ *     The surface whose pending output should be written.
+ */
+void guac_common_surface_flush_complete(guac_common_surface* surface);
+
 /**
  * Duplicates the contents of the current surface to the given socket. Pending
  * changes are not flushed.
@@ -0,0 +1,140 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef __GUAC_COMMON_VIDEO_H
+#define __GUAC_COMMON_VIDEO_H
+
+#include "config.h"
+#include "rect.h"
+
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+
+/**
+ * The mimetype of the video streamed for video regions: a raw H.264
+ * elementary stream in Annex B format, with parameter sets sent inline with
+ * each keyframe.
+ */
+#define GUAC_COMMON_VIDEO_MIMETYPE "video/h264"
+
+/**
+ * The target bitrate of streamed video, in bits per second for each pixel
+ * of the video region.
+ */
+#define GUAC_COMMON_VIDEO_BITRATE_FACTOR 4
+
+/**
+ * The maximum number of frames between keyframes.
+ */
+#define GUAC_COMMON_VIDEO_GOP_SIZE 250
+
+/**
+ * An H.264 video stream, played by the client within a dedicated layer
+ * positioned over a region of another layer. Each frame of the video is
+ * encoded from the contents of that region as the region changes.
+ */
+typedef struct guac_common_video guac_common_video;
+
+/**
+ * Returns whether video regions may be streamed to all users of the given
+ * client. This requires both that libguac_common was built with support for
+ * encoding H.264 and that every connected user advertised support for
+ * GUAC_COMMON_VIDEO_MIMETYPE during the handshake.
+ *
+ * @param client
+ *     The client to check.
+ *
+ * @return
+ *     Non-zero if video regions may be streamed to all users of the given
+ *     client, zero otherwise.
+ */
+int guac_common_video_supported(guac_client* client);
+
+/**
+ * Allocates a new video stream covering the given region of the given
+ * layer. A new layer is allocated to play the video, and the instructions
+ * which position that layer and begin the stream are sent over the given
+ * socket.
+ *
+ * @param client
+ *     The client from which the layer and stream of the video should be
+ *     allocated.
+ *
+ * @param socket
+ *     The socket over which instructions related to the video should be
+ *     sent.
+ *
+ * @param parent
+ *     The layer containing the region covered by the video.
+ *
+ * @param rect
+ *     The region of the parent layer to cover. The width and height of this
+ *     region must be even.
+ *
+ * @return
+ *     A newly-allocated video stream, or NULL if the stream could not be
+ *     created, such as when no H.264 encoder is available.
+ */
+guac_common_video* guac_common_video_alloc(guac_client* client,
+        guac_socket* socket, const guac_layer* parent,
+        const guac_common_rect* rect);
+
+/**
+ * Encodes the given image as the next frame of the given video, sending any
+ * resulting video data over the given socket.
+ *
+ * @param video
+ *     The video to encode a frame of.
+ *
+ * @param socket
+ *     The socket over which video data should be sent.
+ *
+ * @param buffer
+ *     The first pixel of the image to encode, in Cairo's native-endian
+ *     32-bit ARGB format. The image must have the same dimensions as the
+ *     region covered by the video.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image.
+ *
+ * @return
+ *     Zero if the frame was encoded successfully, non-zero otherwise.
+ */
+int guac_common_video_encode(guac_common_video* video, guac_socket* socket,
+        const unsigned char* buffer, int stride);
+
+/**
+ * Ends the given video, disposing of the layer playing that video and
+ * freeing all associated resources. The contents of the covered region
+ * become visible again once the layer is disposed, and must be updated by
+ * the caller if stale.
+ *
+ * @param video
+ *     The video to end and free.
+ *
+ * @param socket
+ *     The socket over which the instructions ending the video should be
+ *     sent.
+ */
+void guac_common_video_free(guac_common_video* video, guac_socket* socket);
+
+#endif
+
@@ -0,0 +1,244 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/damage.h"
+#include "common/rect.h"
+
+#include <stdlib.h>
+
+guac_common_damage_map* guac_common_damage_map_alloc(int width, int height) {
+
+    guac_common_damage_map* map = malloc(sizeof(guac_common_damage_map));
+    map->width = GUAC_COMMON_DAMAGE_DIMENSION(width);
+    map->height = GUAC_COMMON_DAMAGE_DIMENSION(height);
+    map->dirty_count = 0;
+    map->cells = calloc(map->width * map->height,
+            sizeof(guac_common_damage_cell));
+
+    return map;
+
+}
+
+void guac_common_damage_map_free(guac_common_damage_map* map) {
+    free(map->cells);
+    free(map);
+}
+
+/**
+ * Determines the portion of the given rectangle which lies within the damage
+ * map cell at the given column and row.
+ *
+ * @param x
+ *     The column of the cell.
+ *
+ * @param y
+ *     The row of the cell.
+ *
+ * @param rect
+ *     The rectangle to constrain.
+ *
+ * @param cell_rect
+ *     The rectangle which should receive the portion of the given rectangle
+ *     within the cell.
+ */
+static void __guac_common_damage_cell_portion(int x, int y,
+        const guac_common_rect* rect, guac_common_rect* cell_rect) {
+
+    guac_common_rect_init(cell_rect,
+            x * GUAC_COMMON_DAMAGE_CELL_SIZE,
+            y * GUAC_COMMON_DAMAGE_CELL_SIZE,
+            GUAC_COMMON_DAMAGE_CELL_SIZE,
+            GUAC_COMMON_DAMAGE_CELL_SIZE);
+
+    guac_common_rect_constrain(cell_rect, rect);
+
+}
+
+void guac_common_damage_map_mark(guac_common_damage_map* map,
+        const guac_common_rect* rect) {
+
+    int x, y;
+
+    /* Ignore empty rects */
+    if (rect->width <= 0 || rect->height <= 0)
+        return;
+
+    /* Calculate minimum X/Y coordinates intersecting given rect */
+    int min_x = rect->x / GUAC_COMMON_DAMAGE_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_DAMAGE_CELL_SIZE;
+
+    /* Calculate maximum X/Y coordinates intersecting given rect */
+    int max_x = (rect->x + rect->width  - 1) / GUAC_COMMON_DAMAGE_CELL_SIZE;
+    int max_y = (rect->y + rect->height - 1) / GUAC_COMMON_DAMAGE_CELL_SIZE;
+
+    /* Update all damage map cells which intersect with rectangle */
+    for (y = min_y; y <= max_y; y++) {
+
+        guac_common_damage_cell* cell = map->cells + y * map->width + min_x;
+
+        for (x = min_x; x <= max_x; x++, cell++) {
+
+            /* Determine portion of update within current cell */
+            guac_common_rect cell_rect;
+            __guac_common_damage_cell_portion(x, y, rect, &cell_rect);
+
+            /* If already dirty, update existing rect */
+            if (cell->dirty)
+                guac_common_rect_extend(&cell->rect, &cell_rect);
+
+            /* Otherwise init rect */
+            else {
+                cell->rect = cell_rect;
+                cell->dirty = 1;
+                map->dirty_count++;
+            }
+
+        }
+
+    }
+
+}
+
+int guac_common_damage_map_added_area(const guac_common_damage_map* map,
+        const guac_common_rect* rect) {
+
+    int x, y;
+
+    /* Empty rects add nothing */
+    if (rect->width <= 0 || rect->height <= 0)
+        return 0;
+
+    /* Calculate minimum X/Y coordinates intersecting given rect */
+    int min_x = rect->x / GUAC_COMMON_DAMAGE_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_DAMAGE_CELL_SIZE;
+
+    /* Calculate maximum X/Y coordinates intersecting given rect */
+    int max_x = (rect->x + rect->width  - 1) / GUAC_COMMON_DAMAGE_CELL_SIZE;
+    int max_y = (rect->y + rect->height - 1) / GUAC_COMMON_DAMAGE_CELL_SIZE;
+
+    /* Calculate how much would be added to the pending damage */
+    int added_area = 0;
+    for (y = min_y; y <= max_y; y++) {
+
+        const guac_common_damage_cell* cell =
+            map->cells + y * map->width + min_x;
+
+        for (x = min_x; x <= max_x; x++, cell++) {
+
+            /* Determine portion of update within current cell */
+            guac_common_rect cell_rect;
+            __guac_common_damage_cell_portion(x, y, rect, &cell_rect);
+
+            /* Entire portion is new if cell is clean */
+            if (!cell->dirty)
+                added_area += cell_rect.width * cell_rect.height;
+
+            /* Otherwise, only growth of existing damage is new */
+            else {
+                guac_common_rect combined = cell->rect;
+                guac_common_rect_extend(&combined, &cell_rect);
+                added_area += combined.width * combined.height
+                            - cell->rect.width * cell->rect.height;
+            }
+
+        }
+
+    }
+
+    return added_area;
+
+}
+
+int guac_common_damage_map_collect(guac_common_damage_map* map,
+        guac_common_rect* updates, int length, int max_length) {
+
+    int x, y;
+
+    /* Do not collect if not dirty */
+    if (!map->dirty_count)
+        return length;
+
+    guac_common_damage_cell* row = map->cells;
+    guac_common_damage_cell* above = NULL;
+
+    /* For each row of the damage map */
+    for (y = 0; y < map->height; y++) {
+
+        /* For each horizontal run of dirty cells in current row */
+        x = 0;
+        while (x < map->width) {
+
+            guac_common_damage_cell* start = row + x;
+            start->group = -1;
+
+            /* Skip clean cells */
+            if (!start->dirty) {
+                x++;
+                continue;
+            }
+
+            /* Calculate bounds of run */
+            guac_common_rect run_rect = start->rect;
+            int run_length = 0;
+            while (x < map->width && row[x].dirty) {
+                guac_common_rect_extend(&run_rect, &row[x].rect);
+                row[x].dirty = 0;
+                if (run_length)
+                    row[x].group = -1;
+                run_length++;
+                x++;
+            }
+
+            int group;
+
+            /* Continue update of run directly above if spanning same columns */
+            if (above != NULL && above[start - row].group != -1
+                    && above[start - row].run_length == run_length)
+                group = above[start - row].group;
+
+            /* Combine with final update if array is full */
+            else if (length == max_length)
+                group = max_length - 1;
+
+            /* Otherwise, begin new update */
+            else {
+                group = length++;
+                updates[group] = run_rect;
+            }
+
+            guac_common_rect_extend(&updates[group], &run_rect);
+
+            start->group = group;
+            start->run_length = run_length;
+
+        }
+
+        /* Next damage map row */
+        above = row;
+        row += map->width;
+
+    }
+
+    /* Damage map is now clean */
+    map->dirty_count = 0;
+    return length;
+
+}
+
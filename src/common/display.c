@@ -19,6 +19,7 @@
 
 #include "common/cursor.h"
 #include "common/display.h"
+#include "common/encoder.h"
 #include "common/surface.h"
 
 #include <guacamole/client.h>
@@ -135,8 +136,20 @@ guac_common_display* guac_common_display_alloc(guac_client* client,
     /* Associate display with given client */
     display->client = client;
 
+    /* Encode images in parallel if beneficial */
+    display->encoder = guac_common_encoder_alloc();
+
     display->default_surface = guac_common_surface_alloc(client,
             client->socket, GUAC_DEFAULT_LAYER, width, height);
+    guac_common_surface_set_encoder(display->default_surface,
+            display->encoder);
+
+    /* Cache repeated images sent to the default layer */
+    guac_common_surface_set_cache_size(display->default_surface,
+            GUAC_COMMON_DISPLAY_CACHE_SIZE);
+
+    /* Copy scrolled content of the default layer rather than resending it */
+    guac_common_surface_set_motion_detection(display->default_surface, 1);
 
     /* No initial layers or buffers */
     display->layers = NULL;
@@ -158,6 +171,10 @@ void guac_common_display_free(guac_common_display* display) {
     guac_common_display_free_layers(display->buffers, display->client);
     guac_common_display_free_layers(display->layers, display->client);
 
+    /* Stop encoding only after all surfaces have written their output */
+    if (display->encoder != NULL)
+        guac_common_encoder_free(display->encoder);
+
     pthread_mutex_destroy(&display->_lock);
     free(display);
 
@@ -188,13 +205,22 @@ void guac_common_display_flush(guac_common_display* display) {
 
     guac_common_display_layer* current = display->layers;
 
-    /* Flush all surfaces */
+    /* Flush all surfaces, allowing their images to be encoded in parallel */
+    while (current != NULL) {
+        guac_common_surface_flush_deferred(current->surface);
+        current = current->next;
+    }
+
+    guac_common_surface_flush_deferred(display->default_surface);
+
+    /* Write resulting output in the same order as the surfaces were flushed */
+    current = display->layers;
     while (current != NULL) {
-        guac_common_surface_flush(current->surface);
+        guac_common_surface_flush_complete(current->surface);
         current = current->next;
     }
 
-    guac_common_surface_flush(display->default_surface);
+    guac_common_surface_flush_complete(display->default_surface);
 
     pthread_mutex_unlock(&display->_lock);
 
@@ -286,6 +312,7 @@ guac_common_display_layer* guac_common_display_alloc_layer(
     /* Allocate corresponding surface */
     guac_common_surface* surface = guac_common_surface_alloc(display->client,
             display->client->socket, layer, width, height);
+    guac_common_surface_set_encoder(surface, display->encoder);
 
     /* Add layer and surface to list */
     guac_common_display_layer* display_layer =
@@ -307,6 +334,7 @@ guac_common_display_layer* guac_common_display_alloc_buffer(
     /* Allocate corresponding surface */
     guac_common_surface* surface = guac_common_surface_alloc(display->client,
             display->client->socket, buffer, width, height);
+    guac_common_surface_set_encoder(surface, display->encoder);
 
     /* Add buffer and surface to list */
     guac_common_display_layer* display_layer =
@@ -0,0 +1,369 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/encoder.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/image.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Write handler for the in-memory socket of a guac_common_encoder_job,
+ * appending all data written to the job's output buffer.
+ *
+ * @param socket
+ *     The socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes to write.
+ *
+ * @return
+ *     The number of bytes written, or -1 if the output buffer could not be
+ *     grown.
+ */
+static ssize_t __guac_common_encoder_job_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_common_encoder_job* job = (guac_common_encoder_job*) socket->data;
+
+    /* Grow buffer as necessary */
+    if (job->length + count > job->available) {
+
+        size_t available = job->available;
+        while (job->length + count > available)
+            available *= 2;
+
+        char* buffer = realloc(job->buffer, available);
+        if (buffer == NULL)
+            return -1;
+
+        job->buffer = buffer;
+        job->available = available;
+
+    }
+
+    memcpy(job->buffer + job->length, buf, count);
+    job->length += count;
+
+    return count;
+
+}
+
+/**
+ * Encodes the image of the given job, writing the resulting blobs and the
+ * "end" instruction which terminates the image stream to the job's socket.
+ * The image is destroyed once encoded.
+ *
+ * @param job
+ *     The job whose image should be encoded.
+ */
+static void __guac_common_encoder_job_encode(guac_common_encoder_job* job) {
+
+    switch (job->format) {
+
+        case GUAC_COMMON_ENCODER_PNG:
+            guac_image_write_png(job->socket, job->stream, job->image,
+                    job->analyzed ? &job->analysis : NULL);
+            break;
+
+        case GUAC_COMMON_ENCODER_JPEG:
+            guac_image_write_jpeg(job->socket, job->stream, job->image,
+                    job->quality);
+            break;
+
+        case GUAC_COMMON_ENCODER_WEBP:
+            guac_image_write_webp(job->socket, job->stream, job->image,
+                    job->quality, job->lossless, job->method);
+            break;
+
+    }
+
+    guac_protocol_send_end(job->socket, job->stream);
+
+    cairo_surface_destroy(job->image);
+    job->image = NULL;
+
+}
+
+/**
+ * The main loop of each worker thread, encoding queued jobs in the order they
+ * were submitted until the encoder is shut down and no jobs remain.
+ *
+ * @param data
+ *     The guac_common_encoder which owns the worker thread.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* __guac_common_encoder_worker(void* data) {
+
+    guac_common_encoder* encoder = (guac_common_encoder*) data;
+
+    pthread_mutex_lock(&encoder->_lock);
+
+    for (;;) {
+
+        /* Wait for work */
+        while (encoder->queue_head == NULL && !encoder->shutdown)
+            pthread_cond_wait(&encoder->_work_available, &encoder->_lock);
+
+        /* Exit only once all queued work is done */
+        guac_common_encoder_job* job = encoder->queue_head;
+        if (job == NULL)
+            break;
+
+        /* Remove job from queue */
+        encoder->queue_head = job->queue_next;
+        if (encoder->queue_head == NULL)
+            encoder->queue_tail = NULL;
+
+        /* Encode without holding the queue lock */
+        pthread_mutex_unlock(&encoder->_lock);
+        __guac_common_encoder_job_encode(job);
+        pthread_mutex_lock(&encoder->_lock);
+
+        job->finished = 1;
+        pthread_cond_broadcast(&encoder->_job_finished);
+
+    }
+
+    pthread_mutex_unlock(&encoder->_lock);
+    return NULL;
+
+}
+
+guac_common_encoder* guac_common_encoder_alloc() {
+
+    /* Use one worker per processor, within reason */
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > GUAC_COMMON_ENCODER_MAX_THREADS)
+        threads = GUAC_COMMON_ENCODER_MAX_THREADS;
+
+    /* Encoding in parallel is pointless without multiple processors */
+    if (threads < 2)
+        return NULL;
+
+    guac_common_encoder* encoder = calloc(1, sizeof(guac_common_encoder));
+    if (encoder == NULL)
+        return NULL;
+
+    pthread_mutex_init(&encoder->_lock, NULL);
+    pthread_cond_init(&encoder->_work_available, NULL);
+    pthread_cond_init(&encoder->_job_finished, NULL);
+
+    /* Start workers, tolerating failure of all but the first two */
+    while (encoder->thread_count < threads) {
+        if (pthread_create(&encoder->threads[encoder->thread_count], NULL,
+                    __guac_common_encoder_worker, encoder))
+            break;
+        encoder->thread_count++;
+    }
+
+    if (encoder->thread_count < 2) {
+        guac_common_encoder_free(encoder);
+        return NULL;
+    }
+
+    return encoder;
+
+}
+
+void guac_common_encoder_free(guac_common_encoder* encoder) {
+
+    /* Signal all workers to exit */
+    pthread_mutex_lock(&encoder->_lock);
+    encoder->shutdown = 1;
+    pthread_cond_broadcast(&encoder->_work_available);
+    pthread_mutex_unlock(&encoder->_lock);
+
+    /* Wait for workers to finish */
+    for (int i = 0; i < encoder->thread_count; i++)
+        pthread_join(encoder->threads[i], NULL);
+
+    pthread_cond_destroy(&encoder->_job_finished);
+    pthread_cond_destroy(&encoder->_work_available);
+    pthread_mutex_destroy(&encoder->_lock);
+
+    free(encoder);
+
+}
+
+guac_common_encoder_job* guac_common_encoder_job_alloc(guac_client* client) {
+
+    guac_common_encoder_job* job = calloc(1, sizeof(guac_common_encoder_job));
+    if (job == NULL)
+        return NULL;
+
+    job->client = client;
+    job->available = GUAC_COMMON_ENCODER_INITIAL_BUFFER_SIZE;
+    job->buffer = malloc(job->available);
+    job->socket = guac_socket_alloc();
+
+    if (job->buffer == NULL || job->socket == NULL) {
+        if (job->socket != NULL)
+            guac_socket_free(job->socket);
+        free(job->buffer);
+        free(job);
+        return NULL;
+    }
+
+    /* Collect all output within job */
+    job->socket->data = job;
+    job->socket->write_handler = __guac_common_encoder_job_write_handler;
+
+    return job;
+
+}
+
+void guac_common_encoder_job_submit(guac_common_encoder* encoder,
+        guac_common_encoder_job* job, guac_common_encoder_format format,
+        guac_composite_mode mode, const guac_layer* layer, int x, int y,
+        unsigned char* data, cairo_format_t image_format, int width,
+        int height, int stride, int quality, int lossless, int method,
+        const guac_image_analysis* analysis) {
+
+    const char* mimetype;
+    switch (format) {
+
+        case GUAC_COMMON_ENCODER_JPEG:
+            mimetype = "image/jpeg";
+            break;
+
+        case GUAC_COMMON_ENCODER_WEBP:
+            mimetype = "image/webp";
+            break;
+
+        default:
+            mimetype = "image/png";
+
+    }
+
+    job->submitted = 1;
+    job->format = format;
+    job->quality = quality;
+    job->lossless = lossless;
+    job->method = method;
+
+    /* Retain any existing analysis of the image for use by the encoder */
+    if (analysis != NULL) {
+        job->analysis = *analysis;
+        job->analyzed = 1;
+    }
+
+    /* Declare stream as containing image data */
+    job->stream = guac_client_alloc_stream(job->client);
+    guac_protocol_send_img(job->socket, job->stream, mode, layer, mimetype,
+            x, y);
+
+    /* Copy all but small images for encoding by a worker thread, if an
+     * encoder is available */
+    cairo_surface_t* copy = NULL;
+    if (encoder != NULL && width * height >= GUAC_COMMON_ENCODER_MIN_AREA) {
+
+        copy = cairo_image_surface_create(image_format, width, height);
+
+        /* Cairo signals failure with an error surface rather than NULL */
+        if (cairo_surface_status(copy) != CAIRO_STATUS_SUCCESS) {
+            cairo_surface_destroy(copy);
+            copy = NULL;
+        }
+
+    }
+
+    /* Encode all other images (including those which could not be copied)
+     * immediately, in place */
+    if (copy == NULL) {
+        job->image = cairo_image_surface_create_for_data(data, image_format,
+                width, height, stride);
+        __guac_common_encoder_job_encode(job);
+        job->finished = 1;
+        return;
+    }
+
+    job->image = copy;
+
+    unsigned char* snapshot = cairo_image_surface_get_data(job->image);
+    int snapshot_stride = cairo_image_surface_get_stride(job->image);
+
+    cairo_surface_flush(job->image);
+    for (int row = 0; row < height; row++) {
+        memcpy(snapshot, data, width * 4);
+        snapshot += snapshot_stride;
+        data += stride;
+    }
+    cairo_surface_mark_dirty(job->image);
+
+    /* Add to end of queue */
+    pthread_mutex_lock(&encoder->_lock);
+
+    job->encoder = encoder;
+    if (encoder->queue_tail != NULL)
+        encoder->queue_tail->queue_next = job;
+    else
+        encoder->queue_head = job;
+    encoder->queue_tail = job;
+
+    pthread_cond_signal(&encoder->_work_available);
+    pthread_mutex_unlock(&encoder->_lock);
+
+}
+
+void guac_common_encoder_job_complete(guac_common_encoder_job* job,
+        guac_socket* socket) {
+
+    guac_common_encoder* encoder = job->encoder;
+
+    /* Wait for image to be encoded, if being encoded by a worker */
+    if (encoder != NULL) {
+        pthread_mutex_lock(&encoder->_lock);
+        while (!job->finished)
+            pthread_cond_wait(&encoder->_job_finished, &encoder->_lock);
+        pthread_mutex_unlock(&encoder->_lock);
+    }
+
+    /* Write all output as a single unit */
+    if (job->length > 0) {
+        guac_socket_instruction_begin(socket);
+        guac_socket_write(socket, job->buffer, job->length);
+        guac_socket_instruction_end(socket);
+    }
+
+    /* The stream index may only be reused once its data has been sent */
+    if (job->stream != NULL)
+        guac_client_free_stream(job->client, job->stream);
+
+    guac_socket_free(job->socket);
+    free(job->buffer);
+    free(job);
+
+}
+
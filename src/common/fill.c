@@ -0,0 +1,360 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/fill.h"
+#include "common/rect.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The value representing a tile (or run of tiles) which is not a single,
+ * fully-opaque color. As the alpha component of this value is zero, it can
+ * never be the color of a fill.
+ */
+#define GUAC_COMMON_FILL_NONE 0
+
+/**
+ * The minimum percentage of a region which must be covered by fills for that
+ * region to be worth splitting.
+ */
+#define GUAC_COMMON_FILL_MIN_COVERAGE 25
+
+/**
+ * A horizontal run of tiles which share the same color (or which are all not
+ * a single color), and which may extend downward over several rows of tiles.
+ */
+typedef struct guac_common_fill_run {
+
+    /**
+     * The column of the first tile in this run, relative to the first column
+     * of the region.
+     */
+    int start;
+
+    /**
+     * The column immediately after the last tile in this run, relative to
+     * the first column of the region.
+     */
+    int end;
+
+    /**
+     * The first row of tiles covered by this run, relative to the first row
+     * of the region.
+     */
+    int row;
+
+    /**
+     * The color of every tile in this run, or GUAC_COMMON_FILL_NONE if the
+     * tiles are not a single color.
+     */
+    uint32_t color;
+
+} guac_common_fill_run;
+
+/**
+ * The state of an extraction which is in progress.
+ */
+typedef struct guac_common_fill_state {
+
+    /**
+     * The region being divided.
+     */
+    const guac_common_rect* rect;
+
+    /**
+     * The map receiving the fills and residual rectangles of the region.
+     */
+    guac_common_fill_map* map;
+
+    /**
+     * The absolute column of the first tile intersecting the region.
+     */
+    int first_col;
+
+    /**
+     * The absolute row of the first tile intersecting the region.
+     */
+    int first_row;
+
+    /**
+     * The total area covered by fills thus far, in pixels.
+     */
+    int fill_area;
+
+    /**
+     * Non-zero if the region has required more fills or residual rectangles
+     * than the map can hold, zero otherwise.
+     */
+    int overflow;
+
+} guac_common_fill_state;
+
+/**
+ * Returns the color of the given tile, if every pixel within that tile is the
+ * same fully-opaque color.
+ *
+ * @param data
+ *     The first pixel of the tile.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image containing the tile.
+ *
+ * @param width
+ *     The width of the tile, in pixels.
+ *
+ * @param height
+ *     The height of the tile, in pixels.
+ *
+ * @return
+ *     The color of every pixel within the tile, or GUAC_COMMON_FILL_NONE if
+ *     the tile is not a single, fully-opaque color.
+ */
+static uint32_t __guac_common_fill_tile_color(const unsigned char* data,
+        int stride, int width, int height) {
+
+    uint32_t color = *((const uint32_t*) data);
+
+    /* Only fully-opaque tiles can be filled */
+    if ((color & 0xFF000000) != 0xFF000000)
+        return GUAC_COMMON_FILL_NONE;
+
+    for (int y = 0; y < height; y++) {
+
+        /* Compare entire row without branching, such that the comparison
+         * may be vectorized */
+        const uint32_t* row = (const uint32_t*) data;
+        uint32_t difference = 0;
+        for (int x = 0; x < width; x++)
+            difference |= row[x] ^ color;
+
+        if (difference)
+            return GUAC_COMMON_FILL_NONE;
+
+        data += stride;
+
+    }
+
+    return color;
+
+}
+
+/**
+ * Adds the rectangle covered by the given run to the map of the given
+ * extraction, as either a fill or a residual rectangle depending on the
+ * color of the run.
+ *
+ * @param state
+ *     The state of the extraction in progress.
+ *
+ * @param run
+ *     The run to add.
+ *
+ * @param end_row
+ *     The row of tiles immediately after the last row covered by the run,
+ *     relative to the first row of the region.
+ */
+static void __guac_common_fill_add_run(guac_common_fill_state* state,
+        const guac_common_fill_run* run, int end_row) {
+
+    const guac_common_rect* region = state->rect;
+    guac_common_fill_map* map = state->map;
+
+    /* Calculate bounds of run in pixels, clipped to region */
+    int left   = (state->first_col + run->start) * GUAC_COMMON_FILL_TILE_SIZE;
+    int top    = (state->first_row + run->row)   * GUAC_COMMON_FILL_TILE_SIZE;
+    int right  = (state->first_col + run->end)   * GUAC_COMMON_FILL_TILE_SIZE;
+    int bottom = (state->first_row + end_row)    * GUAC_COMMON_FILL_TILE_SIZE;
+
+    if (left < region->x) left = region->x;
+    if (top  < region->y) top  = region->y;
+    if (right  > region->x + region->width)  right  = region->x + region->width;
+    if (bottom > region->y + region->height) bottom = region->y + region->height;
+
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, left, top, right - left, bottom - top);
+
+    /* Store as residual rectangle if not a single color */
+    if (run->color == GUAC_COMMON_FILL_NONE) {
+
+        if (map->num_residual == GUAC_COMMON_FILL_MAX_RESIDUAL) {
+            state->overflow = 1;
+            return;
+        }
+
+        map->residual[map->num_residual++] = rect;
+
+    }
+
+    /* Otherwise, store as fill */
+    else {
+
+        if (map->num_fills == GUAC_COMMON_FILL_MAX_FILLS) {
+            state->overflow = 1;
+            return;
+        }
+
+        guac_common_fill* fill = &map->fills[map->num_fills++];
+        fill->rect = rect;
+        fill->color = run->color;
+
+        state->fill_area += rect.width * rect.height;
+
+    }
+
+}
+
+int guac_common_fill_extract(const unsigned char* buffer, int stride,
+        const guac_common_rect* rect, guac_common_fill_map* map) {
+
+    map->num_fills = 0;
+    map->num_residual = 0;
+
+    /* Small regions are not worth splitting */
+    int area = rect->width * rect->height;
+    if (area < GUAC_COMMON_FILL_MIN_AREA)
+        return 0;
+
+    guac_common_fill_state state = {
+        .rect = rect,
+        .map = map,
+        .first_col = rect->x / GUAC_COMMON_FILL_TILE_SIZE,
+        .first_row = rect->y / GUAC_COMMON_FILL_TILE_SIZE,
+        .fill_area = 0,
+        .overflow = 0
+    };
+
+    int cols = (rect->x + rect->width - 1) / GUAC_COMMON_FILL_TILE_SIZE
+             - state.first_col + 1;
+    int rows = (rect->y + rect->height - 1) / GUAC_COMMON_FILL_TILE_SIZE
+             - state.first_row + 1;
+
+    /* Colors of each tile in the current row, and the runs of the current
+     * and previous rows */
+    uint32_t* colors = malloc(sizeof(uint32_t) * cols);
+    guac_common_fill_run* current = malloc(sizeof(guac_common_fill_run) * cols);
+    guac_common_fill_run* previous = malloc(sizeof(guac_common_fill_run) * cols);
+    int num_previous = 0;
+
+    if (colors == NULL || current == NULL || previous == NULL) {
+        free(colors);
+        free(current);
+        free(previous);
+        return 0;
+    }
+
+    for (int row = 0; row < rows && !state.overflow; row++) {
+
+        /* Calculate vertical bounds of tiles in this row */
+        int top = (state.first_row + row) * GUAC_COMMON_FILL_TILE_SIZE;
+        int bottom = top + GUAC_COMMON_FILL_TILE_SIZE;
+        if (top < rect->y) top = rect->y;
+        if (bottom > rect->y + rect->height) bottom = rect->y + rect->height;
+
+        /* Determine color of each tile */
+        for (int col = 0; col < cols; col++) {
+
+            int left = (state.first_col + col) * GUAC_COMMON_FILL_TILE_SIZE;
+            int right = left + GUAC_COMMON_FILL_TILE_SIZE;
+            if (left < rect->x) left = rect->x;
+            if (right > rect->x + rect->width) right = rect->x + rect->width;
+
+            colors[col] = __guac_common_fill_tile_color(
+                    buffer + top * stride + left * 4, stride,
+                    right - left, bottom - top);
+
+        }
+
+        /* Group tiles into runs of the same color, treating runs too short
+         * to be worth filling as residual */
+        int num_current = 0;
+        for (int col = 0; col < cols;) {
+
+            int start = col;
+            uint32_t color = colors[col];
+            while (col < cols && colors[col] == color)
+                col++;
+
+            if (col - start < GUAC_COMMON_FILL_MIN_TILES)
+                color = GUAC_COMMON_FILL_NONE;
+
+            /* Extend previous run if possible */
+            if (num_current > 0 && current[num_current - 1].color == color)
+                current[num_current - 1].end = col;
+
+            else {
+                guac_common_fill_run* run = &current[num_current++];
+                run->start = start;
+                run->end = col;
+                run->row = row;
+                run->color = color;
+            }
+
+        }
+
+        /* Continue runs from the previous row which match exactly, adding
+         * any others to the map as they can extend no further */
+        int index = 0;
+        for (int i = 0; i < num_current; i++) {
+
+            guac_common_fill_run* run = &current[i];
+
+            while (index < num_previous
+                    && previous[index].start < run->start)
+                __guac_common_fill_add_run(&state, &previous[index++], row);
+
+            if (index < num_previous
+                    && previous[index].start == run->start) {
+
+                guac_common_fill_run* above = &previous[index++];
+                if (above->end == run->end && above->color == run->color)
+                    run->row = above->row;
+                else
+                    __guac_common_fill_add_run(&state, above, row);
+
+            }
+
+        }
+
+        while (index < num_previous)
+            __guac_common_fill_add_run(&state, &previous[index++], row);
+
+        /* Current row becomes previous row */
+        guac_common_fill_run* swap = previous;
+        previous = current;
+        current = swap;
+        num_previous = num_current;
+
+    }
+
+    /* Add all runs which extend to the bottom of the region */
+    for (int i = 0; i < num_previous; i++)
+        __guac_common_fill_add_run(&state, &previous[i], rows);
+
+    free(colors);
+    free(current);
+    free(previous);
+
+    /* Split only if enough of the region can be filled */
+    return !state.overflow && map->num_fills > 0
+        && (int64_t) state.fill_area * 100
+            >= (int64_t) area * GUAC_COMMON_FILL_MIN_COVERAGE;
+
+}
@@ -0,0 +1,421 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+#include "common/motion.h"
+#include "common/rect.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The initial value of each row or column hash (the 32-bit FNV-1a offset
+ * basis).
+ */
+#define GUAC_COMMON_MOTION_HASH_BASIS 2166136261u
+
+/**
+ * The multiplier applied while computing row and column hashes (the 32-bit
+ * FNV-1a prime).
+ */
+#define GUAC_COMMON_MOTION_HASH_PRIME 16777619u
+
+/**
+ * Calculates the hash of each row of the given region.
+ *
+ * @param data
+ *     The first pixel of the region.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image containing the region.
+ *
+ * @param width
+ *     The width of the region, in pixels.
+ *
+ * @param height
+ *     The height of the region, in pixels.
+ *
+ * @param hashes
+ *     An array of at least height elements which will receive the hash of
+ *     each row.
+ */
+static void __guac_common_motion_hash_rows(const unsigned char* data,
+        int stride, int width, int height, unsigned int* hashes) {
+
+    for (int y = 0; y < height; y++) {
+
+        const uint32_t* row = (const uint32_t*) data;
+        unsigned int hash = GUAC_COMMON_MOTION_HASH_BASIS;
+
+        for (int x = 0; x < width; x++)
+            hash = (hash ^ row[x]) * GUAC_COMMON_MOTION_HASH_PRIME;
+
+        hashes[y] = hash;
+        data += stride;
+
+    }
+
+}
+
+/**
+ * Calculates the hash of each column of the given region. The region is
+ * read a row at a time, updating the hash of every column in turn.
+ *
+ * @param data
+ *     The first pixel of the region.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image containing the region.
+ *
+ * @param width
+ *     The width of the region, in pixels.
+ *
+ * @param height
+ *     The height of the region, in pixels.
+ *
+ * @param hashes
+ *     An array of at least width elements which will receive the hash of
+ *     each column.
+ */
+static void __guac_common_motion_hash_columns(const unsigned char* data,
+        int stride, int width, int height, unsigned int* hashes) {
+
+    for (int x = 0; x < width; x++)
+        hashes[x] = GUAC_COMMON_MOTION_HASH_BASIS;
+
+    for (int y = 0; y < height; y++) {
+
+        const uint32_t* row = (const uint32_t*) data;
+
+        for (int x = 0; x < width; x++)
+            hashes[x] = (hashes[x] ^ row[x]) * GUAC_COMMON_MOTION_HASH_PRIME;
+
+        data += stride;
+
+    }
+
+}
+
+/**
+ * Finds the offset at which the largest contiguous run of current lines
+ * (rows or columns) matches the previous lines, given the hash of each line.
+ * Candidate offsets are chosen by voting among evenly-spaced sample lines.
+ *
+ * @param current
+ *     The hashes of the current lines.
+ *
+ * @param count
+ *     The number of current lines.
+ *
+ * @param previous
+ *     The hashes of the previous lines.
+ *
+ * @param previous_start
+ *     The position of the first previous line relative to the first current
+ *     line. This will be negative if the previous lines begin before the
+ *     current lines.
+ *
+ * @param previous_count
+ *     The number of previous lines.
+ *
+ * @param offset
+ *     Pointer to an int which will receive the position of the matching
+ *     previous lines relative to the current lines.
+ *
+ * @param start
+ *     Pointer to an int which will receive the index of the first current
+ *     line within the matching run.
+ *
+ * @param length
+ *     Pointer to an int which will receive the number of lines within the
+ *     matching run.
+ *
+ * @return
+ *     Non-zero if a sufficiently large matching run was found, zero
+ *     otherwise.
+ */
+static int __guac_common_motion_find_offset(const unsigned int* current,
+        int count, const unsigned int* previous, int previous_start,
+        int previous_count, int* offset, int* start, int* length) {
+
+    int votes[GUAC_COMMON_MOTION_SAMPLES * GUAC_COMMON_MOTION_MAX_CANDIDATES];
+    int vote_count = 0;
+
+    /* Collect candidate offsets from distinctive sample lines */
+    for (int sample = 0; sample < GUAC_COMMON_MOTION_SAMPLES; sample++) {
+
+        int i = count * (2 * sample + 1) / (2 * GUAC_COMMON_MOTION_SAMPLES);
+
+        int candidates[GUAC_COMMON_MOTION_MAX_CANDIDATES];
+        int candidate_count = 0;
+
+        for (int j = 0; j < previous_count; j++) {
+
+            int candidate = previous_start + j - i;
+            if (candidate == 0 || previous[j] != current[i])
+                continue;
+
+            /* Ignore samples which match too many lines */
+            if (candidate_count == GUAC_COMMON_MOTION_MAX_CANDIDATES) {
+                candidate_count = 0;
+                break;
+            }
+
+            candidates[candidate_count++] = candidate;
+
+        }
+
+        memcpy(votes + vote_count, candidates, candidate_count * sizeof(int));
+        vote_count += candidate_count;
+
+    }
+
+    /* Choose the most popular offset, preferring smaller offsets */
+    int best_offset = 0;
+    int best_votes = 0;
+
+    for (int i = 0; i < vote_count; i++) {
+
+        int candidate_votes = 0;
+        for (int j = 0; j < vote_count; j++) {
+            if (votes[j] == votes[i])
+                candidate_votes++;
+        }
+
+        if (candidate_votes > best_votes || (candidate_votes == best_votes
+                    && abs(votes[i]) < abs(best_offset))) {
+            best_offset = votes[i];
+            best_votes = candidate_votes;
+        }
+
+    }
+
+    if (best_votes < GUAC_COMMON_MOTION_MIN_VOTES)
+        return 0;
+
+    /* Find the longest run of lines which match at that offset */
+    int run_start = 0;
+    int run_length = 0;
+    *length = 0;
+
+    for (int i = 0; i < count; i++) {
+
+        int j = i + best_offset - previous_start;
+
+        if (j >= 0 && j < previous_count && previous[j] == current[i]) {
+
+            if (run_length++ == 0)
+                run_start = i;
+
+            if (run_length > *length) {
+                *start = run_start;
+                *length = run_length;
+            }
+
+        }
+
+        else
+            run_length = 0;
+
+    }
+
+    /* Ignore motion which would not save enough to be worthwhile */
+    if (*length < GUAC_COMMON_MOTION_MIN_LINES || *length < count / 4)
+        return 0;
+
+    *offset = best_offset;
+    return 1;
+
+}
+
+/**
+ * Searches for vertical motion within the given region, as would result from
+ * content being scrolled up or down.
+ *
+ * @see guac_common_motion_estimate()
+ */
+static int __guac_common_motion_estimate_vertical(
+        const unsigned char* current, const unsigned char* previous,
+        int stride, int height, const guac_common_rect* rect,
+        guac_common_motion* motion) {
+
+    /* Search previous rows within one region-height of the region */
+    int previous_top = rect->y - rect->height;
+    int previous_bottom = rect->y + rect->height * 2;
+
+    if (previous_top < 0)
+        previous_top = 0;
+
+    if (previous_bottom > height)
+        previous_bottom = height;
+
+    int previous_count = previous_bottom - previous_top;
+
+    unsigned int* current_hashes = malloc(rect->height * sizeof(unsigned int));
+    unsigned int* previous_hashes = malloc(previous_count * sizeof(unsigned int));
+
+    if (current_hashes == NULL || previous_hashes == NULL) {
+        free(previous_hashes);
+        free(current_hashes);
+        return 0;
+    }
+
+    const unsigned char* current_data = current
+        + rect->y * stride + rect->x * 4;
+
+    const unsigned char* previous_data = previous
+        + previous_top * stride + rect->x * 4;
+
+    __guac_common_motion_hash_rows(current_data, stride, rect->width,
+            rect->height, current_hashes);
+
+    __guac_common_motion_hash_rows(previous_data, stride, rect->width,
+            previous_count, previous_hashes);
+
+    int offset, start, length;
+    int found = __guac_common_motion_find_offset(current_hashes, rect->height,
+            previous_hashes, previous_top - rect->y, previous_count,
+            &offset, &start, &length);
+
+    free(previous_hashes);
+    free(current_hashes);
+
+    if (!found)
+        return 0;
+
+    /* Verify match, as hashes may collide */
+    current_data += start * stride;
+    previous_data = previous + (rect->y + start + offset) * stride
+                  + rect->x * 4;
+
+    for (int y = 0; y < length; y++) {
+
+        if (memcmp(current_data, previous_data, rect->width * 4))
+            return 0;
+
+        current_data += stride;
+        previous_data += stride;
+
+    }
+
+    guac_common_rect_init(&motion->rect, rect->x, rect->y + start,
+            rect->width, length);
+
+    motion->dx = 0;
+    motion->dy = offset;
+    return 1;
+
+}
+
+/**
+ * Searches for horizontal motion within the given region, as would result
+ * from content being scrolled left or right.
+ *
+ * @see guac_common_motion_estimate()
+ */
+static int __guac_common_motion_estimate_horizontal(
+        const unsigned char* current, const unsigned char* previous,
+        int stride, int width, const guac_common_rect* rect,
+        guac_common_motion* motion) {
+
+    /* Search previous columns within one region-width of the region */
+    int previous_left = rect->x - rect->width;
+    int previous_right = rect->x + rect->width * 2;
+
+    if (previous_left < 0)
+        previous_left = 0;
+
+    if (previous_right > width)
+        previous_right = width;
+
+    int previous_count = previous_right - previous_left;
+
+    unsigned int* current_hashes = malloc(rect->width * sizeof(unsigned int));
+    unsigned int* previous_hashes = malloc(previous_count * sizeof(unsigned int));
+
+    if (current_hashes == NULL || previous_hashes == NULL) {
+        free(previous_hashes);
+        free(current_hashes);
+        return 0;
+    }
+
+    const unsigned char* current_data = current
+        + rect->y * stride + rect->x * 4;
+
+    const unsigned char* previous_data = previous
+        + rect->y * stride + previous_left * 4;
+
+    __guac_common_motion_hash_columns(current_data, stride, rect->width,
+            rect->height, current_hashes);
+
+    __guac_common_motion_hash_columns(previous_data, stride, previous_count,
+            rect->height, previous_hashes);
+
+    int offset, start, length;
+    int found = __guac_common_motion_find_offset(current_hashes, rect->width,
+            previous_hashes, previous_left - rect->x, previous_count,
+            &offset, &start, &length);
+
+    free(previous_hashes);
+    free(current_hashes);
+
+    if (!found)
+        return 0;
+
+    /* Verify match, as hashes may collide */
+    current_data += start * 4;
+    previous_data = previous + rect->y * stride
+                  + (rect->x + start + offset) * 4;
+
+    for (int y = 0; y < rect->height; y++) {
+
+        if (memcmp(current_data, previous_data, length * 4))
+            return 0;
+
+        current_data += stride;
+        previous_data += stride;
+
+    }
+
+    guac_common_rect_init(&motion->rect, rect->x + start, rect->y,
+            length, rect->height);
+
+    motion->dx = offset;
+    motion->dy = 0;
+    return 1;
+
+}
+
+int guac_common_motion_estimate(const unsigned char* current,
+        const unsigned char* previous, int stride, int width, int height,
+        const guac_common_rect* rect, guac_common_motion* motion) {
+
+    /* Small regions are not worth examining */
+    if (rect->width < GUAC_COMMON_MOTION_MIN_SIZE
+            || rect->height < GUAC_COMMON_MOTION_MIN_SIZE)
+        return 0;
+
+    return __guac_common_motion_estimate_vertical(current, previous, stride,
+                height, rect, motion)
+        || __guac_common_motion_estimate_horizontal(current, previous, stride,
+                width, rect, motion);
+
+}
+
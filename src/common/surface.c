@@ -18,11 +18,20 @@
  */
 
 #include "config.h"
+#include "common/blit.h"
+#include "common/cache.h"
+#include "common/damage.h"
+#include "common/encoder.h"
+#include "common/fill.h"
+#include "common/motion.h"
 #include "common/rect.h"
 #include "common/surface.h"
+#include "common/video.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
+#include <guacamole/hash.h>
+#include <guacamole/image.h>
 #include <guacamole/layer.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
@@ -103,6 +112,30 @@
  */
 #define GUAC_SURFACE_WEBP_BLOCK_SIZE 8
 
+/**
+ * The framerate which, if exceeded by a sufficiently large region, indicates
+ * that the region is playing video and should be streamed as such.
+ */
+#define GUAC_SURFACE_VIDEO_FRAMERATE 15
+
+/**
+ * The minimum area of any region streamed as video. Smaller regions are
+ * sent as images regardless of framerate.
+ */
+#define GUAC_SURFACE_VIDEO_MIN_AREA (320 * 240)
+
+/**
+ * The block size to which video regions are aligned, matching the size of
+ * an H.264 macroblock.
+ */
+#define GUAC_SURFACE_VIDEO_BLOCK_SIZE 16
+
+/**
+ * The number of milliseconds that a video region may remain unchanged
+ * before its video is ended and its contents are sent as images again.
+ */
+#define GUAC_SURFACE_VIDEO_TIMEOUT 1000
+
 void guac_common_surface_move(guac_common_surface* surface, int x, int y) {
 
     pthread_mutex_lock(&surface->_lock);
@@ -331,13 +364,98 @@ static int __guac_common_should_combine(guac_common_surface* surface, const guac
 }
 
 /**
- * Expands the dirty rect of the given surface to contain the rect described by the given
- * coordinates.
+ * Returns whether the given rectangle intersects the region covered by the
+ * active video of the given surface, if any. The client's copy of the layer
+ * beneath that video is stale and hidden, thus changes within the region
+ * must be sent as frames of the video, and the region must not be used as
+ * the source of any copy.
+ *
+ * @param surface
+ *     The surface to check.
+ *
+ * @param rect
+ *     The rectangle to check.
+ *
+ * @return
+ *     Non-zero if the given rectangle intersects the region covered by the
+ *     active video of the given surface, zero otherwise.
+ */
+static int __guac_common_surface_is_under_video(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    return surface->video != NULL
+        && guac_common_rect_intersects(rect, &surface->video_rect);
+
+}
+
+/**
+ * Returns whether the given rectangle, which describes an update that could
+ * be sent to the client directly (such as a "copy" or "rect"), should instead
+ * be deferred and added to the damage map of the given surface, to eventually
+ * be flushed as image data.
+ *
+ * @param surface
+ *     The surface being updated.
+ *
+ * @param rect
+ *     The bounding rectangle of the update being made to the surface.
+ *
+ * @return
+ *     Non-zero if the update should be added to the damage map, zero if the
+ *     update should be sent directly.
+ */
+static int __guac_common_surface_should_defer(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    /* Always defer changes beneath an active video, as these must be sent as
+     * frames of that video */
+    if (__guac_common_surface_is_under_video(surface, rect))
+        return 1;
+
+    /* Always defer updates if surface is currently a purely server-side
+     * scratch area */
+    if (!surface->realized)
+        return 1;
+
+    /* Do not defer if there is nothing to combine with */
+    if (!surface->damage_map->dirty_count)
+        return 0;
+
+    /* Estimate cost of sending the update directly, without image data */
+    int update_cost = (GUAC_SURFACE_BASE_COST + rect->width * rect->height)
+                    / GUAC_SURFACE_DATA_FACTOR;
+
+    /* Calculate how much image data would be added to the pending damage */
+    int added_cost = guac_common_damage_map_added_area(surface->damage_map,
+            rect);
+
+    /* Defer only if doing so adds less than sending the update directly */
+    return added_cost <= update_cost;
+
+}
+
+/**
+ * Records the given rectangle within the damage map of the given surface,
+ * such that it will be sent as image data when the surface is next flushed.
+ * Only the damage map cells which intersect the rectangle are affected, thus
+ * unrelated changes within distant areas of the surface remain independent.
  *
  * @param surface The surface to mark as dirty.
  * @param rect The rectangle of the update which is dirtying the surface.
  */
 static void __guac_common_mark_dirty(guac_common_surface* surface, const guac_common_rect* rect) {
+    guac_common_damage_map_mark(surface->damage_map, rect);
+}
+
+/**
+ * Expands the dirty rect of the given surface, which represents the bitmap
+ * update currently being assembled during a flush, to contain the given
+ * rect.
+ *
+ * @param surface The surface whose dirty rect should be expanded.
+ * @param rect The rectangle to add to the dirty rect.
+ */
+static void __guac_common_extend_dirty(guac_common_surface* surface, const guac_common_rect* rect) {
 
     /* Ignore empty rects */
     if (rect->width <= 0 || rect->height <= 0)
@@ -441,63 +559,19 @@ static unsigned int __guac_common_surface_calculate_framerate(
  * indicate PNG is likely to be superior, while negative values indicate the
  * opposite.
  *
- * @param surface
- *     The surface containing the image data to check.
- *
- * @param rect
- *     The rect to check within the given surface.
+ * @param analysis
+ *     The analysis of the image data within the rectangle to check.
  *
  * @return
  *     Positive values if PNG compression is likely to perform better than
  *     lossy alternatives, or negative values if PNG is likely to perform
  *     worse.
  */
-static int __guac_common_surface_png_optimality(guac_common_surface* surface,
-        const guac_common_rect* rect) {
-
-    int x, y;
-
-    int num_same = 0;
-    int num_different = 1;
-
-    /* Get image/buffer metrics */
-    int width = rect->width;
-    int height = rect->height;
-    int stride = surface->stride;
+static int __guac_common_surface_png_optimality(
+        const guac_image_analysis* analysis) {
 
-    /* Get buffer from surface */
-    unsigned char* buffer = surface->buffer + rect->y * stride + rect->x * 4;
-
-    /* Image must be at least 1x1 */
-    if (width < 1 || height < 1)
-        return 0;
-
-    /* For each row */
-    for (y = 0; y < height; y++) {
-
-        uint32_t* row = (uint32_t*) buffer;
-        uint32_t last_pixel = *(row++) | 0xFF000000;
-
-        /* For each pixel in current row */
-        for (x = 1; x < width; x++) {
-
-            /* Get next pixel */
-            uint32_t current_pixel = *(row++) | 0xFF000000;
-
-            /* Update same/different counts according to pixel value */
-            if (current_pixel == last_pixel)
-                num_same++;
-            else
-                num_different++;
-
-            last_pixel = current_pixel;
-
-        }
-
-        /* Advance to next row */
-        buffer += stride;
-
-    }
+    int num_same = analysis->num_same;
+    int num_different = analysis->num_different + 1;
 
     /* Return rough approximation of optimality for PNG compression */
     return 0x100 * num_same / num_different - 0x400;
@@ -514,12 +588,15 @@ static int __guac_common_surface_png_optimality(guac_common_surface* surface,
  * @param rect
  *     The rectangle to check.
  *
+ * @param analysis
+ *     The analysis of the image data within the rectangle to check.
+ *
  * @return
  *     Non-zero if the rectangle would be optimally encoded as JPEG, zero
  *     otherwise.
  */
 static int __guac_common_surface_should_use_jpeg(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+        const guac_common_rect* rect, const guac_image_analysis* analysis) {
 
     /* Calculate the average framerate for the given rect */
     int framerate = __guac_common_surface_calculate_framerate(surface, rect);
@@ -532,7 +609,7 @@ static int __guac_common_surface_should_use_jpeg(guac_common_surface* surface,
      * - PNG is not more optimal based on image contents */
     return framerate >= GUAC_COMMON_SURFACE_JPEG_FRAMERATE
         && rect_size > GUAC_SURFACE_JPEG_MIN_BITMAP_SIZE
-        && __guac_common_surface_png_optimality(surface, rect) < 0;
+        && __guac_common_surface_png_optimality(analysis) < 0;
 
 }
 
@@ -546,12 +623,15 @@ static int __guac_common_surface_should_use_jpeg(guac_common_surface* surface,
  * @param rect
  *     The rectangle to check.
  *
+ * @param analysis
+ *     The analysis of the image data within the rectangle to check.
+ *
  * @return
  *     Non-zero if the rectangle would be optimally encoded as WebP, zero
  *     otherwise.
  */
 static int __guac_common_surface_should_use_webp(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+        const guac_common_rect* rect, const guac_image_analysis* analysis) {
 
     /* Do not use WebP if not supported */
     if (!guac_client_supports_webp(surface->client))
@@ -564,7 +644,7 @@ static int __guac_common_surface_should_use_webp(guac_common_surface* surface,
      * - frame rate is high enough
      * - PNG is not more optimal based on image contents */
     return framerate >= GUAC_COMMON_SURFACE_JPEG_FRAMERATE
-        && __guac_common_surface_png_optimality(surface, rect) < 0;
+        && __guac_common_surface_png_optimality(analysis) < 0;
 
 }
 
@@ -659,122 +739,53 @@ static void __guac_common_surface_flush_to_queue(guac_common_surface* surface) {
 }
 
 /**
- * Flushes the given surface, drawing any pending operations on the remote
- * display. Surface properties are not flushed.
- *
- * @param surface
- *     The surface to flush.
- */
-static void __guac_common_surface_flush(guac_common_surface* surface);
-
-/**
- * Schedules a deferred flush of the given surface. This will not immediately
- * flush the surface to the client. Instead, the result of the flush is
- * added to a queue which is reinspected and combined (if possible) with other
- * deferred flushes during the call to guac_common_surface_flush().
+ * Converts all changes recorded within the damage map of the given surface
+ * into bitmap updates within that surface's bitmap queue, clearing the damage
+ * map. Horizontal runs of dirty cells are grouped together, and runs which
+ * span the same columns as the run directly above them are added to the same
+ * update, such that each resulting update covers a roughly rectangular region
+ * of changes. If the queue fills, all remaining changes are combined into the
+ * final update within the queue.
  *
  * @param surface The surface to flush.
  */
-static void __guac_common_surface_flush_deferred(guac_common_surface* surface) {
+static void __guac_common_surface_flush_damage_to_queue(
+        guac_common_surface* surface) {
+
+    int i;
 
     /* Do not flush if not dirty */
-    if (!surface->dirty)
+    if (!surface->damage_map->dirty_count)
         return;
 
-    /* Flush if queue size has reached maximum (space is reserved for the final
-     * dirty rect, as __guac_common_surface_flush() MAY add an additional rect
-     * to the queue */
-    if (surface->bitmap_queue_length == GUAC_COMMON_SURFACE_QUEUE_SIZE-1)
-        __guac_common_surface_flush(surface);
+    guac_common_rect updates[GUAC_COMMON_SURFACE_QUEUE_SIZE];
+    int length = surface->bitmap_queue_length;
+
+    /* Collect damage following any updates already queued */
+    for (i = 0; i < length; i++)
+        updates[i] = surface->bitmap_queue[i].rect;
 
-    /* Append dirty rect to queue */
-    __guac_common_surface_flush_to_queue(surface);
+    surface->bitmap_queue_length = guac_common_damage_map_collect(
+            surface->damage_map, updates, length,
+            GUAC_COMMON_SURFACE_QUEUE_SIZE);
+
+    /* Store new and extended updates, leaving existing flush state intact */
+    for (i = 0; i < surface->bitmap_queue_length; i++) {
+        surface->bitmap_queue[i].rect = updates[i];
+        if (i >= length)
+            surface->bitmap_queue[i].flushed = 0;
+    }
 
 }
 
 /**
- * Transfers a single uint32_t using the given transfer function.
+ * Flushes the given surface, drawing any pending operations on the remote
+ * display. Surface properties are not flushed.
  *
- * @param op The transfer function to use.
- * @param src The source of the uint32_t value.
- * @param dst THe destination which will hold the result of the transfer.
- * @return Non-zero if the destination value was changed, zero otherwise.
+ * @param surface
+ *     The surface to flush.
  */
-static int __guac_common_surface_transfer_int(guac_transfer_function op, uint32_t* src, uint32_t* dst) {
-
-    uint32_t orig = *dst;
-
-    switch (op) {
-
-        case GUAC_TRANSFER_BINARY_BLACK:
-            *dst = 0xFF000000;
-            break;
-
-        case GUAC_TRANSFER_BINARY_WHITE:
-            *dst = 0xFFFFFFFF;
-            break;
-
-        case GUAC_TRANSFER_BINARY_SRC:
-            *dst = *src;
-            break;
-
-        case GUAC_TRANSFER_BINARY_DEST:
-            /* NOP */
-            break;
-
-        case GUAC_TRANSFER_BINARY_NSRC:
-            *dst = *src ^ 0x00FFFFFF;
-            break;
-
-        case GUAC_TRANSFER_BINARY_NDEST:
-            *dst = *dst ^ 0x00FFFFFF;
-            break;
-
-        case GUAC_TRANSFER_BINARY_AND:
-            *dst = ((*dst) & (0xFF000000 | *src));
-            break;
-
-        case GUAC_TRANSFER_BINARY_NAND:
-            *dst = ((*dst) & (0xFF000000 | *src)) ^ 0x00FFFFFF;
-            break;
-
-        case GUAC_TRANSFER_BINARY_OR:
-            *dst = ((*dst) | (0x00FFFFFF & *src));
-            break;
-
-        case GUAC_TRANSFER_BINARY_NOR:
-            *dst = ((*dst) | (0x00FFFFFF & *src)) ^ 0x00FFFFFF;
-            break;
-
-        case GUAC_TRANSFER_BINARY_XOR:
-            *dst = ((*dst) ^ (0x00FFFFFF & *src));
-            break;
-
-        case GUAC_TRANSFER_BINARY_XNOR:
-            *dst = ((*dst) ^ (0x00FFFFFF & *src)) ^ 0x00FFFFFF;
-            break;
-
-        case GUAC_TRANSFER_BINARY_NSRC_AND:
-            *dst = ((*dst) & (0xFF000000 | (*src ^ 0x00FFFFFF)));
-            break;
-
-        case GUAC_TRANSFER_BINARY_NSRC_NAND:
-            *dst = ((*dst) & (0xFF000000 | (*src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
-            break;
-
-        case GUAC_TRANSFER_BINARY_NSRC_OR:
-            *dst = ((*dst) | (0x00FFFFFF & (*src ^ 0x00FFFFFF)));
-            break;
-
-        case GUAC_TRANSFER_BINARY_NSRC_NOR:
-            *dst = ((*dst) | (0x00FFFFFF & (*src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
-            break;
-
-    }
-
-    return *dst != orig;
-
-}
+static void __guac_common_surface_flush(guac_common_surface* surface);
 
 /**
  * Assigns the given value to all pixels within a rectangle of the backing
@@ -806,7 +817,7 @@ static int __guac_common_surface_transfer_int(guac_transfer_function op, uint32_
 static void __guac_common_surface_set(guac_common_surface* dst,
         guac_common_rect* rect, int red, int green, int blue, int alpha) {
 
-    int x, y;
+    int y;
 
     int dst_stride;
     unsigned char* dst_buffer;
@@ -824,22 +835,15 @@ static void __guac_common_surface_set(guac_common_surface* dst,
     /* For each row */
     for (y=0; y < rect->height; y++) {
 
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
-
-        /* Set row */
-        for (x=0; x < rect->width; x++) {
-
-            uint32_t old_color = *dst_current;
-
-            if (old_color != color) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-                *dst_current = color;
-            }
+        int row_min_x, row_max_x;
 
-            dst_current++;
+        /* Set row, updating bounds only if changed */
+        if (guac_common_blit_set((uint32_t*) dst_buffer, color, rect->width,
+                    &row_min_x, &row_max_x)) {
+            if (row_min_x < min_x) min_x = row_min_x;
+            if (row_max_x > max_x) max_x = row_max_x;
+            if (y < min_y) min_y = y;
+            if (y > max_y) max_y = y;
         }
 
         /* Next row */
@@ -861,83 +865,6 @@ static void __guac_common_surface_set(guac_common_surface* dst,
 
 }
 
-/**
- * Applies the Porter-Duff "over" composite operator, blending the two given
- * color components using the given alpha value.
- *
- * @param dst
- *     The destination color component.
- *
- * @param src
- *     The source color component.
- *
- * @param alpha
- *     The alpha value which applies to the blending operation.
- *
- * @return
- *     The result of applying the Porter-Duff "over" composite operator to the
- *     given source and destination components.
- */
-static int guac_common_surface_blend_component(int dst, int src, int alpha) {
-
-    int blended = src + dst * (0xFF - alpha);
-
-    /* Do not exceed maximum component value */
-    if (blended > 0xFF)
-        return 0xFF;
-
-    return blended;
-
-}
-
-/**
- * Applies the Porter-Duff "over" composite operator, blending each component
- * of the two given ARGB colors.
- *
- * @param dst
- *     The destination ARGB color.
- *
- * @param src
- *     The source ARGB color.
- *
- * @return
- *     The result of applying the Porter-Duff "over" composite operator to the
- *     given source and destination colors.
- */
-static uint32_t guac_common_surface_argb_blend(uint32_t dst, uint32_t src) {
-
-    /* Separate destination ARGB color into its components */
-    int dst_a = (dst >> 24) & 0xFF;
-    int dst_r = (dst >> 16) & 0xFF;
-    int dst_g = (dst >>  8) & 0xFF;
-    int dst_b =  dst        & 0xFF;
-
-    /* Separate source ARGB color into its components */
-    int src_a = (src >> 24) & 0xFF;
-    int src_r = (src >> 16) & 0xFF;
-    int src_g = (src >>  8) & 0xFF;
-    int src_b =  src        & 0xFF;
-
-    /* If source is fully opaque (or destination is fully transparent), the
-     * blended result is the source */
-    if (src_a == 0xFF || dst_a == 0x00)
-        return src;
-
-    /* If source is fully transparent, the blended result is the destination */
-    if (src_a == 0x00)
-        return dst;
-
-    /* Otherwise, blend each ARGB component, assuming pre-multiplied alpha */
-    int r = guac_common_surface_blend_component(dst_r, src_r, src_a);
-    int g = guac_common_surface_blend_component(dst_g, src_g, src_a);
-    int b = guac_common_surface_blend_component(dst_b, src_b, src_a);
-    int a = guac_common_surface_blend_component(dst_a, src_a, src_a);
-
-    /* Recombine blended components */
-    return (a << 24) | (r << 16) | (g << 8) | b;
-
-}
-
 /**
  * Copies data from the given buffer to the surface at the given coordinates.
  * The dimensions and location of the destination rectangle will be altered
@@ -960,7 +887,7 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
     unsigned char* dst_buffer = dst->buffer;
     int dst_stride = dst->stride;
 
-    int x, y;
+    int y;
 
     int min_x = rect->width;
     int min_y = rect->height;
@@ -976,40 +903,16 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
     /* For each row */
     for (y=0; y < rect->height; y++) {
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
-
-        /* Copy row */
-        for (x=0; x < rect->width; x++) {
-
-            uint32_t color;
-
-            /* Get source and destination color values */
-            uint32_t src_color = *src_current;
-            uint32_t dst_color = *dst_current;
-
-            /* Ignore alpha channel if opaque */
-            if (opaque)
-                color = src_color | 0xFF000000;
-
-            /* Otherwise, perform alpha blending operation */
-            else
-                color = guac_common_surface_argb_blend(dst_color, src_color);
-
-            /* If the destination color is changing, update rectangle bounds
-             * and store the new color */
-            if (dst_color != color) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-                *dst_current = color;
-            }
-
-            /* Advance to next pixel */
-            src_current++;
-            dst_current++;
+        int row_min_x, row_max_x;
 
+        /* Copy row, updating bounds only if changed */
+        if (guac_common_blit_put((uint32_t*) dst_buffer,
+                    (const uint32_t*) src_buffer, rect->width, opaque,
+                    &row_min_x, &row_max_x)) {
+            if (row_min_x < min_x) min_x = row_min_x;
+            if (row_max_x > max_x) max_x = row_max_x;
+            if (y < min_y) min_y = y;
+            if (y > max_y) max_y = y;
         }
 
         /* Next row */
@@ -1109,9 +1012,9 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
     unsigned char* src_buffer = src->buffer;
     unsigned char* dst_buffer = dst->buffer;
 
-    int x, y;
+    int y;
     int src_stride, dst_stride;
-    int step = 1;
+    int backwards;
 
     int min_x = rect->width - 1;
     int min_y = rect->height - 1;
@@ -1127,36 +1030,31 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
         dst_buffer += (dst->stride * rect->y) + (4 * rect->x);
         src_stride = src->stride;
         dst_stride = dst->stride;
-        step = 1;
+        backwards = 0;
     }
 
     /* Otherwise, copy backwards */
     else {
-        src_buffer += src->stride * (*sy + rect->height - 1) + 4 * (*sx + rect->width - 1);
-        dst_buffer += dst->stride * (rect->y + rect->height - 1) + 4 * (rect->x + rect->width - 1);
+        src_buffer += src->stride * (*sy + rect->height - 1) + 4 * (*sx);
+        dst_buffer += dst->stride * (rect->y + rect->height - 1) + 4 * rect->x;
         src_stride = -src->stride;
         dst_stride = -dst->stride;
-        step = -1;
+        backwards = 1;
     }
 
     /* For each row */
     for (y=0; y < rect->height; y++) {
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
-
-        /* Transfer each pixel in row */
-        for (x=0; x < rect->width; x++) {
+        int row_min_x, row_max_x;
 
-            if (__guac_common_surface_transfer_int(op, src_current, dst_current)) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-            }
-
-            src_current += step;
-            dst_current += step;
+        /* Transfer row, updating bounds only if changed */
+        if (guac_common_blit_transfer((uint32_t*) dst_buffer,
+                    (const uint32_t*) src_buffer, rect->width, op, backwards,
+                    &row_min_x, &row_max_x)) {
+            if (row_min_x < min_x) min_x = row_min_x;
+            if (row_max_x > max_x) max_x = row_max_x;
+            if (y < min_y) min_y = y;
+            if (y > max_y) max_y = y;
         }
 
         /* Next row */
@@ -1165,15 +1063,8 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
 
     }
 
-    /* Translate X coordinate space of moving backwards */
-    if (step < 0) {
-        int old_max_x = max_x;
-        max_x = rect->width - 1 - min_x;
-        min_x = rect->width - 1 - old_max_x;
-    }
-
     /* Translate Y coordinate space of moving backwards */
-    if (dst_stride < 0) {
+    if (backwards) {
         int old_max_y = max_y;
         max_y = rect->height - 1 - min_y;
         min_y = rect->height - 1 - old_max_y;
@@ -1197,58 +1088,196 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
 
 }
 
-guac_common_surface* guac_common_surface_alloc(guac_client* client,
-        guac_socket* socket, const guac_layer* layer, int w, int h) {
+/**
+ * Writes all output which is pending for the given surface, in the order it
+ * was produced, waiting for any images which are still being encoded. This
+ * must be invoked before any instruction is written directly to the socket of
+ * a surface that has an encoder, or that instruction may be sent out of
+ * order.
+ *
+ * @param surface
+ *     The surface whose pending output should be written.
+ */
+static void __guac_common_surface_flush_pending(guac_common_surface* surface) {
 
-    /* Calculate heat map dimensions */
-    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(w);
-    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(h);
+    guac_common_encoder_job* job = surface->pending_head;
+    while (job != NULL) {
+        guac_common_encoder_job* next = job->next;
+        guac_common_encoder_job_complete(job, surface->socket);
+        job = next;
+    }
 
-    /* Init surface */
-    guac_common_surface* surface = calloc(1, sizeof(guac_common_surface));
-    surface->client = client;
-    surface->socket = socket;
-    surface->layer = layer;
-    surface->parent = GUAC_DEFAULT_LAYER;
-    surface->opacity = 0xFF;
-    surface->width = w;
-    surface->height = h;
+    surface->pending_head = NULL;
+    surface->pending_tail = NULL;
 
-    pthread_mutex_init(&surface->_lock, NULL);
+}
 
-    /* Create corresponding Cairo surface */
-    surface->stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, w);
-    surface->buffer = calloc(h, surface->stride);
+/**
+ * Updates the shadow copy of the given surface within the given rectangle,
+ * such that it matches the current contents of the surface. This must be
+ * invoked whenever the contents of the given rectangle have been sent to the
+ * client. If motion detection is disabled, this function has no effect.
+ *
+ * @param surface
+ *     The surface whose shadow copy should be updated.
+ *
+ * @param rect
+ *     The rectangle to update. This rectangle must lie entirely within the
+ *     surface.
+ */
+static void __guac_common_surface_update_shadow(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-    /* Create corresponding heat map */
-    surface->heat_map = calloc(heat_width * heat_height,
-            sizeof(guac_common_surface_heat_cell));
+    if (surface->shadow == NULL)
+        return;
 
-    /* Reset clipping rect */
-    guac_common_surface_reset_clip(surface);
+    size_t offset = rect->y * surface->stride + rect->x * 4;
+    const unsigned char* src = surface->buffer + offset;
+    unsigned char* dst = surface->shadow + offset;
 
-    /* Layers must initially exist */
-    if (layer->index >= 0) {
-        guac_protocol_send_size(socket, layer, w, h);
-        surface->realized = 1;
+    for (int y = 0; y < rect->height; y++) {
+        memcpy(dst, src, rect->width * 4);
+        src += surface->stride;
+        dst += surface->stride;
     }
 
-    /* Defer creation of buffers */
-    else
-        surface->realized = 0;
-
-    return surface;
 }
 
-void guac_common_surface_free(guac_common_surface* surface) {
-
+/**
+ * Returns the socket to which instructions produced while flushing the given
+ * surface should be written. If the surface has an encoder, this will be the
+ * socket of the newest unit of pending output, such that those instructions
+ * remain ordered relative to any images that are still being encoded.
+ * Otherwise, this will be the socket of the surface itself.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @return
+ *     The socket to which instructions produced while flushing the given
+ *     surface should be written.
+ */
+static guac_socket* __guac_common_surface_get_socket(
+        guac_common_surface* surface) {
+
+    if (surface->encoder == NULL)
+        return surface->socket;
+
+    /* Continue newest unit of output if nothing has been submitted yet */
+    guac_common_encoder_job* job = surface->pending_tail;
+    if (job != NULL && !job->submitted)
+        return job->socket;
+
+    /* Otherwise start a new unit of output, falling back to writing directly
+     * if that is not possible */
+    job = guac_common_encoder_job_alloc(surface->client);
+    if (job == NULL) {
+        __guac_common_surface_flush_pending(surface);
+        return surface->socket;
+    }
+
+    if (surface->pending_tail != NULL)
+        surface->pending_tail->next = job;
+    else
+        surface->pending_head = job;
+
+    surface->pending_tail = job;
+    return job->socket;
+
+}
+
+/**
+ * Ends the active video of the given surface, if any, marking the region
+ * covered by that video as dirty such that the client's (stale) copy of that
+ * region is updated when the surface is next flushed.
+ *
+ * @param surface
+ *     The surface whose active video should be ended.
+ */
+static void __guac_common_surface_end_video(guac_common_surface* surface) {
+
+    if (surface->video == NULL)
+        return;
+
+    guac_common_video_free(surface->video,
+            __guac_common_surface_get_socket(surface));
+
+    surface->video = NULL;
+    surface->video_dirty = 0;
+    surface->video_updated = guac_timestamp_current();
+
+    __guac_common_mark_dirty(surface, &surface->video_rect);
+
+}
+
+guac_common_surface* guac_common_surface_alloc(guac_client* client,
+        guac_socket* socket, const guac_layer* layer, int w, int h) {
+
+    /* Calculate heat map dimensions */
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(w);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(h);
+
+    /* Init surface */
+    guac_common_surface* surface = calloc(1, sizeof(guac_common_surface));
+    surface->client = client;
+    surface->socket = socket;
+    surface->layer = layer;
+    surface->parent = GUAC_DEFAULT_LAYER;
+    surface->opacity = 0xFF;
+    surface->width = w;
+    surface->height = h;
+
+    pthread_mutex_init(&surface->_lock, NULL);
+
+    /* Create corresponding Cairo surface */
+    surface->stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, w);
+    surface->buffer = calloc(h, surface->stride);
+
+    /* Create corresponding heat map */
+    surface->heat_map = calloc(heat_width * heat_height,
+            sizeof(guac_common_surface_heat_cell));
+
+    /* Create corresponding damage map */
+    surface->damage_map = guac_common_damage_map_alloc(w, h);
+
+    /* Reset clipping rect */
+    guac_common_surface_reset_clip(surface);
+
+    /* Layers must initially exist */
+    if (layer->index >= 0) {
+        guac_protocol_send_size(socket, layer, w, h);
+        surface->realized = 1;
+    }
+
+    /* Defer creation of buffers */
+    else
+        surface->realized = 0;
+
+    return surface;
+}
+
+void guac_common_surface_free(guac_common_surface* surface) {
+
+    /* Write anything still pending prior to disposal */
+    __guac_common_surface_flush_pending(surface);
+
+    /* End any active video */
+    if (surface->video != NULL)
+        guac_common_video_free(surface->video, surface->socket);
+
+    /* Dispose of all cached images */
+    if (surface->cache != NULL)
+        guac_common_bitmap_cache_free(surface->cache, surface->socket);
+
     /* Only dispose of surface if it exists */
     if (surface->realized)
         guac_protocol_send_dispose(surface->socket, surface->layer);
 
     pthread_mutex_destroy(&surface->_lock);
 
+    guac_common_damage_map_free(surface->damage_map);
     free(surface->heat_map);
+    free(surface->shadow);
     free(surface->buffer);
     free(surface);
 
@@ -1272,6 +1301,10 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
     int sx = 0;
     int sy = 0;
 
+    /* The video region may no longer fit, and its contents will be resent
+     * as images along with the rest of the old damage */
+    __guac_common_surface_end_video(surface);
+
     /* Calculate heat map dimensions */
     int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(w);
     int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(h);
@@ -1281,6 +1314,24 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
     old_stride = surface->stride;
     guac_common_rect_init(&old_rect, 0, 0, surface->width, surface->height);
 
+    /* Resize shadow copy in the same manner as the client resizes the layer,
+     * preserving any contents which remain within bounds */
+    if (surface->shadow != NULL) {
+
+        unsigned char* old_shadow = surface->shadow;
+        int new_stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, w);
+        int copy_width = w < surface->width ? w : surface->width;
+        int copy_height = h < surface->height ? h : surface->height;
+
+        surface->shadow = calloc(h, new_stride);
+        for (int y = 0; y < copy_height; y++)
+            memcpy(surface->shadow + y * new_stride,
+                    old_shadow + y * old_stride, copy_width * 4);
+
+        free(old_shadow);
+
+    }
+
     /* Re-initialize at new size */
     surface->width  = w;
     surface->height = h;
@@ -1300,13 +1351,27 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
     surface->heat_map = calloc(heat_width * heat_height,
             sizeof(guac_common_surface_heat_cell));
 
-    /* Resize dirty rect to fit new surface dimensions */
-    if (surface->dirty) {
-        __guac_common_bound_rect(surface, &surface->dirty_rect, NULL, NULL);
-        if (surface->dirty_rect.width <= 0 || surface->dirty_rect.height <= 0)
-            surface->dirty = 0;
+    /* Allocate new damage map, preserving any damage which remains within
+     * the new surface dimensions */
+    guac_common_damage_map* old_damage_map = surface->damage_map;
+    guac_common_damage_cell* old_damage_cell = old_damage_map->cells;
+    int old_damage_cells = old_damage_map->width * old_damage_map->height;
+
+    surface->damage_map = guac_common_damage_map_alloc(w, h);
+
+    /* Re-add old damage, clipped to new surface dimensions */
+    for (; old_damage_cells > 0; old_damage_cells--, old_damage_cell++) {
+        if (old_damage_cell->dirty) {
+            __guac_common_bound_rect(surface, &old_damage_cell->rect, NULL, NULL);
+            __guac_common_mark_dirty(surface, &old_damage_cell->rect);
+        }
     }
 
+    guac_common_damage_map_free(old_damage_map);
+
+    /* Write anything still pending at the old size */
+    __guac_common_surface_flush_pending(surface);
+
     /* Update Guacamole layer */
     if (surface->realized)
         guac_protocol_send_size(socket, layer, w, h);
@@ -1346,10 +1411,6 @@ void guac_common_surface_draw(guac_common_surface* surface, int x, int y, cairo_
     guac_timestamp time = guac_timestamp_current();
     __guac_common_surface_touch_rect(surface, &rect, time);
 
-    /* Flush if not combining */
-    if (!__guac_common_should_combine(surface, &rect, 0))
-        __guac_common_surface_flush_deferred(surface);
-
     /* Always defer draws */
     __guac_common_mark_dirty(surface, &rect);
 
@@ -1382,10 +1443,6 @@ void guac_common_surface_paint(guac_common_surface* surface, int x, int y,
     /* Update backing surface */
     __guac_common_surface_fill_mask(buffer, stride, sx, sy, surface, &rect, red, green, blue);
 
-    /* Flush if not combining */
-    if (!__guac_common_should_combine(surface, &rect, 0))
-        __guac_common_surface_flush_deferred(surface);
-
     /* Always defer draws */
     __guac_common_mark_dirty(surface, &rect);
 
@@ -1405,6 +1462,7 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
     guac_socket* socket = dst->socket;
     const guac_layer* src_layer = src->layer;
     const guac_layer* dst_layer = dst->layer;
+    int sent = 0;
 
     guac_common_rect srect;
     guac_common_rect_init(&srect, sx, sy, w, h);
@@ -1434,8 +1492,14 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
             goto complete;
     }
 
-    /* Defer if combining */
-    if (__guac_common_should_combine(dst, &drect, 1))
+    guac_common_rect source;
+    guac_common_rect_init(&source, srect.x, srect.y,
+            drect.width, drect.height);
+
+    /* Defer if combining, or if the client's copy of the source is hidden
+     * beneath a video */
+    if (__guac_common_surface_should_defer(dst, &drect)
+            || __guac_common_surface_is_under_video(src, &source))
         __guac_common_mark_dirty(dst, &drect);
 
     /* Otherwise, flush and draw immediately */
@@ -1446,6 +1510,7 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
                 drect.width, drect.height, GUAC_COMP_OVER, dst_layer,
                 drect.x, drect.y);
         dst->realized = 1;
+        sent = 1;
     }
 
     /* Update backing surface last if drect can intersect srect */
@@ -1453,6 +1518,10 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy,
         __guac_common_surface_transfer(src, &srect.x, &srect.y,
                 GUAC_TRANSFER_BINARY_SRC, dst, &drect);
 
+    /* The client now has the same contents as the backing surface */
+    if (sent)
+        __guac_common_surface_update_shadow(dst, &drect);
+
 complete:
 
     /* Unlock both surfaces */
@@ -1473,6 +1542,7 @@ void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int
     guac_socket* socket = dst->socket;
     const guac_layer* src_layer = src->layer;
     const guac_layer* dst_layer = dst->layer;
+    int sent = 0;
 
     guac_common_rect srect;
     guac_common_rect_init(&srect, sx, sy, w, h);
@@ -1501,8 +1571,14 @@ void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int
             goto complete;
     }
 
-    /* Defer if combining */
-    if (__guac_common_should_combine(dst, &drect, 1))
+    guac_common_rect source;
+    guac_common_rect_init(&source, srect.x, srect.y,
+            drect.width, drect.height);
+
+    /* Defer if combining, or if the client's copy of the source is hidden
+     * beneath a video */
+    if (__guac_common_surface_should_defer(dst, &drect)
+            || __guac_common_surface_is_under_video(src, &source))
         __guac_common_mark_dirty(dst, &drect);
 
     /* Otherwise, flush and draw immediately */
@@ -1512,12 +1588,17 @@ void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int
         guac_protocol_send_transfer(socket, src_layer, srect.x, srect.y,
                 drect.width, drect.height, op, dst_layer, drect.x, drect.y);
         dst->realized = 1;
+        sent = 1;
     }
 
     /* Update backing surface last if drect can intersect srect */
     if (src == dst)
         __guac_common_surface_transfer(src, &srect.x, &srect.y, op, dst, &drect);
 
+    /* The client now has the same contents as the backing surface */
+    if (sent)
+        __guac_common_surface_update_shadow(dst, &drect);
+
 complete:
 
     /* Unlock both surfaces */
@@ -1551,17 +1632,13 @@ void guac_common_surface_set(guac_common_surface* surface,
     /* Handle as normal draw if non-opaque */
     if (alpha != 0xFF) {
 
-        /* Flush if not combining */
-        if (!__guac_common_should_combine(surface, &rect, 0))
-            __guac_common_surface_flush_deferred(surface);
-
         /* Always defer draws */
         __guac_common_mark_dirty(surface, &rect);
 
     }
 
     /* Defer if combining */
-    else if (__guac_common_should_combine(surface, &rect, 1))
+    else if (__guac_common_surface_should_defer(surface, &rect))
         __guac_common_mark_dirty(surface, &rect);
 
     /* Otherwise, flush and draw immediately */
@@ -1570,6 +1647,7 @@ void guac_common_surface_set(guac_common_surface* surface,
         guac_protocol_send_rect(socket, layer, rect.x, rect.y, rect.width, rect.height);
         guac_protocol_send_cfill(socket, GUAC_COMP_OVER, layer, red, green, blue, alpha);
         surface->realized = 1;
+        __guac_common_surface_update_shadow(surface, &rect);
     }
 
 complete:
@@ -1603,59 +1681,138 @@ void guac_common_surface_reset_clip(guac_common_surface* surface) {
 }
 
 /**
- * Flushes the bitmap update currently described by the dirty rectangle within
- * the given surface directly via an "img" instruction as PNG data. The
- * resulting instructions will be sent over the socket associated with the
- * given surface.
+ * Encodes the bitmap update currently described by the dirty rectangle within
+ * the given surface in the given format, sending the result via an "img"
+ * instruction. If the surface has an encoder, the image may be encoded in
+ * parallel with other images, with the resulting instructions written in
+ * order once pending output is flushed. Otherwise, the resulting instructions
+ * are sent over the socket associated with the given surface immediately.
  *
  * @param surface
  *     The surface to flush.
  *
+ * @param format
+ *     The format to encode the image in.
+ *
  * @param opaque
  *     Whether the rectangle being flushed contains only fully-opaque pixels.
+ *
+ * @param quality
+ *     The quality to use when encoding with a lossy format, between 0 and
+ *     100 inclusive. This is ignored for PNG.
+ *
+ * @param lossless
+ *     Non-zero if WebP images should be encoded losslessly, zero otherwise.
+ *     This is ignored for formats other than WebP.
+ *
+ * @param method
+ *     The WebP compression method to use, from 0 (fastest) to 6 (smallest
+ *     output). This is ignored for formats other than WebP.
+ *
+ * @param analysis
+ *     The analysis of the image data within the dirty rectangle, or NULL if
+ *     no such analysis is available.
  */
-static void __guac_common_surface_flush_to_png(guac_common_surface* surface,
-        int opaque) {
+static void __guac_common_surface_flush_image(guac_common_surface* surface,
+        guac_common_encoder_format format, int opaque, int quality,
+        int lossless, int method, const guac_image_analysis* analysis) {
 
-    if (surface->dirty) {
+    guac_socket* socket = __guac_common_surface_get_socket(surface);
+    const guac_layer* layer = surface->layer;
+    const guac_common_rect* dirty_rect = &surface->dirty_rect;
+
+    /* Get image data for specified rect */
+    unsigned char* buffer = surface->buffer
+                          + dirty_rect->y * surface->stride
+                          + dirty_rect->x * 4;
+
+    /* Use RGB24 if the image is fully opaque, otherwise ARGB32 is needed */
+    cairo_format_t image_format =
+        opaque ? CAIRO_FORMAT_RGB24 : CAIRO_FORMAT_ARGB32;
+
+    /* Submit image to encoder if output is pending within a job */
+    if (socket != surface->socket) {
+        guac_common_encoder_job_submit(surface->encoder,
+                surface->pending_tail, format, GUAC_COMP_OVER, layer,
+                dirty_rect->x, dirty_rect->y, buffer, image_format,
+                dirty_rect->width, dirty_rect->height, surface->stride,
+                quality, lossless, method, analysis);
+        return;
+    }
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
+    /* Otherwise, encode and send immediately */
+    cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer,
+            image_format, dirty_rect->width, dirty_rect->height,
+            surface->stride);
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-                              + surface->dirty_rect.y * surface->stride
-                              + surface->dirty_rect.x * 4;
+    switch (format) {
 
-        cairo_surface_t* rect;
+        case GUAC_COMMON_ENCODER_JPEG:
+            guac_client_stream_jpeg(surface->client, socket, GUAC_COMP_OVER,
+                    layer, dirty_rect->x, dirty_rect->y, rect, quality);
+            break;
 
-        /* Use RGB24 if the image is fully opaque */
-        if (opaque)
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_RGB24, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
+        /* Stream WebP manually such that the compression method is used */
+        case GUAC_COMMON_ENCODER_WEBP: {
+            guac_stream* stream = guac_client_alloc_stream(surface->client);
+            guac_protocol_send_img(socket, stream, GUAC_COMP_OVER, layer,
+                    "image/webp", dirty_rect->x, dirty_rect->y);
+            guac_image_write_webp(socket, stream, rect, quality, lossless,
+                    method);
+            guac_protocol_send_end(socket, stream);
+            guac_client_free_stream(surface->client, stream);
+            break;
+        }
 
-        /* Otherwise ARGB32 is needed */
-        else {
+        /* Stream PNG manually such that the existing analysis is reused */
+        default: {
+            guac_stream* stream = guac_client_alloc_stream(surface->client);
+            guac_protocol_send_img(socket, stream, GUAC_COMP_OVER, layer,
+                    "image/png", dirty_rect->x, dirty_rect->y);
+            guac_image_write_png(socket, stream, rect, analysis);
+            guac_protocol_send_end(socket, stream);
+            guac_client_free_stream(surface->client, stream);
+        }
 
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_ARGB32, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
+    }
+
+    cairo_surface_destroy(rect);
+
+}
 
-            /* Clear destination rect first */
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface via an "img" instruction as PNG data. The resulting
+ * instructions will be sent over the socket associated with the given
+ * surface.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param analysis
+ *     The analysis of the image data within the dirty rectangle.
+ */
+static void __guac_common_surface_flush_to_png(guac_common_surface* surface,
+        const guac_image_analysis* analysis) {
+
+    if (surface->dirty) {
+
+        int opaque = analysis->opaque;
+
+        /* Clear destination rect first if the image is not opaque */
+        if (!opaque) {
+            guac_socket* socket = __guac_common_surface_get_socket(surface);
+            const guac_layer* layer = surface->layer;
             guac_protocol_send_rect(socket, layer,
                     surface->dirty_rect.x, surface->dirty_rect.y,
                     surface->dirty_rect.width, surface->dirty_rect.height);
             guac_protocol_send_cfill(socket, GUAC_COMP_ROUT, layer,
                     0x00, 0x00, 0x00, 0xFF);
-
         }
 
         /* Send PNG for rect */
-        guac_client_stream_png(surface->client, socket, GUAC_COMP_OVER,
-                layer, surface->dirty_rect.x, surface->dirty_rect.y, rect);
-
-        cairo_surface_destroy(rect);
+        __guac_common_surface_flush_image(surface, GUAC_COMMON_ENCODER_PNG,
+                opaque, 0, 0, 0, analysis);
         surface->realized = 1;
 
         /* Surface is no longer dirty */
@@ -1695,11 +1852,40 @@ static int guac_common_surface_suggest_quality(guac_client* client) {
 
 }
 
+/**
+ * Returns an appropriate WebP compression method depending on the current
+ * processing lag calculated for the given client. Slower methods produce
+ * smaller images, and are used only while the client is keeping up.
+ *
+ * @param client
+ *     The client for which the WebP compression method is being calculated.
+ *
+ * @return
+ *     A WebP compression method between 0 (fastest) and
+ *     GUAC_IMAGE_WEBP_DEFAULT_METHOD inclusive which seems appropriate for
+ *     the client based on lag measurements.
+ */
+static int guac_common_surface_suggest_webp_method(guac_client* client) {
+
+    int lag = guac_client_get_processing_lag(client);
+
+    /* Use the default method while lag is no more than 20ms */
+    if (lag <= 20)
+        return GUAC_IMAGE_WEBP_DEFAULT_METHOD;
+
+    /* Trade size for speed as lag grows */
+    if (lag <= 60)
+        return 1;
+
+    return 0;
+
+}
+
 /**
  * Flushes the bitmap update currently described by the dirty rectangle within
- * the given surface directly via an "img" instruction as JPEG data. The
- * resulting instructions will be sent over the socket associated with the
- * given surface.
+ * the given surface via an "img" instruction as JPEG data. The resulting
+ * instructions will be sent over the socket associated with the given
+ * surface.
  *
  * @param surface
  *     The surface to flush.
@@ -1708,9 +1894,6 @@ static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface) {
 
     if (surface->dirty) {
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
-
         guac_common_rect max;
         guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
 
@@ -1719,21 +1902,10 @@ static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface) {
         guac_common_rect_expand_to_grid(GUAC_SURFACE_JPEG_BLOCK_SIZE,
                                         &surface->dirty_rect, &max);
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-                              + surface->dirty_rect.y * surface->stride
-                              + surface->dirty_rect.x * 4;
-
-        cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer,
-                CAIRO_FORMAT_RGB24, surface->dirty_rect.width,
-                surface->dirty_rect.height, surface->stride);
-
         /* Send JPEG for rect */
-        guac_client_stream_jpeg(surface->client, socket, GUAC_COMP_OVER, layer,
-                surface->dirty_rect.x, surface->dirty_rect.y, rect,
-                guac_common_surface_suggest_quality(surface->client));
-
-        cairo_surface_destroy(rect);
+        __guac_common_surface_flush_image(surface, GUAC_COMMON_ENCODER_JPEG,
+                1, guac_common_surface_suggest_quality(surface->client), 0,
+                0, NULL);
         surface->realized = 1;
 
         /* Surface is no longer dirty */
@@ -1745,24 +1917,21 @@ static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface) {
 
 /**
  * Flushes the bitmap update currently described by the dirty rectangle within
- * the given surface directly via an "img" instruction as WebP data. The
- * resulting instructions will be sent over the socket associated with the
- * given surface.
+ * the given surface via an "img" instruction as WebP data. The resulting
+ * instructions will be sent over the socket associated with the given
+ * surface.
  *
  * @param surface
  *     The surface to flush.
  *
- * @param opaque
- *     Whether the rectangle being flushed contains only fully-opaque pixels.
+ * @param analysis
+ *     The analysis of the image data within the dirty rectangle.
  */
 static void __guac_common_surface_flush_to_webp(guac_common_surface* surface,
-        int opaque) {
+        const guac_image_analysis* analysis) {
 
     if (surface->dirty) {
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
-
         guac_common_rect max;
         guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
 
@@ -1771,38 +1940,563 @@ static void __guac_common_surface_flush_to_webp(guac_common_surface* surface,
         guac_common_rect_expand_to_grid(GUAC_SURFACE_WEBP_BLOCK_SIZE,
                                         &surface->dirty_rect, &max);
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-                              + surface->dirty_rect.y * surface->stride
-                              + surface->dirty_rect.x * 4;
+        /* Images with few colors compress well losslessly */
+        int lossless = analysis->palette_size != 0;
 
-        cairo_surface_t* rect;
+        /* Send WebP for rect */
+        __guac_common_surface_flush_image(surface, GUAC_COMMON_ENCODER_WEBP,
+                analysis->opaque,
+                guac_common_surface_suggest_quality(surface->client),
+                lossless,
+                guac_common_surface_suggest_webp_method(surface->client),
+                NULL);
+        surface->realized = 1;
 
-        /* Use RGB24 if the image is fully opaque */
-        if (opaque)
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_RGB24, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
+        /* Surface is no longer dirty */
+        surface->dirty = 0;
 
-        /* Otherwise ARGB32 is needed */
-        else
-            rect = cairo_image_surface_create_for_data(buffer,
-                    CAIRO_FORMAT_ARGB32, surface->dirty_rect.width,
-                    surface->dirty_rect.height, surface->stride);
+    }
 
-        /* Send WebP for rect */
-        guac_client_stream_webp(surface->client, socket, GUAC_COMP_OVER, layer,
-                surface->dirty_rect.x, surface->dirty_rect.y, rect,
-                guac_common_surface_suggest_quality(surface->client), 0);
+}
 
-        cairo_surface_destroy(rect);
-        surface->realized = 1;
+/**
+ * Returns whether the given rectangle of the given surface is eligible for
+ * caching, based on whether the surface has a cache and the size of the
+ * rectangle.
+ *
+ * @param surface
+ *     The surface containing the rectangle.
+ *
+ * @param rect
+ *     The rectangle to test.
+ *
+ * @return
+ *     Non-zero if the image within the given rectangle may be cached, zero
+ *     otherwise.
+ */
+static int __guac_common_surface_is_cacheable(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-        /* Surface is no longer dirty */
+    if (surface->cache == NULL)
+        return 0;
+
+    int area = rect->width * rect->height;
+    return area >= GUAC_COMMON_BITMAP_CACHE_MIN_AREA
+        && area <= GUAC_COMMON_BITMAP_CACHE_MAX_AREA;
+
+}
+
+/**
+ * Draws the bitmap update currently described by the dirty rectangle within
+ * the given surface by copying an identical image from the cache, if such an
+ * image has been cached. If no identical image is cached, this function has
+ * no effect.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param image
+ *     A Cairo surface wrapping the contents of the dirty rectangle.
+ *
+ * @param hash
+ *     The hash of the given image, as produced by guac_hash_surface().
+ *
+ * @param opaque
+ *     Whether the rectangle being flushed contains only fully-opaque pixels.
+ *
+ * @return
+ *     Non-zero if the update was drawn from the cache, zero otherwise.
+ */
+static int __guac_common_surface_flush_from_cache(guac_common_surface* surface,
+        cairo_surface_t* image, unsigned int hash, int opaque) {
+
+    const guac_layer* buffer = guac_common_bitmap_cache_lookup(surface->cache,
+            image, hash);
+
+    if (buffer == NULL)
+        return 0;
+
+    guac_socket* socket = __guac_common_surface_get_socket(surface);
+    const guac_layer* layer = surface->layer;
+    const guac_common_rect* rect = &surface->dirty_rect;
+
+    /* Clear destination rect first if the image is not opaque */
+    if (!opaque) {
+        guac_protocol_send_rect(socket, layer,
+                rect->x, rect->y, rect->width, rect->height);
+        guac_protocol_send_cfill(socket, GUAC_COMP_ROUT, layer,
+                0x00, 0x00, 0x00, 0xFF);
+    }
+
+    guac_protocol_send_copy(socket, buffer, 0, 0, rect->width, rect->height,
+            GUAC_COMP_OVER, layer, rect->x, rect->y);
+
+    surface->realized = 1;
+
+    /* Surface is no longer dirty */
+    surface->dirty = 0;
+
+    return 1;
+
+}
+
+/**
+ * Notes that the given image has been drawn to the given rectangle of the
+ * given surface, adding the image to the cache of that surface if it has
+ * been sent recently. Cached images are copied into their client-side buffers
+ * from the surface itself.
+ *
+ * @param surface
+ *     The surface that the image was drawn to.
+ *
+ * @param rect
+ *     The rectangle that the image was drawn to.
+ *
+ * @param image
+ *     A Cairo surface wrapping the image that was drawn.
+ *
+ * @param hash
+ *     The hash of the given image, as produced by guac_hash_surface().
+ */
+static void __guac_common_surface_add_to_cache(guac_common_surface* surface,
+        const guac_common_rect* rect, cairo_surface_t* image,
+        unsigned int hash) {
+
+    guac_socket* socket = __guac_common_surface_get_socket(surface);
+
+    const guac_layer* buffer = guac_common_bitmap_cache_add(surface->cache,
+            socket, image, hash);
+
+    if (buffer != NULL)
+        guac_protocol_send_copy(socket, surface->layer, rect->x, rect->y,
+                rect->width, rect->height, GUAC_COMP_OVER, buffer, 0, 0);
+
+}
+
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface as a simple rectangle fill, rather than as an image. The
+ * dirty rectangle must be a single, fully-opaque color.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param color
+ *     The color of every pixel within the dirty rectangle, in the same 32-bit
+ *     ARGB format as the surface.
+ */
+static void __guac_common_surface_flush_to_fill(guac_common_surface* surface,
+        uint32_t color) {
+
+    guac_socket* socket = __guac_common_surface_get_socket(surface);
+    const guac_layer* layer = surface->layer;
+    const guac_common_rect* rect = &surface->dirty_rect;
+
+    guac_protocol_send_rect(socket, layer,
+            rect->x, rect->y, rect->width, rect->height);
+    guac_protocol_send_cfill(socket, GUAC_COMP_OVER, layer,
+            (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF, 0xFF);
+
+    surface->realized = 1;
+
+    /* Surface is no longer dirty */
+    surface->dirty = 0;
+
+}
+
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface as image data, copying the image from the cache if
+ * possible, or encoding the image in whichever format seems most appropriate
+ * otherwise. The given analysis is used both to select the format and by the
+ * encoder itself.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param analysis
+ *     The analysis of the image data within the dirty rectangle.
+ */
+static void __guac_common_surface_flush_encoded(guac_common_surface* surface,
+        const guac_image_analysis* analysis) {
+
+    /* Lossy formats may expand the dirty rect, so note its original size */
+    guac_common_rect rect = surface->dirty_rect;
+    cairo_surface_t* image = NULL;
+    unsigned int hash = 0;
+
+    /* Copy from cache rather than resending an identical image */
+    if (__guac_common_surface_is_cacheable(surface, &rect)) {
+
+        image = cairo_image_surface_create_for_data(surface->buffer
+                    + rect.y * surface->stride + rect.x * 4,
+                CAIRO_FORMAT_ARGB32, rect.width, rect.height,
+                surface->stride);
+
+        hash = guac_hash_surface(image);
+        if (__guac_common_surface_flush_from_cache(surface, image, hash,
+                    analysis->opaque)) {
+            cairo_surface_destroy(image);
+            return;
+        }
+
+    }
+
+    /* Prefer WebP when reasonable */
+    if (__guac_common_surface_should_use_webp(surface, &rect, analysis))
+        __guac_common_surface_flush_to_webp(surface, analysis);
+
+    /* If not WebP, JPEG is the next best (lossy) choice */
+    else if (analysis->opaque
+            && __guac_common_surface_should_use_jpeg(surface, &rect,
+                analysis))
+        __guac_common_surface_flush_to_jpeg(surface);
+
+    /* Use PNG if no lossy formats are appropriate */
+    else {
+
+        __guac_common_surface_flush_to_png(surface, analysis);
+
+        /* Only cache images which the client received losslessly */
+        if (image != NULL)
+            __guac_common_surface_add_to_cache(surface, &rect, image, hash);
+
+    }
+
+    if (image != NULL)
+        cairo_surface_destroy(image);
+
+}
+
+/**
+ * Draws the bitmap update currently described by the dirty rectangle within
+ * the given surface by sending any large areas of uniform color as simple
+ * rectangle fills, sending only the remainder as images. If the dirty
+ * rectangle does not contain enough uniform color to be worth splitting,
+ * this function has no effect.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @return
+ *     Non-zero if the update was drawn, zero otherwise.
+ */
+static int __guac_common_surface_flush_fills(guac_common_surface* surface) {
+
+    guac_common_fill_map map;
+
+    /* Locate areas of uniform color */
+    if (!guac_common_fill_extract(surface->buffer, surface->stride,
+                &surface->dirty_rect, &map))
+        return 0;
+
+    /* Send uniform areas as fills */
+    for (int i = 0; i < map.num_fills; i++) {
+        surface->dirty_rect = map.fills[i].rect;
+        __guac_common_surface_flush_to_fill(surface, map.fills[i].color);
+    }
+
+    /* Send everything else as images */
+    for (int i = 0; i < map.num_residual; i++) {
+
+        const guac_common_rect* rect = &map.residual[i];
+
+        guac_image_analysis analysis;
+        guac_image_analyze(surface->buffer + rect->y * surface->stride
+                    + rect->x * 4, rect->width, rect->height,
+                surface->stride, &analysis);
+
+        surface->dirty_rect = *rect;
+        surface->dirty = 1;
+        __guac_common_surface_flush_encoded(surface, &analysis);
+
+    }
+
+    /* Surface is no longer dirty */
+    surface->dirty = 0;
+
+    return 1;
+
+}
+
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface, sending areas of uniform color as rectangle fills and
+ * the remainder as images. The image data is analyzed only once, with that
+ * analysis used both to select the format and by the encoder itself.
+ *
+ * @param surface
+ *     The surface to flush.
+ */
+static void __guac_common_surface_flush_bitmap(guac_common_surface* surface) {
+
+    const guac_common_rect* rect = &surface->dirty_rect;
+
+    /* Determine opacity, color distribution, etc. in a single pass */
+    guac_image_analysis analysis;
+    guac_image_analyze(surface->buffer + rect->y * surface->stride
+                + rect->x * 4, rect->width, rect->height, surface->stride,
+            &analysis);
+
+    /* Send single-color updates as simple fills */
+    if (analysis.solid && analysis.opaque) {
+        __guac_common_surface_flush_to_fill(surface, analysis.color);
+        return;
+    }
+
+    /* Split out any large areas of uniform color, unless the update varies
+     * too much (as with photos or video) for such areas to be likely */
+    if (analysis.num_same > analysis.num_different
+            && __guac_common_surface_flush_fills(surface))
+        return;
+
+    __guac_common_surface_flush_encoded(surface, &analysis);
+
+}
+
+/**
+ * Draws the bitmap update currently described by the dirty rectangle within
+ * the given surface by copying any content which has merely moved since it
+ * was last sent (such as content which has been scrolled), sending only the
+ * remainder as images. If no such content is found, this function has no
+ * effect.
+ *
+ * @param surface
+ *     The surface to flush. Motion detection must be enabled for this
+ *     surface.
+ *
+ * @return
+ *     Non-zero if the update was drawn, zero otherwise.
+ */
+static int __guac_common_surface_flush_motion(guac_common_surface* surface) {
+
+    guac_common_rect rect = surface->dirty_rect;
+    guac_common_motion motion;
+
+    /* Search for content that the client already has elsewhere */
+    if (!guac_common_motion_estimate(surface->buffer, surface->shadow,
+                surface->stride, surface->width, surface->height, &rect,
+                &motion))
+        return 0;
+
+    /* Moved content can only be copied in place if opaque */
+    if (!__guac_common_surface_is_opaque(surface, &motion.rect))
+        return 0;
+
+    guac_socket* socket = __guac_common_surface_get_socket(surface);
+    const guac_layer* layer = surface->layer;
+
+    guac_protocol_send_copy(socket, layer,
+            motion.rect.x + motion.dx, motion.rect.y + motion.dy,
+            motion.rect.width, motion.rect.height, GUAC_COMP_OVER, layer,
+            motion.rect.x, motion.rect.y);
+
+    surface->realized = 1;
+
+    /* Send newly-exposed content above/below or left/right of the moved
+     * content as images */
+    guac_common_rect exposed[2];
+    if (motion.dy != 0) {
+        guac_common_rect_init(&exposed[0], rect.x, rect.y,
+                rect.width, motion.rect.y - rect.y);
+        guac_common_rect_init(&exposed[1], rect.x,
+                motion.rect.y + motion.rect.height, rect.width,
+                rect.y + rect.height - motion.rect.y - motion.rect.height);
+    }
+    else {
+        guac_common_rect_init(&exposed[0], rect.x, rect.y,
+                motion.rect.x - rect.x, rect.height);
+        guac_common_rect_init(&exposed[1],
+                motion.rect.x + motion.rect.width, rect.y,
+                rect.x + rect.width - motion.rect.x - motion.rect.width,
+                rect.height);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (exposed[i].width > 0 && exposed[i].height > 0) {
+            surface->dirty_rect = exposed[i];
+            surface->dirty = 1;
+            __guac_common_surface_flush_bitmap(surface);
+        }
+    }
+
+    /* Surface is no longer dirty */
+    surface->dirty = 0;
+
+    return 1;
+
+}
+
+/**
+ * Returns whether the given rectangle, which is about to be flushed, is
+ * changing rapidly enough and is large enough that it should be streamed as
+ * video.
+ *
+ * @param surface
+ *     The surface being flushed.
+ *
+ * @param rect
+ *     The rectangle to check.
+ *
+ * @return
+ *     Non-zero if the rectangle should be streamed as video, zero otherwise.
+ */
+static int __guac_common_surface_should_use_video(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    /* Video can only be played within visible layers */
+    if (surface->layer->index < 0)
+        return 0;
+
+    /* Wait for any previous video to be replaced with images before starting
+     * another, as the heat map still describes the previous video and cannot
+     * be trusted until the area changes again */
+    if (guac_timestamp_current() - surface->video_updated
+            <= GUAC_SURFACE_VIDEO_TIMEOUT)
+        return 0;
+
+    if (rect->width * rect->height < GUAC_SURFACE_VIDEO_MIN_AREA)
+        return 0;
+
+    if (__guac_common_surface_calculate_framerate(surface, rect)
+            < GUAC_SURFACE_VIDEO_FRAMERATE)
+        return 0;
+
+    /* Check support last, as this involves every connected user */
+    return guac_common_video_supported(surface->client);
+
+}
+
+/**
+ * Begins streaming the region containing the given rectangle as video. Once
+ * streaming has begun, all changes within the region are sent as frames of
+ * that video rather than as images, until the region stops changing. If the
+ * video cannot be created, this function has no effect.
+ *
+ * @param surface
+ *     The surface containing the region to stream.
+ *
+ * @param rect
+ *     The rectangle which should be covered by the video.
+ */
+static void __guac_common_surface_start_video(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    guac_common_rect max;
+    guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
+
+    /* Align region to macroblocks, with H.264 additionally requiring even
+     * dimensions (any uncovered edge is simply sent as images) */
+    guac_common_rect video_rect = *rect;
+    guac_common_rect_expand_to_grid(GUAC_SURFACE_VIDEO_BLOCK_SIZE,
+            &video_rect, &max);
+    video_rect.width &= ~1;
+    video_rect.height &= ~1;
+
+    guac_common_video* video = guac_common_video_alloc(surface->client,
+            __guac_common_surface_get_socket(surface), surface->layer,
+            &video_rect);
+    if (video == NULL)
+        return;
+
+    surface->video = video;
+    surface->video_rect = video_rect;
+    surface->video_dirty = 0;
+    surface->video_updated = guac_timestamp_current();
+
+}
+
+/**
+ * Ends the active video of the given surface if its region has not changed
+ * recently, such that the region is again sent as images.
+ *
+ * @param surface
+ *     The surface whose active video should be checked.
+ */
+static void __guac_common_surface_expire_video(guac_common_surface* surface) {
+
+    if (surface->video != NULL && !surface->video_dirty
+            && guac_timestamp_current() - surface->video_updated
+               > GUAC_SURFACE_VIDEO_TIMEOUT)
+        __guac_common_surface_end_video(surface);
+
+}
+
+/**
+ * Encodes the current contents of the active video region of the given
+ * surface as the next frame of that video, if the region has changed since
+ * the last frame. If encoding fails, the video is ended.
+ *
+ * @param surface
+ *     The surface whose active video should be updated.
+ */
+static void __guac_common_surface_flush_video(guac_common_surface* surface) {
+
+    if (surface->video == NULL || !surface->video_dirty)
+        return;
+
+    const guac_common_rect* rect = &surface->video_rect;
+    const unsigned char* buffer = surface->buffer
+                                + rect->y * surface->stride + rect->x * 4;
+
+    if (guac_common_video_encode(surface->video,
+                __guac_common_surface_get_socket(surface), buffer,
+                surface->stride)) {
+        __guac_common_surface_end_video(surface);
+        return;
+    }
+
+    surface->video_dirty = 0;
+    surface->video_updated = guac_timestamp_current();
+
+}
+
+/**
+ * Flushes the bitmap update currently described by the dirty rectangle within
+ * the given surface, copying any moved content where motion detection is
+ * enabled, and updating the shadow copy of the surface accordingly. Any part
+ * of the update within the region of an active video is instead included in
+ * the next frame of that video.
+ *
+ * @param surface
+ *     The surface to flush.
+ */
+static void __guac_common_surface_flush_update(guac_common_surface* surface) {
+
+    guac_common_rect rect = surface->dirty_rect;
+
+    /* Stream rapidly-changing regions as video where possible */
+    if (surface->video == NULL
+            && __guac_common_surface_should_use_video(surface, &rect))
+        __guac_common_surface_start_video(surface, &rect);
+
+    if (__guac_common_surface_is_under_video(surface, &rect)) {
+
+        /* Send any parts of the update outside the video region separately */
+        guac_common_rect split;
+        while (guac_common_rect_clip_and_split(&rect, &surface->video_rect,
+                    &split)) {
+            surface->dirty_rect = split;
+            surface->dirty = 1;
+            __guac_common_surface_flush_update(surface);
+        }
+
+        /* Include the remainder in the next frame. The shadow copy is not
+         * updated, as the client's copy of the layer beneath the video is
+         * unchanged. */
+        surface->video_dirty = 1;
         surface->dirty = 0;
+        return;
 
     }
 
+    /* Copy moved content if possible, sending everything else as images */
+    if (surface->shadow == NULL || surface->shadow_stale
+            || !__guac_common_surface_flush_motion(surface))
+        __guac_common_surface_flush_bitmap(surface);
+
+    __guac_common_surface_update_shadow(surface, &rect);
+
 }
 
 /**
@@ -1839,12 +2533,16 @@ static int __guac_common_surface_bitmap_rect_compare(const void* a, const void*
 static void __guac_common_surface_flush_properties(
         guac_common_surface* surface) {
 
-    guac_socket* socket = surface->socket;
-
     /* Only applicable to non-default visible layers */
     if (surface->layer->index <= 0)
         return;
 
+    /* Do not produce any output if nothing has changed */
+    if (!surface->opacity_dirty && !surface->location_dirty)
+        return;
+
+    guac_socket* socket = __guac_common_surface_get_socket(surface);
+
     /* Flush opacity */
     if (surface->opacity_dirty) {
         guac_protocol_send_shade(socket, surface->layer, surface->opacity);
@@ -1860,10 +2558,23 @@ static void __guac_common_surface_flush_properties(
 
 }
 
-static void __guac_common_surface_flush(guac_common_surface* surface) {
+/**
+ * Flushes all pending changes of the given surface as bitmap updates, without
+ * necessarily writing the resulting output. If the surface has an encoder,
+ * the output will remain pending until __guac_common_surface_flush_pending()
+ * is invoked.
+ *
+ * @param surface
+ *     The surface to flush.
+ */
+static void __guac_common_surface_flush_deferred(guac_common_surface* surface) {
 
-    /* Flush final dirty rectangle to queue. */
-    __guac_common_surface_flush_to_queue(surface);
+    /* Resume sending images for any video region which has stopped changing,
+     * prior to collecting damage such that the region is included */
+    __guac_common_surface_expire_video(surface);
+
+    /* Convert all pending changes into bitmap updates */
+    __guac_common_surface_flush_damage_to_queue(surface);
 
     guac_common_surface_bitmap_rect* current = surface->bitmap_queue;
     int i, j;
@@ -1897,7 +2608,7 @@ static void __guac_common_surface_flush(guac_common_surface* surface) {
 
                     /* Combine if reasonable */
                     else if (__guac_common_should_combine(surface, &candidate->rect, 0) || !surface->dirty) {
-                        __guac_common_mark_dirty(surface, &candidate->rect);
+                        __guac_common_extend_dirty(surface, &candidate->rect);
                         candidate->flushed = 1;
                         combined++;
                     }
@@ -1917,23 +2628,7 @@ static void __guac_common_surface_flush(guac_common_surface* surface) {
             else if (surface->dirty) {
 
                 flushed++;
-
-                int opaque = __guac_common_surface_is_opaque(surface,
-                            &surface->dirty_rect);
-
-                /* Prefer WebP when reasonable */
-                if (__guac_common_surface_should_use_webp(surface,
-                            &surface->dirty_rect))
-                    __guac_common_surface_flush_to_webp(surface, opaque);
-
-                /* If not WebP, JPEG is the next best (lossy) choice */
-                else if (opaque && __guac_common_surface_should_use_jpeg(
-                            surface, &surface->dirty_rect))
-                    __guac_common_surface_flush_to_jpeg(surface);
-
-                /* Use PNG if no lossy formats are appropriate */
-                else
-                    __guac_common_surface_flush_to_png(surface, opaque);
+                __guac_common_surface_flush_update(surface);
 
             }
 
@@ -1943,9 +2638,28 @@ static void __guac_common_surface_flush(guac_common_surface* surface) {
 
     }
 
+    /* Send all changes within any video region as a single frame */
+    __guac_common_surface_flush_video(surface);
+
     /* Flush complete */
     surface->bitmap_queue_length = 0;
 
+    /* All users now see the same contents as the shadow copy */
+    surface->shadow_stale = 0;
+
+}
+
+/**
+ * Flushes all pending changes of the given surface as bitmap updates, writing
+ * all resulting output (and any output which was already pending) before
+ * returning.
+ *
+ * @param surface
+ *     The surface to flush.
+ */
+static void __guac_common_surface_flush(guac_common_surface* surface) {
+    __guac_common_surface_flush_deferred(surface);
+    __guac_common_surface_flush_pending(surface);
 }
 
 void guac_common_surface_flush(guac_common_surface* surface) {
@@ -1962,6 +2676,93 @@ void guac_common_surface_flush(guac_common_surface* surface) {
 
 }
 
+void guac_common_surface_set_encoder(guac_common_surface* surface,
+        guac_common_encoder* encoder) {
+
+    pthread_mutex_lock(&surface->_lock);
+
+    /* Output pending for the old encoder must not be reordered */
+    __guac_common_surface_flush_pending(surface);
+    surface->encoder = encoder;
+
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+void guac_common_surface_set_cache_size(guac_common_surface* surface,
+        size_t max_size) {
+
+    pthread_mutex_lock(&surface->_lock);
+
+    /* Disable caching entirely if no images may be cached */
+    if (max_size == 0) {
+        if (surface->cache != NULL) {
+            __guac_common_surface_flush_pending(surface);
+            guac_common_bitmap_cache_free(surface->cache, surface->socket);
+            surface->cache = NULL;
+        }
+    }
+
+    /* Otherwise create cache or resize existing cache */
+    else if (surface->cache == NULL)
+        surface->cache = guac_common_bitmap_cache_alloc(surface->client,
+                max_size);
+
+    else
+        guac_common_bitmap_cache_set_max_size(surface->cache,
+                __guac_common_surface_get_socket(surface), max_size);
+
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+void guac_common_surface_set_motion_detection(guac_common_surface* surface,
+        int enabled) {
+
+    pthread_mutex_lock(&surface->_lock);
+
+    if (enabled && surface->shadow == NULL) {
+
+        /* Changes may still be pending, so the shadow copy can only be
+         * trusted after the next flush */
+        surface->shadow = malloc(surface->height * surface->stride);
+        memcpy(surface->shadow, surface->buffer,
+                surface->height * surface->stride);
+        surface->shadow_stale = 1;
+
+    }
+
+    else if (!enabled) {
+        free(surface->shadow);
+        surface->shadow = NULL;
+    }
+
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+void guac_common_surface_flush_deferred(guac_common_surface* surface) {
+
+    pthread_mutex_lock(&surface->_lock);
+
+    /* Flush any applicable layer properties */
+    __guac_common_surface_flush_properties(surface);
+
+    /* Flush surface contents, leaving output pending */
+    __guac_common_surface_flush_deferred(surface);
+
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
+void guac_common_surface_flush_complete(guac_common_surface* surface) {
+
+    pthread_mutex_lock(&surface->_lock);
+    __guac_common_surface_flush_pending(surface);
+    pthread_mutex_unlock(&surface->_lock);
+
+}
+
 void guac_common_surface_dup(guac_common_surface* surface, guac_user* user,
         guac_socket* socket) {
 
@@ -2002,6 +2803,18 @@ void guac_common_surface_dup(guac_common_surface* surface, guac_user* user,
 
     }
 
+    /* Recreate any cached images */
+    if (surface->cache != NULL)
+        guac_common_bitmap_cache_dup(surface->cache, user, socket);
+
+    /* The new user cannot join a video already in progress, so any video
+     * must be restarted (or replaced with images) */
+    __guac_common_surface_end_video(surface);
+
+    /* The new user sees changes which other users have not yet received, so
+     * the shadow copy cannot be trusted until the next flush */
+    surface->shadow_stale = 1;
+
 complete:
     pthread_mutex_unlock(&surface->_lock);
 
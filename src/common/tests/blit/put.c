@@ -0,0 +1,345 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/blit.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The largest row width tested, in pixels. This is several times the width
+ * of the widest vector used by guac_common_blit_put(), such that rows both
+ * with and without a partial group of pixels at their end are tested.
+ */
+#define TEST_MAX_WIDTH 40
+
+/**
+ * The number of distinct pixel offsets at which rows are placed within the
+ * test buffers, such that rows which are not aligned to any vector size are
+ * tested.
+ */
+#define TEST_OFFSETS 4
+
+/**
+ * The size of each test buffer, in pixels.
+ */
+#define TEST_BUFFER_SIZE (TEST_MAX_WIDTH + TEST_OFFSETS)
+
+/**
+ * Fully opaque source pixels.
+ */
+static const uint32_t test_opaque[] = {
+    0xFF000000, 0xFFFFFFFF, 0xFF123456, 0xFF808080
+};
+
+/**
+ * Fully transparent source pixels.
+ */
+static const uint32_t test_transparent[] = {
+    0x00000000, 0x00123456
+};
+
+/**
+ * Partially transparent source pixels, using premultiplied alpha.
+ */
+static const uint32_t test_translucent[] = {
+    0x80402010, 0x01010101, 0xFEFEFEFE, 0x40404040
+};
+
+/**
+ * Destination pixels, including pixels which are fully transparent.
+ */
+static const uint32_t test_dst[] = {
+    0x00000000, 0xFF000000, 0xFFFFFFFF, 0xFF123456,
+    0x80402010, 0x00FFFFFF
+};
+
+/**
+ * The kinds of source row tested. The vector implementations handle groups
+ * of pixels which are entirely opaque or entirely transparent separately
+ * from all other groups.
+ */
+typedef enum test_source {
+
+    /**
+     * Every source pixel is fully opaque.
+     */
+    TEST_SOURCE_OPAQUE,
+
+    /**
+     * Every source pixel is fully transparent.
+     */
+    TEST_SOURCE_TRANSPARENT,
+
+    /**
+     * Source pixels may be opaque, transparent or translucent.
+     */
+    TEST_SOURCE_MIXED,
+
+    /**
+     * The number of kinds of source row.
+     */
+    TEST_SOURCE_COUNT
+
+} test_source;
+
+/**
+ * Returns a pseudo-random value, advancing the given seed.
+ *
+ * @param seed
+ *     Pointer to the seed to advance.
+ *
+ * @return
+ *     A pseudo-random value between 0 and 32767 inclusive.
+ */
+static unsigned int next_random(unsigned int* seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7FFF;
+}
+
+/**
+ * Selects a pseudo-random element of the given array of pixels.
+ */
+#define RANDOM_PIXEL(array, seed) \
+    ((array)[next_random(seed) % (sizeof(array) / sizeof((array)[0]))])
+
+/**
+ * Fills the given buffers with a pseudo-random destination row and source
+ * row of the given kind.
+ *
+ * @param dst
+ *     The destination buffer to fill, which must be TEST_BUFFER_SIZE pixels
+ *     long.
+ *
+ * @param src
+ *     The source buffer to fill, which must be TEST_BUFFER_SIZE pixels long.
+ *
+ * @param kind
+ *     The kind of source row to generate.
+ *
+ * @param seed
+ *     Pointer to the seed to use and advance.
+ */
+static void fill_buffers(uint32_t* dst, uint32_t* src, test_source kind,
+        unsigned int* seed) {
+
+    for (int i = 0; i < TEST_BUFFER_SIZE; i++) {
+
+        dst[i] = RANDOM_PIXEL(test_dst, seed);
+
+        int choice = kind;
+        if (kind == TEST_SOURCE_MIXED)
+            choice = next_random(seed) % 3;
+
+        if (choice == TEST_SOURCE_OPAQUE)
+            src[i] = RANDOM_PIXEL(test_opaque, seed);
+        else if (choice == TEST_SOURCE_TRANSPARENT)
+            src[i] = RANDOM_PIXEL(test_transparent, seed);
+        else
+            src[i] = RANDOM_PIXEL(test_translucent, seed);
+
+    }
+
+}
+
+/**
+ * Returns the result of blending a single color component using the
+ * Porter-Duff "over" operator, assuming premultiplied alpha.
+ *
+ * @param dst
+ *     The destination color component.
+ *
+ * @param src
+ *     The source color component.
+ *
+ * @param alpha
+ *     The alpha component of the source.
+ *
+ * @return
+ *     The blended color component.
+ */
+static int reference_blend_component(int dst, int src, int alpha) {
+    int blended = src + dst * (0xFF - alpha);
+    return blended > 0xFF ? 0xFF : blended;
+}
+
+/**
+ * Returns the result of drawing a single source pixel over a single
+ * destination pixel, one pixel at a time.
+ *
+ * @param dst
+ *     The destination pixel.
+ *
+ * @param src
+ *     The source pixel.
+ *
+ * @param opaque
+ *     Non-zero if the alpha channel of the source should be ignored, zero if
+ *     the source should be blended using the Porter-Duff "over" operator.
+ *
+ * @return
+ *     The new value of the destination pixel.
+ */
+static uint32_t reference_put(uint32_t dst, uint32_t src, int opaque) {
+
+    if (opaque)
+        return src | 0xFF000000;
+
+    int src_a = src >> 24;
+    int dst_a = dst >> 24;
+
+    if (src_a == 0xFF || dst_a == 0x00)
+        return src;
+
+    if (src_a == 0x00)
+        return dst;
+
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+        result |= (uint32_t) reference_blend_component((dst >> shift) & 0xFF,
+                (src >> shift) & 0xFF, src_a) << shift;
+
+    return result;
+
+}
+
+/**
+ * Draws a row of pixels using guac_common_blit_put(), verifying that the
+ * entire destination buffer matches the result of applying reference_put()
+ * to each pixel of the row, and that the reported changed span covers
+ * exactly the pixels which changed.
+ *
+ * @param dst_buffer
+ *     The buffer containing the destination row, which must be
+ *     TEST_BUFFER_SIZE pixels long.
+ *
+ * @param dst
+ *     The first pixel of the destination row.
+ *
+ * @param src
+ *     The first pixel of the source row.
+ *
+ * @param width
+ *     The width of both rows, in pixels.
+ *
+ * @param opaque
+ *     Non-zero if the alpha channel of the source should be ignored, zero
+ *     otherwise.
+ */
+static void verify_put(uint32_t* dst_buffer, uint32_t* dst,
+        const uint32_t* src, int width, int opaque) {
+
+    uint32_t expected[TEST_BUFFER_SIZE];
+    int expected_min_x = -1;
+    int expected_max_x = -1;
+
+    memcpy(expected, dst_buffer, sizeof(expected));
+    for (int x = 0; x < width; x++) {
+
+        uint32_t* pixel = &expected[dst - dst_buffer + x];
+        uint32_t result = reference_put(*pixel, src[x], opaque);
+
+        if (result != *pixel) {
+            if (expected_min_x == -1)
+                expected_min_x = x;
+            expected_max_x = x;
+        }
+
+        *pixel = result;
+
+    }
+
+    int min_x, max_x;
+    int changed = guac_common_blit_put(dst, src, width, opaque,
+            &min_x, &max_x);
+
+    CU_ASSERT_FATAL(memcmp(dst_buffer, expected, sizeof(expected)) == 0);
+    CU_ASSERT_EQUAL_FATAL(changed != 0, expected_max_x != -1);
+
+    if (changed) {
+        CU_ASSERT_EQUAL_FATAL(min_x, expected_min_x);
+        CU_ASSERT_EQUAL_FATAL(max_x, expected_max_x);
+    }
+
+}
+
+/**
+ * Test which verifies that guac_common_blit_put() produces the same results
+ * as drawing one pixel at a time, both when ignoring the alpha channel and
+ * when blending, for rows of every width up to TEST_MAX_WIDTH at arbitrary
+ * alignments.
+ */
+void test_blit__put() {
+
+    uint32_t dst_buffer[TEST_BUFFER_SIZE];
+    uint32_t src_buffer[TEST_BUFFER_SIZE];
+
+    unsigned int seed = 0;
+
+    for (int kind = 0; kind < TEST_SOURCE_COUNT; kind++) {
+        for (int opaque = 0; opaque <= 1; opaque++) {
+            for (int width = 0; width <= TEST_MAX_WIDTH; width++) {
+                for (int offset = 0; offset < TEST_OFFSETS; offset++) {
+
+                    fill_buffers(dst_buffer, src_buffer, kind, &seed);
+                    verify_put(dst_buffer, dst_buffer + offset,
+                            src_buffer + TEST_OFFSETS - 1 - offset, width,
+                            opaque);
+
+                }
+            }
+        }
+    }
+
+}
+
+/**
+ * Test which verifies that the span of changed pixels reported by
+ * guac_common_blit_put() is exact for every possible first and last changed
+ * pixel, including pixels within partial groups at the end of the row.
+ */
+void test_blit__put_span() {
+
+    uint32_t dst_buffer[TEST_BUFFER_SIZE];
+    uint32_t src_buffer[TEST_BUFFER_SIZE];
+
+    unsigned int seed = 0;
+
+    for (int opaque = 0; opaque <= 1; opaque++) {
+        for (int first = 0; first < TEST_MAX_WIDTH; first++) {
+            for (int last = first; last < TEST_MAX_WIDTH; last++) {
+
+                /* Drawing an opaque source over itself changes nothing,
+                 * except where the destination has been altered */
+                fill_buffers(dst_buffer, src_buffer, TEST_SOURCE_OPAQUE,
+                        &seed);
+                memcpy(dst_buffer, src_buffer, sizeof(dst_buffer));
+                dst_buffer[1 + first] ^= 0x00000100;
+                dst_buffer[1 + last] ^= 0x00010000;
+
+                verify_put(dst_buffer, dst_buffer + 1, src_buffer + 1,
+                        TEST_MAX_WIDTH, opaque);
+
+            }
+        }
+    }
+
+}
+
@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/blit.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The largest row width tested, in pixels. This is several times the width
+ * of the widest vector used by guac_common_blit_set(), such that rows both
+ * with and without a partial group of pixels at their end are tested.
+ */
+#define TEST_MAX_WIDTH 40
+
+/**
+ * The number of distinct pixel offsets at which rows are placed within the
+ * test buffer, such that rows which are not aligned to any vector size are
+ * tested.
+ */
+#define TEST_OFFSETS 4
+
+/**
+ * The size of the test buffer, in pixels.
+ */
+#define TEST_BUFFER_SIZE (TEST_MAX_WIDTH + TEST_OFFSETS)
+
+/**
+ * The color assigned by each call to guac_common_blit_set().
+ */
+#define TEST_COLOR 0x80336699
+
+/**
+ * Test which verifies that guac_common_blit_set() assigns the given color to
+ * exactly the pixels of the given row, reporting the exact span of pixels
+ * which changed, for every possible first and last changed pixel within rows
+ * of every width up to TEST_MAX_WIDTH at arbitrary alignments.
+ */
+void test_blit__set() {
+
+    uint32_t buffer[TEST_BUFFER_SIZE];
+    uint32_t expected[TEST_BUFFER_SIZE];
+
+    for (int width = 0; width <= TEST_MAX_WIDTH; width++) {
+        for (int offset = 0; offset < TEST_OFFSETS; offset++) {
+
+            uint32_t* row = buffer + offset;
+
+            /* Setting a row to its current color changes nothing */
+            for (int i = 0; i < TEST_BUFFER_SIZE; i++)
+                buffer[i] = TEST_COLOR;
+
+            int min_x, max_x;
+            CU_ASSERT_FALSE(guac_common_blit_set(row, TEST_COLOR, width,
+                        &min_x, &max_x));
+
+            for (int first = 0; first < width; first++) {
+                for (int last = first; last < width; last++) {
+
+                    /* Only the first and last pixels of the row, and the
+                     * pixels surrounding the row, differ */
+                    for (int i = 0; i < TEST_BUFFER_SIZE; i++)
+                        buffer[i] = TEST_COLOR ^ 0x01000000;
+                    for (int x = 0; x < width; x++)
+                        row[x] = TEST_COLOR;
+                    row[first] = 0x00000000;
+                    row[last] = 0xFFFFFFFF;
+
+                    memcpy(expected, buffer, sizeof(expected));
+                    for (int x = 0; x < width; x++)
+                        expected[offset + x] = TEST_COLOR;
+
+                    CU_ASSERT_TRUE_FATAL(guac_common_blit_set(row,
+                                TEST_COLOR, width, &min_x, &max_x));
+                    CU_ASSERT_FATAL(memcmp(buffer, expected,
+                                sizeof(expected)) == 0);
+                    CU_ASSERT_EQUAL_FATAL(min_x, first);
+                    CU_ASSERT_EQUAL_FATAL(max_x, last);
+
+                }
+            }
+
+        }
+    }
+
+}
+
@@ -0,0 +1,316 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/blit.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/protocol-types.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The largest row width tested, in pixels. This is several times the width
+ * of the widest vector used by guac_common_blit_transfer(), such that rows
+ * both with and without a partial group of pixels at their end are tested.
+ */
+#define TEST_MAX_WIDTH 40
+
+/**
+ * The number of distinct pixel offsets at which rows are placed within the
+ * test buffers, such that rows which are not aligned to any vector size are
+ * tested.
+ */
+#define TEST_OFFSETS 4
+
+/**
+ * The size of each test buffer, in pixels.
+ */
+#define TEST_BUFFER_SIZE (TEST_MAX_WIDTH + 2 * TEST_OFFSETS)
+
+/**
+ * Every transfer function.
+ */
+static const guac_transfer_function test_ops[] = {
+    GUAC_TRANSFER_BINARY_BLACK,
+    GUAC_TRANSFER_BINARY_WHITE,
+    GUAC_TRANSFER_BINARY_SRC,
+    GUAC_TRANSFER_BINARY_DEST,
+    GUAC_TRANSFER_BINARY_NSRC,
+    GUAC_TRANSFER_BINARY_NDEST,
+    GUAC_TRANSFER_BINARY_AND,
+    GUAC_TRANSFER_BINARY_NAND,
+    GUAC_TRANSFER_BINARY_OR,
+    GUAC_TRANSFER_BINARY_NOR,
+    GUAC_TRANSFER_BINARY_XOR,
+    GUAC_TRANSFER_BINARY_XNOR,
+    GUAC_TRANSFER_BINARY_NSRC_AND,
+    GUAC_TRANSFER_BINARY_NSRC_NAND,
+    GUAC_TRANSFER_BINARY_NSRC_OR,
+    GUAC_TRANSFER_BINARY_NSRC_NOR
+};
+
+/**
+ * The number of transfer functions within test_ops.
+ */
+#define TEST_OP_COUNT (sizeof(test_ops) / sizeof(test_ops[0]))
+
+/**
+ * Pixel values from which test rows are built. Values are reused often
+ * enough that many pixels are left unchanged by each transfer function.
+ */
+static const uint32_t test_palette[] = {
+    0x00000000, 0xFF000000, 0xFFFFFFFF, 0x00FFFFFF,
+    0x80402010, 0xFF123456, 0x7FEDCBA9
+};
+
+/**
+ * The number of pixel values within test_palette.
+ */
+#define TEST_PALETTE_SIZE (sizeof(test_palette) / sizeof(test_palette[0]))
+
+/**
+ * Returns the result of applying the given transfer function to a single
+ * pair of source and destination pixels, one pixel at a time, exactly as
+ * defined by the Guacamole protocol.
+ *
+ * @param op
+ *     The transfer function to apply.
+ *
+ * @param src
+ *     The source pixel.
+ *
+ * @param dst
+ *     The destination pixel.
+ *
+ * @return
+ *     The new value of the destination pixel.
+ */
+static uint32_t reference_transfer(guac_transfer_function op, uint32_t src,
+        uint32_t dst) {
+
+    switch (op) {
+        case GUAC_TRANSFER_BINARY_BLACK:     return 0xFF000000;
+        case GUAC_TRANSFER_BINARY_WHITE:     return 0xFFFFFFFF;
+        case GUAC_TRANSFER_BINARY_SRC:       return src;
+        case GUAC_TRANSFER_BINARY_DEST:      return dst;
+        case GUAC_TRANSFER_BINARY_NSRC:      return src ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_NDEST:     return dst ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_AND:       return dst & (0xFF000000 | src);
+        case GUAC_TRANSFER_BINARY_NAND:
+            return (dst & (0xFF000000 | src)) ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_OR:        return dst | (0x00FFFFFF & src);
+        case GUAC_TRANSFER_BINARY_NOR:
+            return (dst | (0x00FFFFFF & src)) ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_XOR:       return dst ^ (0x00FFFFFF & src);
+        case GUAC_TRANSFER_BINARY_XNOR:
+            return (dst ^ (0x00FFFFFF & src)) ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_NSRC_AND:
+            return dst & (0xFF000000 | (src ^ 0x00FFFFFF));
+        case GUAC_TRANSFER_BINARY_NSRC_NAND:
+            return (dst & (0xFF000000 | (src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
+        case GUAC_TRANSFER_BINARY_NSRC_OR:
+            return dst | (0x00FFFFFF & (src ^ 0x00FFFFFF));
+        case GUAC_TRANSFER_BINARY_NSRC_NOR:
+            return (dst | (0x00FFFFFF & (src ^ 0x00FFFFFF))) ^ 0x00FFFFFF;
+    }
+
+    return dst;
+
+}
+
+/**
+ * Fills the given buffer with pixels chosen from test_palette, varying with
+ * the given seed.
+ *
+ * @param buffer
+ *     The buffer to fill, which must be TEST_BUFFER_SIZE pixels long.
+ *
+ * @param seed
+ *     An arbitrary value determining the pixels chosen.
+ */
+static void fill_buffer(uint32_t* buffer, unsigned int seed) {
+    for (int i = 0; i < TEST_BUFFER_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = test_palette[(seed >> 16) % TEST_PALETTE_SIZE];
+    }
+}
+
+/**
+ * Transfers a row of pixels using guac_common_blit_transfer(), verifying
+ * that the entire buffer containing the destination row matches the result
+ * of applying reference_transfer() to each pixel of the original row, and
+ * that the reported changed span covers exactly the pixels which changed.
+ *
+ * @param buffer
+ *     The buffer containing the destination row, which must be
+ *     TEST_BUFFER_SIZE pixels long. The source row may lie within this same
+ *     buffer.
+ *
+ * @param dst
+ *     The first pixel of the destination row.
+ *
+ * @param src
+ *     The first pixel of the source row.
+ *
+ * @param width
+ *     The width of both rows, in pixels.
+ *
+ * @param op
+ *     The transfer function to test.
+ *
+ * @param backwards
+ *     Non-zero if the row should be processed from its last pixel to its
+ *     first, zero otherwise.
+ */
+static void verify_transfer(uint32_t* buffer, uint32_t* dst,
+        const uint32_t* src, int width, guac_transfer_function op,
+        int backwards) {
+
+    uint32_t original_src[TEST_BUFFER_SIZE];
+    uint32_t expected[TEST_BUFFER_SIZE];
+    int expected_min_x = -1;
+    int expected_max_x = -1;
+
+    /* Compute expected result from the original contents of both rows */
+    memcpy(original_src, src, width * sizeof(uint32_t));
+    memcpy(expected, buffer, sizeof(expected));
+    for (int x = 0; x < width; x++) {
+
+        uint32_t* pixel = &expected[dst - buffer + x];
+        uint32_t result = reference_transfer(op, original_src[x], *pixel);
+
+        if (result != *pixel) {
+            if (expected_min_x == -1)
+                expected_min_x = x;
+            expected_max_x = x;
+        }
+
+        *pixel = result;
+
+    }
+
+    int min_x, max_x;
+    int changed = guac_common_blit_transfer(dst, src, width, op, backwards,
+            &min_x, &max_x);
+
+    CU_ASSERT_FATAL(memcmp(buffer, expected, sizeof(expected)) == 0);
+    CU_ASSERT_EQUAL_FATAL(changed != 0, expected_max_x != -1);
+
+    if (changed) {
+        CU_ASSERT_EQUAL_FATAL(min_x, expected_min_x);
+        CU_ASSERT_EQUAL_FATAL(max_x, expected_max_x);
+    }
+
+}
+
+/**
+ * Test which verifies that guac_common_blit_transfer() produces the same
+ * results as applying each transfer function one pixel at a time, for rows
+ * of every width up to TEST_MAX_WIDTH at arbitrary alignments, processed in
+ * either direction.
+ */
+void test_blit__transfer() {
+
+    uint32_t dst_buffer[TEST_BUFFER_SIZE];
+    uint32_t src_buffer[TEST_BUFFER_SIZE];
+
+    unsigned int seed = 0;
+
+    for (int i = 0; i < (int) TEST_OP_COUNT; i++) {
+        for (int width = 0; width <= TEST_MAX_WIDTH; width++) {
+            for (int offset = 0; offset < TEST_OFFSETS; offset++) {
+                for (int backwards = 0; backwards <= 1; backwards++) {
+
+                    fill_buffer(dst_buffer, seed++);
+                    fill_buffer(src_buffer, seed++);
+
+                    /* Source and destination rows at differing alignments */
+                    verify_transfer(dst_buffer, dst_buffer + offset,
+                            src_buffer + TEST_OFFSETS - 1 - offset, width,
+                            test_ops[i], backwards);
+
+                }
+            }
+        }
+    }
+
+}
+
+/**
+ * Test which verifies that guac_common_blit_transfer() produces the same
+ * results as applying each transfer function one pixel at a time when the
+ * source and destination rows overlap, so long as the row is processed in
+ * the direction which reads each source pixel before overwriting it.
+ */
+void test_blit__transfer_overlap() {
+
+    uint32_t buffer[TEST_BUFFER_SIZE];
+
+    unsigned int seed = 0;
+
+    for (int i = 0; i < (int) TEST_OP_COUNT; i++) {
+        for (int width = 0; width <= TEST_MAX_WIDTH; width++) {
+            for (int shift = 1; shift < TEST_OFFSETS; shift++) {
+
+                /* Destination after source must be processed backwards */
+                fill_buffer(buffer, seed++);
+                verify_transfer(buffer, buffer + shift, buffer, width,
+                        test_ops[i], 1);
+
+                /* Destination before source must be processed forwards */
+                fill_buffer(buffer, seed++);
+                verify_transfer(buffer, buffer, buffer + shift, width,
+                        test_ops[i], 0);
+
+            }
+        }
+    }
+
+}
+
+/**
+ * Test which verifies that the span of changed pixels reported by
+ * guac_common_blit_transfer() is exact for every possible first and last
+ * changed pixel, including pixels within partial groups at the end of the
+ * row.
+ */
+void test_blit__transfer_span() {
+
+    uint32_t dst_buffer[TEST_BUFFER_SIZE];
+    uint32_t src_buffer[TEST_BUFFER_SIZE];
+
+    for (int backwards = 0; backwards <= 1; backwards++) {
+        for (int first = 0; first < TEST_MAX_WIDTH; first++) {
+            for (int last = first; last < TEST_MAX_WIDTH; last++) {
+
+                /* Only the first and last pixels differ */
+                fill_buffer(src_buffer, first * TEST_MAX_WIDTH + last);
+                memcpy(dst_buffer, src_buffer, sizeof(dst_buffer));
+                dst_buffer[1 + first] ^= 0x00010000;
+                dst_buffer[1 + last] ^= 0x01000000;
+
+                verify_transfer(dst_buffer, dst_buffer + 1, src_buffer + 1,
+                        TEST_MAX_WIDTH, GUAC_TRANSFER_BINARY_SRC, backwards);
+
+            }
+        }
+    }
+
+}
+
@@ -0,0 +1,246 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/cache.h"
+
+#include <CUnit/CUnit.h>
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+
+#include <fcntl.h>
+#include <stdint.h>
+
+/**
+ * The width and height of each test image, in pixels.
+ */
+#define TEST_IMAGE_SIZE 32
+
+/**
+ * The number of bytes of image data within each test image, as accounted
+ * for by the bitmap cache.
+ */
+#define TEST_IMAGE_BYTES (TEST_IMAGE_SIZE * TEST_IMAGE_SIZE * 4)
+
+/**
+ * Creates a new image of the given size, filled with content derived from
+ * the given seed. Images created with different seeds have different
+ * content.
+ *
+ * @param seed
+ *     An arbitrary value distinguishing one image from another.
+ *
+ * @param size
+ *     The width and height of the image, in pixels.
+ *
+ * @return
+ *     A newly-allocated image, which must eventually be freed with
+ *     cairo_surface_destroy().
+ */
+static cairo_surface_t* create_image(int seed, int size) {
+
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            size, size);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+
+    cairo_surface_flush(image);
+    for (int y = 0; y < size; y++) {
+
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        for (int x = 0; x < size; x++)
+            row[x] = 0xFF000000 | (seed << 16) | (y << 8) | x;
+
+    }
+    cairo_surface_mark_dirty(image);
+
+    return image;
+
+}
+
+/**
+ * Adds the given image to the given cache, offering the image twice such
+ * that it is cached rather than merely noted as a candidate.
+ *
+ * @param cache
+ *     The cache to add the image to.
+ *
+ * @param socket
+ *     The socket over which any buffers should be created or disposed.
+ *
+ * @param image
+ *     The image to add.
+ *
+ * @param hash
+ *     The hash to associate with the image.
+ *
+ * @return
+ *     The buffer now containing the image, or NULL if the image was not
+ *     cached.
+ */
+static const guac_layer* cache_image(guac_common_bitmap_cache* cache,
+        guac_socket* socket, cairo_surface_t* image, unsigned int hash) {
+
+    guac_common_bitmap_cache_add(cache, socket, image, hash);
+    return guac_common_bitmap_cache_add(cache, socket, image, hash);
+
+}
+
+/**
+ * Test which verifies that guac_common_bitmap_cache_add() caches an image
+ * only once it has been seen twice, that guac_common_bitmap_cache_lookup()
+ * finds only identical images with the same hash, and that the size of
+ * each cached image is accounted for.
+ */
+void test_cache__add() {
+
+    int fd = open("/dev/null", O_WRONLY);
+    CU_ASSERT_FATAL(fd != -1);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = guac_socket_open(fd);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_common_bitmap_cache* cache = guac_common_bitmap_cache_alloc(client,
+            TEST_IMAGE_BYTES * 4);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    /* Hashes sharing the same bucket */
+    unsigned int hash_a = 1;
+    unsigned int hash_b = 1 + GUAC_COMMON_BITMAP_CACHE_BUCKETS;
+
+    cairo_surface_t* image_a = create_image(1, TEST_IMAGE_SIZE);
+    cairo_surface_t* image_b = create_image(2, TEST_IMAGE_SIZE);
+
+    /* Images are not cached when first seen */
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_add(cache, socket,
+                image_a, hash_a));
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_lookup(cache, image_a,
+                hash_a));
+    CU_ASSERT_EQUAL(cache->size, 0);
+
+    /* Images are cached when seen again */
+    const guac_layer* buffer_a = guac_common_bitmap_cache_add(cache, socket,
+            image_a, hash_a);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer_a);
+    CU_ASSERT_EQUAL(cache->size, TEST_IMAGE_BYTES);
+
+    const guac_layer* buffer_b = cache_image(cache, socket, image_b, hash_b);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer_b);
+    CU_ASSERT_PTR_NOT_EQUAL(buffer_a, buffer_b);
+    CU_ASSERT_EQUAL(cache->size, TEST_IMAGE_BYTES * 2);
+
+    /* Cached images are found only with both the same hash and content */
+    CU_ASSERT_PTR_EQUAL(guac_common_bitmap_cache_lookup(cache, image_a,
+                hash_a), buffer_a);
+    CU_ASSERT_PTR_EQUAL(guac_common_bitmap_cache_lookup(cache, image_b,
+                hash_b), buffer_b);
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_lookup(cache, image_b,
+                hash_a));
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_lookup(cache, image_a,
+                hash_a + 1));
+
+    /* Images of a different size sharing the same hash reset the count of
+     * sightings */
+    cairo_surface_t* image_c = create_image(3, TEST_IMAGE_SIZE);
+    cairo_surface_t* small = create_image(3, TEST_IMAGE_SIZE / 2);
+    unsigned int hash_c = 3;
+
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_add(cache, socket,
+                image_c, hash_c));
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_add(cache, socket,
+                small, hash_c));
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_add(cache, socket,
+                image_c, hash_c));
+    CU_ASSERT_EQUAL(cache->size, TEST_IMAGE_BYTES * 2);
+
+    /* Images larger than the entire cache are never cached */
+    cairo_surface_t* large = create_image(4, TEST_IMAGE_SIZE * 4);
+    CU_ASSERT_PTR_NULL(cache_image(cache, socket, large, 4));
+    CU_ASSERT_EQUAL(cache->size, TEST_IMAGE_BYTES * 2);
+    CU_ASSERT_PTR_NOT_NULL(guac_common_bitmap_cache_lookup(cache, image_a,
+                hash_a));
+
+    cairo_surface_destroy(large);
+    cairo_surface_destroy(small);
+    cairo_surface_destroy(image_c);
+    cairo_surface_destroy(image_b);
+    cairo_surface_destroy(image_a);
+
+    guac_common_bitmap_cache_free(cache, socket);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that the buffers of images evicted from the cache are
+ * reused for later images, rather than new buffers being allocated.
+ */
+void test_cache__add_reuse() {
+
+    int fd = open("/dev/null", O_WRONLY);
+    CU_ASSERT_FATAL(fd != -1);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = guac_socket_open(fd);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Cache has room for only a single image */
+    guac_common_bitmap_cache* cache = guac_common_bitmap_cache_alloc(client,
+            TEST_IMAGE_BYTES);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    cairo_surface_t* image_a = create_image(1, TEST_IMAGE_SIZE);
+    cairo_surface_t* image_b = create_image(2, TEST_IMAGE_SIZE);
+
+    const guac_layer* buffer_a = cache_image(cache, socket, image_a, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(buffer_a);
+
+    /* Caching a second image evicts the first, reusing its buffer */
+    const guac_layer* buffer_b = cache_image(cache, socket, image_b, 2);
+    CU_ASSERT_PTR_EQUAL(buffer_b, buffer_a);
+    CU_ASSERT_EQUAL(cache->spare_buffer_count, 0);
+    CU_ASSERT_EQUAL(cache->size, TEST_IMAGE_BYTES);
+
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_lookup(cache, image_a, 1));
+    CU_ASSERT_PTR_EQUAL(guac_common_bitmap_cache_lookup(cache, image_b, 2),
+            buffer_b);
+
+    /* Evicted images must again be seen twice before being cached */
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_add(cache, socket,
+                image_a, 1));
+    CU_ASSERT_PTR_EQUAL(guac_common_bitmap_cache_add(cache, socket,
+                image_a, 1), buffer_b);
+
+    cairo_surface_destroy(image_b);
+    cairo_surface_destroy(image_a);
+
+    guac_common_bitmap_cache_free(cache, socket);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
@@ -0,0 +1,249 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/cache.h"
+
+#include <CUnit/CUnit.h>
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+
+#include <fcntl.h>
+#include <stdint.h>
+
+/**
+ * The width and height of each test image, in pixels.
+ */
+#define TEST_IMAGE_SIZE 32
+
+/**
+ * The number of bytes of image data within each test image, as accounted
+ * for by the bitmap cache.
+ */
+#define TEST_IMAGE_BYTES (TEST_IMAGE_SIZE * TEST_IMAGE_SIZE * 4)
+
+/**
+ * Creates a new image of the given size, filled with content derived from
+ * the given seed. Images created with different seeds have different
+ * content.
+ *
+ * @param seed
+ *     An arbitrary value distinguishing one image from another.
+ *
+ * @param size
+ *     The width and height of the image, in pixels.
+ *
+ * @return
+ *     A newly-allocated image, which must eventually be freed with
+ *     cairo_surface_destroy().
+ */
+static cairo_surface_t* create_image(int seed, int size) {
+
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            size, size);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+
+    cairo_surface_flush(image);
+    for (int y = 0; y < size; y++) {
+
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        for (int x = 0; x < size; x++)
+            row[x] = 0xFF000000 | (seed << 16) | (y << 8) | x;
+
+    }
+    cairo_surface_mark_dirty(image);
+
+    return image;
+
+}
+
+/**
+ * Adds the given image to the given cache, offering the image twice such
+ * that it is cached rather than merely noted as a candidate.
+ *
+ * @param cache
+ *     The cache to add the image to.
+ *
+ * @param socket
+ *     The socket over which any buffers should be created or disposed.
+ *
+ * @param image
+ *     The image to add.
+ *
+ * @param hash
+ *     The hash to associate with the image.
+ *
+ * @return
+ *     The buffer now containing the image, or NULL if the image was not
+ *     cached.
+ */
+static const guac_layer* cache_image(guac_common_bitmap_cache* cache,
+        guac_socket* socket, cairo_surface_t* image, unsigned int hash) {
+
+    guac_common_bitmap_cache_add(cache, socket, image, hash);
+    return guac_common_bitmap_cache_add(cache, socket, image, hash);
+
+}
+
+/**
+ * The number of test images used by each test.
+ */
+#define TEST_IMAGES 4
+
+/**
+ * Returns the hash to associate with the test image having the given index.
+ * All such hashes share the same bucket, such that evictions must correctly
+ * unlink entries from the middle of that bucket.
+ *
+ * @param index
+ *     The index of the test image.
+ *
+ * @return
+ *     The hash to associate with the test image.
+ */
+static unsigned int test_hash(int index) {
+    return 7 + index * GUAC_COMMON_BITMAP_CACHE_BUCKETS;
+}
+
+/**
+ * Test which verifies that, once the cache is full, adding an image evicts
+ * the least-recently-used image, where looking up an image counts as a use.
+ */
+void test_cache__evict_lru() {
+
+    cairo_surface_t* images[TEST_IMAGES];
+
+    int fd = open("/dev/null", O_WRONLY);
+    CU_ASSERT_FATAL(fd != -1);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = guac_socket_open(fd);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Cache has room for all but one image */
+    guac_common_bitmap_cache* cache = guac_common_bitmap_cache_alloc(client,
+            TEST_IMAGE_BYTES * (TEST_IMAGES - 1));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    for (int i = 0; i < TEST_IMAGES; i++)
+        images[i] = create_image(i, TEST_IMAGE_SIZE);
+
+    /* Fill cache */
+    for (int i = 0; i < TEST_IMAGES - 1; i++)
+        CU_ASSERT_PTR_NOT_NULL(cache_image(cache, socket, images[i],
+                    test_hash(i)));
+
+    CU_ASSERT_EQUAL(cache->size, TEST_IMAGE_BYTES * (TEST_IMAGES - 1));
+
+    /* Use the oldest image, leaving the second image least recently used */
+    CU_ASSERT_PTR_NOT_NULL(guac_common_bitmap_cache_lookup(cache, images[0],
+                test_hash(0)));
+
+    /* Adding another image evicts only the least recently used image */
+    CU_ASSERT_PTR_NOT_NULL(cache_image(cache, socket, images[3],
+                test_hash(3)));
+
+    CU_ASSERT_EQUAL(cache->size, TEST_IMAGE_BYTES * (TEST_IMAGES - 1));
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_lookup(cache, images[1],
+                test_hash(1)));
+
+    CU_ASSERT_PTR_NOT_NULL(guac_common_bitmap_cache_lookup(cache, images[0],
+                test_hash(0)));
+    CU_ASSERT_PTR_NOT_NULL(guac_common_bitmap_cache_lookup(cache, images[2],
+                test_hash(2)));
+    CU_ASSERT_PTR_NOT_NULL(guac_common_bitmap_cache_lookup(cache, images[3],
+                test_hash(3)));
+
+    for (int i = 0; i < TEST_IMAGES; i++)
+        cairo_surface_destroy(images[i]);
+
+    guac_common_bitmap_cache_free(cache, socket);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
+/**
+ * Test which verifies that reducing the maximum size of the cache evicts the
+ * least-recently-used images until the cache is within its new budget.
+ */
+void test_cache__evict_set_max_size() {
+
+    cairo_surface_t* images[TEST_IMAGES];
+
+    int fd = open("/dev/null", O_WRONLY);
+    CU_ASSERT_FATAL(fd != -1);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = guac_socket_open(fd);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_common_bitmap_cache* cache = guac_common_bitmap_cache_alloc(client,
+            TEST_IMAGE_BYTES * TEST_IMAGES);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    /* Fill cache */
+    for (int i = 0; i < TEST_IMAGES; i++) {
+        images[i] = create_image(i, TEST_IMAGE_SIZE);
+        CU_ASSERT_PTR_NOT_NULL(cache_image(cache, socket, images[i],
+                    test_hash(i)));
+    }
+
+    CU_ASSERT_EQUAL(cache->size, TEST_IMAGE_BYTES * TEST_IMAGES);
+
+    /* Shrinking the cache evicts the oldest images */
+    guac_common_bitmap_cache_set_max_size(cache, socket,
+            TEST_IMAGE_BYTES * 2 + TEST_IMAGE_BYTES / 2);
+
+    CU_ASSERT_EQUAL(cache->size, TEST_IMAGE_BYTES * 2);
+    CU_ASSERT_EQUAL(cache->spare_buffer_count, 2);
+
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_lookup(cache, images[0],
+                test_hash(0)));
+    CU_ASSERT_PTR_NULL(guac_common_bitmap_cache_lookup(cache, images[1],
+                test_hash(1)));
+    CU_ASSERT_PTR_NOT_NULL(guac_common_bitmap_cache_lookup(cache, images[2],
+                test_hash(2)));
+    CU_ASSERT_PTR_NOT_NULL(guac_common_bitmap_cache_lookup(cache, images[3],
+                test_hash(3)));
+
+    /* Emptying the cache evicts everything */
+    guac_common_bitmap_cache_set_max_size(cache, socket, 0);
+
+    CU_ASSERT_EQUAL(cache->size, 0);
+    CU_ASSERT_EQUAL(cache->spare_buffer_count, TEST_IMAGES);
+    CU_ASSERT_PTR_NULL(cache->newest);
+    CU_ASSERT_PTR_NULL(cache->oldest);
+
+    for (int i = 0; i < TEST_IMAGES; i++)
+        cairo_surface_destroy(images[i]);
+
+    guac_common_bitmap_cache_free(cache, socket);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
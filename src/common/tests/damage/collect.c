@@ -0,0 +1,187 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/damage.h"
+#include "common/rect.h"
+
+#include <CUnit/CUnit.h>
+
+/**
+ * The width and height of the image covered by each test damage map, in
+ * pixels. This spans four cells in each dimension.
+ */
+#define TEST_IMAGE_SIZE 256
+
+/**
+ * The maximum number of updates which may be collected by each test.
+ */
+#define TEST_MAX_UPDATES 8
+
+/**
+ * Verifies that the given update has the given position and size.
+ *
+ * @param update
+ *     The update to check.
+ *
+ * @param x
+ *     The expected X coordinate of the update.
+ *
+ * @param y
+ *     The expected Y coordinate of the update.
+ *
+ * @param width
+ *     The expected width of the update.
+ *
+ * @param height
+ *     The expected height of the update.
+ */
+static void verify_update(const guac_common_rect* update, int x, int y,
+        int width, int height) {
+    CU_ASSERT_EQUAL(update->x, x);
+    CU_ASSERT_EQUAL(update->y, y);
+    CU_ASSERT_EQUAL(update->width, width);
+    CU_ASSERT_EQUAL(update->height, height);
+}
+
+/**
+ * Marks the given rectangle within the given damage map.
+ *
+ * @param map
+ *     The damage map to update.
+ *
+ * @param x
+ *     The X coordinate of the rectangle.
+ *
+ * @param y
+ *     The Y coordinate of the rectangle.
+ *
+ * @param width
+ *     The width of the rectangle.
+ *
+ * @param height
+ *     The height of the rectangle.
+ */
+static void mark(guac_common_damage_map* map, int x, int y,
+        int width, int height) {
+
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, x, y, width, height);
+    guac_common_damage_map_mark(map, &rect);
+
+}
+
+/**
+ * Test which verifies that guac_common_damage_map_collect() merges runs of
+ * dirty cells which span the same columns as the run above into a single
+ * update, keeps unrelated runs separate, and clears the damage map.
+ */
+void test_damage__collect() {
+
+    guac_common_rect updates[TEST_MAX_UPDATES];
+
+    guac_common_damage_map* map = guac_common_damage_map_alloc(
+            TEST_IMAGE_SIZE, TEST_IMAGE_SIZE);
+
+    /* Two rows of two cells each, plus an unrelated cell to the right */
+    mark(map, 10, 20, 100, 100);
+    mark(map, 200, 10, 10, 10);
+
+    int length = guac_common_damage_map_collect(map, updates, 0,
+            TEST_MAX_UPDATES);
+
+    CU_ASSERT_EQUAL_FATAL(length, 2);
+    verify_update(&updates[0], 10, 20, 100, 100);
+    verify_update(&updates[1], 200, 10, 10, 10);
+
+    /* Damage map is clean after collecting */
+    CU_ASSERT_EQUAL(map->dirty_count, 0);
+    for (int i = 0; i < map->width * map->height; i++)
+        CU_ASSERT_FALSE(map->cells[i].dirty);
+
+    /* Nothing further is collected from a clean map */
+    CU_ASSERT_EQUAL(guac_common_damage_map_collect(map, updates, length,
+                TEST_MAX_UPDATES), length);
+
+    guac_common_damage_map_free(map);
+
+}
+
+/**
+ * Test which verifies that guac_common_damage_map_collect() does not merge
+ * runs which span different columns, even if the runs overlap.
+ */
+void test_damage__collect_unaligned() {
+
+    guac_common_rect updates[TEST_MAX_UPDATES];
+
+    guac_common_damage_map* map = guac_common_damage_map_alloc(
+            TEST_IMAGE_SIZE, TEST_IMAGE_SIZE);
+
+    /* One cell, with two cells directly beneath */
+    mark(map, 0, 0, 64, 64);
+    mark(map, 0, 64, 128, 64);
+
+    /* One cell, with the same cell continuing over the following rows */
+    mark(map, 192, 0, 64, 192);
+
+    int length = guac_common_damage_map_collect(map, updates, 0,
+            TEST_MAX_UPDATES);
+
+    CU_ASSERT_EQUAL_FATAL(length, 3);
+    verify_update(&updates[0], 0, 0, 64, 64);
+    verify_update(&updates[1], 192, 0, 64, 192);
+    verify_update(&updates[2], 0, 64, 128, 64);
+
+    guac_common_damage_map_free(map);
+
+}
+
+/**
+ * Test which verifies that guac_common_damage_map_collect() appends to any
+ * existing updates, and combines all remaining changes into the final update
+ * once the array of updates is full.
+ */
+void test_damage__collect_full() {
+
+    guac_common_rect updates[TEST_MAX_UPDATES];
+
+    guac_common_damage_map* map = guac_common_damage_map_alloc(
+            TEST_IMAGE_SIZE, TEST_IMAGE_SIZE);
+
+    /* Existing update must be left untouched */
+    guac_common_rect_init(&updates[0], 1, 2, 3, 4);
+
+    /* Three unrelated cells */
+    mark(map, 0, 0, 10, 10);
+    mark(map, 130, 0, 10, 10);
+    mark(map, 0, 130, 10, 10);
+
+    int length = guac_common_damage_map_collect(map, updates, 1, 3);
+
+    CU_ASSERT_EQUAL_FATAL(length, 3);
+    verify_update(&updates[0], 1, 2, 3, 4);
+    verify_update(&updates[1], 0, 0, 10, 10);
+    verify_update(&updates[2], 0, 0, 140, 140);
+
+    CU_ASSERT_EQUAL(map->dirty_count, 0);
+
+    guac_common_damage_map_free(map);
+
+}
+
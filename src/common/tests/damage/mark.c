@@ -0,0 +1,195 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/damage.h"
+#include "common/rect.h"
+
+#include <CUnit/CUnit.h>
+
+/**
+ * The width of the image covered by each test damage map, in pixels. This
+ * spans four cells, the last of which is only partially covered.
+ */
+#define TEST_IMAGE_WIDTH 200
+
+/**
+ * The height of the image covered by each test damage map, in pixels. This
+ * spans three cells, the last of which is only partially covered.
+ */
+#define TEST_IMAGE_HEIGHT 130
+
+/**
+ * Verifies that the given cell of the given damage map is dirty and has the
+ * given bounding rectangle.
+ *
+ * @param map
+ *     The damage map to check.
+ *
+ * @param x
+ *     The column of the cell to check.
+ *
+ * @param y
+ *     The row of the cell to check.
+ *
+ * @param rect
+ *     The expected bounding rectangle of the cell.
+ */
+static void verify_dirty_cell(const guac_common_damage_map* map, int x, int y,
+        const guac_common_rect* rect) {
+
+    const guac_common_damage_cell* cell = map->cells + y * map->width + x;
+
+    CU_ASSERT_TRUE(cell->dirty);
+    CU_ASSERT_EQUAL(cell->rect.x, rect->x);
+    CU_ASSERT_EQUAL(cell->rect.y, rect->y);
+    CU_ASSERT_EQUAL(cell->rect.width, rect->width);
+    CU_ASSERT_EQUAL(cell->rect.height, rect->height);
+
+}
+
+/**
+ * Test which verifies that guac_common_damage_map_alloc() sizes the damage
+ * map to cover the entire image, including any partial cells.
+ */
+void test_damage__alloc() {
+
+    guac_common_damage_map* map = guac_common_damage_map_alloc(
+            TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT);
+
+    CU_ASSERT_EQUAL(map->width, 4);
+    CU_ASSERT_EQUAL(map->height, 3);
+    CU_ASSERT_EQUAL(map->dirty_count, 0);
+
+    for (int i = 0; i < map->width * map->height; i++)
+        CU_ASSERT_FALSE(map->cells[i].dirty);
+
+    guac_common_damage_map_free(map);
+
+}
+
+/**
+ * Test which verifies that guac_common_damage_map_mark() marks only the cells
+ * intersecting each rectangle, records only the portion of the rectangle
+ * within each cell, and grows the rectangles of cells which are already
+ * dirty.
+ */
+void test_damage__mark() {
+
+    guac_common_rect rect;
+    guac_common_rect expected;
+
+    guac_common_damage_map* map = guac_common_damage_map_alloc(
+            TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT);
+
+    /* Rectangle within a single cell marks only that cell */
+    guac_common_rect_init(&rect, 10, 10, 20, 20);
+    guac_common_damage_map_mark(map, &rect);
+    CU_ASSERT_EQUAL(map->dirty_count, 1);
+    verify_dirty_cell(map, 0, 0, &rect);
+
+    /* Rectangle spanning four cells is split between those cells, growing
+     * the rectangle of the cell which is already dirty */
+    guac_common_rect_init(&rect, 50, 60, 30, 10);
+    guac_common_damage_map_mark(map, &rect);
+    CU_ASSERT_EQUAL(map->dirty_count, 4);
+
+    guac_common_rect_init(&expected, 10, 10, 54, 54);
+    verify_dirty_cell(map, 0, 0, &expected);
+
+    guac_common_rect_init(&expected, 64, 60, 16, 4);
+    verify_dirty_cell(map, 1, 0, &expected);
+
+    guac_common_rect_init(&expected, 50, 64, 14, 6);
+    verify_dirty_cell(map, 0, 1, &expected);
+
+    guac_common_rect_init(&expected, 64, 64, 16, 6);
+    verify_dirty_cell(map, 1, 1, &expected);
+
+    /* Rectangle within the partial cell at the image corner */
+    guac_common_rect_init(&rect, 195, 128, 5, 2);
+    guac_common_damage_map_mark(map, &rect);
+    CU_ASSERT_EQUAL(map->dirty_count, 5);
+    verify_dirty_cell(map, 3, 2, &rect);
+
+    /* Empty rectangles are ignored */
+    guac_common_rect_init(&rect, 150, 10, 0, 10);
+    guac_common_damage_map_mark(map, &rect);
+    CU_ASSERT_EQUAL(map->dirty_count, 5);
+    CU_ASSERT_FALSE(map->cells[2].dirty);
+
+    /* All other cells remain clean */
+    CU_ASSERT_FALSE(map->cells[0 * map->width + 2].dirty);
+    CU_ASSERT_FALSE(map->cells[0 * map->width + 3].dirty);
+    CU_ASSERT_FALSE(map->cells[1 * map->width + 2].dirty);
+    CU_ASSERT_FALSE(map->cells[1 * map->width + 3].dirty);
+    CU_ASSERT_FALSE(map->cells[2 * map->width + 0].dirty);
+    CU_ASSERT_FALSE(map->cells[2 * map->width + 1].dirty);
+    CU_ASSERT_FALSE(map->cells[2 * map->width + 2].dirty);
+
+    guac_common_damage_map_free(map);
+
+}
+
+/**
+ * Test which verifies that guac_common_damage_map_added_area() counts the
+ * entire portion of a rectangle within clean cells, only the growth of the
+ * rectangles of dirty cells, and leaves the damage map untouched.
+ */
+void test_damage__added_area() {
+
+    guac_common_rect rect;
+
+    guac_common_damage_map* map = guac_common_damage_map_alloc(
+            TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT);
+
+    /* Everything is new within a clean map */
+    guac_common_rect_init(&rect, 50, 60, 30, 10);
+    CU_ASSERT_EQUAL(guac_common_damage_map_added_area(map, &rect), 300);
+
+    guac_common_rect_init(&rect, 10, 10, 20, 20);
+    guac_common_damage_map_mark(map, &rect);
+
+    /* Nothing is added by damage which is already recorded */
+    CU_ASSERT_EQUAL(guac_common_damage_map_added_area(map, &rect), 0);
+
+    /* Only growth of a dirty cell's rectangle is added */
+    guac_common_rect_init(&rect, 0, 0, 40, 40);
+    CU_ASSERT_EQUAL(guac_common_damage_map_added_area(map, &rect),
+            40 * 40 - 20 * 20);
+
+    /* Growth of a dirty cell plus the portion within a clean cell, where
+     * the dirty cell grows to (10, 0) - (64, 30) */
+    guac_common_rect_init(&rect, 60, 0, 10, 10);
+    CU_ASSERT_EQUAL(guac_common_damage_map_added_area(map, &rect),
+            (54 * 30 - 20 * 20) + 6 * 10);
+
+    /* Empty rectangles add nothing */
+    guac_common_rect_init(&rect, 150, 10, 0, 10);
+    CU_ASSERT_EQUAL(guac_common_damage_map_added_area(map, &rect), 0);
+
+    /* Map itself is unchanged */
+    guac_common_rect_init(&rect, 10, 10, 20, 20);
+    CU_ASSERT_EQUAL(map->dirty_count, 1);
+    verify_dirty_cell(map, 0, 0, &rect);
+    CU_ASSERT_FALSE(map->cells[1].dirty);
+
+    guac_common_damage_map_free(map);
+
+}
+
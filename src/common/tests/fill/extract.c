@@ -0,0 +1,178 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/fill.h"
+#include "common/rect.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+
+/**
+ * The width of the test image, in pixels.
+ */
+#define TEST_IMAGE_WIDTH 96
+
+/**
+ * The height of the test image, in pixels.
+ */
+#define TEST_IMAGE_HEIGHT 64
+
+/**
+ * The background color of the test image.
+ */
+#define TEST_IMAGE_COLOR 0xFF336699
+
+/**
+ * Test image data.
+ */
+static uint32_t test_image[TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT];
+
+/**
+ * Fills the test image with TEST_IMAGE_COLOR, and then fills the given
+ * rectangle within the test image with pixels which all differ from their
+ * neighbors.
+ *
+ * @param rect
+ *     The rectangle to fill with varying pixels.
+ */
+static void init_test_image(const guac_common_rect* rect) {
+
+    for (int y = 0; y < TEST_IMAGE_HEIGHT; y++) {
+        for (int x = 0; x < TEST_IMAGE_WIDTH; x++) {
+
+            uint32_t* pixel = &test_image[y * TEST_IMAGE_WIDTH + x];
+
+            if (x >= rect->x && x < rect->x + rect->width
+                    && y >= rect->y && y < rect->y + rect->height)
+                *pixel = 0xFF000000 | (y << 8) | x;
+            else
+                *pixel = TEST_IMAGE_COLOR;
+
+        }
+    }
+
+}
+
+/**
+ * Test which verifies that guac_common_fill_extract() divides a region into
+ * fills covering the uniform areas around a block of varying pixels, and a
+ * single residual rectangle covering the tiles containing that block.
+ */
+void test_fill__extract() {
+
+    guac_common_fill_map map;
+    guac_common_rect block;
+    guac_common_rect region;
+
+    guac_common_rect_init(&block, 40, 20, 20, 20);
+    guac_common_rect_init(&region, 0, 0, TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT);
+    init_test_image(&block);
+
+    CU_ASSERT_TRUE_FATAL(guac_common_fill_extract(
+                (unsigned char*) test_image, TEST_IMAGE_WIDTH * 4,
+                &region, &map));
+
+    /* The block lies within tile columns 2-3 and tile rows 1-2 */
+    CU_ASSERT_EQUAL_FATAL(map.num_residual, 1);
+    CU_ASSERT_EQUAL(map.residual[0].x, 32);
+    CU_ASSERT_EQUAL(map.residual[0].y, 16);
+    CU_ASSERT_EQUAL(map.residual[0].width, 32);
+    CU_ASSERT_EQUAL(map.residual[0].height, 32);
+
+    /* Everything else is covered by fills above, left, right, and below */
+    int fill_area = 0;
+    CU_ASSERT_EQUAL_FATAL(map.num_fills, 4);
+    for (int i = 0; i < map.num_fills; i++) {
+        CU_ASSERT_EQUAL(map.fills[i].color, TEST_IMAGE_COLOR);
+        fill_area += map.fills[i].rect.width * map.fills[i].rect.height;
+    }
+
+    CU_ASSERT_EQUAL(fill_area, TEST_IMAGE_WIDTH * TEST_IMAGE_HEIGHT - 32 * 32);
+
+}
+
+/**
+ * Test which verifies that guac_common_fill_extract() clips fills and
+ * residual rectangles to regions which are not aligned with the tile grid.
+ */
+void test_fill__extract_unaligned() {
+
+    guac_common_fill_map map;
+    guac_common_rect block;
+    guac_common_rect region;
+
+    guac_common_rect_init(&block, 40, 20, 20, 20);
+    guac_common_rect_init(&region, 5, 3, 80, 60);
+    init_test_image(&block);
+
+    CU_ASSERT_TRUE_FATAL(guac_common_fill_extract(
+                (unsigned char*) test_image, TEST_IMAGE_WIDTH * 4,
+                &region, &map));
+
+    int area = 0;
+    for (int i = 0; i < map.num_fills; i++) {
+        guac_common_rect* rect = &map.fills[i].rect;
+        CU_ASSERT_TRUE(rect->x >= region.x && rect->y >= region.y);
+        CU_ASSERT_TRUE(rect->x + rect->width <= region.x + region.width);
+        CU_ASSERT_TRUE(rect->y + rect->height <= region.y + region.height);
+        area += rect->width * rect->height;
+    }
+
+    for (int i = 0; i < map.num_residual; i++) {
+        guac_common_rect* rect = &map.residual[i];
+        CU_ASSERT_TRUE(rect->x >= region.x && rect->y >= region.y);
+        CU_ASSERT_TRUE(rect->x + rect->width <= region.x + region.width);
+        CU_ASSERT_TRUE(rect->y + rect->height <= region.y + region.height);
+        area += rect->width * rect->height;
+    }
+
+    /* Fills and residual rectangles must exactly cover the region */
+    CU_ASSERT_EQUAL(area, region.width * region.height);
+
+}
+
+/**
+ * Test which verifies that guac_common_fill_extract() refuses to divide
+ * regions which contain too little uniform color or which are too small.
+ */
+void test_fill__extract_rejected() {
+
+    guac_common_fill_map map;
+    guac_common_rect block;
+    guac_common_rect region;
+
+    /* Entirely varying pixels */
+    guac_common_rect_init(&block, 0, 0, TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT);
+    guac_common_rect_init(&region, 0, 0, TEST_IMAGE_WIDTH, TEST_IMAGE_HEIGHT);
+    init_test_image(&block);
+
+    CU_ASSERT_FALSE(guac_common_fill_extract(
+                (unsigned char*) test_image, TEST_IMAGE_WIDTH * 4,
+                &region, &map));
+
+    /* Region too small to be worth splitting */
+    guac_common_rect_init(&block, 40, 20, 20, 20);
+    guac_common_rect_init(&region, 32, 16, 48, 48);
+    init_test_image(&block);
+
+    CU_ASSERT_FALSE(guac_common_fill_extract(
+                (unsigned char*) test_image, TEST_IMAGE_WIDTH * 4,
+                &region, &map));
+
+}
@@ -0,0 +1,287 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "common/motion.h"
+#include "common/rect.h"
+
+#include <CUnit/CUnit.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The width and height of each test image, in pixels.
+ */
+#define TEST_IMAGE_SIZE 128
+
+/**
+ * The number of bytes in each row of each test image.
+ */
+#define TEST_IMAGE_STRIDE (TEST_IMAGE_SIZE * 4)
+
+/**
+ * The distance, in pixels, that content is scrolled between the previous and
+ * current test images.
+ */
+#define TEST_SCROLL 10
+
+/**
+ * The previous contents of the test image.
+ */
+static uint32_t test_previous[TEST_IMAGE_SIZE * TEST_IMAGE_SIZE];
+
+/**
+ * The current contents of the test image.
+ */
+static uint32_t test_current[TEST_IMAGE_SIZE * TEST_IMAGE_SIZE];
+
+/**
+ * Returns an arbitrary, fully-opaque pixel for the given coordinates, such
+ * that no two rows or columns of an image built from these pixels are alike,
+ * and images built using different seeds do not share any rows or columns.
+ *
+ * @param seed
+ *     An arbitrary value distinguishing one image from another.
+ *
+ * @param x
+ *     The X coordinate of the pixel.
+ *
+ * @param y
+ *     The Y coordinate of the pixel.
+ *
+ * @return
+ *     The 32-bit ARGB value of the pixel.
+ */
+static uint32_t test_pixel(int seed, int x, int y) {
+
+    uint32_t value = (seed * 73856093u) ^ (x * 19349663u) ^ (y * 83492791u);
+    value ^= value >> 13;
+    value *= 0x5BD1E995u;
+    value ^= value >> 15;
+
+    return 0xFF000000 | value;
+
+}
+
+/**
+ * Fills the previous test image with arbitrary content, and fills the current
+ * test image with that same content scrolled by the given amount. Any part of
+ * the current test image not covered by the scrolled content receives new
+ * content.
+ *
+ * @param dx
+ *     The position of the previous content relative to the current content
+ *     along the X axis. A positive value means that content has moved left.
+ *
+ * @param dy
+ *     The position of the previous content relative to the current content
+ *     along the Y axis. A positive value means that content has moved up.
+ */
+static void init_test_images(int dx, int dy) {
+
+    for (int y = 0; y < TEST_IMAGE_SIZE; y++) {
+        for (int x = 0; x < TEST_IMAGE_SIZE; x++) {
+
+            test_previous[y * TEST_IMAGE_SIZE + x] = test_pixel(1, x, y);
+
+            int px = x + dx;
+            int py = y + dy;
+
+            if (px >= 0 && px < TEST_IMAGE_SIZE
+                    && py >= 0 && py < TEST_IMAGE_SIZE)
+                test_current[y * TEST_IMAGE_SIZE + x] = test_pixel(1, px, py);
+            else
+                test_current[y * TEST_IMAGE_SIZE + x] = test_pixel(2, x, y);
+
+        }
+    }
+
+}
+
+/**
+ * Searches the entire current test image for motion relative to the previous
+ * test image.
+ *
+ * @param motion
+ *     Pointer to a guac_common_motion which will receive any motion found.
+ *
+ * @return
+ *     The value returned by guac_common_motion_estimate().
+ */
+static int estimate(guac_common_motion* motion) {
+
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, 0, 0, TEST_IMAGE_SIZE, TEST_IMAGE_SIZE);
+
+    return guac_common_motion_estimate((unsigned char*) test_current,
+            (unsigned char*) test_previous, TEST_IMAGE_STRIDE,
+            TEST_IMAGE_SIZE, TEST_IMAGE_SIZE, &rect, motion);
+
+}
+
+/**
+ * Test which verifies that guac_common_motion_estimate() detects content
+ * which has been scrolled up or down.
+ */
+void test_motion__estimate_vertical() {
+
+    guac_common_motion motion;
+
+    /* Content scrolled up */
+    init_test_images(0, TEST_SCROLL);
+    CU_ASSERT_TRUE_FATAL(estimate(&motion));
+    CU_ASSERT_EQUAL(motion.dx, 0);
+    CU_ASSERT_EQUAL(motion.dy, TEST_SCROLL);
+    CU_ASSERT_EQUAL(motion.rect.x, 0);
+    CU_ASSERT_EQUAL(motion.rect.y, 0);
+    CU_ASSERT_EQUAL(motion.rect.width, TEST_IMAGE_SIZE);
+    CU_ASSERT_EQUAL(motion.rect.height, TEST_IMAGE_SIZE - TEST_SCROLL);
+
+    /* Content scrolled down */
+    init_test_images(0, -TEST_SCROLL);
+    CU_ASSERT_TRUE_FATAL(estimate(&motion));
+    CU_ASSERT_EQUAL(motion.dx, 0);
+    CU_ASSERT_EQUAL(motion.dy, -TEST_SCROLL);
+    CU_ASSERT_EQUAL(motion.rect.x, 0);
+    CU_ASSERT_EQUAL(motion.rect.y, TEST_SCROLL);
+    CU_ASSERT_EQUAL(motion.rect.width, TEST_IMAGE_SIZE);
+    CU_ASSERT_EQUAL(motion.rect.height, TEST_IMAGE_SIZE - TEST_SCROLL);
+
+}
+
+/**
+ * Test which verifies that guac_common_motion_estimate() detects content
+ * which has been scrolled left or right.
+ */
+void test_motion__estimate_horizontal() {
+
+    guac_common_motion motion;
+
+    /* Content scrolled left */
+    init_test_images(TEST_SCROLL, 0);
+    CU_ASSERT_TRUE_FATAL(estimate(&motion));
+    CU_ASSERT_EQUAL(motion.dx, TEST_SCROLL);
+    CU_ASSERT_EQUAL(motion.dy, 0);
+    CU_ASSERT_EQUAL(motion.rect.x, 0);
+    CU_ASSERT_EQUAL(motion.rect.y, 0);
+    CU_ASSERT_EQUAL(motion.rect.width, TEST_IMAGE_SIZE - TEST_SCROLL);
+    CU_ASSERT_EQUAL(motion.rect.height, TEST_IMAGE_SIZE);
+
+    /* Content scrolled right */
+    init_test_images(-TEST_SCROLL, 0);
+    CU_ASSERT_TRUE_FATAL(estimate(&motion));
+    CU_ASSERT_EQUAL(motion.dx, -TEST_SCROLL);
+    CU_ASSERT_EQUAL(motion.dy, 0);
+    CU_ASSERT_EQUAL(motion.rect.x, TEST_SCROLL);
+    CU_ASSERT_EQUAL(motion.rect.y, 0);
+    CU_ASSERT_EQUAL(motion.rect.width, TEST_IMAGE_SIZE - TEST_SCROLL);
+    CU_ASSERT_EQUAL(motion.rect.height, TEST_IMAGE_SIZE);
+
+}
+
+/**
+ * Test which verifies that guac_common_motion_estimate() does not report
+ * motion for unchanged content, entirely new content, or regions too small
+ * to be worth examining.
+ */
+void test_motion__estimate_none() {
+
+    guac_common_motion motion;
+    guac_common_rect rect;
+
+    /* Unchanged content has not moved */
+    init_test_images(0, 0);
+    CU_ASSERT_FALSE(estimate(&motion));
+
+    /* Entirely new content has not moved */
+    init_test_images(TEST_IMAGE_SIZE, TEST_IMAGE_SIZE);
+    CU_ASSERT_FALSE(estimate(&motion));
+
+    /* Small regions are ignored, even if scrolled */
+    init_test_images(0, TEST_SCROLL);
+    guac_common_rect_init(&rect, 0, 0, GUAC_COMMON_MOTION_MIN_SIZE - 1,
+            TEST_IMAGE_SIZE);
+    CU_ASSERT_FALSE(guac_common_motion_estimate(
+                (unsigned char*) test_current, (unsigned char*) test_previous,
+                TEST_IMAGE_STRIDE, TEST_IMAGE_SIZE, TEST_IMAGE_SIZE,
+                &rect, &motion));
+
+}
+
+/**
+ * Calculates the hash of the given row of the given image in the same manner
+ * as guac_common_motion_estimate() (32-bit FNV-1a over each pixel).
+ *
+ * @param image
+ *     The image containing the row.
+ *
+ * @param y
+ *     The index of the row.
+ *
+ * @return
+ *     The hash of the row.
+ */
+static unsigned int row_hash(const uint32_t* image, int y) {
+
+    unsigned int hash = 2166136261u;
+
+    for (int x = 0; x < TEST_IMAGE_SIZE; x++)
+        hash = (hash ^ image[y * TEST_IMAGE_SIZE + x]) * 16777619u;
+
+    return hash;
+
+}
+
+/**
+ * Test which verifies that guac_common_motion_estimate() rejects motion if a
+ * row within the matching region has the same hash as the previous row it
+ * appears to have moved from, but different pixels.
+ */
+void test_motion__estimate_collision() {
+
+    guac_common_motion motion;
+
+    init_test_images(0, TEST_SCROLL);
+
+    int y = TEST_IMAGE_SIZE / 2;
+    int k = TEST_IMAGE_SIZE / 2;
+    uint32_t* row = &test_current[y * TEST_IMAGE_SIZE];
+
+    /* Calculate hash of the row prior to the pixels being changed */
+    unsigned int hash = 2166136261u;
+    for (int x = 0; x < k; x++)
+        hash = (hash ^ row[x]) * 16777619u;
+
+    /* Change one pixel, then change the following pixel such that the hash
+     * after both pixels is unaffected */
+    unsigned int original = (hash ^ row[k]) * 16777619u;
+    row[k] ^= 0x00FFFFFF;
+    unsigned int altered = (hash ^ row[k]) * 16777619u;
+    row[k + 1] ^= original ^ altered;
+
+    /* The row now differs from the previous row while sharing its hash */
+    CU_ASSERT_NOT_EQUAL(memcmp(row,
+                &test_previous[(y + TEST_SCROLL) * TEST_IMAGE_SIZE],
+                TEST_IMAGE_STRIDE), 0);
+    CU_ASSERT_EQUAL(row_hash(test_current, y),
+            row_hash(test_previous, y + TEST_SCROLL));
+
+    CU_ASSERT_FALSE(estimate(&motion));
+
+}
+
@@ -0,0 +1,360 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "common/rect.h"
+#include "common/video.h"
+
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/user.h>
+
+#ifdef ENABLE_VIDEO_STREAMING
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+
+/* Live streaming requires the decoupled send/receive encoding API */
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57,37,100)
+#define GUAC_COMMON_VIDEO_ENCODING
+#endif
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef GUAC_COMMON_VIDEO_ENCODING
+
+struct guac_common_video {
+
+    /**
+     * The client from which the layer and stream of this video were
+     * allocated.
+     */
+    guac_client* client;
+
+    /**
+     * The layer playing this video.
+     */
+    guac_layer* layer;
+
+    /**
+     * The stream over which video data is sent.
+     */
+    guac_stream* stream;
+
+    /**
+     * The width of the video, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the video, in pixels.
+     */
+    int height;
+
+    /**
+     * The H.264 encoder.
+     */
+    AVCodecContext* context;
+
+    /**
+     * The frame receiving the YUV conversion of each image prior to
+     * encoding.
+     */
+    AVFrame* frame;
+
+    /**
+     * Packet receiving each unit of encoded video data.
+     */
+    AVPacket* packet;
+
+    /**
+     * The context used to convert each image from ARGB to YUV.
+     */
+    struct SwsContext* sws;
+
+    /**
+     * The time at which the video started. Frame timestamps are relative to
+     * this time, in milliseconds.
+     */
+    guac_timestamp start;
+
+    /**
+     * The timestamp of the last frame encoded, or -1 if no frames have yet
+     * been encoded.
+     */
+    int64_t last_pts;
+
+};
+
+/**
+ * Callback which is invoked by guac_common_video_supported() for each user
+ * associated with a client, clearing the given support flag if that user
+ * did not advertise support for GUAC_COMMON_VIDEO_MIMETYPE.
+ *
+ * @param user
+ *     The user to check for video support.
+ *
+ * @param data
+ *     Pointer to an int which is 1 if all users checked so far support
+ *     video, or 0 otherwise.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* __guac_common_video_support_callback(guac_user* user,
+        void* data) {
+
+    int* supported = (int*) data;
+
+    /* Skip check if another user already lacks support */
+    if (!*supported)
+        return NULL;
+
+    const char** mimetype = user->info.video_mimetypes;
+    if (mimetype != NULL) {
+
+        /* Search for H.264 in list of supported video mimetypes */
+        for (; *mimetype != NULL; mimetype++) {
+            if (strcmp(*mimetype, GUAC_COMMON_VIDEO_MIMETYPE) == 0)
+                return NULL;
+        }
+
+    }
+
+    *supported = 0;
+    return NULL;
+
+}
+
+int guac_common_video_supported(guac_client* client) {
+
+    /* Video cannot be streamed without an encoder */
+    if (avcodec_find_encoder(AV_CODEC_ID_H264) == NULL)
+        return 0;
+
+    int supported = 1;
+    guac_client_foreach_user(client, __guac_common_video_support_callback,
+            &supported);
+
+    return supported;
+
+}
+
+/**
+ * Frees the encoding state of the given video, along with the video itself.
+ * The layer and stream of the video, if any, are not freed.
+ *
+ * @param video
+ *     The video to free.
+ */
+static void __guac_common_video_free_encoder(guac_common_video* video) {
+
+    avcodec_free_context(&video->context);
+    av_frame_free(&video->frame);
+    av_packet_free(&video->packet);
+    sws_freeContext(video->sws);
+    free(video);
+
+}
+
+guac_common_video* guac_common_video_alloc(guac_client* client,
+        guac_socket* socket, const guac_layer* parent,
+        const guac_common_rect* rect) {
+
+    const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (codec == NULL)
+        return NULL;
+
+    guac_common_video* video = calloc(1, sizeof(guac_common_video));
+    if (video == NULL)
+        return NULL;
+
+    video->client = client;
+    video->width = rect->width;
+    video->height = rect->height;
+    video->last_pts = -1;
+
+    /* Configure encoder for low latency, with timestamps in milliseconds
+     * such that frames may be encoded at whatever rate the region changes */
+    video->context = avcodec_alloc_context3(codec);
+    if (video->context == NULL)
+        goto fail;
+
+    video->context->width = rect->width;
+    video->context->height = rect->height;
+    video->context->pix_fmt = AV_PIX_FMT_YUV420P;
+    video->context->time_base = (AVRational) { 1, 1000 };
+    video->context->bit_rate = (int64_t) rect->width * rect->height
+        * GUAC_COMMON_VIDEO_BITRATE_FACTOR;
+    video->context->gop_size = GUAC_COMMON_VIDEO_GOP_SIZE;
+    video->context->max_b_frames = 0;
+
+    /* Tune for speed if the encoder allows (these options are specific to
+     * libx264 and are ignored by other encoders) */
+    av_opt_set(video->context->priv_data, "preset", "ultrafast", 0);
+    av_opt_set(video->context->priv_data, "tune", "zerolatency", 0);
+
+    if (avcodec_open2(video->context, codec, NULL) < 0)
+        goto fail;
+
+    /* Allocate frame for converted images */
+    video->frame = av_frame_alloc();
+    if (video->frame == NULL)
+        goto fail;
+
+    video->frame->format = AV_PIX_FMT_YUV420P;
+    video->frame->width = rect->width;
+    video->frame->height = rect->height;
+    if (av_frame_get_buffer(video->frame, 32) < 0)
+        goto fail;
+
+    video->packet = av_packet_alloc();
+    if (video->packet == NULL)
+        goto fail;
+
+    /* Cairo's ARGB32 is native-endian, as is AV_PIX_FMT_RGB32 */
+    video->sws = sws_getContext(rect->width, rect->height, AV_PIX_FMT_RGB32,
+            rect->width, rect->height, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR,
+            NULL, NULL, NULL);
+    if (video->sws == NULL)
+        goto fail;
+
+    /* Play video within a dedicated layer over the covered region */
+    video->layer = guac_client_alloc_layer(client);
+    video->stream = guac_client_alloc_stream(client);
+    if (video->stream == NULL) {
+        guac_client_free_layer(client, video->layer);
+        goto fail;
+    }
+
+    guac_protocol_send_size(socket, video->layer, rect->width, rect->height);
+    guac_protocol_send_move(socket, video->layer, parent, rect->x, rect->y, 0);
+    guac_protocol_send_video(socket, video->stream, video->layer,
+            GUAC_COMMON_VIDEO_MIMETYPE);
+
+    video->start = guac_timestamp_current();
+    return video;
+
+fail:
+    __guac_common_video_free_encoder(video);
+    return NULL;
+
+}
+
+int guac_common_video_encode(guac_common_video* video, guac_socket* socket,
+        const unsigned char* buffer, int stride) {
+
+    AVFrame* frame = video->frame;
+
+    /* The encoder may still reference the previous frame */
+    if (av_frame_make_writable(frame) < 0)
+        return -1;
+
+    /* Convert image to YUV */
+    const uint8_t* src[1] = { buffer };
+    int src_stride[1] = { stride };
+    sws_scale(video->sws, src, src_stride, 0, video->height,
+            frame->data, frame->linesize);
+
+    /* Timestamp frame, keeping timestamps strictly increasing */
+    int64_t pts = guac_timestamp_current() - video->start;
+    if (pts <= video->last_pts)
+        pts = video->last_pts + 1;
+
+    frame->pts = video->last_pts = pts;
+
+    if (avcodec_send_frame(video->context, frame) < 0)
+        return -1;
+
+    /* Send all available video data as blobs */
+    AVPacket* packet = video->packet;
+    while (avcodec_receive_packet(video->context, packet) == 0) {
+
+        const unsigned char* data = packet->data;
+        int length = packet->size;
+
+        while (length > 0) {
+
+            int block_size = length;
+            if (block_size > GUAC_PROTOCOL_BLOB_MAX_LENGTH)
+                block_size = GUAC_PROTOCOL_BLOB_MAX_LENGTH;
+
+            guac_protocol_send_blob(socket, video->stream, data, block_size);
+
+            data += block_size;
+            length -= block_size;
+
+        }
+
+        av_packet_unref(packet);
+
+    }
+
+    return 0;
+
+}
+
+void guac_common_video_free(guac_common_video* video, guac_socket* socket) {
+
+    guac_client* client = video->client;
+
+    /* End stream and remove layer, revealing the covered region */
+    guac_protocol_send_end(socket, video->stream);
+    guac_protocol_send_dispose(socket, video->layer);
+
+    guac_client_free_stream(client, video->stream);
+    guac_client_free_layer(client, video->layer);
+
+    __guac_common_video_free_encoder(video);
+
+}
+
+#else
+
+/* Stubs for builds lacking H.264 encoding support */
+
+int guac_common_video_supported(guac_client* client) {
+    return 0;
+}
+
+guac_common_video* guac_common_video_alloc(guac_client* client,
+        guac_socket* socket, const guac_layer* parent,
+        const guac_common_rect* rect) {
+    return NULL;
+}
+
+int guac_common_video_encode(guac_common_video* video, guac_socket* socket,
+        const unsigned char* buffer, int stride) {
+    return -1;
+}
+
+void guac_common_video_free(guac_common_video* video, guac_socket* socket) {
+}
+
+#endif
+
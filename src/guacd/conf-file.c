@@ -22,6 +22,8 @@
 #include "conf.h"
 #include "conf-file.h"
 #include "conf-parse.h"
+#include "proc-pool.h"
+#include "reactor.h"
 
 #include <guacamole/client.h>
 
@@ -89,6 +91,44 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
 
         }
 
+        /* Number of idle processes per protocol */
+        else if (strcmp(param, "pool_size") == 0) {
+
+            char* end;
+            long size = strtol(value, &end, 10);
+
+            /* Invalid pool size */
+            if (*value == '\0' || *end != '\0' || size < 0
+                    || size > GUACD_PROC_POOL_MAX_SIZE) {
+                guacd_conf_parse_error = "Invalid pool size. The pool size must be a whole number no greater than " GUACD_PROC_POOL_MAX_SIZE_STR ".";
+                return 1;
+            }
+
+            /* Valid pool size */
+            config->pool_size = size;
+            return 0;
+
+        }
+
+        /* Number of reactor threads */
+        else if (strcmp(param, "reactor_threads") == 0) {
+
+            char* end;
+            long threads = strtol(value, &end, 10);
+
+            /* Invalid thread count */
+            if (*value == '\0' || *end != '\0' || threads < 0
+                    || threads > GUACD_REACTOR_MAX_THREADS) {
+                guacd_conf_parse_error = "Invalid number of reactor threads. The number of reactor threads must be a whole number no greater than " GUACD_REACTOR_MAX_THREADS_STR ".";
+                return 1;
+            }
+
+            /* Valid thread count */
+            config->reactor_threads = threads;
+            return 0;
+
+        }
+
     }
 
     /* SSL-specific options */
@@ -182,6 +222,8 @@ guacd_config* guacd_conf_load() {
     conf->foreground = 0;
     conf->print_version = 0;
     conf->max_log_level = GUAC_LOG_INFO;
+    conf->pool_size = 0;
+    conf->reactor_threads = 0;
 
 #ifdef ENABLE_SSL
     conf->cert_file = NULL;
@@ -71,6 +71,21 @@ typedef struct guacd_config {
      */
     guac_client_log_level max_log_level;
 
+    /**
+     * The number of idle processes to keep ready for each protocol, each
+     * having already loaded the client plugin for that protocol. If zero, a
+     * new process is created only once a connection requires it.
+     */
+    int pool_size;
+
+    /**
+     * The number of reactor threads which should transfer data between users
+     * and their client processes whenever a user's connection cannot be given
+     * directly to its process. If zero, each such user is given its own pair
+     * of threads.
+     */
+    int reactor_threads;
+
 } guacd_config;
 
 #endif
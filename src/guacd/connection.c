@@ -24,6 +24,8 @@
 #include "move-fd.h"
 #include "proc.h"
 #include "proc-map.h"
+#include "proc-pool.h"
+#include "reactor.h"
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
@@ -157,10 +159,16 @@ void* guacd_connection_io_thread(void* data) {
 }
 
 /**
- * Adds the given socket as a new user to the given process, automatically
- * reading/writing from the socket via read/write threads. The given socket,
- * parser, and any associated resources will be freed unless the user is not
- * added successfully.
+ * Adds the given socket as a new user to the given process. If the file
+ * descriptor underlying the socket may be read and written directly, and the
+ * given parser has not buffered any data beyond the instruction already
+ * handled, that file descriptor is given directly to the process, such that
+ * the process communicates with the user without further involvement of guacd.
+ * Otherwise, all data is transferred to the process through a new UNIX domain
+ * socket, with the user's socket being read/written automatically by the given
+ * reactor or, if there is no reactor, via read/write threads. The given
+ * socket, parser, and any associated resources will be freed unless the user
+ * is not added successfully.
  *
  * If adding the user fails for any reason, non-zero is returned. Zero is
  * returned upon success.
@@ -176,10 +184,40 @@ void* guacd_connection_io_thread(void* data) {
  *     The socket associated with the user to be added to the existing
  *     process.
  *
+ * @param fd
+ *     The file descriptor of the user's network connection.
+ *
+ * @param direct
+ *     Non-zero if all data read from or written to the given socket is read
+ *     from or written to the given file descriptor unmodified, zero if the
+ *     file descriptor cannot be read or written directly (such as when
+ *     SSL/TLS is in use).
+ *
+ * @param reactor
+ *     The reactor which should transfer data between the user and the
+ *     process if the user's file descriptor cannot be given directly to the
+ *     process, or NULL if dedicated threads should be used instead.
+ *
  * @return
  *     Zero if the user was added successfully, non-zero if an error occurred.
  */
-static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* socket) {
+static int guacd_add_user(guacd_proc* proc, guac_parser* parser,
+        guac_socket* socket, int fd, int direct, guacd_reactor* reactor) {
+
+    /* Give user's connection directly to process if no data would be lost */
+    if (direct && guac_parser_length(parser) == 0) {
+
+        if (!guacd_send_fd(proc->fd_socket, fd)) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to add user.");
+            return 1;
+        }
+
+        /* The process now has its own copy of the file descriptor */
+        guac_parser_free(parser);
+        guac_socket_free(socket);
+        return 0;
+
+    }
 
     int sockets[2];
 
@@ -201,6 +239,35 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
     /* Close our end of the process file descriptor */
     close(proc_fd);
 
+    /* Transfer data using reactor, if enabled */
+    if (reactor != NULL) {
+
+        /* Write all buffered data from parser before the reactor takes over
+         * the connection, failing if the process cannot receive that data */
+        char buffer[8192];
+        int length;
+        while ((length = guac_parser_shift(parser, buffer, sizeof(buffer))) > 0) {
+            if (__write_all(user_fd, buffer, length) < 0) {
+                guacd_log(GUAC_LOG_ERROR, "Unable to add user: %s",
+                        strerror(errno));
+                close(user_fd);
+                return 1;
+            }
+        }
+
+        if (guacd_reactor_add(reactor, socket, fd, direct, user_fd)) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to add user.");
+            close(user_fd);
+            return 1;
+        }
+
+        /* Parser is only freed once the user has been added, as it is freed
+         * by the caller otherwise */
+        guac_parser_free(parser);
+        return 0;
+
+    }
+
     guacd_connection_io_thread_params* params = malloc(sizeof(guacd_connection_io_thread_params));
     params->parser = parser;
     params->socket = socket;
@@ -224,18 +291,32 @@ static int guacd_add_user(guacd_proc* proc, guac_parser* parser, guac_socket* so
  * The socket provided will be automatically freed when the connection
  * terminates unless routing fails, in which case non-zero is returned.
  *
- * @param map
- *     The map of existing client processes.
+ * @param params
+ *     The parameters of the connection thread handling the new connection,
+ *     including the map of existing client processes, the pool of idle client
+ *     processes from which new processes should be taken, the reactor which
+ *     should transfer data between users and processes (if any), and the file
+ *     descriptor of the new connection.
  *
  * @param socket
  *     The socket associated with the new connection that must be routed to
  *     a new or existing process within the given map.
  *
+ * @param direct
+ *     Non-zero if all data read from or written to the given socket is read
+ *     from or written to the file descriptor of the new connection
+ *     unmodified, zero if the socket transforms that data (such as when
+ *     SSL/TLS is in use).
+ *
  * @return
  *     Zero if the connection was successfully routed, non-zero if routing has
  *     failed.
  */
-static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
+static int guacd_route_connection(guacd_connection_thread_params* params,
+        guac_socket* socket, int direct) {
+
+    guacd_proc_map* map = params->map;
+    guacd_proc_pool* pool = params->pool;
 
     guac_parser* parser = guac_parser_alloc();
 
@@ -269,6 +350,7 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
 
     guacd_proc* proc;
     int new_process;
+    char* protocol = NULL;
 
     const char* identifier = parser->argv[0];
 
@@ -294,21 +376,26 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
         guacd_log(GUAC_LOG_INFO, "Creating new client for protocol \"%s\"",
                 identifier);
 
-        /* Create new process */
-        proc = guacd_create_proc(identifier);
+        /* Take idle process from pool, creating a new process if needed */
+        proc = guacd_proc_pool_take(pool, identifier);
         new_process = 1;
 
+        /* Retain protocol name beyond the life of the parser */
+        protocol = strdup(identifier);
+
     }
 
     /* Abort if no process exists for the requested connection */
     if (proc == NULL) {
         guacd_log_guac_error(GUAC_LOG_INFO, "Connection did not succeed");
         guac_parser_free(parser);
+        free(protocol);
         return 1;
     }
 
     /* Add new user (in the case of a new process, this will be the owner */
-    int add_user_failed = guacd_add_user(proc, parser, socket);
+    int add_user_failed = guacd_add_user(proc, parser, socket,
+            params->connected_socket_fd, direct, params->reactor);
 
     /* If new process was created, manage that process */
     if (new_process) {
@@ -323,6 +410,11 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
             /* Store process, allowing other users to join */
             guacd_proc_map_add(map, proc);
 
+            /* Replenish idle processes, now that the protocol is known to
+             * be supported */
+            if (protocol != NULL)
+                guacd_proc_pool_fill(pool, protocol);
+
             /* Wait for child to finish */
             waitpid(proc->pid, NULL, 0);
 
@@ -353,6 +445,8 @@ static int guacd_route_connection(guacd_proc_map* map, guac_socket* socket) {
 
     }
 
+    free(protocol);
+
     /* Routing succeeded only if the user was added to a process */
     return add_user_failed;
 
@@ -362,11 +456,13 @@ void* guacd_connection_thread(void* data) {
 
     guacd_connection_thread_params* params = (guacd_connection_thread_params*) data;
 
-    guacd_proc_map* map = params->map;
     int connected_socket_fd = params->connected_socket_fd;
 
     guac_socket* socket;
 
+    /* Connection may be read and written directly unless encrypted */
+    int direct = 1;
+
 #ifdef ENABLE_SSL
 
     SSL_CTX* ssl_context = params->ssl_context;
@@ -380,6 +476,12 @@ void* guacd_connection_thread(void* data) {
             free(params);
             return NULL;
         }
+
+        /* Encrypted connections are always relayed by guacd, even if
+         * encryption is handled by the kernel, as non-data TLS records (alerts,
+         * key updates, etc.) must still be handled by OpenSSL */
+        direct = 0;
+
     }
     else
         socket = guac_socket_open(connected_socket_fd);
@@ -390,7 +492,7 @@ void* guacd_connection_thread(void* data) {
 #endif
 
     /* Route connection according to Guacamole, creating a new process if needed */
-    if (guacd_route_connection(map, socket))
+    if (guacd_route_connection(params, socket, direct))
         guac_socket_free(socket);
 
     free(params);
@@ -23,6 +23,8 @@
 #include "config.h"
 
 #include "proc-map.h"
+#include "proc-pool.h"
+#include "reactor.h"
 
 #ifdef ENABLE_SSL
 #include <openssl/ssl.h>
@@ -38,6 +40,18 @@ typedef struct guacd_connection_thread_params {
      */
     guacd_proc_map* map;
 
+    /**
+     * The shared pool of idle client processes.
+     */
+    guacd_proc_pool* pool;
+
+    /**
+     * The shared reactor which transfers data between users and their client
+     * processes, or NULL if each user should have dedicated threads for that
+     * transfer.
+     */
+    guacd_reactor* reactor;
+
 #ifdef ENABLE_SSL
     /**
      * SSL context for encrypted connections to guacd. If SSL is not active,
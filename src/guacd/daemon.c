@@ -25,6 +25,8 @@
 #include "connection.h"
 #include "log.h"
 #include "proc-map.h"
+#include "proc-pool.h"
+#include "reactor.h"
 
 #ifdef ENABLE_SSL
 #include <openssl/ssl.h>
@@ -280,6 +282,11 @@ int main(int argc, char* argv[]) {
     if (config == NULL || guacd_conf_parse_args(config, argc, argv))
        exit(EXIT_FAILURE);
 
+    /* Idle processes are kept for each protocol as configured */
+    guacd_proc_pool* pool = guacd_proc_pool_alloc(config->pool_size);
+    if (pool == NULL)
+       exit(EXIT_FAILURE);
+
     /* If requested, simply print version and exit, without initializing the
      * logging system, etc. */
     if (config->print_version) {
@@ -422,6 +429,21 @@ int main(int argc, char* argv[]) {
 
     }
 
+    /* Start reactor threads only once any fork() has completed, as threads do
+     * not survive fork() */
+    guacd_reactor* reactor = NULL;
+    if (config->reactor_threads > 0) {
+
+        reactor = guacd_reactor_alloc(config->reactor_threads);
+        if (reactor == NULL)
+            guacd_log(GUAC_LOG_WARNING, "Reactor could not be started. Each "
+                    "relayed connection will use dedicated threads.");
+        else
+            guacd_log(GUAC_LOG_INFO, "Relaying connections using %i reactor "
+                    "thread(s).", reactor->thread_count);
+
+    }
+
     /* Write PID file if requested */
     if (config->pidfile != NULL) {
 
@@ -487,6 +509,8 @@ int main(int argc, char* argv[]) {
         }
 
         params->map = map;
+        params->pool = pool;
+        params->reactor = reactor;
         params->connected_socket_fd = connected_socket_fd;
 
 #ifdef ENABLE_SSL
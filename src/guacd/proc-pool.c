@@ -0,0 +1,232 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "common/list.h"
+#include "log.h"
+#include "proc.h"
+#include "proc-pool.h"
+
+#include <guacamole/client.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+/**
+ * An idle process within a guacd_proc_pool.
+ */
+typedef struct guacd_proc_pool_entry {
+
+    /**
+     * The protocol that the process has loaded the client plugin for.
+     */
+    char* protocol;
+
+    /**
+     * The idle process, or NULL if the process is still being created. Entries
+     * for processes being created reserve space within the pool, and are
+     * never taken.
+     */
+    guacd_proc* proc;
+
+} guacd_proc_pool_entry;
+
+/**
+ * Returns whether the given process is still running. Idle processes may
+ * terminate on their own, for example if the client plugin for their
+ * protocol could not be loaded.
+ *
+ * @param proc
+ *     The process to check.
+ *
+ * @return
+ *     Non-zero if the process is still running, zero otherwise.
+ */
+static int guacd_proc_pool_is_alive(guacd_proc* proc) {
+
+    /* Terminated children are automatically reaped, as SIGCHLD is ignored,
+     * thus waitpid() will fail for any child which is no longer running */
+    return waitpid(proc->pid, NULL, WNOHANG) == 0;
+
+}
+
+/**
+ * Frees the given idle process, which must not have been given any users.
+ * The process, if still running, terminates once its end of the process's
+ * UNIX domain socket is closed.
+ *
+ * @param proc
+ *     The idle process to free.
+ */
+static void guacd_proc_pool_free_proc(guacd_proc* proc) {
+    guacd_proc_stop(proc);
+    guac_client_free(proc->client);
+    free(proc);
+}
+
+guacd_proc_pool* guacd_proc_pool_alloc(int size) {
+
+    guacd_proc_pool* pool = malloc(sizeof(guacd_proc_pool));
+    if (pool == NULL)
+        return NULL;
+
+    pool->size = size;
+    pool->idle = guac_common_list_alloc();
+
+    return pool;
+
+}
+
+guacd_proc* guacd_proc_pool_take(guacd_proc_pool* pool, const char* protocol) {
+
+    guacd_proc* proc = NULL;
+
+    guac_common_list_lock(pool->idle);
+
+    /* Search for a running idle process for the given protocol */
+    guac_common_list_element* current = pool->idle->head;
+    while (current != NULL && proc == NULL) {
+
+        guacd_proc_pool_entry* entry = (guacd_proc_pool_entry*) current->data;
+        guac_common_list_element* next = current->next;
+
+        /* Consider only processes which have finished being created */
+        if (entry->proc != NULL && strcmp(entry->protocol, protocol) == 0) {
+
+            guac_common_list_remove(pool->idle, current);
+
+            /* Use process only if it has not terminated */
+            if (guacd_proc_pool_is_alive(entry->proc))
+                proc = entry->proc;
+            else {
+                guacd_log(GUAC_LOG_DEBUG, "Discarding terminated idle "
+                        "process for protocol \"%s\"", protocol);
+                guacd_proc_pool_free_proc(entry->proc);
+            }
+
+            free(entry->protocol);
+            free(entry);
+
+        }
+
+        current = next;
+
+    }
+
+    guac_common_list_unlock(pool->idle);
+
+    /* Fall back to creating a new process */
+    if (proc == NULL)
+        return guacd_create_proc(protocol);
+
+    guacd_log(GUAC_LOG_DEBUG, "Using idle process for protocol \"%s\"",
+            protocol);
+
+    return proc;
+
+}
+
+/**
+ * Returns the number of idle processes within the given pool for the given
+ * protocol, including any which are still being created. The pool's list of
+ * idle processes must already be locked.
+ *
+ * @param pool
+ *     The pool containing the idle processes to count.
+ *
+ * @param protocol
+ *     The protocol of the idle processes to count.
+ *
+ * @return
+ *     The number of idle processes within the given pool for the given
+ *     protocol, including any which are still being created.
+ */
+static int guacd_proc_pool_count(guacd_proc_pool* pool,
+        const char* protocol) {
+
+    int count = 0;
+
+    guac_common_list_element* current;
+    for (current = pool->idle->head; current != NULL; current = current->next) {
+        guacd_proc_pool_entry* entry = (guacd_proc_pool_entry*) current->data;
+        if (strcmp(entry->protocol, protocol) == 0)
+            count++;
+    }
+
+    return count;
+
+}
+
+void guacd_proc_pool_fill(guacd_proc_pool* pool, const char* protocol) {
+
+    for (;;) {
+
+        guac_common_list_lock(pool->idle);
+
+        /* Stop once the pool contains enough idle processes, counting those
+         * which other fills are still creating */
+        if (guacd_proc_pool_count(pool, protocol) >= pool->size) {
+            guac_common_list_unlock(pool->idle);
+            break;
+        }
+
+        guacd_proc_pool_entry* entry = malloc(sizeof(guacd_proc_pool_entry));
+        if (entry == NULL) {
+            guac_common_list_unlock(pool->idle);
+            break;
+        }
+
+        /* Reserve space for the new process before creating it, such that
+         * concurrent fills cannot exceed the size of the pool */
+        entry->protocol = strdup(protocol);
+        entry->proc = NULL;
+        guac_common_list_element* element =
+            guac_common_list_add(pool->idle, entry);
+
+        guac_common_list_unlock(pool->idle);
+
+        /* Create new process, loading the client plugin ahead of time */
+        guacd_proc* proc = guacd_create_proc(protocol);
+
+        guac_common_list_lock(pool->idle);
+
+        /* Release reserved space if the process could not be created */
+        if (proc == NULL) {
+            guac_common_list_remove(pool->idle, element);
+            guac_common_list_unlock(pool->idle);
+            free(entry->protocol);
+            free(entry);
+            break;
+        }
+
+        /* Process may now be taken from the pool */
+        entry->proc = proc;
+        guac_common_list_unlock(pool->idle);
+
+        guacd_log(GUAC_LOG_DEBUG, "Created idle process for protocol \"%s\"",
+                protocol);
+
+    }
+
+}
+
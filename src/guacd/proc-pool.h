@@ -0,0 +1,111 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACD_PROC_POOL_H
+#define GUACD_PROC_POOL_H
+
+#include "config.h"
+#include "common/list.h"
+#include "proc.h"
+
+/**
+ * The maximum number of idle processes which may be kept for any one
+ * protocol.
+ */
+#define GUACD_PROC_POOL_MAX_SIZE 64
+
+/**
+ * The value of GUACD_PROC_POOL_MAX_SIZE as a string literal, for use within
+ * error messages.
+ */
+#define GUACD_PROC_POOL_MAX_SIZE_STR "64"
+
+/**
+ * Set of idle client processes which have been created ahead of time, each
+ * having already loaded the client plugin for its protocol, and each waiting
+ * to be given its first user.
+ */
+typedef struct guacd_proc_pool {
+
+    /**
+     * The number of idle processes to keep for each protocol which has been
+     * used at least once. If zero, no idle processes are kept.
+     */
+    int size;
+
+    /**
+     * All idle processes, including those still being created, in no
+     * particular order. Each element of this list is a guacd_proc_pool_entry.
+     */
+    guac_common_list* idle;
+
+} guacd_proc_pool;
+
+/**
+ * Allocates a new, empty process pool. There is intended to be exactly one
+ * process pool instance, which persists for the life of guacd.
+ *
+ * @param size
+ *     The number of idle processes to keep for each protocol which has been
+ *     used at least once. If zero, no idle processes are kept.
+ *
+ * @return
+ *     A newly-allocated process pool, or NULL if the pool cannot be
+ *     allocated.
+ */
+guacd_proc_pool* guacd_proc_pool_alloc(int size);
+
+/**
+ * Removes and returns an idle process for the given protocol from the given
+ * pool. If no such process is available, a new process is created with
+ * guacd_create_proc(). Either way, the returned process has not yet been
+ * given any users.
+ *
+ * @param pool
+ *     The pool to take the process from.
+ *
+ * @param protocol
+ *     The protocol for which a process is required.
+ *
+ * @return
+ *     A process for the given protocol, or NULL if no idle process is
+ *     available and a new process could not be created.
+ */
+guacd_proc* guacd_proc_pool_take(guacd_proc_pool* pool, const char* protocol);
+
+/**
+ * Creates new idle processes for the given protocol until the given pool
+ * contains the configured number of idle processes for that protocol. This
+ * function should only be invoked for protocols which are known to be
+ * supported, such as after a process for that protocol has successfully
+ * accepted its first user. It may safely be invoked concurrently for the same
+ * protocol, as processes still being created count toward the size of the
+ * pool.
+ *
+ * @param pool
+ *     The pool to fill.
+ *
+ * @param protocol
+ *     The protocol for which idle processes should be created.
+ */
+void guacd_proc_pool_fill(guacd_proc_pool* pool, const char* protocol);
+
+#endif
+
@@ -32,11 +32,13 @@
 #include <guacamole/socket.h>
 #include <guacamole/user.h>
 
+#include <dirent.h>
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <syslog.h>
 #include <unistd.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -88,6 +90,17 @@ static void* guacd_user_thread(void* data) {
     if (socket == NULL)
         return NULL;
 
+    /* Write to the user from a dedicated thread, such that a slow user cannot
+     * stall the connection for everyone else */
+    guac_socket* queued = guac_socket_queue(socket, GUACD_USER_QUEUE_LENGTH,
+            params->owner ? GUAC_SOCKET_QUEUE_BLOCK : GUAC_SOCKET_QUEUE_CLOSE);
+    if (queued == NULL) {
+        guac_socket_free(socket);
+        return NULL;
+    }
+
+    socket = queued;
+
     /* Create skeleton user */
     guac_user* user = guac_user_alloc();
     user->socket = socket;
@@ -287,6 +300,57 @@ static int guacd_timed_client_free(guac_client* client, int timeout) {
     return !free_operation.completed;
 }
 
+/**
+ * Closes all file descriptors inherited from the parent guacd process except
+ * for standard input, output, and error, and the given file descriptor. New
+ * processes may be forked while guacd holds the connections of other users,
+ * and may remain idle for an arbitrarily long time before being used. If
+ * those connections were not closed, they would remain open within the new
+ * process long after guacd and the process handling them had closed them.
+ *
+ * @param keep_fd
+ *     The file descriptor which should remain open.
+ */
+static void guacd_proc_close_inherited_fds(int keep_fd) {
+
+    /* Syslog may hold its own file descriptor, which must not be closed
+     * from beneath it */
+    closelog();
+
+    /* Close only the file descriptors actually open, if they can be listed */
+    DIR* fds = opendir("/proc/self/fd");
+    if (fds != NULL) {
+
+        struct dirent* entry;
+        while ((entry = readdir(fds)) != NULL) {
+
+            /* Skip "." and ".." */
+            if (entry->d_name[0] == '.')
+                continue;
+
+            int fd = atoi(entry->d_name);
+            if (fd > STDERR_FILENO && fd != keep_fd && fd != dirfd(fds))
+                close(fd);
+
+        }
+
+        closedir(fds);
+
+    }
+
+    /* Otherwise, close every possible file descriptor */
+    else {
+        long max_fd = sysconf(_SC_OPEN_MAX);
+        for (int fd = STDERR_FILENO + 1; fd < max_fd; fd++) {
+            if (fd != keep_fd)
+                close(fd);
+        }
+    }
+
+    openlog(GUACD_LOG_NAME, LOG_PID, LOG_DAEMON);
+
+}
+
 /**
  * Starts protocol-specific handling on the given process by loading the client
  * plugin for that protocol. This function does NOT return. It initializes the
@@ -440,6 +504,9 @@ guacd_proc* guacd_create_proc(const char* protocol) {
         proc->fd_socket = parent_socket;
         close(child_socket);
 
+        /* Do not hold on to the connections of other users */
+        guacd_proc_close_inherited_fds(parent_socket);
+
         /* Start protocol-specific handling */
         guacd_exec_proc(proc, protocol);
 
@@ -48,6 +48,15 @@
  */
 #define GUACD_CLIENT_FREE_TIMEOUT 5
 
+/**
+ * The maximum number of bytes which may be queued for writing to any one
+ * user before that user is considered to be lagging. Output to the owner of
+ * a connection is throttled once this limit is reached, while any other user
+ * exceeding this limit is disconnected, such that one slow connection cannot
+ * stall a shared session.
+ */
+#define GUACD_USER_QUEUE_LENGTH 8388608
+
 /**
  * Process information of the internal remote desktop client.
  */
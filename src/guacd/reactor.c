@@ -0,0 +1,638 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+#include "log.h"
+#include "reactor.h"
+
+#include <guacamole/error.h>
+#include <guacamole/socket.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+/**
+ * Data which has been read from one side of a relayed connection but not yet
+ * written to the other.
+ */
+typedef struct guacd_relay_buffer {
+
+    /**
+     * The buffered data. Only the bytes between start and end are valid.
+     */
+    char data[GUACD_REACTOR_BUFFER_SIZE];
+
+    /**
+     * The offset of the first byte which has not yet been written.
+     */
+    int start;
+
+    /**
+     * The offset of the byte after the last byte which has been read.
+     */
+    int end;
+
+    /**
+     * Non-zero if the side of the connection which fills this buffer has
+     * closed, zero otherwise.
+     */
+    int closed;
+
+    /**
+     * Non-zero if data read into this buffer should be discarded rather than
+     * written, as the side of the connection which drains this buffer can no
+     * longer be written, zero otherwise.
+     */
+    int discard;
+
+    /**
+     * Non-zero if no further data will be transferred through this buffer,
+     * either because all data has been transferred and the side of the
+     * connection which fills this buffer has closed, or because the side of
+     * the connection which drains this buffer can no longer be written. Zero
+     * otherwise.
+     */
+    int finished;
+
+} guacd_relay_buffer;
+
+/**
+ * A user connection being relayed by a reactor thread.
+ */
+typedef struct guacd_relay {
+
+    /**
+     * The guac_socket of the user's connection.
+     */
+    guac_socket* socket;
+
+    /**
+     * The file descriptor underlying the user's guac_socket.
+     */
+    int user_fd;
+
+    /**
+     * Non-zero if user_fd may be read and written directly, zero if all I/O
+     * must go through the user's guac_socket.
+     */
+    int direct;
+
+    /**
+     * The file descriptor which is being handled by a guac_socket within the
+     * client process.
+     */
+    int proc_fd;
+
+    /**
+     * Data read from the user which has not yet been written to the client
+     * process.
+     */
+    guacd_relay_buffer to_proc;
+
+    /**
+     * Data read from the client process which has not yet been written to
+     * the user.
+     */
+    guacd_relay_buffer to_user;
+
+} guacd_relay;
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/**
+ * Returns whether the most recent failed operation on the given relay failed
+ * only because it could not complete without blocking.
+ *
+ * @param relay
+ *     The relay on which the operation was attempted.
+ *
+ * @param direct
+ *     Non-zero if the operation was performed on a file descriptor directly,
+ *     zero if the operation was performed through the user's guac_socket.
+ *
+ * @return
+ *     Non-zero if the operation should be retried once the relevant file
+ *     descriptor is ready, zero otherwise.
+ */
+static int guacd_relay_would_block(guacd_relay* relay, int direct) {
+
+    if (direct)
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+
+    return guac_error == GUAC_STATUS_WOULD_BLOCK;
+
+}
+
+/**
+ * Reads as much data as will fit from the given side of a relayed connection
+ * into the given buffer, which must be empty.
+ *
+ * @param relay
+ *     The relay whose connection should be read.
+ *
+ * @param buffer
+ *     The buffer to read data into.
+ *
+ * @param from_user
+ *     Non-zero if data should be read from the user, zero if data should be
+ *     read from the client process.
+ *
+ * @return
+ *     Non-zero if any progress was made, including if that side of the
+ *     connection has been found to be closed, zero if no data could be read
+ *     without blocking.
+ */
+static int guacd_relay_fill(guacd_relay* relay, guacd_relay_buffer* buffer,
+        int from_user) {
+
+    int direct = !from_user || relay->direct;
+    int length;
+
+    if (!from_user)
+        length = read(relay->proc_fd, buffer->data, sizeof(buffer->data));
+    else if (relay->direct)
+        length = read(relay->user_fd, buffer->data, sizeof(buffer->data));
+    else
+        length = guac_socket_read(relay->socket, buffer->data,
+                sizeof(buffer->data));
+
+    /* Try again later if no data is available yet */
+    if (length < 0 && guacd_relay_would_block(relay, direct))
+        return 0;
+
+    /* Treat errors as closure of the connection */
+    if (length <= 0) {
+        buffer->closed = 1;
+        return 1;
+    }
+
+    buffer->start = 0;
+    buffer->end = length;
+    return 1;
+
+}
+
+/**
+ * Writes as much data as possible from the given buffer to the given side of
+ * a relayed connection.
+ *
+ * @param relay
+ *     The relay whose connection should be written.
+ *
+ * @param buffer
+ *     The buffer containing the data to write.
+ *
+ * @param to_user
+ *     Non-zero if data should be written to the user, zero if data should be
+ *     written to the client process.
+ *
+ * @return
+ *     Positive if any progress was made, zero if no data could be written
+ *     without blocking, or negative if the connection can no longer be
+ *     written.
+ */
+static int guacd_relay_drain(guacd_relay* relay, guacd_relay_buffer* buffer,
+        int to_user) {
+
+    int direct = !to_user || relay->direct;
+    int length = buffer->end - buffer->start;
+    int written;
+
+    /* Writes through the socket are all-or-nothing, and must be retried with
+     * the same arguments if they would block */
+    if (!direct) {
+        if (guac_socket_write(relay->socket, buffer->data + buffer->start,
+                    length))
+            return guacd_relay_would_block(relay, direct) ? 0 : -1;
+        written = length;
+    }
+
+    else {
+        written = write(to_user ? relay->user_fd : relay->proc_fd,
+                buffer->data + buffer->start, length);
+        if (written < 0)
+            return guacd_relay_would_block(relay, direct) ? 0 : -1;
+    }
+
+    buffer->start += written;
+    return 1;
+
+}
+
+/**
+ * Transfers data through one direction of a relayed connection until doing so
+ * would block.
+ *
+ * @param relay
+ *     The relay whose connection should be transferred.
+ *
+ * @param buffer
+ *     The buffer associated with the direction of transfer.
+ *
+ * @param to_user
+ *     Non-zero if data should be transferred from the client process to the
+ *     user, zero if data should be transferred from the user to the client
+ *     process.
+ *
+ * @return
+ *     Positive if any progress was made, zero if no progress could be made
+ *     without blocking, or negative if this direction of the connection is
+ *     finished.
+ */
+static int guacd_relay_transfer(guacd_relay* relay,
+        guacd_relay_buffer* buffer, int to_user) {
+
+    int progress = 0;
+
+    /* Nothing further can be transferred once finished */
+    if (buffer->finished)
+        return 0;
+
+    for (;;) {
+
+        /* Read more only once previously-read data has been written */
+        if (buffer->start == buffer->end) {
+
+            if (buffer->closed)
+                return -1;
+
+            if (!guacd_relay_fill(relay, buffer, !to_user))
+                return progress;
+
+            if (buffer->discard)
+                buffer->start = buffer->end;
+
+        }
+
+        else {
+
+            int result = guacd_relay_drain(relay, buffer, to_user);
+            if (result <= 0)
+                return result < 0 ? -1 : progress;
+
+        }
+
+        progress = 1;
+
+    }
+
+}
+
+/**
+ * Marks one direction of a relayed connection as finished, discarding any
+ * data which can no longer be written and shutting down the write side of the
+ * connection receiving that data, such that the receiving side sees the
+ * connection close while the other direction continues to be relayed.
+ *
+ * @param relay
+ *     The relay whose connection has finished in one direction.
+ *
+ * @param buffer
+ *     The buffer associated with the finished direction.
+ *
+ * @param to_user
+ *     Non-zero if the direction from the client process to the user has
+ *     finished, zero if the direction from the user to the client process has
+ *     finished.
+ */
+static void guacd_relay_finish(guacd_relay* relay,
+        guacd_relay_buffer* buffer, int to_user) {
+
+    buffer->start = buffer->end;
+
+    if (!to_user) {
+
+        /* Let the process see that the user's input has ended */
+        shutdown(relay->proc_fd, SHUT_WR);
+
+        /* If the process stopped accepting input before the user closed,
+         * continue reading and discarding the user's input until the user
+         * closes, as closing a connection with unread data resets that
+         * connection, possibly before the user receives the process's final
+         * output */
+        if (!buffer->closed && !buffer->discard) {
+            buffer->discard = 1;
+            return;
+        }
+
+        buffer->finished = 1;
+        return;
+
+    }
+
+    buffer->finished = 1;
+
+    /* Let the user see that the process's output has ended */
+    if (relay->direct) {
+        shutdown(relay->user_fd, SHUT_WR);
+        return;
+    }
+
+    /* An SSL/TLS session cannot be shut down in one direction only, and is
+     * instead shut down when the user's guac_socket is freed. As the process
+     * has no further output, nothing further from the user is relayed. */
+    relay->to_proc.start = relay->to_proc.end;
+    relay->to_proc.finished = 1;
+    shutdown(relay->proc_fd, SHUT_WR);
+
+}
+
+/**
+ * Transfers data through both directions of a relayed connection until doing
+ * so would block. Each direction is relayed until its source has closed and
+ * all of its data has been written, or until its destination can no longer be
+ * written, such that the final output of a client process still reaches the
+ * user even if the user's input can no longer be delivered.
+ *
+ * @param relay
+ *     The relay whose connection should be transferred.
+ *
+ * @return
+ *     Zero if the relay should continue to await events, non-zero if both
+ *     directions of the connection have finished and the relay should be
+ *     freed.
+ */
+static int guacd_relay_pump(guacd_relay* relay) {
+
+    int to_proc;
+    int to_user;
+
+    /* Data written in one direction may allow data to flow in the other
+     * (such as an SSL/TLS record which could not be written until another
+     * was read), so continue until neither direction makes progress */
+    do {
+
+        to_proc = guacd_relay_transfer(relay, &relay->to_proc, 0);
+        to_user = guacd_relay_transfer(relay, &relay->to_user, 1);
+
+        /* Continue relaying the other direction once one has finished */
+        if (to_proc < 0)
+            guacd_relay_finish(relay, &relay->to_proc, 0);
+
+        if (to_user < 0)
+            guacd_relay_finish(relay, &relay->to_user, 1);
+
+    } while (to_proc || to_user);
+
+    return relay->to_proc.finished && relay->to_user.finished;
+
+}
+
+/**
+ * Stops relaying the given connection, freeing the relay and closing both
+ * sides of the connection.
+ *
+ * @param thread
+ *     The reactor thread handling the relay.
+ *
+ * @param relay
+ *     The relay to free.
+ */
+static void guacd_relay_free(guacd_reactor_thread* thread,
+        guacd_relay* relay) {
+
+    epoll_ctl(thread->epoll_fd, EPOLL_CTL_DEL, relay->user_fd, NULL);
+    epoll_ctl(thread->epoll_fd, EPOLL_CTL_DEL, relay->proc_fd, NULL);
+
+    guac_socket_free(relay->socket);
+    close(relay->proc_fd);
+    free(relay);
+
+}
+
+/**
+ * Waits for and handles events for all connections assigned to a reactor
+ * thread, for as long as guacd is running.
+ *
+ * @param data
+ *     A pointer to the guacd_reactor_thread being run.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guacd_reactor_thread_run(void* data) {
+
+    guacd_reactor_thread* thread = (guacd_reactor_thread*) data;
+    struct epoll_event events[GUACD_REACTOR_MAX_EVENTS];
+
+    for (;;) {
+
+        int count = epoll_wait(thread->epoll_fd, events,
+                GUACD_REACTOR_MAX_EVENTS, -1);
+
+        if (count < 0) {
+
+            if (errno == EINTR)
+                continue;
+
+            guacd_log(GUAC_LOG_ERROR, "Reactor thread failed: %s",
+                    strerror(errno));
+            break;
+
+        }
+
+        pthread_mutex_lock(&thread->lock);
+
+        for (int i = 0; i < count; i++) {
+
+            guacd_relay* relay = (guacd_relay*) events[i].data.ptr;
+
+            /* Skip events for relays freed earlier within this batch */
+            if (relay == NULL || !guacd_relay_pump(relay))
+                continue;
+
+            /* Each relay may have one event per file descriptor */
+            for (int j = i + 1; j < count; j++) {
+                if (events[j].data.ptr == relay)
+                    events[j].data.ptr = NULL;
+            }
+
+            guacd_relay_free(thread, relay);
+
+        }
+
+        pthread_mutex_unlock(&thread->lock);
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Makes the given file descriptor non-blocking.
+ *
+ * @param fd
+ *     The file descriptor to modify.
+ *
+ * @return
+ *     Zero on success, non-zero if an error occurs.
+ */
+static int guacd_reactor_set_nonblocking(int fd) {
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+        return 1;
+
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0;
+
+}
+
+guacd_reactor* guacd_reactor_alloc(int thread_count) {
+
+    guacd_reactor* reactor = malloc(sizeof(guacd_reactor));
+    if (reactor == NULL)
+        return NULL;
+
+    reactor->threads = malloc(sizeof(guacd_reactor_thread) * thread_count);
+    if (reactor->threads == NULL) {
+        free(reactor);
+        return NULL;
+    }
+
+    reactor->thread_count = 0;
+    reactor->next_thread = 0;
+    pthread_mutex_init(&reactor->next_thread_lock, NULL);
+
+    /* Start each thread with its own epoll instance */
+    while (reactor->thread_count < thread_count) {
+
+        guacd_reactor_thread* thread =
+            &reactor->threads[reactor->thread_count];
+
+        thread->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (thread->epoll_fd < 0) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to create epoll instance: %s",
+                    strerror(errno));
+            break;
+        }
+
+        pthread_mutex_init(&thread->lock, NULL);
+
+        if (pthread_create(&thread->thread, NULL, guacd_reactor_thread_run,
+                    thread)) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to start reactor thread.");
+            pthread_mutex_destroy(&thread->lock);
+            close(thread->epoll_fd);
+            break;
+        }
+
+        pthread_detach(thread->thread);
+        reactor->thread_count++;
+
+    }
+
+    /* A reactor without threads cannot relay anything */
+    if (reactor->thread_count == 0) {
+        pthread_mutex_destroy(&reactor->next_thread_lock);
+        free(reactor->threads);
+        free(reactor);
+        return NULL;
+    }
+
+    return reactor;
+
+}
+
+int guacd_reactor_add(guacd_reactor* reactor, guac_socket* socket,
+        int user_fd, int direct, int proc_fd) {
+
+    /* All I/O performed by the reactor must be non-blocking */
+    if (guacd_reactor_set_nonblocking(user_fd)
+            || guacd_reactor_set_nonblocking(proc_fd)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to make file descriptors "
+                "non-blocking: %s", strerror(errno));
+        return 1;
+    }
+
+    guacd_relay* relay = calloc(1, sizeof(guacd_relay));
+    if (relay == NULL)
+        return 1;
+
+    relay->socket = socket;
+    relay->user_fd = user_fd;
+    relay->direct = direct;
+    relay->proc_fd = proc_fd;
+
+    /* Assign relays to threads in turn */
+    pthread_mutex_lock(&reactor->next_thread_lock);
+    guacd_reactor_thread* thread = &reactor->threads[reactor->next_thread];
+    reactor->next_thread = (reactor->next_thread + 1) % reactor->thread_count;
+    pthread_mutex_unlock(&reactor->next_thread_lock);
+
+    /* Events are edge-triggered, as the relay always transfers data until
+     * doing so would block */
+    struct epoll_event event = {
+        .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+        .data.ptr = relay
+    };
+
+    /* Events for the relay cannot be handled until both file descriptors are
+     * watched */
+    pthread_mutex_lock(&thread->lock);
+
+    if (epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, user_fd, &event)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to watch user connection: %s",
+                strerror(errno));
+        pthread_mutex_unlock(&thread->lock);
+        free(relay);
+        return 1;
+    }
+
+    if (epoll_ctl(thread->epoll_fd, EPOLL_CTL_ADD, proc_fd, &event)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to watch process connection: %s",
+                strerror(errno));
+        epoll_ctl(thread->epoll_fd, EPOLL_CTL_DEL, user_fd, NULL);
+        pthread_mutex_unlock(&thread->lock);
+        free(relay);
+        return 1;
+    }
+
+    /* The relay is now owned by the reactor thread */
+    pthread_mutex_unlock(&thread->lock);
+
+    return 0;
+
+}
+
+#else
+
+guacd_reactor* guacd_reactor_alloc(int thread_count) {
+    guacd_log(GUAC_LOG_ERROR, "Reactor threads are not supported on this "
+            "platform.");
+    return NULL;
+}
+
+int guacd_reactor_add(guacd_reactor* reactor, guac_socket* socket,
+        int user_fd, int direct, int proc_fd) {
+    return 1;
+}
+
+#endif
+
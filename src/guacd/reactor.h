@@ -0,0 +1,155 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUACD_REACTOR_H
+#define GUACD_REACTOR_H
+
+#include "config.h"
+
+#include <guacamole/socket.h>
+
+#include <pthread.h>
+
+/**
+ * The maximum number of threads which may be used by a single reactor.
+ */
+#define GUACD_REACTOR_MAX_THREADS 64
+
+/**
+ * The value of GUACD_REACTOR_MAX_THREADS as a string literal, for use within
+ * error messages.
+ */
+#define GUACD_REACTOR_MAX_THREADS_STR "64"
+
+/**
+ * The number of bytes which may be buffered in each direction for each user
+ * connection being relayed by a reactor.
+ */
+#define GUACD_REACTOR_BUFFER_SIZE 8192
+
+/**
+ * The maximum number of events handled by a reactor thread for each call to
+ * epoll_wait().
+ */
+#define GUACD_REACTOR_MAX_EVENTS 64
+
+/**
+ * A single thread of a guacd_reactor, waiting on its own epoll instance for
+ * events affecting the user connections assigned to it.
+ */
+typedef struct guacd_reactor_thread {
+
+    /**
+     * The file descriptor of the epoll instance used by this thread.
+     */
+    int epoll_fd;
+
+    /**
+     * The thread itself.
+     */
+    pthread_t thread;
+
+    /**
+     * Lock which is held while this thread handles events, and while new
+     * connections are being assigned to this thread, such that no connection
+     * is handled before it is completely assigned.
+     */
+    pthread_mutex_t lock;
+
+} guacd_reactor_thread;
+
+/**
+ * A fixed set of threads which together relay data between users and their
+ * client processes, replacing the pair of threads otherwise required for each
+ * user. All file descriptors handled by a reactor are non-blocking.
+ */
+typedef struct guacd_reactor {
+
+    /**
+     * The number of threads within this reactor.
+     */
+    int thread_count;
+
+    /**
+     * All threads within this reactor.
+     */
+    guacd_reactor_thread* threads;
+
+    /**
+     * The index of the thread which should be given the next user
+     * connection.
+     */
+    int next_thread;
+
+    /**
+     * Lock which guards access to next_thread.
+     */
+    pthread_mutex_t next_thread_lock;
+
+} guacd_reactor;
+
+/**
+ * Allocates a new reactor and starts all of its threads. As the threads of
+ * the reactor persist until guacd terminates, there is intended to be at most
+ * one reactor, created only after guacd has become a daemon.
+ *
+ * @param thread_count
+ *     The number of threads to start.
+ *
+ * @return
+ *     A newly-allocated reactor, or NULL if the reactor could not be created,
+ *     including if reactors are not supported on this platform.
+ */
+guacd_reactor* guacd_reactor_alloc(int thread_count);
+
+/**
+ * Begins relaying data between the given user socket and the given file
+ * descriptor of a client process using one of the reactor's threads. Both
+ * file descriptors are made non-blocking, and the socket, file descriptor,
+ * and any associated resources are freed automatically once either side of
+ * the connection has closed, unless the relay could not be started.
+ *
+ * @param reactor
+ *     The reactor which should relay the data.
+ *
+ * @param socket
+ *     The guac_socket of the user's connection.
+ *
+ * @param user_fd
+ *     The file descriptor underlying the given guac_socket.
+ *
+ * @param direct
+ *     Non-zero if all data read from or written to the given socket is read
+ *     from or written to its file descriptor unmodified, such that the file
+ *     descriptor may be read and written directly, zero if the socket must be
+ *     used (such as when SSL/TLS is in use).
+ *
+ * @param proc_fd
+ *     The file descriptor which is being handled by a guac_socket within the
+ *     client process.
+ *
+ * @return
+ *     Zero if relaying has started, non-zero otherwise.
+ */
+int guacd_reactor_add(guacd_reactor* reactor, guac_socket* socket,
+        int user_fd, int direct, int proc_fd);
+
+#endif
+
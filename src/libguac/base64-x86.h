@@ -0,0 +1,339 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+/*
+ * Vector implementations of base64 encoding and decoding for x86. This file
+ * is included by base64.c once for each supported instruction set, with
+ * GUAC_BASE64_X86_AVX2 defined to 1 for AVX2 and to 0 for SSSE3. Each
+ * inclusion defines __guac_base64_encode_blocks_<isa>() and
+ * __guac_base64_decode_blocks_<isa>(), compiled for that instruction set
+ * regardless of the instruction sets targeted by the rest of the build, such
+ * that the appropriate implementation can be selected at runtime.
+ *
+ * When encoding, each group of 12 bytes is rearranged such that each 32-bit
+ * lane contains one triplet, the four 6-bit values of each triplet are
+ * separated into their own bytes using multiplication as a variable shift,
+ * and each value is then translated to its character by adding an offset
+ * selected from a small lookup table. The offset table is indexed by a
+ * reduced form of each value: 13 for "A" through "Z", 0 for "a" through "z",
+ * 1 through 10 for "0" through "9", 11 for "+", and 12 for "/".
+ *
+ * When decoding, the high and low nibbles of each character are used to look
+ * up bitmasks of the character classes permitted for that nibble. A
+ * character is part of the base64 alphabet only if the two masks have no bit
+ * in common. Valid characters are then translated to their values by adding
+ * an offset selected by the high nibble, and each group of four values is
+ * packed into three bytes using multiply-add instructions.
+ */
+
+#if GUAC_BASE64_X86_AVX2
+
+#define GUAC_BASE64_TARGET __attribute__((target("avx2")))
+#define GUAC_BASE64_NAME(name) __guac_base64_##name##_avx2
+
+#define GUAC_BASE64_VECTOR __m256i
+
+#define GUAC_BASE64_VECTOR_INPUT 24
+#define GUAC_BASE64_VECTOR_READ  28
+#define GUAC_BASE64_VECTOR_OUTPUT 32
+#define GUAC_BASE64_DECODE_INPUT  32
+#define GUAC_BASE64_DECODE_OUTPUT 24
+#define GUAC_BASE64_LOAD(p)     _mm256_loadu_si256((const __m256i*) (p))
+#define GUAC_BASE64_LOAD_TRIPLETS(p)                                          \
+    _mm256_inserti128_si256(                                                  \
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) (p))),    \
+            _mm_loadu_si128((const __m128i*) ((p) + 12)), 1)
+#define GUAC_BASE64_STORE(p, v) _mm256_storeu_si256((__m256i*) (p), v)
+#define GUAC_BASE64_COMPACT(v)                                                \
+    _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7))
+#define GUAC_BASE64_IS_ZERO(v)                                                \
+    (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256())) == -1)
+#define GUAC_BASE64_SETR(...)   _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+#define GUAC_BASE64_SPLAT8(c)   _mm256_set1_epi8(c)
+#define GUAC_BASE64_SPLAT32(c)  _mm256_set1_epi32(c)
+#define GUAC_BASE64_SHUFFLE(a, b) _mm256_shuffle_epi8(a, b)
+#define GUAC_BASE64_AND(a, b)   _mm256_and_si256(a, b)
+#define GUAC_BASE64_OR(a, b)    _mm256_or_si256(a, b)
+#define GUAC_BASE64_ADD(a, b)   _mm256_add_epi8(a, b)
+#define GUAC_BASE64_SUBS(a, b)  _mm256_subs_epu8(a, b)
+#define GUAC_BASE64_GT(a, b)    _mm256_cmpgt_epi8(a, b)
+#define GUAC_BASE64_MULHI(a, b) _mm256_mulhi_epu16(a, b)
+#define GUAC_BASE64_MULLO(a, b) _mm256_mullo_epi16(a, b)
+#define GUAC_BASE64_EQ(a, b)    _mm256_cmpeq_epi8(a, b)
+#define GUAC_BASE64_SRLI32(v, n) _mm256_srli_epi32(v, n)
+#define GUAC_BASE64_MADDUBS(a, b) _mm256_maddubs_epi16(a, b)
+#define GUAC_BASE64_MADD(a, b)  _mm256_madd_epi16(a, b)
+
+#else
+
+#define GUAC_BASE64_TARGET __attribute__((target("ssse3")))
+#define GUAC_BASE64_NAME(name) __guac_base64_##name##_ssse3
+
+#define GUAC_BASE64_VECTOR __m128i
+
+#define GUAC_BASE64_VECTOR_INPUT 12
+#define GUAC_BASE64_VECTOR_READ  16
+#define GUAC_BASE64_VECTOR_OUTPUT 16
+#define GUAC_BASE64_DECODE_INPUT  16
+#define GUAC_BASE64_DECODE_OUTPUT 12
+#define GUAC_BASE64_LOAD(p)     _mm_loadu_si128((const __m128i*) (p))
+#define GUAC_BASE64_LOAD_TRIPLETS(p) GUAC_BASE64_LOAD(p)
+#define GUAC_BASE64_STORE(p, v) _mm_storeu_si128((__m128i*) (p), v)
+#define GUAC_BASE64_COMPACT(v)  (v)
+#define GUAC_BASE64_IS_ZERO(v)                                                \
+    (_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())) == 0xFFFF)
+#define GUAC_BASE64_SETR(...)   _mm_setr_epi8(__VA_ARGS__)
+#define GUAC_BASE64_SPLAT8(c)   _mm_set1_epi8(c)
+#define GUAC_BASE64_SPLAT32(c)  _mm_set1_epi32(c)
+#define GUAC_BASE64_SHUFFLE(a, b) _mm_shuffle_epi8(a, b)
+#define GUAC_BASE64_AND(a, b)   _mm_and_si128(a, b)
+#define GUAC_BASE64_OR(a, b)    _mm_or_si128(a, b)
+#define GUAC_BASE64_ADD(a, b)   _mm_add_epi8(a, b)
+#define GUAC_BASE64_SUBS(a, b)  _mm_subs_epu8(a, b)
+#define GUAC_BASE64_GT(a, b)    _mm_cmpgt_epi8(a, b)
+#define GUAC_BASE64_MULHI(a, b) _mm_mulhi_epu16(a, b)
+#define GUAC_BASE64_MULLO(a, b) _mm_mullo_epi16(a, b)
+#define GUAC_BASE64_EQ(a, b)    _mm_cmpeq_epi8(a, b)
+#define GUAC_BASE64_SRLI32(v, n) _mm_srli_epi32(v, n)
+#define GUAC_BASE64_MADDUBS(a, b) _mm_maddubs_epi16(a, b)
+#define GUAC_BASE64_MADD(a, b)  _mm_madd_epi16(a, b)
+
+#endif
+
+/**
+ * Encodes GUAC_BASE64_VECTOR_INPUT bytes as GUAC_BASE64_VECTOR_OUTPUT base64
+ * characters. GUAC_BASE64_VECTOR_READ bytes must be readable from the input
+ * buffer, though only the first GUAC_BASE64_VECTOR_INPUT bytes are encoded.
+ *
+ * @param input
+ *     The bytes to encode.
+ *
+ * @param output
+ *     The buffer which should receive the resulting characters.
+ */
+GUAC_BASE64_TARGET
+static void GUAC_BASE64_NAME(encode_vector)(const unsigned char* input,
+        char* output) {
+
+    /* Place each triplet within its own 32-bit lane as bytes B, A, C, B */
+    GUAC_BASE64_VECTOR value = GUAC_BASE64_SHUFFLE(GUAC_BASE64_LOAD_TRIPLETS(input),
+            GUAC_BASE64_SETR(1, 0, 2, 1, 4, 3, 5, 4,
+                             7, 6, 8, 7, 10, 9, 11, 10));
+
+    /* Shift the first and third values of each triplet into place */
+    GUAC_BASE64_VECTOR high = GUAC_BASE64_MULHI(
+            GUAC_BASE64_AND(value, GUAC_BASE64_SPLAT32(0x0FC0FC00)),
+            GUAC_BASE64_SPLAT32(0x04000040));
+
+    /* Shift the second and fourth values of each triplet into place */
+    GUAC_BASE64_VECTOR low = GUAC_BASE64_MULLO(
+            GUAC_BASE64_AND(value, GUAC_BASE64_SPLAT32(0x003F03F0)),
+            GUAC_BASE64_SPLAT32(0x01000010));
+
+    /* Each byte now contains exactly one 6-bit value */
+    GUAC_BASE64_VECTOR indices = GUAC_BASE64_OR(high, low);
+
+    /* Reduce each value to an index within the offset table */
+    GUAC_BASE64_VECTOR reduced = GUAC_BASE64_SUBS(indices,
+            GUAC_BASE64_SPLAT8(51));
+    GUAC_BASE64_VECTOR uppercase = GUAC_BASE64_GT(GUAC_BASE64_SPLAT8(26),
+            indices);
+    reduced = GUAC_BASE64_OR(reduced,
+            GUAC_BASE64_AND(uppercase, GUAC_BASE64_SPLAT8(13)));
+
+    /* Translate each value to its character */
+    GUAC_BASE64_VECTOR offsets = GUAC_BASE64_SHUFFLE(
+            GUAC_BASE64_SETR('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+                             '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                             '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                             '/' - 63, 'A', 0, 0),
+            reduced);
+
+    GUAC_BASE64_STORE(output, GUAC_BASE64_ADD(indices, offsets));
+
+}
+
+/**
+ * Decodes GUAC_BASE64_DECODE_INPUT base64 characters as
+ * GUAC_BASE64_DECODE_OUTPUT bytes, provided that all characters are part of
+ * the base64 alphabet. GUAC_BASE64_DECODE_INPUT bytes may be written to the
+ * output buffer, though only the first GUAC_BASE64_DECODE_OUTPUT bytes are
+ * meaningful. As all characters are read before any bytes are written, the
+ * output buffer may overlap the input buffer, so long as it does not begin
+ * after the input buffer.
+ *
+ * @param input
+ *     The base64 characters to decode.
+ *
+ * @param output
+ *     The buffer which should receive the resulting bytes.
+ *
+ * @return
+ *     Non-zero if the characters were decoded, zero if any character is not
+ *     part of the base64 alphabet, in which case nothing is written.
+ */
+GUAC_BASE64_TARGET
+static int GUAC_BASE64_NAME(decode_vector)(const char* input,
+        unsigned char* output) {
+
+    GUAC_BASE64_VECTOR value = GUAC_BASE64_LOAD(input);
+
+    GUAC_BASE64_VECTOR nibble = GUAC_BASE64_SPLAT8(0x0F);
+    GUAC_BASE64_VECTOR high = GUAC_BASE64_AND(GUAC_BASE64_SRLI32(value, 4),
+            nibble);
+    GUAC_BASE64_VECTOR low = GUAC_BASE64_AND(value, nibble);
+
+    /* Reject the entire group if any character is not part of the alphabet */
+    GUAC_BASE64_VECTOR invalid = GUAC_BASE64_AND(
+            GUAC_BASE64_SHUFFLE(
+                GUAC_BASE64_SETR(0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A,
+                                 0x1B, 0x1B, 0x1B, 0x1A), low),
+            GUAC_BASE64_SHUFFLE(
+                GUAC_BASE64_SETR(0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                 0x04, 0x08, 0x10, 0x10, 0x10, 0x10,
+                                 0x10, 0x10, 0x10, 0x10), high));
+
+    if (!GUAC_BASE64_IS_ZERO(invalid))
+        return 0;
+
+    /* Translate each character to its value, distinguishing "/" from "+" */
+    GUAC_BASE64_VECTOR slash = GUAC_BASE64_EQ(value,
+            GUAC_BASE64_SPLAT8('/'));
+    value = GUAC_BASE64_ADD(value, GUAC_BASE64_SHUFFLE(
+            GUAC_BASE64_SETR(0, 16, 19, 4, -65, -65, -71, -71,
+                             0, 0, 0, 0, 0, 0, 0, 0),
+            GUAC_BASE64_ADD(slash, high)));
+
+    /* Combine each group of four 6-bit values into one 24-bit value */
+    value = GUAC_BASE64_MADDUBS(value, GUAC_BASE64_SPLAT32(0x01400140));
+    value = GUAC_BASE64_MADD(value, GUAC_BASE64_SPLAT32(0x00011000));
+
+    /* Store the bytes of each 24-bit value contiguously, most significant
+     * byte first */
+    value = GUAC_BASE64_SHUFFLE(value,
+            GUAC_BASE64_SETR(2, 1, 0, 6, 5, 4, 10, 9,
+                             8, 14, 13, 12, -1, -1, -1, -1));
+
+    GUAC_BASE64_STORE(output, GUAC_BASE64_COMPACT(value));
+    return 1;
+
+}
+
+/**
+ * Encodes as many bytes as possible from the given buffer as base64 using
+ * vector instructions, GUAC_BASE64_VECTOR_INPUT bytes at a time. Any bytes
+ * remaining must be encoded separately.
+ *
+ * @param input
+ *     The bytes to encode.
+ *
+ * @param length
+ *     The number of bytes within the input buffer.
+ *
+ * @param output
+ *     The buffer which should receive the base64 characters.
+ *
+ * @return
+ *     The number of bytes encoded, which will be a multiple of
+ *     GUAC_BASE64_VECTOR_INPUT.
+ */
+GUAC_BASE64_TARGET
+static size_t GUAC_BASE64_NAME(encode_blocks)(const unsigned char* input,
+        size_t length, char* output) {
+
+    size_t encoded = 0;
+
+    while (length - encoded >= GUAC_BASE64_VECTOR_READ) {
+        GUAC_BASE64_NAME(encode_vector)(input + encoded, output);
+        encoded += GUAC_BASE64_VECTOR_INPUT;
+        output += GUAC_BASE64_VECTOR_OUTPUT;
+    }
+
+    return encoded;
+
+}
+
+/**
+ * Decodes as many characters as possible from the given base64 string using
+ * vector instructions, GUAC_BASE64_DECODE_INPUT characters at a time,
+ * stopping at the first group containing padding or invalid characters. Any
+ * characters remaining must be decoded separately.
+ *
+ * @param input
+ *     The base64 characters to decode.
+ *
+ * @param length
+ *     The number of characters within the base64 string.
+ *
+ * @param output
+ *     The buffer which should receive the resulting bytes. This buffer may
+ *     overlap the input buffer, so long as it does not begin after the input
+ *     buffer.
+ *
+ * @return
+ *     The number of characters decoded, which will be a multiple of
+ *     GUAC_BASE64_DECODE_INPUT.
+ */
+GUAC_BASE64_TARGET
+static size_t GUAC_BASE64_NAME(decode_blocks)(const char* input,
+        size_t length, unsigned char* output) {
+
+    size_t decoded = 0;
+
+    while (length - decoded >= GUAC_BASE64_DECODE_INPUT
+            && GUAC_BASE64_NAME(decode_vector)(input + decoded, output)) {
+        decoded += GUAC_BASE64_DECODE_INPUT;
+        output += GUAC_BASE64_DECODE_OUTPUT;
+    }
+
+    return decoded;
+
+}
+
+#undef GUAC_BASE64_ADD
+#undef GUAC_BASE64_AND
+#undef GUAC_BASE64_COMPACT
+#undef GUAC_BASE64_DECODE_INPUT
+#undef GUAC_BASE64_DECODE_OUTPUT
+#undef GUAC_BASE64_EQ
+#undef GUAC_BASE64_GT
+#undef GUAC_BASE64_IS_ZERO
+#undef GUAC_BASE64_LOAD
+#undef GUAC_BASE64_LOAD_TRIPLETS
+#undef GUAC_BASE64_MADD
+#undef GUAC_BASE64_MADDUBS
+#undef GUAC_BASE64_MULHI
+#undef GUAC_BASE64_MULLO
+#undef GUAC_BASE64_NAME
+#undef GUAC_BASE64_OR
+#undef GUAC_BASE64_SETR
+#undef GUAC_BASE64_SHUFFLE
+#undef GUAC_BASE64_SPLAT32
+#undef GUAC_BASE64_SPLAT8
+#undef GUAC_BASE64_SRLI32
+#undef GUAC_BASE64_STORE
+#undef GUAC_BASE64_SUBS
+#undef GUAC_BASE64_TARGET
+#undef GUAC_BASE64_VECTOR
+#undef GUAC_BASE64_VECTOR_INPUT
+#undef GUAC_BASE64_VECTOR_OUTPUT
+#undef GUAC_BASE64_VECTOR_READ
+
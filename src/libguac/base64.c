@@ -0,0 +1,463 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "base64.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GUAC_BASE64_X86
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define GUAC_BASE64_NEON
+#endif
+
+/**
+ * The instruction set selected with guac_base64_set_isa(), or
+ * GUAC_BASE64_ISA_AUTO if the best instruction set supported by the current
+ * CPU should be used.
+ */
+static guac_base64_isa __guac_base64_selected_isa = GUAC_BASE64_ISA_AUTO;
+
+/**
+ * The 64 characters of the base64 alphabet, in order of value.
+ */
+static const char __guac_base64_characters[65] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * The value of each of the first 128 possible characters of a base64
+ * string, indexed by character. Characters which are not part of the base64
+ * alphabet, including the "=" used for padding, have the value 0xFF.
+ */
+static const unsigned char __guac_base64_values[128] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12,
+    0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24,
+    0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30,
+    0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/**
+ * Encodes a single triplet of bytes as four base64 characters.
+ *
+ * @param input
+ *     The three bytes to encode.
+ *
+ * @param output
+ *     The buffer which should receive the four resulting characters.
+ */
+static void __guac_base64_encode_triplet(const unsigned char* input,
+        char* output) {
+
+    unsigned int a = input[0];
+    unsigned int b = input[1];
+    unsigned int c = input[2];
+
+    /* [AAAAAA] AABBBB BBBBCC CCCCCC */
+    output[0] = __guac_base64_characters[a >> 2];
+
+    /* AAAAAA [AABBBB] BBBBCC CCCCCC */
+    output[1] = __guac_base64_characters[((a & 0x03) << 4) | (b >> 4)];
+
+    /* AAAAAA AABBBB [BBBBCC] CCCCCC */
+    output[2] = __guac_base64_characters[((b & 0x0F) << 2) | (c >> 6)];
+
+    /* AAAAAA AABBBB BBBBCC [CCCCCC] */
+    output[3] = __guac_base64_characters[c & 0x3F];
+
+}
+
+#ifdef GUAC_BASE64_X86
+
+/* SSSE3 implementation */
+#define GUAC_BASE64_X86_AVX2 0
+#include "base64-x86.h"
+#undef GUAC_BASE64_X86_AVX2
+
+/* AVX2 implementation */
+#define GUAC_BASE64_X86_AVX2 1
+#include "base64-x86.h"
+#undef GUAC_BASE64_X86_AVX2
+
+#elif defined(GUAC_BASE64_NEON)
+
+#define GUAC_BASE64_VECTOR_INPUT 48
+#define GUAC_BASE64_VECTOR_READ  48
+#define GUAC_BASE64_VECTOR_OUTPUT 64
+#define GUAC_BASE64_DECODE_INPUT  64
+#define GUAC_BASE64_DECODE_OUTPUT 48
+
+/**
+ * Encodes GUAC_BASE64_VECTOR_INPUT bytes as GUAC_BASE64_VECTOR_OUTPUT base64
+ * characters. The bytes of each triplet are deinterleaved into separate
+ * vectors as they are loaded, such that each 6-bit value can be computed
+ * with simple shifts and translated with a single 64-byte table lookup.
+ *
+ * @param input
+ *     The bytes to encode.
+ *
+ * @param output
+ *     The buffer which should receive the resulting characters.
+ */
+static void __guac_base64_encode_vector(const unsigned char* input,
+        char* output) {
+
+    uint8x16x4_t table = vld1q_u8_x4(
+            (const uint8_t*) __guac_base64_characters);
+
+    uint8x16x3_t bytes = vld3q_u8(input);
+    uint8x16_t mask = vdupq_n_u8(0x3F);
+    uint8x16x4_t values;
+
+    values.val[0] = vshrq_n_u8(bytes.val[0], 2);
+    values.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(bytes.val[0], 4),
+                vshrq_n_u8(bytes.val[1], 4)), mask);
+    values.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(bytes.val[1], 2),
+                vshrq_n_u8(bytes.val[2], 6)), mask);
+    values.val[3] = vandq_u8(bytes.val[2], mask);
+
+    values.val[0] = vqtbl4q_u8(table, values.val[0]);
+    values.val[1] = vqtbl4q_u8(table, values.val[1]);
+    values.val[2] = vqtbl4q_u8(table, values.val[2]);
+    values.val[3] = vqtbl4q_u8(table, values.val[3]);
+
+    vst4q_u8((uint8_t*) output, values);
+
+}
+
+/**
+ * Decodes GUAC_BASE64_DECODE_INPUT base64 characters as
+ * GUAC_BASE64_DECODE_OUTPUT bytes, provided that all characters are part of
+ * the base64 alphabet. The characters of each group of four are
+ * deinterleaved into separate vectors as they are loaded, translated to
+ * their values with table lookups, and recombined with simple shifts. As all
+ * characters are read before any bytes are written, the output buffer may
+ * overlap the input buffer, so long as it does not begin after the input
+ * buffer.
+ *
+ * @param input
+ *     The base64 characters to decode.
+ *
+ * @param output
+ *     The buffer which should receive the resulting bytes.
+ *
+ * @return
+ *     Non-zero if the characters were decoded, zero if any character is not
+ *     part of the base64 alphabet, in which case nothing is written.
+ */
+static int __guac_base64_decode_vector(const char* input,
+        unsigned char* output) {
+
+    uint8x16x4_t low_table = vld1q_u8_x4(__guac_base64_values);
+    uint8x16x4_t high_table = vld1q_u8_x4(__guac_base64_values + 64);
+
+    uint8x16x4_t chars = vld4q_u8((const uint8_t*) input);
+    uint8x16x4_t values;
+    uint8x16x3_t bytes;
+
+    uint8x16_t invalid = vdupq_n_u8(0);
+
+    int i;
+    for (i = 0; i < 4; i++) {
+
+        uint8x16_t c = chars.val[i];
+
+        /* Look up characters 0 through 127 (out-of-range lookups are 0),
+         * marking all characters above 127 as invalid */
+        uint8x16_t value = vorrq_u8(
+                vorrq_u8(vqtbl4q_u8(low_table, c),
+                         vqtbl4q_u8(high_table, vsubq_u8(c, vdupq_n_u8(64)))),
+                vcgeq_u8(c, vdupq_n_u8(128)));
+
+        invalid = vorrq_u8(invalid, value);
+        values.val[i] = value;
+
+    }
+
+    /* Reject the entire group if any character is not part of the alphabet */
+    if (vmaxvq_u8(invalid) > 0x3F)
+        return 0;
+
+    bytes.val[0] = vorrq_u8(vshlq_n_u8(values.val[0], 2),
+            vshrq_n_u8(values.val[1], 4));
+    bytes.val[1] = vorrq_u8(vshlq_n_u8(values.val[1], 4),
+            vshrq_n_u8(values.val[2], 2));
+    bytes.val[2] = vorrq_u8(vshlq_n_u8(values.val[2], 6), values.val[3]);
+
+    vst3q_u8(output, bytes);
+    return 1;
+
+}
+
+/**
+ * Encodes as many bytes as possible from the given buffer as base64 using
+ * NEON instructions, GUAC_BASE64_VECTOR_INPUT bytes at a time. Any bytes
+ * remaining must be encoded separately.
+ *
+ * @param input
+ *     The bytes to encode.
+ *
+ * @param length
+ *     The number of bytes within the input buffer.
+ *
+ * @param output
+ *     The buffer which should receive the base64 characters.
+ *
+ * @return
+ *     The number of bytes encoded, which will be a multiple of
+ *     GUAC_BASE64_VECTOR_INPUT.
+ */
+static size_t __guac_base64_encode_blocks_neon(const unsigned char* input,
+        size_t length, char* output) {
+
+    size_t encoded = 0;
+
+    while (length - encoded >= GUAC_BASE64_VECTOR_READ) {
+        __guac_base64_encode_vector(input + encoded, output);
+        encoded += GUAC_BASE64_VECTOR_INPUT;
+        output += GUAC_BASE64_VECTOR_OUTPUT;
+    }
+
+    return encoded;
+
+}
+
+/**
+ * Decodes as many characters as possible from the given base64 string using
+ * NEON instructions, GUAC_BASE64_DECODE_INPUT characters at a time, stopping
+ * at the first group containing padding or invalid characters. Any
+ * characters remaining must be decoded separately.
+ *
+ * @param input
+ *     The base64 characters to decode.
+ *
+ * @param length
+ *     The number of characters within the base64 string.
+ *
+ * @param output
+ *     The buffer which should receive the resulting bytes. This buffer may
+ *     overlap the input buffer, so long as it does not begin after the input
+ *     buffer.
+ *
+ * @return
+ *     The number of characters decoded, which will be a multiple of
+ *     GUAC_BASE64_DECODE_INPUT.
+ */
+static size_t __guac_base64_decode_blocks_neon(const char* input,
+        size_t length, unsigned char* output) {
+
+    size_t decoded = 0;
+
+    while (length - decoded >= GUAC_BASE64_DECODE_INPUT
+            && __guac_base64_decode_vector(input + decoded, output)) {
+        decoded += GUAC_BASE64_DECODE_INPUT;
+        output += GUAC_BASE64_DECODE_OUTPUT;
+    }
+
+    return decoded;
+
+}
+
+#endif
+
+int guac_base64_isa_supported(guac_base64_isa isa) {
+
+    switch (isa) {
+
+        case GUAC_BASE64_ISA_AUTO:
+        case GUAC_BASE64_ISA_SCALAR:
+            return 1;
+
+#ifdef GUAC_BASE64_X86
+        case GUAC_BASE64_ISA_SSSE3:
+            return __builtin_cpu_supports("ssse3");
+
+        case GUAC_BASE64_ISA_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+
+#ifdef GUAC_BASE64_NEON
+        case GUAC_BASE64_ISA_NEON:
+            return 1;
+#endif
+
+        default:
+            return 0;
+
+    }
+
+}
+
+int guac_base64_set_isa(guac_base64_isa isa) {
+
+    if (!guac_base64_isa_supported(isa))
+        return 1;
+
+    __guac_base64_selected_isa = isa;
+    return 0;
+
+}
+
+/**
+ * Returns the instruction set which should be used to encode or decode
+ * base64. Unless a specific instruction set has been selected with
+ * guac_base64_set_isa(), this is the best instruction set supported by the
+ * current CPU.
+ *
+ * @return
+ *     The instruction set which should be used to encode or decode base64.
+ */
+static guac_base64_isa guac_base64_get_isa() {
+
+    if (__guac_base64_selected_isa != GUAC_BASE64_ISA_AUTO)
+        return __guac_base64_selected_isa;
+
+#if defined(GUAC_BASE64_X86)
+    if (__builtin_cpu_supports("avx2"))
+        return GUAC_BASE64_ISA_AVX2;
+
+    if (__builtin_cpu_supports("ssse3"))
+        return GUAC_BASE64_ISA_SSSE3;
+#elif defined(GUAC_BASE64_NEON)
+    return GUAC_BASE64_ISA_NEON;
+#endif
+
+    return GUAC_BASE64_ISA_SCALAR;
+
+}
+
+size_t guac_base64_encode(const unsigned char* input, size_t length,
+        char* output) {
+
+    const unsigned char* end = input + length;
+    size_t encoded = 0;
+
+    /* Encode as many bytes as possible using vector instructions */
+    switch (guac_base64_get_isa()) {
+
+#ifdef GUAC_BASE64_X86
+        case GUAC_BASE64_ISA_SSSE3:
+            encoded = __guac_base64_encode_blocks_ssse3(input, length, output);
+            break;
+
+        case GUAC_BASE64_ISA_AVX2:
+            encoded = __guac_base64_encode_blocks_avx2(input, length, output);
+            break;
+#endif
+
+#ifdef GUAC_BASE64_NEON
+        case GUAC_BASE64_ISA_NEON:
+            encoded = __guac_base64_encode_blocks_neon(input, length, output);
+            break;
+#endif
+
+        default:
+            break;
+
+    }
+
+    input += encoded;
+    char* current = output + encoded / 3 * 4;
+
+    /* Encode any remaining bytes one triplet at a time */
+    while (input < end) {
+        __guac_base64_encode_triplet(input, current);
+        input += 3;
+        current += 4;
+    }
+
+    return current - output;
+
+}
+
+size_t guac_base64_decode(char* base64, size_t length) {
+
+    const char* input = base64;
+    const char* end = base64 + length;
+    unsigned char* output = (unsigned char*) base64;
+
+    unsigned int value = 0;
+    int bits_read = 0;
+    size_t decoded = 0;
+
+    /* Decode as many characters as possible using vector instructions,
+     * stopping at the first group containing padding or invalid characters */
+    switch (guac_base64_get_isa()) {
+
+#ifdef GUAC_BASE64_X86
+        case GUAC_BASE64_ISA_SSSE3:
+            decoded = __guac_base64_decode_blocks_ssse3(input, length, output);
+            break;
+
+        case GUAC_BASE64_ISA_AVX2:
+            decoded = __guac_base64_decode_blocks_avx2(input, length, output);
+            break;
+#endif
+
+#ifdef GUAC_BASE64_NEON
+        case GUAC_BASE64_ISA_NEON:
+            decoded = __guac_base64_decode_blocks_neon(input, length, output);
+            break;
+#endif
+
+        default:
+            break;
+
+    }
+
+    input += decoded;
+    output += decoded / 4 * 3;
+
+    /* Decode any remaining characters individually */
+    while (input < end) {
+
+        unsigned char current = *(input++);
+
+        /* Stop at padding or at any character outside the alphabet */
+        if (current > 0x7F || __guac_base64_values[current] > 0x3F)
+            break;
+
+        /* Shift on the latest 6 bits */
+        value = (value << 6) | __guac_base64_values[current];
+        bits_read += 6;
+
+        /* If we have at least one byte, write out the latest whole byte */
+        if (bits_read >= 8) {
+            bits_read -= 8;
+            *(output++) = (value >> bits_read) & 0xFF;
+        }
+
+    }
+
+    return output - (unsigned char*) base64;
+
+}
+
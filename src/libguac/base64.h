@@ -0,0 +1,140 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_BASE64_H
+#define GUAC_BASE64_H
+
+#include <stddef.h>
+
+/**
+ * The instruction sets which may be used to encode and decode base64.
+ */
+typedef enum guac_base64_isa {
+
+    /**
+     * The best instruction set supported by both the compiler and the
+     * current CPU.
+     */
+    GUAC_BASE64_ISA_AUTO,
+
+    /**
+     * No vector instructions. Each triplet of bytes or each character is
+     * handled individually.
+     */
+    GUAC_BASE64_ISA_SCALAR,
+
+    /**
+     * The SSSE3 instructions of x86 processors.
+     */
+    GUAC_BASE64_ISA_SSSE3,
+
+    /**
+     * The AVX2 instructions of x86 processors.
+     */
+    GUAC_BASE64_ISA_AVX2,
+
+    /**
+     * The NEON instructions of 64-bit ARM processors.
+     */
+    GUAC_BASE64_ISA_NEON
+
+} guac_base64_isa;
+
+/**
+ * Returns whether the given instruction set may be used to encode and decode
+ * base64, being supported by both the compiler used to build libguac and the
+ * current CPU.
+ *
+ * @param isa
+ *     The instruction set to check.
+ *
+ * @return
+ *     Non-zero if the given instruction set is supported, zero otherwise.
+ */
+int guac_base64_isa_supported(guac_base64_isa isa);
+
+/**
+ * Forces all future calls to guac_base64_encode() and guac_base64_decode()
+ * to use the given instruction set, such as to verify that each
+ * implementation produces identical results. By default, the best
+ * instruction set supported by the current CPU is used.
+ *
+ * @param isa
+ *     The instruction set to use, or GUAC_BASE64_ISA_AUTO to restore the
+ *     default behavior.
+ *
+ * @return
+ *     Zero if the given instruction set will be used, non-zero if that
+ *     instruction set is not supported, in which case the instruction set
+ *     in use is unchanged.
+ */
+int guac_base64_set_isa(guac_base64_isa isa);
+
+/**
+ * Encodes the given buffer of bytes as base64, writing the resulting
+ * characters to the given output buffer. The length of the input buffer
+ * must be a multiple of 3, such that no padding is required. The output
+ * buffer must be large enough to contain (length / 3) * 4 characters. No
+ * null terminator is written.
+ *
+ * Where supported by the current CPU, large inputs are encoded using vector
+ * instructions (AVX2 or SSSE3 on x86, NEON on 64-bit ARM), with any
+ * remaining bytes encoded one triplet at a time.
+ *
+ * @param input
+ *     The bytes to encode.
+ *
+ * @param length
+ *     The number of bytes within the input buffer. This must be a multiple
+ *     of 3.
+ *
+ * @param output
+ *     The buffer which should receive the base64 characters.
+ *
+ * @return
+ *     The number of characters written to the output buffer.
+ */
+size_t guac_base64_encode(const unsigned char* input, size_t length,
+        char* output);
+
+/**
+ * Decodes the given base64 string in-place, stopping at the first character
+ * which is not part of the base64 alphabet, such as the "=" used for padding.
+ * Any characters decoded prior to that point are retained. The string need
+ * not be null-terminated.
+ *
+ * Where supported by the current CPU, large inputs are decoded and validated
+ * using vector instructions (AVX2 or SSSE3 on x86, NEON on 64-bit ARM), with
+ * any remaining characters decoded one at a time.
+ *
+ * @param base64
+ *     The base64 string to decode. The decoded bytes are written to the
+ *     beginning of this same buffer.
+ *
+ * @param length
+ *     The number of characters within the base64 string.
+ *
+ * @return
+ *     The number of bytes resulting from the decode operation.
+ */
+size_t guac_base64_decode(char* base64, size_t length);
+
+#endif
+
@@ -585,7 +585,7 @@ void guac_client_stream_png(guac_client* client, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/png", x, y);
 
     /* Write PNG data */
-    guac_png_write(socket, stream, surface);
+    guac_png_write(socket, stream, surface, NULL);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -628,7 +628,8 @@ void guac_client_stream_webp(guac_client* client, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/webp", x, y);
 
     /* Write WebP data */
-    guac_webp_write(socket, stream, surface, quality, lossless);
+    guac_webp_write(socket, stream, surface, quality, lossless,
+            GUAC_IMAGE_WEBP_DEFAULT_METHOD);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
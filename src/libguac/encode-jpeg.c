@@ -26,13 +26,182 @@
 #include "palette.h"
 
 #include <cairo/cairo.h>
+
+#ifdef ENABLE_TURBOJPEG
+#include <turbojpeg.h>
+#else
 #include <jpeglib.h>
+#endif
+
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_LIBPTHREAD
+
+/* PThread implementation of guac_jpeg_encoder_get() */
+
+static pthread_key_t  __guac_jpeg_encoder_key;
+static pthread_once_t __guac_jpeg_encoder_key_init = PTHREAD_ONCE_INIT;
+
+static void __guac_jpeg_encoder_free_pointer(void* encoder) {
+
+    /* Free encoder allocated to thread */
+    guac_jpeg_encoder_free((guac_jpeg_encoder*) encoder);
+
+}
+
+static void __guac_jpeg_encoder_alloc_key() {
+
+    /* Create key, destroy any allocated encoder on thread exit */
+    pthread_key_create(&__guac_jpeg_encoder_key,
+            __guac_jpeg_encoder_free_pointer);
+
+}
+
+guac_jpeg_encoder* guac_jpeg_encoder_get() {
+
+    /* Init encoder key, if not already initialized */
+    pthread_once(&__guac_jpeg_encoder_key_init, __guac_jpeg_encoder_alloc_key);
+
+    /* Retrieve thread-local encoder */
+    guac_jpeg_encoder* encoder =
+        (guac_jpeg_encoder*) pthread_getspecific(__guac_jpeg_encoder_key);
+
+    /* Allocate thread-local encoder if not already allocated */
+    if (encoder == NULL) {
+        encoder = guac_jpeg_encoder_alloc();
+        pthread_setspecific(__guac_jpeg_encoder_key, encoder);
+    }
+
+    return encoder;
+
+}
+
+#else
+
+/* Default (not-threadsafe) implementation */
+static guac_jpeg_encoder* __guac_jpeg_encoder_unsafe_storage = NULL;
+
+guac_jpeg_encoder* guac_jpeg_encoder_get() {
+
+    /* Allocate encoder if not already allocated */
+    if (__guac_jpeg_encoder_unsafe_storage == NULL)
+        __guac_jpeg_encoder_unsafe_storage = guac_jpeg_encoder_alloc();
+
+    return __guac_jpeg_encoder_unsafe_storage;
+
+}
+
+#endif
+
+#ifdef ENABLE_TURBOJPEG
+
+guac_jpeg_encoder* guac_jpeg_encoder_alloc() {
+
+    guac_jpeg_encoder* encoder = calloc(1, sizeof(guac_jpeg_encoder));
+    if (encoder == NULL)
+        return NULL;
+
+    /* Create TurboJPEG compressor */
+    encoder->handle = tjInitCompress();
+    if (encoder->handle == NULL) {
+        free(encoder);
+        return NULL;
+    }
+
+    return encoder;
+
+}
+
+void guac_jpeg_encoder_free(guac_jpeg_encoder* encoder) {
+
+    if (encoder == NULL)
+        return;
+
+    tjDestroy(encoder->handle);
+    tjFree(encoder->buffer);
+    free(encoder);
+
+}
+
+int guac_jpeg_encoder_write(guac_jpeg_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface, int quality) {
+
+    /* Get image surface properties and data */
+    cairo_format_t format = cairo_image_surface_get_format(surface);
+
+    if (format != CAIRO_FORMAT_RGB24) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message =
+            "Invalid Cairo image format. Unable to create JPEG.";
+        return -1;
+    }
+
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char* data = cairo_image_surface_get_data(surface);
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(surface);
+
+    /* Grow output buffer to the worst-case compressed size, if necessary,
+     * such that TurboJPEG never needs to reallocate it */
+    unsigned long required = tjBufSize(width, height, TJSAMP_420);
+    if (required > encoder->buffer_size) {
+
+        tjFree(encoder->buffer);
+        encoder->buffer = tjAlloc(required);
+
+        if (encoder->buffer == NULL) {
+            encoder->buffer_size = 0;
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Unable to allocate JPEG output buffer.";
+            return -1;
+        }
+
+        encoder->buffer_size = required;
+
+    }
+
+    /* Compress BGRX surface contents directly, without conversion */
+    unsigned char* jpeg = encoder->buffer;
+    unsigned long jpeg_size = encoder->buffer_size;
+    if (tjCompress2(encoder->handle, data, width, stride, height, TJPF_BGRX,
+                &jpeg, &jpeg_size, TJSAMP_420, quality,
+                TJFLAG_FASTDCT | TJFLAG_NOREALLOC)) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "TurboJPEG compression failed.";
+        return -1;
+    }
+
+    /* Send compressed image as blobs */
+    unsigned char* current = jpeg;
+    while (jpeg_size > 0) {
+
+        unsigned long block_size = jpeg_size;
+        if (block_size > GUAC_PROTOCOL_BLOB_MAX_LENGTH)
+            block_size = GUAC_PROTOCOL_BLOB_MAX_LENGTH;
+
+        guac_protocol_send_blob(socket, stream, current, block_size);
+
+        current += block_size;
+        jpeg_size -= block_size;
+
+    }
+
+    return 0;
+
+}
+
+#else
+
 /**
  * Extended version of the standard libjpeg jpeg_destination_mgr struct, which
  * provides access to the pointers to the output buffer and size. The values
@@ -164,8 +333,33 @@ static void jpeg_guac_dest(j_compress_ptr cinfo, guac_socket* socket,
 
 }
 
-int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface, int quality) {
+guac_jpeg_encoder* guac_jpeg_encoder_alloc() {
+
+    guac_jpeg_encoder* encoder = calloc(1, sizeof(guac_jpeg_encoder));
+    if (encoder == NULL)
+        return NULL;
+
+    /* Create compressor, which is reused for all images */
+    encoder->cinfo.err = jpeg_std_error(&encoder->jerr);
+    jpeg_create_compress(&encoder->cinfo);
+
+    return encoder;
+
+}
+
+void guac_jpeg_encoder_free(guac_jpeg_encoder* encoder) {
+
+    if (encoder == NULL)
+        return;
+
+    jpeg_destroy_compress(&encoder->cinfo);
+    free(encoder->scanline);
+    free(encoder);
+
+}
+
+int guac_jpeg_encoder_write(guac_jpeg_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface, int quality) {
 
     /* Get image surface properties and data */
     cairo_format_t format = cairo_image_surface_get_format(surface);
@@ -185,48 +379,64 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
-    /* Prepare JPEG bits */
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
+    j_compress_ptr cinfo = &encoder->cinfo;
 
     /* Write JPEG directly to given stream */
-    jpeg_guac_dest(&cinfo, socket, stream);
+    jpeg_guac_dest(cinfo, socket, stream);
 
-    cinfo.image_width = width; /* image width and height, in pixels */
-    cinfo.image_height = height;
-    cinfo.arith_code = TRUE;
+    cinfo->image_width = width; /* image width and height, in pixels */
+    cinfo->image_height = height;
 
 #ifdef JCS_EXTENSIONS
     /* The Turbo JPEG extentions allows us to use the Cairo surface
      * (BGRx) as input without converting it */
-    cinfo.input_components = 4;
-    cinfo.in_color_space = JCS_EXT_BGRX;
+    cinfo->input_components = 4;
+    cinfo->in_color_space = JCS_EXT_BGRX;
 #else
     /* Standard JPEG supports RGB as input so we will have to convert
      * the contents of the Cairo surface from (BGRx) to RGB */
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-
-    /* Create a buffer for the write scan line which is where we will
-     * put the converted pixels (BGRx -> RGB) */
-    int write_stride = cinfo.image_width * cinfo.input_components;
-    unsigned char *scanline_data = malloc(write_stride);
-    memset(scanline_data, 0, write_stride);
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_RGB;
+
+    /* Grow the buffer for the write scan line, which is where we will
+     * put the converted pixels (BGRx -> RGB), if necessary */
+    size_t write_stride = (size_t) width * cinfo->input_components;
+    if (write_stride > encoder->scanline_size) {
+
+        free(encoder->scanline);
+        encoder->scanline = malloc(write_stride);
+
+        if (encoder->scanline == NULL) {
+            encoder->scanline_size = 0;
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Unable to allocate JPEG scanline buffer.";
+            return -1;
+        }
+
+        encoder->scanline_size = write_stride;
+
+    }
+
+    unsigned char* scanline_data = encoder->scanline;
 #endif
 
     /* Initialize the JPEG compressor */
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
-    jpeg_start_compress(&cinfo, TRUE);
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+
+    /* Subsample chroma 2x2 (4:2:0) and use the fast integer DCT */
+    cinfo->comp_info[0].h_samp_factor = 2;
+    cinfo->comp_info[0].v_samp_factor = 2;
+    cinfo->dct_method = JDCT_IFAST;
+
+    jpeg_start_compress(cinfo, TRUE);
 
     JSAMPROW row_pointer[1]; /* pointer to a single row */
 
     /* Write scanlines to be used in JPEG compression */
-    while (cinfo.next_scanline < cinfo.image_height) {
+    while (cinfo->next_scanline < cinfo->image_height) {
 
-        int row_offset = stride * cinfo.next_scanline;
+        int row_offset = stride * cinfo->next_scanline;
 
 #ifdef JCS_EXTENSIONS
         /* In Turbo JPEG we can use the raw BGRx scanline  */
@@ -250,19 +460,28 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         row_pointer[0] = scanline_data;
 #endif
 
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        jpeg_write_scanlines(cinfo, row_pointer, 1);
     }
 
-#ifndef JCS_EXTENSIONS
-    free(scanline_data);
+    /* Finalize compression, leaving the compressor ready for reuse */
+    jpeg_finish_compress(cinfo);
+    return 0;
+
+}
+
 #endif
 
-    /* Finalize compression */
-    jpeg_finish_compress(&cinfo);
+int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality) {
 
-    /* Clean up */
-    jpeg_destroy_compress(&cinfo);
-    return 0;
+    guac_jpeg_encoder* encoder = guac_jpeg_encoder_get();
+    if (encoder == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate JPEG encoder.";
+        return -1;
+    }
+
+    return guac_jpeg_encoder_write(encoder, socket, stream, surface, quality);
 
 }
 
@@ -27,8 +27,122 @@
 
 #include <cairo/cairo.h>
 
+#ifdef ENABLE_TURBOJPEG
+#include <turbojpeg.h>
+#else
+#include <stdio.h> /* Required by jpeglib.h */
+#include <jpeglib.h>
+#endif
+
+#include <stddef.h>
+
+/**
+ * A reusable JPEG encoder, holding the compressor state and buffers which are
+ * retained between images. An encoder may only be used by one thread at a
+ * time.
+ */
+typedef struct guac_jpeg_encoder {
+
+#ifdef ENABLE_TURBOJPEG
+    /**
+     * The TurboJPEG compressor instance.
+     */
+    tjhandle handle;
+
+    /**
+     * Buffer receiving the compressed JPEG data, allocated with tjAlloc().
+     * This buffer is always large enough to hold the worst-case compressed
+     * size of the last image encoded.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The number of bytes allocated for the output buffer.
+     */
+    unsigned long buffer_size;
+#else
+    /**
+     * The libjpeg compression structure. The destination manager of this
+     * structure is allocated from the permanent pool the first time the
+     * encoder is used and reused thereafter.
+     */
+    struct jpeg_compress_struct cinfo;
+
+    /**
+     * The libjpeg error manager associated with the compression structure.
+     */
+    struct jpeg_error_mgr jerr;
+
+    /**
+     * Buffer holding the converted contents of the scanline currently being
+     * written, if the libjpeg in use cannot accept BGRX scanlines directly.
+     */
+    unsigned char* scanline;
+
+    /**
+     * The number of bytes allocated for the scanline buffer.
+     */
+    size_t scanline_size;
+#endif
+
+} guac_jpeg_encoder;
+
+/**
+ * Allocates a new JPEG encoder.
+ *
+ * @return
+ *     A newly-allocated JPEG encoder, or NULL if allocation fails.
+ */
+guac_jpeg_encoder* guac_jpeg_encoder_alloc();
+
+/**
+ * Frees the given JPEG encoder and all buffers associated with it.
+ *
+ * @param encoder
+ *     The JPEG encoder to free.
+ */
+void guac_jpeg_encoder_free(guac_jpeg_encoder* encoder);
+
+/**
+ * Returns the JPEG encoder of the calling thread, allocating that encoder if
+ * necessary. The encoder is freed automatically when the thread exits.
+ *
+ * @return
+ *     The JPEG encoder of the calling thread, or NULL if the encoder could
+ *     not be allocated.
+ */
+guac_jpeg_encoder* guac_jpeg_encoder_get();
+
+/**
+ * Encodes the given surface as a JPEG using the given encoder, and sends the
+ * resulting data over the given stream and socket as blobs. Chroma is
+ * subsampled 2x2 (4:2:0) and the fast integer DCT is used, as images sent as
+ * JPEG are typically large and frequently updated.
+ *
+ * @param encoder
+ *     The encoder to use.
+ *
+ * @param socket
+ *     The socket to send JPEG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as JPEG blobs.
+ *
+ * @param quality
+ *     JPEG image quality.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_jpeg_encoder_write(guac_jpeg_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface, int quality);
+
 /**
- * Encodes the given surface as a JPEG, and sends the resulting data over the
+ * Encodes the given surface as a JPEG using the JPEG encoder of the calling
+ * thread, and sends the resulting data over the
  * given stream and socket as blobs.
  *
  * @param socket
@@ -21,12 +21,14 @@
 
 #include "encode-png.h"
 #include "guacamole/error.h"
+#include "guacamole/image.h"
 #include "guacamole/protocol.h"
 #include "guacamole/stream.h"
 #include "palette.h"
 
 #include <png.h>
 #include <cairo/cairo.h>
+#include <zlib.h>
 
 #ifdef HAVE_PNGSTRUCT_H
 #include <pngstruct.h>
@@ -34,10 +36,15 @@
 
 #include <inttypes.h>
 #include <setjmp.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
 /**
  * Data describing the current write state of PNG data.
  */
@@ -132,79 +139,6 @@ static void guac_png_write_data(guac_png_write_state* write_state,
 
 }
 
-/**
- * Writes the given buffer of PNG data to the buffer of the given write state,
- * flushing that buffer to blob instructions if necessary. This handler is
- * called by Cairo when writing PNG data via
- * cairo_surface_write_to_png_stream().
- *
- * @param closure
- *     Pointer to arbitrary data passed to cairo_surface_write_to_png_stream().
- *     In the case of this handler, this data will be the guac_png_write_state.
- *
- * @param data
- *     The buffer of PNG data to write.
- * 
- * @param length
- *     The size of the given buffer, in bytes.
- *
- * @return
- *     A Cairo status code indicating whether the write operation succeeded.
- *     In the case of this handler, this will always be CAIRO_STATUS_SUCCESS.
- */
-static cairo_status_t guac_png_cairo_write_handler(void* closure,
-        const unsigned char* data, unsigned int length) {
-
-    guac_png_write_state* write_state = (guac_png_write_state*) closure;
-
-    /* Append data to buffer, writing as necessary */
-    guac_png_write_data(write_state, data, length);
-
-    return CAIRO_STATUS_SUCCESS;
-
-}
-
-/**
- * Implementation of guac_png_write() which uses Cairo's own PNG encoder to
- * write PNG data, rather than using libpng directly.
- *
- * @param socket
- *     The socket to send PNG blobs over.
- *
- * @param stream
- *     The stream to associate with each blob.
- *
- * @param surface
- *     The Cairo surface to write to the given stream and socket as PNG blobs.
- *
- * @return
- *     Zero if the encoding operation is successful, non-zero otherwise.
- */
-static int guac_png_cairo_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface) {
-
-    guac_png_write_state write_state;
-
-    /* Init write state */
-    write_state.socket = socket;
-    write_state.stream = stream;
-    write_state.buffer_size = 0;
-
-    /* Write surface as PNG */
-    if (cairo_surface_write_to_png_stream(surface,
-                guac_png_cairo_write_handler,
-                &write_state) != CAIRO_STATUS_SUCCESS) {
-        guac_error = GUAC_STATUS_INTERNAL_ERROR;
-        guac_error_message = "Cairo PNG backend failed";
-        return -1;
-    }
-
-    /* Flush remaining PNG data */
-    guac_png_flush_data(&write_state);
-    return 0;
-
-}
-
 /**
  * Writes the given buffer of PNG data to the buffer of the given write state,
  * flushing that buffer to blob instructions if necessary. This handler is
@@ -265,15 +199,262 @@ static void guac_png_flush_handler(png_structp png) {
 
 }
 
-int guac_png_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface) {
+
+#ifdef HAVE_LIBPTHREAD
+
+/* PThread implementation of guac_png_encoder_get() */
+
+static pthread_key_t  __guac_png_encoder_key;
+static pthread_once_t __guac_png_encoder_key_init = PTHREAD_ONCE_INIT;
+
+static void __guac_png_encoder_free_pointer(void* encoder) {
+
+    /* Free encoder allocated to thread */
+    guac_png_encoder_free((guac_png_encoder*) encoder);
+
+}
+
+static void __guac_png_encoder_alloc_key() {
+
+    /* Create key, destroy any allocated encoder on thread exit */
+    pthread_key_create(&__guac_png_encoder_key,
+            __guac_png_encoder_free_pointer);
+
+}
+
+guac_png_encoder* guac_png_encoder_get() {
+
+    /* Init encoder key, if not already initialized */
+    pthread_once(&__guac_png_encoder_key_init, __guac_png_encoder_alloc_key);
+
+    /* Retrieve thread-local encoder */
+    guac_png_encoder* encoder =
+        (guac_png_encoder*) pthread_getspecific(__guac_png_encoder_key);
+
+    /* Allocate thread-local encoder if not already allocated */
+    if (encoder == NULL) {
+        encoder = guac_png_encoder_alloc();
+        pthread_setspecific(__guac_png_encoder_key, encoder);
+    }
+
+    return encoder;
+
+}
+
+#else
+
+/* Default (not-threadsafe) implementation */
+static guac_png_encoder* __guac_png_encoder_unsafe_storage = NULL;
+
+guac_png_encoder* guac_png_encoder_get() {
+
+    /* Allocate encoder if not already allocated */
+    if (__guac_png_encoder_unsafe_storage == NULL)
+        __guac_png_encoder_unsafe_storage = guac_png_encoder_alloc();
+
+    return __guac_png_encoder_unsafe_storage;
+
+}
+
+#endif
+
+guac_png_encoder* guac_png_encoder_alloc() {
+
+    guac_png_encoder* encoder = calloc(1, sizeof(guac_png_encoder));
+    if (encoder == NULL)
+        return NULL;
+
+    /* Use libpng defaults until tuned */
+    encoder->level = Z_DEFAULT_COMPRESSION;
+    encoder->strategy = Z_FILTERED;
+    encoder->filters = PNG_ALL_FILTERS;
+
+    return encoder;
+
+}
+
+void guac_png_encoder_free(guac_png_encoder* encoder) {
+    free(encoder->row);
+    free(encoder);
+}
+
+void guac_png_encoder_tune(guac_png_encoder* encoder,
+        const guac_image_analysis* analysis, int alpha) {
+
+    /* Filtering only harms palette images, which compress well as-is */
+    if (!alpha && analysis->palette_size != 0) {
+        encoder->level = GUAC_PNG_PALETTE_LEVEL;
+        encoder->strategy = Z_DEFAULT_STRATEGY;
+        encoder->filters = PNG_FILTER_NONE;
+    }
+
+    /* Long runs of identical pixels (text, user interface elements, etc.)
+     * become runs of zeroes once filtered, which are cheaply found by
+     * run-length encoding */
+    else if (analysis->num_same
+            >= analysis->num_different * GUAC_PNG_FLAT_RATIO) {
+        encoder->level = GUAC_PNG_FLAT_LEVEL;
+        encoder->strategy = Z_RLE;
+        encoder->filters = PNG_FILTER_SUB;
+    }
+
+    /* Everything else (photos, gradients, etc.) benefits from prediction */
+    else {
+        encoder->level = GUAC_PNG_DETAILED_LEVEL;
+        encoder->strategy = Z_FILTERED;
+        encoder->filters = PNG_FILTER_SUB | PNG_FILTER_PAETH;
+    }
+
+}
+
+/**
+ * Returns the row buffer of the given encoder, expanding that buffer as
+ * necessary to hold at least the given number of bytes.
+ *
+ * @param encoder
+ *     The encoder whose row buffer should be returned.
+ *
+ * @param size
+ *     The number of bytes required.
+ *
+ * @return
+ *     The row buffer of the given encoder, or NULL if the buffer could not
+ *     be expanded.
+ */
+static unsigned char* guac_png_encoder_get_row(guac_png_encoder* encoder,
+        size_t size) {
+
+    /* Expand buffer only if necessary */
+    if (size > encoder->row_size) {
+
+        unsigned char* row = realloc(encoder->row, size);
+        if (row == NULL)
+            return NULL;
+
+        encoder->row = row;
+        encoder->row_size = size;
+
+    }
+
+    return encoder->row;
+
+}
+
+/**
+ * Converts a row of 32-bit RGB pixels to palette indices.
+ *
+ * @param palette
+ *     The palette containing every color within the row.
+ *
+ * @param src
+ *     The row of pixels to convert.
+ *
+ * @param dst
+ *     The buffer which should receive one palette index per pixel.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ */
+static void guac_png_convert_row_palette(guac_palette* palette,
+        const uint32_t* src, png_byte* dst, int width) {
+
+    int last_color = -1;
+    int last_index = 0;
+
+    for (int x = 0; x < width; x++) {
+
+        /* Get pixel color */
+        int color = src[x] & 0xFFFFFF;
+
+        /* Look up index only if not part of a run of the same color */
+        if (color != last_color) {
+            last_index = guac_palette_find(palette, color);
+            last_color = color;
+        }
+
+        /* Set index in row */
+        dst[x] = last_index;
+
+    }
+
+}
+
+/**
+ * Converts a row of 32-bit RGB pixels to 24-bit RGB, as required by PNG.
+ *
+ * @param src
+ *     The row of pixels to convert.
+ *
+ * @param dst
+ *     The buffer which should receive three bytes per pixel.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ */
+static void guac_png_convert_row_rgb(const uint32_t* src, png_byte* dst,
+        int width) {
+
+    for (int x = 0; x < width; x++) {
+
+        uint32_t color = src[x];
+
+        *(dst++) = (color >> 16) & 0xFF;
+        *(dst++) = (color >> 8)  & 0xFF;
+        *(dst++) =  color        & 0xFF;
+
+    }
+
+}
+
+/**
+ * Converts a row of 32-bit premultiplied ARGB pixels to 32-bit
+ * non-premultiplied RGBA, as required by PNG.
+ *
+ * @param src
+ *     The row of pixels to convert.
+ *
+ * @param dst
+ *     The buffer which should receive four bytes per pixel.
+ *
+ * @param width
+ *     The number of pixels in the row.
+ */
+static void guac_png_convert_row_rgba(const uint32_t* src, png_byte* dst,
+        int width) {
+
+    for (int x = 0; x < width; x++) {
+
+        uint32_t color = src[x];
+        unsigned int alpha = color >> 24;
+
+        /* Fully-transparent pixels have no meaningful color */
+        if (alpha == 0) {
+            *(dst++) = 0;
+            *(dst++) = 0;
+            *(dst++) = 0;
+            *(dst++) = 0;
+            continue;
+        }
+
+        /* Undo premultiplication, rounding to nearest */
+        *(dst++) = (((color >> 16) & 0xFF) * 255 + alpha / 2) / alpha;
+        *(dst++) = (((color >> 8)  & 0xFF) * 255 + alpha / 2) / alpha;
+        *(dst++) = (( color        & 0xFF) * 255 + alpha / 2) / alpha;
+        *(dst++) = alpha;
+
+    }
+
+}
+
+int guac_png_encoder_write(guac_png_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface,
+        const guac_image_analysis* analysis) {
 
     png_structp png;
     png_infop png_info;
-    png_byte** png_rows;
+    int color_type;
     int bpp;
-
-    int x, y;
+    int channels;
 
     guac_png_write_state write_state;
 
@@ -284,25 +465,53 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
     int stride = cairo_image_surface_get_stride(surface);
     unsigned char* data = cairo_image_surface_get_data(surface);
 
-    /* If not RGB24, use Cairo PNG writer */
-    if (format != CAIRO_FORMAT_RGB24 || data == NULL)
-        return guac_png_cairo_write(socket, stream, surface);
+    if ((format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_ARGB32)
+            || data == NULL) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "Invalid Cairo image format. Unable to create PNG.";
+        return -1;
+    }
 
-    /* Flush pending operations to surface */
-    cairo_surface_flush(surface);
+    /* Alpha channel is needed only if image is actually transparent */
+    int alpha = (format == CAIRO_FORMAT_ARGB32 && !analysis->opaque);
+
+    /* Build palette if the image has few enough colors */
+    guac_palette* palette = NULL;
+    if (!alpha && analysis->palette_size != 0)
+        palette = guac_palette_alloc(analysis->palette,
+                analysis->palette_size);
 
-    /* Attempt to build palette */
-    guac_palette* palette = guac_palette_alloc(surface);
+    /* Use palette if possible, falling back to truecolor */
+    if (palette != NULL) {
 
-    /* If not possible, resort to Cairo PNG writer */
-    if (palette == NULL)
-        return guac_png_cairo_write(socket, stream, surface);
+        color_type = PNG_COLOR_TYPE_PALETTE;
+        channels = 1;
 
-    /* Calculate BPP from palette size */
-    if      (palette->size <= 2)  bpp = 1;
-    else if (palette->size <= 4)  bpp = 2;
-    else if (palette->size <= 16) bpp = 4;
-    else                          bpp = 8;
+        /* Calculate BPP from palette size */
+        if      (palette->size <= 2)  bpp = 1;
+        else if (palette->size <= 4)  bpp = 2;
+        else if (palette->size <= 16) bpp = 4;
+        else                          bpp = 8;
+
+    }
+    else if (alpha) {
+        color_type = PNG_COLOR_TYPE_RGB_ALPHA;
+        channels = 4;
+        bpp = 8;
+    }
+    else {
+        color_type = PNG_COLOR_TYPE_RGB;
+        channels = 3;
+        bpp = 8;
+    }
+
+    /* Ensure row buffer is large enough for converted rows */
+    if (guac_png_encoder_get_row(encoder, (size_t) width * channels) == NULL) {
+        guac_palette_free(palette);
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate PNG row buffer";
+        return -1;
+    }
 
     /* Set up PNG writer */
     png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -341,29 +550,10 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
             guac_png_write_handler,
             guac_png_flush_handler);
 
-    /* Copy data from surface into PNG data */
-    png_rows = (png_byte**) malloc(sizeof(png_byte*) * height);
-    for (y=0; y<height; y++) {
-
-        /* Allocate new PNG row */
-        png_byte* row = (png_byte*) malloc(sizeof(png_byte) * width);
-        png_rows[y] = row;
-
-        /* Copy data from surface into current row */
-        for (x=0; x<width; x++) {
-
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
-
-            /* Set index in row */
-            row[x] = guac_palette_find(palette, color);
-
-        }
-
-        /* Advance to next data row */
-        data += stride;
-
-    }
+    /* Apply compression parameters */
+    png_set_compression_level(png, encoder->level);
+    png_set_compression_strategy(png, encoder->strategy);
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, encoder->filters);
 
     /* Write image info */
     png_set_IHDR(
@@ -372,33 +562,111 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
         width,
         height,
         bpp,
-        PNG_COLOR_TYPE_PALETTE,
+        color_type,
         PNG_INTERLACE_NONE,
         PNG_COMPRESSION_TYPE_DEFAULT,
         PNG_FILTER_TYPE_DEFAULT
     );
 
     /* Write palette */
-    png_set_PLTE(png, png_info, palette->colors, palette->size);
+    if (palette != NULL)
+        png_set_PLTE(png, png_info, palette->colors, palette->size);
 
-    /* Write image */
-    png_set_rows(png, png_info, png_rows);
-    png_write_png(png, png_info, PNG_TRANSFORM_PACKING, NULL);
+    png_write_info(png, png_info);
+
+    /* Pack palette indices into fewer than 8 bits as necessary */
+    if (bpp < 8)
+        png_set_packing(png);
+
+    /* Convert and write each row, reusing the same row buffer */
+    for (int y = 0; y < height; y++) {
+
+        const uint32_t* src = (const uint32_t*) data;
+        png_byte* row = encoder->row;
+
+        if (palette != NULL)
+            guac_png_convert_row_palette(palette, src, row, width);
+        else if (alpha)
+            guac_png_convert_row_rgba(src, row, width);
+        else
+            guac_png_convert_row_rgb(src, row, width);
+
+        png_write_row(png, row);
+
+        /* Advance to next data row */
+        data += stride;
+
+    }
 
     /* Finish write */
+    png_write_end(png, NULL);
     png_destroy_write_struct(&png, &png_info);
 
     /* Free palette */
     guac_palette_free(palette);
 
-    /* Free PNG data */
-    for (y=0; y<height; y++)
-        free(png_rows[y]);
-    free(png_rows);
-
     /* Ensure all data is written */
     guac_png_flush_data(&write_state);
     return 0;
 
 }
 
+int guac_png_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, const guac_image_analysis* analysis) {
+
+    /* Get image surface properties and data */
+    cairo_format_t format = cairo_image_surface_get_format(surface);
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char* data = cairo_image_surface_get_data(surface);
+
+    /* Convert any other format to ARGB32 before encoding */
+    if (format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_ARGB32) {
+
+        cairo_surface_t* converted = cairo_image_surface_create(
+                CAIRO_FORMAT_ARGB32, width, height);
+
+        cairo_t* cairo = cairo_create(converted);
+        cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_surface(cairo, surface, 0, 0);
+        cairo_paint(cairo);
+        cairo_destroy(cairo);
+
+        int retval = guac_png_write(socket, stream, converted, NULL);
+        cairo_surface_destroy(converted);
+        return retval;
+
+    }
+
+    guac_png_encoder* encoder = guac_png_encoder_get();
+    if (encoder == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate PNG encoder";
+        return -1;
+    }
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(surface);
+
+    /* Analyze surface only if not already analyzed */
+    guac_image_analysis local_analysis;
+    if (analysis == NULL && data != NULL) {
+        guac_image_analyze(data, width, height, stride, &local_analysis);
+        analysis = &local_analysis;
+    }
+
+    /* Images which are not image surfaces cannot be encoded directly */
+    if (analysis == NULL) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "Invalid Cairo surface. Unable to create PNG.";
+        return -1;
+    }
+
+    /* Choose compression parameters suited to the image */
+    guac_png_encoder_tune(encoder, analysis,
+            format == CAIRO_FORMAT_ARGB32 && !analysis->opaque);
+
+    return guac_png_encoder_write(encoder, socket, stream, surface, analysis);
+
+}
@@ -22,14 +22,155 @@
 
 #include "config.h"
 
+#include "guacamole/image.h"
 #include "guacamole/socket.h"
 #include "guacamole/stream.h"
 
 #include <cairo/cairo.h>
 
+#include <stddef.h>
+
+/**
+ * The zlib compression level used for palette images. Palette images are
+ * small (one byte or less per pixel) and compress quickly, so a moderate
+ * level is affordable.
+ */
+#define GUAC_PNG_PALETTE_LEVEL 6
+
+/**
+ * The zlib compression level used for truecolor images consisting largely
+ * of runs of identical pixels, such as text and user interface elements.
+ */
+#define GUAC_PNG_FLAT_LEVEL 1
+
+/**
+ * The zlib compression level used for truecolor images with few runs of
+ * identical pixels, such as photos and gradients.
+ */
+#define GUAC_PNG_DETAILED_LEVEL 3
+
+/**
+ * The minimum ratio of pixels which match their neighbor to pixels which do
+ * not for a truecolor image to be considered flat (consisting largely of runs
+ * of identical pixels).
+ */
+#define GUAC_PNG_FLAT_RATIO 4
+
+/**
+ * A reusable PNG encoder, holding the compression parameters to use for the
+ * next image along with buffers which are retained between images. An
+ * encoder may only be used by one thread at a time.
+ */
+typedef struct guac_png_encoder {
+
+    /**
+     * The zlib compression level to use, from 0 (no compression) to 9 (best
+     * compression).
+     */
+    int level;
+
+    /**
+     * The zlib compression strategy to use, such as Z_DEFAULT_STRATEGY,
+     * Z_FILTERED, or Z_RLE.
+     */
+    int strategy;
+
+    /**
+     * The PNG row filters which libpng may choose between, as a bitwise OR of
+     * the PNG_FILTER_* flags.
+     */
+    int filters;
+
+    /**
+     * Buffer holding the converted contents of the row currently being
+     * written.
+     */
+    unsigned char* row;
+
+    /**
+     * The number of bytes allocated for the row buffer.
+     */
+    size_t row_size;
+
+} guac_png_encoder;
+
+/**
+ * Allocates a new PNG encoder with default compression parameters.
+ *
+ * @return
+ *     A newly-allocated PNG encoder, or NULL if allocation fails.
+ */
+guac_png_encoder* guac_png_encoder_alloc();
+
+/**
+ * Frees the given PNG encoder and all buffers associated with it.
+ *
+ * @param encoder
+ *     The PNG encoder to free.
+ */
+void guac_png_encoder_free(guac_png_encoder* encoder);
+
+/**
+ * Returns the PNG encoder of the calling thread, allocating that encoder if
+ * necessary. The encoder is freed automatically when the thread exits.
+ *
+ * @return
+ *     The PNG encoder of the calling thread, or NULL if the encoder could
+ *     not be allocated.
+ */
+guac_png_encoder* guac_png_encoder_get();
+
+/**
+ * Selects the compression level, strategy, and filters of the given encoder
+ * according to the given image analysis. Palette images are compressed
+ * without filtering, truecolor images consisting largely of runs of
+ * identical pixels use run-length compression, and all other images use
+ * filtered compression.
+ *
+ * @param encoder
+ *     The encoder to tune.
+ *
+ * @param analysis
+ *     The analysis of the image about to be encoded.
+ *
+ * @param alpha
+ *     Non-zero if the image will be encoded with an alpha channel (and thus
+ *     cannot be encoded using a palette), zero otherwise.
+ */
+void guac_png_encoder_tune(guac_png_encoder* encoder,
+        const guac_image_analysis* analysis, int alpha);
+
+/**
+ * Encodes the given surface as a PNG using the given encoder and its current
+ * compression parameters, and sends the resulting data over the given stream
+ * and socket as blobs.
+ *
+ * @param encoder
+ *     The encoder to use.
+ *
+ * @param socket
+ *     The socket to send PNG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as PNG blobs.
+ *
+ * @param analysis
+ *     The analysis of the given surface, as produced by guac_image_analyze().
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_png_encoder_write(guac_png_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface,
+        const guac_image_analysis* analysis);
+
 /**
  * Encodes the given surface as a PNG, and sends the resulting data over the
- * given stream and socket as blobs.
+ * given stream and socket as blobs. The PNG encoder of the calling thread is
+ * used, tuned according to the analysis of the surface.
  *
  * @param socket
  *     The socket to send PNG blobs over.
@@ -40,11 +181,15 @@
  * @param surface
  *     The Cairo surface to write to the given stream and socket as PNG blobs.
  *
+ * @param analysis
+ *     The analysis of the given surface, as produced by guac_image_analyze(),
+ *     or NULL if the surface should be analyzed as part of encoding.
+ *
  * @return
  *     Zero if the encoding operation is successful, non-zero otherwise.
  */
 int guac_png_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface);
+        cairo_surface_t* surface, const guac_image_analysis* analysis);
 
 #endif
 
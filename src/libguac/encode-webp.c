@@ -28,6 +28,10 @@
 #include <cairo/cairo.h>
 #include <webp/encode.h>
 
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
 #include <assert.h>
 #include <inttypes.h>
 #include <stdint.h>
@@ -162,11 +166,93 @@ static int guac_webp_stream_write(const uint8_t* data, size_t data_size,
     return 1;
 }
 
+#ifdef HAVE_LIBPTHREAD
+
+/* PThread implementation of guac_webp_encoder_get() */
+
+static pthread_key_t  __guac_webp_encoder_key;
+static pthread_once_t __guac_webp_encoder_key_init = PTHREAD_ONCE_INIT;
+
+static void __guac_webp_encoder_free_pointer(void* encoder) {
+
+    /* Free encoder allocated to thread */
+    guac_webp_encoder_free((guac_webp_encoder*) encoder);
+
+}
+
+static void __guac_webp_encoder_alloc_key() {
+
+    /* Create key, destroy any allocated encoder on thread exit */
+    pthread_key_create(&__guac_webp_encoder_key,
+            __guac_webp_encoder_free_pointer);
+
+}
+
+guac_webp_encoder* guac_webp_encoder_get() {
+
+    /* Init encoder key, if not already initialized */
+    pthread_once(&__guac_webp_encoder_key_init, __guac_webp_encoder_alloc_key);
+
+    /* Retrieve thread-local encoder */
+    guac_webp_encoder* encoder =
+        (guac_webp_encoder*) pthread_getspecific(__guac_webp_encoder_key);
+
+    /* Allocate thread-local encoder if not already allocated */
+    if (encoder == NULL) {
+        encoder = guac_webp_encoder_alloc();
+        pthread_setspecific(__guac_webp_encoder_key, encoder);
+    }
+
+    return encoder;
+
+}
+
+#else
+
+/* Default (not-threadsafe) implementation */
+static guac_webp_encoder* __guac_webp_encoder_unsafe_storage = NULL;
+
+guac_webp_encoder* guac_webp_encoder_get() {
+
+    /* Allocate encoder if not already allocated */
+    if (__guac_webp_encoder_unsafe_storage == NULL)
+        __guac_webp_encoder_unsafe_storage = guac_webp_encoder_alloc();
+
+    return __guac_webp_encoder_unsafe_storage;
+
+}
+
+#endif
+
+guac_webp_encoder* guac_webp_encoder_alloc() {
+
+    guac_webp_encoder* encoder = calloc(1, sizeof(guac_webp_encoder));
+    if (encoder == NULL)
+        return NULL;
+
+    if (!WebPPictureInit(&encoder->picture)) {
+        free(encoder);
+        return NULL;
+    }
+
+    return encoder;
+
+}
+
+void guac_webp_encoder_free(guac_webp_encoder* encoder) {
+
+    if (encoder == NULL)
+        return;
+
+    WebPPictureFree(&encoder->picture);
+    free(encoder);
+
+}
+
 int guac_webp_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface, int quality, int lossless) {
+        cairo_surface_t* surface, int quality, int lossless, int method) {
 
     guac_webp_stream_writer writer;
-    WebPPicture picture;
     uint32_t* argb_output;
 
     int x, y;
@@ -183,6 +269,15 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
         return -1;
     }
 
+    guac_webp_encoder* encoder = guac_webp_encoder_get();
+    if (encoder == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate WebP encoder.";
+        return -1;
+    }
+
+    WebPPicture* picture = &encoder->picture;
+
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
@@ -195,25 +290,44 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
     config.lossless = lossless;
     config.quality = quality;
     config.thread_level = 1; /* Multi threaded */
-    config.method = 2; /* Compression method (0=fast/larger, 6=slow/smaller) */
+    config.method = method; /* Compression method (0=fast/larger, 6=slow/smaller) */
 
     /* Validate configuration */
-    WebPValidateConfig(&config);
-
-    /* Set up WebP picture */
-    WebPPictureInit(&picture);
-    picture.use_argb = 1;
-    picture.width = width;
-    picture.height = height;
-
-    /* Allocate and init writer */
-    WebPPictureAlloc(&picture);
-    picture.writer = guac_webp_stream_write;
-    picture.custom_ptr = &writer;
+    if (!WebPValidateConfig(&config)) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Invalid WebP encoder configuration.";
+        return -1;
+    }
+
+    /* Lossy encoding converts the picture to YUV in place, clearing
+     * use_argb, so the picture must be switched back to ARGB each time */
+    picture->use_argb = 1;
+
+    /* Reallocate the picture only if its dimensions have changed */
+    if (encoder->width != width || encoder->height != height) {
+
+        picture->width = width;
+        picture->height = height;
+
+        if (!WebPPictureAlloc(picture)) {
+            encoder->width = encoder->height = 0;
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Unable to allocate WebP picture.";
+            return -1;
+        }
+
+        encoder->width = width;
+        encoder->height = height;
+
+    }
+
+    /* Init writer */
+    picture->writer = guac_webp_stream_write;
+    picture->custom_ptr = &writer;
     guac_webp_stream_writer_init(&writer, socket, stream);
 
     /* Copy image data into WebP picture */
-    argb_output = picture.argb;
+    argb_output = picture->argb;
     for (y = 0; y < height; y++) {
 
         /* Get pixels at start of each row */
@@ -239,15 +353,15 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
 
         /* Next row */
         data += stride;
-        argb_output += picture.argb_stride;
+        argb_output += picture->argb_stride;
 
     }
 
     /* Encode image */
-    WebPEncode(&config, &picture);
+    WebPEncode(&config, picture);
 
-    /* Free picture */
-    WebPPictureFree(&picture);
+    /* The writer is local to this call and must not be referenced later */
+    picture->custom_ptr = NULL;
 
     /* Ensure all data is written */
     guac_webp_flush_data(&writer);
@@ -255,4 +369,3 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
     return 0;
 
 }
-
@@ -22,14 +22,69 @@
 
 #include "config.h"
 
+#include "guacamole/image.h"
 #include "guacamole/socket.h"
 #include "guacamole/stream.h"
 
 #include <cairo/cairo.h>
+#include <webp/encode.h>
 
 /**
- * Encodes the given surface as a WebP, and sends the resulting data over the
- * given stream and socket as blobs.
+ * A reusable WebP encoder, holding a picture whose pixel buffer is retained
+ * between images of the same dimensions. An encoder may only be used by one
+ * thread at a time.
+ */
+typedef struct guac_webp_encoder {
+
+    /**
+     * The WebP picture into which each image is copied prior to encoding.
+     */
+    WebPPicture picture;
+
+    /**
+     * The width of the pixel buffer currently allocated for the picture, in
+     * pixels, or zero if no buffer has yet been allocated.
+     */
+    int width;
+
+    /**
+     * The height of the pixel buffer currently allocated for the picture, in
+     * pixels, or zero if no buffer has yet been allocated.
+     */
+    int height;
+
+} guac_webp_encoder;
+
+/**
+ * Allocates a new WebP encoder.
+ *
+ * @return
+ *     A newly-allocated WebP encoder, or NULL if allocation fails.
+ */
+guac_webp_encoder* guac_webp_encoder_alloc();
+
+/**
+ * Frees the given WebP encoder and all buffers associated with it.
+ *
+ * @param encoder
+ *     The WebP encoder to free.
+ */
+void guac_webp_encoder_free(guac_webp_encoder* encoder);
+
+/**
+ * Returns the WebP encoder of the calling thread, allocating that encoder if
+ * necessary. The encoder is freed automatically when the thread exits.
+ *
+ * @return
+ *     The WebP encoder of the calling thread, or NULL if the encoder could
+ *     not be allocated.
+ */
+guac_webp_encoder* guac_webp_encoder_get();
+
+/**
+ * Encodes the given surface as a WebP using the WebP encoder of the calling
+ * thread, and sends the resulting data over the given stream and socket as
+ * blobs.
  *
  * @param socket
  *     The socket to send WebP blobs over.
@@ -49,10 +104,14 @@
  * @param lossless
  *     Zero for a lossy image, non-zero for lossless.
  *
+ * @param method
+ *     The WebP compression method to use, from 0 (fastest, larger output) to
+ *     6 (slowest, smaller output).
+ *
  * @return
  *     Zero if the encoding operation is successful, non-zero otherwise.
  */
 int guac_webp_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface, int quality, int lossless);
+        cairo_surface_t* surface, int quality, int lossless, int method);
 
 #endif
@@ -0,0 +1,215 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef GUAC_IMAGE_H
+#define GUAC_IMAGE_H
+
+/**
+ * Provides functions for analyzing image data and for encoding Cairo surfaces
+ * as PNG, JPEG, or WebP images, sending the resulting data as blobs over an
+ * already-allocated stream. Unlike guac_client_stream_png() and similar
+ * functions, these functions neither allocate nor free the stream involved,
+ * nor do they send the "img" or "end" instructions, allowing the image data
+ * to be produced separately from (and potentially in parallel with) the rest
+ * of the instruction stream.
+ *
+ * @file image.h
+ */
+
+#include "socket-types.h"
+#include "stream-types.h"
+
+#include <cairo/cairo.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of distinct colors which guac_image_analyze() will
+ * record within the palette of an image. Images having more colors than this
+ * are considered to have no palette.
+ */
+#define GUAC_IMAGE_MAX_PALETTE_SIZE 256
+
+/**
+ * The result of analyzing the contents of an image with guac_image_analyze().
+ * The analysis is produced by a single pass over the image data, and may be
+ * used both to select the most appropriate format for an image and by the
+ * encoders of those formats, avoiding repeated passes over the same data.
+ */
+typedef struct guac_image_analysis {
+
+    /**
+     * Non-zero if every pixel of the image is fully opaque, zero otherwise.
+     */
+    int opaque;
+
+    /**
+     * Non-zero if every pixel of the image has exactly the same color and
+     * alpha value, zero otherwise.
+     */
+    int solid;
+
+    /**
+     * The color of the first pixel of the image, in the same 32-bit ARGB
+     * format as the image data. If the image is solid, this is the color of
+     * every pixel.
+     */
+    uint32_t color;
+
+    /**
+     * The number of pixels which have the same color as the pixel to their
+     * immediate left, disregarding alpha.
+     */
+    int num_same;
+
+    /**
+     * The number of pixels which have a different color from the pixel to
+     * their immediate left, disregarding alpha. The first pixel of each row
+     * is counted neither as the same nor as different.
+     */
+    int num_different;
+
+    /**
+     * The number of distinct colors within the image, disregarding alpha, or
+     * zero if the image contains more than GUAC_IMAGE_MAX_PALETTE_SIZE
+     * distinct colors.
+     */
+    int palette_size;
+
+    /**
+     * Each of the distinct colors within the image, in the order they first
+     * occur, as 24-bit RGB values. Only the first palette_size entries are
+     * valid.
+     */
+    uint32_t palette[GUAC_IMAGE_MAX_PALETTE_SIZE];
+
+} guac_image_analysis;
+
+/**
+ * Analyzes the given 32-bit ARGB image data in a single pass, determining
+ * its opacity, whether it is a single solid color, how often adjacent pixels
+ * share the same color, and its palette (if it has few enough colors).
+ *
+ * @param data
+ *     The first pixel of the image data to analyze.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param stride
+ *     The number of bytes in each row of the image data.
+ *
+ * @param analysis
+ *     The guac_image_analysis to populate with the results of the analysis.
+ */
+void guac_image_analyze(const unsigned char* data, int width, int height,
+        int stride, guac_image_analysis* analysis);
+
+/**
+ * Encodes the given surface as a PNG, and sends the resulting data over the
+ * given stream and socket as blobs.
+ *
+ * @param socket
+ *     The socket to send PNG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as PNG blobs.
+ *
+ * @param analysis
+ *     The analysis of the given surface, as produced by guac_image_analyze(),
+ *     or NULL if the surface should be analyzed as part of encoding.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_image_write_png(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, const guac_image_analysis* analysis);
+
+/**
+ * Encodes the given surface as a JPEG, and sends the resulting data over the
+ * given stream and socket as blobs. The surface must be opaque, as any
+ * transparency will be lost.
+ *
+ * @param socket
+ *     The socket to send JPEG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as JPEG blobs.
+ *
+ * @param quality
+ *     JPEG image quality, which must be an integer value between 0 and 100
+ *     inclusive. Larger values indicate improving quality at the expense of
+ *     larger file size.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_image_write_jpeg(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality);
+
+/**
+ * The WebP compression method used when no other method is specified. Methods
+ * range from 0 (fastest, larger output) to 6 (slowest, smaller output).
+ */
+#define GUAC_IMAGE_WEBP_DEFAULT_METHOD 2
+
+/**
+ * Encodes the given surface as a WebP, and sends the resulting data over the
+ * given stream and socket as blobs. If libguac was built without WebP
+ * support, this function fails with guac_error set to
+ * GUAC_STATUS_NOT_SUPPORTED.
+ *
+ * @param socket
+ *     The socket to send WebP blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as WebP blobs.
+ *
+ * @param quality
+ *     The WebP image quality, which must be an integer value between 0 and 100
+ *     inclusive. For lossy images, larger values indicate improving quality.
+ *     For lossless images, larger values indicate improving compression.
+ *
+ * @param lossless
+ *     Zero to encode a lossy image, non-zero to encode losslessly.
+ *
+ * @param method
+ *     The WebP compression method, which must be an integer value between 0
+ *     and 6 inclusive. Lower values encode faster at the expense of larger
+ *     output. GUAC_IMAGE_WEBP_DEFAULT_METHOD is a reasonable default.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_image_write_webp(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, int lossless, int method);
+
+#endif
+
@@ -26,11 +26,31 @@
  * @file parser-constants.h
  */
 
+#include <limits.h>
+
 /**
  * The maximum number of characters per instruction.
  */
 #define GUAC_INSTRUCTION_MAX_LENGTH 8192
 
+/**
+ * The initial size of the buffer used by guac_parser to store received
+ * instructions, in bytes. This is also the largest size that buffer may grow
+ * to unless a maximum element length greater than GUAC_INSTRUCTION_MAX_LENGTH
+ * has been set with guac_parser_set_max_element_length().
+ */
+#define GUAC_PARSER_BUFFER_SIZE 32768
+
+/**
+ * The largest maximum element length which may be set with
+ * guac_parser_set_max_element_length(), in characters. As the buffer used by
+ * guac_parser may grow in proportion to the maximum element length, this is
+ * the largest length for which the size of that buffer can still be
+ * represented as an int.
+ */
+#define GUAC_PARSER_MAX_ELEMENT_LENGTH \
+    (INT_MAX / (GUAC_PARSER_BUFFER_SIZE / GUAC_INSTRUCTION_MAX_LENGTH))
+
 /**
  * The maximum number of digits to allow per length prefix.
  */
@@ -79,12 +79,25 @@ struct guac_parser {
      */
     char* __instructionbuf_unparsed_end;
 
+    /**
+     * The maximum length of any element, in characters.
+     */
+    int __max_element_length;
+
+    /**
+     * The current size of the instruction buffer, in bytes. The instruction
+     * buffer grows as needed to contain the current in-progress instruction,
+     * up to GUAC_PARSER_BUFFER_SIZE bytes for every GUAC_INSTRUCTION_MAX_LENGTH
+     * characters of the maximum element length.
+     */
+    int __instructionbuf_size;
+
     /**
      * The instruction buffer. This is essentially the input buffer,
      * provided as a convenience to be used to buffer instructions until
      * those instructions are complete and ready to be parsed.
      */
-    char __instructionbuf[32768];
+    char* __instructionbuf;
 
 };
 
@@ -96,6 +109,29 @@ struct guac_parser {
  */
 guac_parser* guac_parser_alloc();
 
+/**
+ * Sets the maximum length of each element accepted by the given parser, in
+ * characters. By default, parsers accept elements of up to
+ * GUAC_INSTRUCTION_MAX_LENGTH characters. Allowing larger elements allows
+ * the parser's internal buffer to grow proportionally when larger
+ * instructions are received. This function should be invoked before any data
+ * is parsed.
+ *
+ * @param parser
+ *     The parser to modify.
+ *
+ * @param length
+ *     The maximum number of characters to accept within each element. This
+ *     must be at least GUAC_INSTRUCTION_MAX_LENGTH and no greater than
+ *     GUAC_PARSER_MAX_ELEMENT_LENGTH.
+ *
+ * @return
+ *     Zero if the maximum element length was set, non-zero if the given
+ *     length is out of range, in which case the maximum element length is
+ *     left unchanged and guac_error is set to GUAC_STATUS_INVALID_ARGUMENT.
+ */
+int guac_parser_set_max_element_length(guac_parser* parser, int length);
+
 /**
  * Appends data from the given buffer to the given parser. The data will be
  * appended, if possible, to the in-progress instruction as a reference and
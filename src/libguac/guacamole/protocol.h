@@ -1016,7 +1016,9 @@ int guac_protocol_send_name(guac_socket* socket, const char* name);
 
 /**
  * Decodes the given base64-encoded string in-place. The base64 string must
- * be NULL-terminated.
+ * be NULL-terminated. Decoding stops at the first character which is not
+ * part of the base64 alphabet, such as the "=" used for padding, retaining
+ * any bytes decoded prior to that character.
  *
  * @param base64 The base64-encoded string to decode.
  * @return The number of bytes resulting from the decode operation.
@@ -37,5 +37,12 @@
  */
 #define GUAC_SOCKET_KEEP_ALIVE_INTERVAL 5000
 
+/**
+ * The maximum number of milliseconds that freeing a queued guac_socket will
+ * wait for any remaining queued data to be written. Data which cannot be
+ * written within this time is discarded.
+ */
+#define GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT 2000
+
 #endif
 
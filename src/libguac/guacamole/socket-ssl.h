@@ -54,11 +54,25 @@ typedef struct guac_socket_ssl_data {
      */
     SSL* ssl;
 
+    /**
+     * Non-zero if the kernel has taken over encryption and decryption in both
+     * directions (kernel TLS), in which case application data is read and
+     * written using the file descriptor directly, without involving OpenSSL.
+     * Zero if all communication must pass through OpenSSL.
+     */
+    int kernel_tls;
+
 } guac_socket_ssl_data;
 
 /**
  * Creates a new guac_socket which will use SSL for all communication. Freeing
  * this guac_socket will automatically close the associated file descriptor.
+ * If supported by both OpenSSL and the kernel, encryption and decryption are
+ * offloaded to the kernel once the SSL handshake has completed, in which case
+ * the file descriptor is read and written directly. If the file descriptor is
+ * non-blocking, reads and writes which cannot complete immediately fail with
+ * guac_error set to GUAC_STATUS_WOULD_BLOCK, and must be retried with the same
+ * arguments once the file descriptor is ready.
  *
  * @param context
  *     The SSL_CTX structure describing the desired SSL configuration.
@@ -49,5 +49,28 @@ typedef enum guac_socket_state {
 
 } guac_socket_state;
 
+/**
+ * The action taken by a queued socket (see guac_socket_queue()) when data is
+ * written faster than it can be written to the underlying socket, such that
+ * the amount of queued data would exceed the configured maximum.
+ */
+typedef enum guac_socket_queue_policy {
+
+    /**
+     * The write waits until the underlying socket has caught up enough for
+     * the data to be queued. Writers of a lagging socket are slowed to the
+     * speed of that socket.
+     */
+    GUAC_SOCKET_QUEUE_BLOCK,
+
+    /**
+     * The write fails, all queued data is discarded, and all further writes
+     * to the queued socket fail. Writers are never slowed by a lagging
+     * socket, which is instead effectively disconnected.
+     */
+    GUAC_SOCKET_QUEUE_CLOSE
+
+} guac_socket_queue_policy;
+
 #endif
 
@@ -30,6 +30,7 @@
 #include "socket-constants.h"
 #include "socket-fntypes.h"
 #include "socket-types.h"
+#include "timer-types.h"
 #include "timestamp-types.h"
 
 #include <pthread.h>
@@ -109,10 +110,37 @@ struct guac_socket {
     int __keep_alive_enabled;
 
     /**
-     * The keep-alive thread.
+     * The timer which periodically checks whether a keep-alive ping is
+     * needed. This is only valid if keep-alive is enabled.
+     */
+    guac_timer* __keep_alive_timer;
+
+    /**
+     * Non-zero if a thread has been started to send a keep-alive ping and has
+     * not yet been joined, zero otherwise. Keep-alive pings are sent by their
+     * own threads, as writing to the socket may block.
+     */
+    int __keep_alive_pinging;
+
+    /**
+     * The thread sending the current keep-alive ping. This is only valid if
+     * __keep_alive_pinging is non-zero.
      */
     pthread_t __keep_alive_thread;
 
+    /**
+     * The result of the current keep-alive ping: negative if the ping is still
+     * being sent, zero if the ping was sent successfully, and positive if
+     * sending the ping failed. Access to this value is guarded by
+     * __keep_alive_lock.
+     */
+    int __keep_alive_result;
+
+    /**
+     * Lock which guards access to __keep_alive_result.
+     */
+    pthread_mutex_t __keep_alive_lock;
+
 };
 
 /**
@@ -134,7 +162,10 @@ void guac_socket_free(guac_socket* socket);
 /**
  * Declares that the given socket must automatically send a keep-alive ping
  * to ensure neither side of the socket times out while the socket is open.
- * This ping will take the form of a "nop" instruction.
+ * This ping will take the form of a "nop" instruction. The need for a ping is
+ * checked by the timer thread shared by the entire process, while each ping
+ * is sent by a short-lived thread of its own, such that a socket which cannot
+ * currently be written does not delay any other timer.
  *
  * @param socket
  *     The guac_socket to declare as requiring an automatic keep-alive ping.
@@ -228,6 +259,44 @@ guac_socket* guac_socket_nest(guac_socket* parent, int index);
  */
 guac_socket* guac_socket_tee(guac_socket* primary, guac_socket* secondary);
 
+/**
+ * Allocates and initializes a new guac_socket which queues all written data
+ * in memory, writing that data to the given socket from a dedicated thread.
+ * Writes to the returned guac_socket thus do not wait for the underlying
+ * socket unless the amount of queued data would exceed the given maximum,
+ * in which case the given policy is applied. Flushing the returned
+ * guac_socket requests that the underlying socket be flushed once all data
+ * written thus far has been written, but does not wait for this to happen.
+ * Reads are delegated to the underlying socket. Freeing the returned
+ * guac_socket will write any remaining queued data and then free the
+ * underlying socket, waiting no longer than GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT
+ * milliseconds for that data to be written. Any data which cannot be written
+ * in that time is discarded, and the underlying socket is freed in the
+ * background once any write already in progress completes.
+ *
+ * If an error occurs while allocating the guac_socket object, NULL is returned,
+ * and guac_error is set appropriately.
+ *
+ * @param socket
+ *     The guac_socket to which all queued data should be written, and from
+ *     which all data should be read.
+ *
+ * @param max_length
+ *     The maximum number of bytes which may be queued before the given policy
+ *     is applied.
+ *
+ * @param policy
+ *     The action to take if a write would cause the amount of queued data to
+ *     exceed max_length.
+ *
+ * @return
+ *     A newly allocated guac_socket object which queues all data written to
+ *     the given guac_socket, or NULL if an error occurs while allocating the
+ *     guac_socket object.
+ */
+guac_socket* guac_socket_queue(guac_socket* socket, size_t max_length,
+        guac_socket_queue_policy policy);
+
 /**
  * Allocates and initializes a new guac_socket which duplicates all
  * instructions written across the sockets of each connected user of the given
@@ -0,0 +1,56 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_TIMER_CONSTANTS_H
+#define GUAC_TIMER_CONSTANTS_H
+
+/**
+ * Constants related to timers which are run by the shared timer thread.
+ *
+ * @file timer-constants.h
+ */
+
+/**
+ * The number of milliseconds in each tick of the shared timer thread. Timers
+ * are invoked no earlier than requested, but may be invoked up to this many
+ * milliseconds later than requested.
+ */
+#define GUAC_TIMER_RESOLUTION 10
+
+/**
+ * The number of bits of each tick represented by each level of the
+ * hierarchical timer wheel. Each level has 2^GUAC_TIMER_WHEEL_BITS slots.
+ */
+#define GUAC_TIMER_WHEEL_BITS 6
+
+/**
+ * The number of slots within each level of the hierarchical timer wheel.
+ */
+#define GUAC_TIMER_WHEEL_SLOTS (1 << GUAC_TIMER_WHEEL_BITS)
+
+/**
+ * The number of levels within the hierarchical timer wheel. With a resolution
+ * of 10 milliseconds and 64 slots per level, four levels cover delays of up
+ * to roughly 46 hours without further cascading.
+ */
+#define GUAC_TIMER_WHEEL_LEVELS 4
+
+#endif
+
@@ -0,0 +1,56 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_TIMER_FNTYPES_H
+#define GUAC_TIMER_FNTYPES_H
+
+/**
+ * Function type definitions related to timers which are run by the shared
+ * timer thread.
+ *
+ * @file timer-fntypes.h
+ */
+
+#include "timer-types.h"
+
+/**
+ * Callback which is invoked by the shared timer thread once the delay given
+ * to guac_timer_schedule() has elapsed. As all timers within a process share
+ * the same thread, this callback must return promptly, and must not free the
+ * timer invoking it. No other timer within the process can fire until the
+ * callback returns, thus any work which may block, such as writing to a
+ * guac_socket, must be handed off to another thread.
+ *
+ * @param timer
+ *     The timer invoking the callback.
+ *
+ * @param data
+ *     The arbitrary data given when the timer was allocated with
+ *     guac_timer_alloc().
+ *
+ * @return
+ *     The number of milliseconds to wait before invoking the callback again,
+ *     or zero if the callback should not be invoked again unless the timer is
+ *     explicitly rescheduled.
+ */
+typedef int guac_timer_callback(guac_timer* timer, void* data);
+
+#endif
+
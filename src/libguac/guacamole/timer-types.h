@@ -0,0 +1,38 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_TIMER_TYPES_H
+#define GUAC_TIMER_TYPES_H
+
+/**
+ * Type definitions related to timers which are run by the shared timer
+ * thread.
+ *
+ * @file timer-types.h
+ */
+
+/**
+ * A callback which is invoked by the shared timer thread after a requested
+ * delay, optionally repeating at an interval chosen by the callback.
+ */
+typedef struct guac_timer guac_timer;
+
+#endif
+
@@ -0,0 +1,146 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_TIMER_H
+#define GUAC_TIMER_H
+
+/**
+ * Provides timers which are run by a single thread shared by the entire
+ * process, rather than by a dedicated thread per timer. Pending timers are
+ * stored within a hierarchical timer wheel, such that scheduling and
+ * cancelling a timer take constant time regardless of the number of timers.
+ *
+ * @file timer.h
+ */
+
+#include "timer-constants.h"
+#include "timer-fntypes.h"
+#include "timer-types.h"
+
+#include <stdint.h>
+
+struct guac_timer {
+
+    /**
+     * The function to invoke when this timer expires.
+     */
+    guac_timer_callback* __callback;
+
+    /**
+     * The arbitrary data to pass to the callback.
+     */
+    void* __data;
+
+    /**
+     * The tick of the shared timer thread at which this timer expires. This
+     * value is only meaningful while the timer is scheduled.
+     */
+    uint64_t __expires;
+
+    /**
+     * Non-zero if this timer is currently scheduled, zero otherwise.
+     */
+    int __scheduled;
+
+    /**
+     * Non-zero if the callback of this timer is currently being invoked by
+     * the shared timer thread, zero otherwise.
+     */
+    int __running;
+
+    /**
+     * Non-zero if the interval returned by the callback currently being
+     * invoked should be used to reschedule this timer, zero if the timer has
+     * been scheduled or cancelled explicitly since the callback was invoked.
+     */
+    int __rearm;
+
+    /**
+     * The next timer within the same slot of the timer wheel, or NULL if this
+     * is the last timer in that slot.
+     */
+    guac_timer* __next;
+
+    /**
+     * The pointer which points to this timer within its slot of the timer
+     * wheel (either the slot itself or the __next pointer of the previous
+     * timer).
+     */
+    guac_timer** __ptr;
+
+};
+
+/**
+ * Allocates a new timer which will invoke the given callback once scheduled
+ * with guac_timer_schedule(). The timer is not initially scheduled.
+ *
+ * @param callback
+ *     The function to invoke when the timer expires.
+ *
+ * @param data
+ *     Arbitrary data to pass to the callback.
+ *
+ * @return
+ *     A newly-allocated timer, or NULL if the timer could not be allocated.
+ */
+guac_timer* guac_timer_alloc(guac_timer_callback* callback, void* data);
+
+/**
+ * Schedules the given timer such that its callback is invoked after the given
+ * number of milliseconds, replacing any previous schedule. The shared timer
+ * thread is started automatically if not already running, including within
+ * child processes created with fork(), which inherit all scheduled timers but
+ * not the shared timer thread itself.
+ *
+ * @param timer
+ *     The timer to schedule.
+ *
+ * @param delay
+ *     The number of milliseconds to wait before invoking the timer's
+ *     callback.
+ *
+ * @return
+ *     Zero if the timer was scheduled successfully, non-zero if the shared
+ *     timer thread could not be started, in which case guac_error is set
+ *     appropriately.
+ */
+int guac_timer_schedule(guac_timer* timer, int delay);
+
+/**
+ * Cancels the given timer, such that its callback will not be invoked unless
+ * the timer is scheduled again. If the callback is currently being invoked by
+ * another thread, this function blocks until that invocation has completed.
+ *
+ * @param timer
+ *     The timer to cancel.
+ */
+void guac_timer_cancel(guac_timer* timer);
+
+/**
+ * Cancels and frees the given timer. This function must not be invoked from
+ * within the timer's own callback.
+ *
+ * @param timer
+ *     The timer to free.
+ */
+void guac_timer_free(guac_timer* timer);
+
+#endif
+
@@ -37,6 +37,27 @@
  */
 #define GUAC_USER_MAX_STREAMS 64
 
+/**
+ * The maximum length of any element of any instruction received from a
+ * guac_user, in characters. This is larger than GUAC_INSTRUCTION_MAX_LENGTH
+ * such that users may send data using fewer, larger blobs.
+ */
+#define GUAC_USER_MAX_ELEMENT_LENGTH 65536
+
+/**
+ * The maximum number of times a mouse event received from a guac_user may be
+ * replaced by a newer mouse event before being passed to the mouse handler,
+ * even if further input is waiting to be handled.
+ */
+#define GUAC_USER_MOUSE_MAX_COALESCED 16
+
+/**
+ * The maximum amount of time that a mouse event received from a guac_user may
+ * be held back for coalescing before being passed to the mouse handler, even
+ * if further input is waiting to be handled, in milliseconds.
+ */
+#define GUAC_USER_MOUSE_MAX_DELAY 50
+
 /**
  * The index of a closed stream.
  */
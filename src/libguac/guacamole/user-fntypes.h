@@ -365,6 +365,28 @@ typedef int guac_user_end_handler(guac_user* user, guac_stream* stream);
  */
 typedef int guac_user_join_handler(guac_user* user, int argc, char** argv);
 
+/**
+ * Handler for arbitrary Guacamole instructions received from a user. Such
+ * handlers are registered with guac_user_register_instruction_handler(), and
+ * are invoked for all received instructions having the opcode they were
+ * registered with.
+ *
+ * @param user
+ *     The user that sent the instruction.
+ *
+ * @param argc
+ *     The number of arguments stored within argv.
+ *
+ * @param argv
+ *     The arguments included with the instruction, excluding the opcode.
+ *
+ * @return
+ *     Zero if the instruction was handled successfully, non-zero otherwise.
+ *     If non-zero is returned, the user will be disconnected.
+ */
+typedef int guac_user_instruction_handler(guac_user* user, int argc,
+        char** argv);
+
 /**
  * Handler for Guacamole leave events. A leave event is fired by the
  * guac_client whenever a guac_user leaves the connection. There is no
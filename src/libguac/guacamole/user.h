@@ -576,6 +576,32 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout);
 int guac_user_handle_instruction(guac_user* user, const char* opcode,
         int argc, char** argv);
 
+/**
+ * Registers a handler for all instructions having the given opcode which are
+ * received from any user after the handshake has completed. The handler is
+ * added to the same lookup table used for instructions handled by libguac
+ * itself, and thus may not replace the handler of an existing opcode.
+ * Handlers are registered for the life of the process, and must be
+ * registered by a protocol plugin when its guac_client is initialized, before
+ * any users have joined. As handlers are looked up without locking,
+ * registration fails once any instruction has been handled.
+ *
+ * @param opcode
+ *     The opcode of the instructions to be handled. This string must remain
+ *     valid for the life of the process.
+ *
+ * @param handler
+ *     The handler to invoke for all instructions having the given opcode.
+ *
+ * @return
+ *     Zero if the handler was registered successfully, non-zero if the opcode
+ *     already has a handler, no further handlers may be registered, or
+ *     instructions have already been handled, in which case guac_error and
+ *     guac_error_message are set appropriately.
+ */
+int guac_user_register_instruction_handler(const char* opcode,
+        guac_user_instruction_handler* handler);
+
 /**
  * Allocates a new stream. An arbitrary index is automatically assigned
  * if no previously-allocated stream is available for use.
@@ -0,0 +1,356 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "guacamole/image.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Mask selecting only the alpha component of an ARGB pixel.
+ */
+#define GUAC_IMAGE_ANALYSIS_ALPHA 0xFF000000
+
+/**
+ * Mask selecting only the color components of an ARGB pixel.
+ */
+#define GUAC_IMAGE_ANALYSIS_COLOR 0x00FFFFFF
+
+/**
+ * The number of entries within the hash table used to locate the distinct
+ * colors of an image. This must be a power of two, and should be at least
+ * twice GUAC_IMAGE_MAX_PALETTE_SIZE to keep probe sequences short.
+ */
+#define GUAC_IMAGE_ANALYSIS_TABLE_SIZE 512
+
+/**
+ * The number of bits required to index the hash table used to locate the
+ * distinct colors of an image (the base-2 logarithm of
+ * GUAC_IMAGE_ANALYSIS_TABLE_SIZE).
+ */
+#define GUAC_IMAGE_ANALYSIS_TABLE_BITS 9
+
+/*
+ * Vector operations on groups of GUAC_IMAGE_ANALYSIS_VECTOR_SIZE pixels. The
+ * widest instruction set available at compile time is used, with AVX2 and
+ * SSE2 available on x86 and NEON available on 64-bit ARM. If none are
+ * available, GUAC_IMAGE_ANALYSIS_VECTOR_SIZE is left undefined and each pixel
+ * is analyzed individually.
+ */
+
+#if defined(__AVX2__)
+
+typedef __m256i guac_image_analysis_vector;
+
+#define GUAC_IMAGE_ANALYSIS_VECTOR_SIZE 8
+#define GUAC_IMAGE_ANALYSIS_LOAD(p)   _mm256_loadu_si256((const __m256i*) (p))
+#define GUAC_IMAGE_ANALYSIS_STORE(p, v) _mm256_storeu_si256((__m256i*) (p), v)
+#define GUAC_IMAGE_ANALYSIS_SPLAT(c)  _mm256_set1_epi32((int) (c))
+#define GUAC_IMAGE_ANALYSIS_AND(a, b) _mm256_and_si256(a, b)
+#define GUAC_IMAGE_ANALYSIS_OR(a, b)  _mm256_or_si256(a, b)
+#define GUAC_IMAGE_ANALYSIS_EQ(a, b)  _mm256_cmpeq_epi32(a, b)
+#define GUAC_IMAGE_ANALYSIS_MASK(v) \
+    _mm256_movemask_ps(_mm256_castsi256_ps(v))
+
+#elif defined(__SSE2__)
+
+typedef __m128i guac_image_analysis_vector;
+
+#define GUAC_IMAGE_ANALYSIS_VECTOR_SIZE 4
+#define GUAC_IMAGE_ANALYSIS_LOAD(p)   _mm_loadu_si128((const __m128i*) (p))
+#define GUAC_IMAGE_ANALYSIS_STORE(p, v) _mm_storeu_si128((__m128i*) (p), v)
+#define GUAC_IMAGE_ANALYSIS_SPLAT(c)  _mm_set1_epi32((int) (c))
+#define GUAC_IMAGE_ANALYSIS_AND(a, b) _mm_and_si128(a, b)
+#define GUAC_IMAGE_ANALYSIS_OR(a, b)  _mm_or_si128(a, b)
+#define GUAC_IMAGE_ANALYSIS_EQ(a, b)  _mm_cmpeq_epi32(a, b)
+#define GUAC_IMAGE_ANALYSIS_MASK(v) \
+    _mm_movemask_ps(_mm_castsi128_ps(v))
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+typedef uint32x4_t guac_image_analysis_vector;
+
+#define GUAC_IMAGE_ANALYSIS_VECTOR_SIZE 4
+#define GUAC_IMAGE_ANALYSIS_LOAD(p)   vld1q_u32((const uint32_t*) (p))
+#define GUAC_IMAGE_ANALYSIS_STORE(p, v) vst1q_u32((uint32_t*) (p), v)
+#define GUAC_IMAGE_ANALYSIS_SPLAT(c)  vdupq_n_u32(c)
+#define GUAC_IMAGE_ANALYSIS_AND(a, b) vandq_u32(a, b)
+#define GUAC_IMAGE_ANALYSIS_OR(a, b)  vorrq_u32(a, b)
+#define GUAC_IMAGE_ANALYSIS_EQ(a, b)  vceqq_u32(a, b)
+#define GUAC_IMAGE_ANALYSIS_MASK(v) guac_image_analysis_neon_mask(v)
+
+/**
+ * Returns a bitmask containing the most significant bit of each lane of the
+ * given vector, where bit N of the result corresponds to lane N. This is the
+ * NEON equivalent of the SSE "movemask" instructions.
+ *
+ * @param v
+ *     The vector to convert to a bitmask, where each lane is expected to be
+ *     either all zeroes or all ones.
+ *
+ * @return
+ *     A bitmask with one bit for each lane of the given vector.
+ */
+static inline int guac_image_analysis_neon_mask(uint32x4_t v) {
+    static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(v, vld1q_u32(lanes)));
+}
+
+#endif
+
+#ifdef GUAC_IMAGE_ANALYSIS_VECTOR_SIZE
+
+/**
+ * Bitmask which would be returned by GUAC_IMAGE_ANALYSIS_MASK() if all lanes
+ * of the vector are set.
+ */
+#define GUAC_IMAGE_ANALYSIS_ALL_LANES \
+    ((1 << GUAC_IMAGE_ANALYSIS_VECTOR_SIZE) - 1)
+
+#endif
+
+/**
+ * The intermediate state of an image analysis which is in progress.
+ */
+typedef struct guac_image_analysis_state {
+
+    /**
+     * The analysis being populated.
+     */
+    guac_image_analysis* analysis;
+
+    /**
+     * Hash table of all distinct colors found thus far, where each color is
+     * stored with its alpha component set to 0xFF, and empty entries are
+     * zero.
+     */
+    uint32_t table[GUAC_IMAGE_ANALYSIS_TABLE_SIZE];
+
+    /**
+     * Non-zero if more than GUAC_IMAGE_MAX_PALETTE_SIZE distinct colors have
+     * been found, zero otherwise.
+     */
+    int overflow;
+
+} guac_image_analysis_state;
+
+/**
+ * Adds the given color to the palette of the analysis in progress, if not
+ * already present. If the palette is already full, the palette is marked as
+ * having overflowed, and no further colors will be added.
+ *
+ * @param state
+ *     The state of the analysis in progress.
+ *
+ * @param pixel
+ *     The pixel whose color should be added. Any alpha component is ignored.
+ */
+static void guac_image_analysis_add_color(guac_image_analysis_state* state,
+        uint32_t pixel) {
+
+    guac_image_analysis* analysis = state->analysis;
+
+    uint32_t color = pixel & GUAC_IMAGE_ANALYSIS_COLOR;
+    uint32_t key = color | GUAC_IMAGE_ANALYSIS_ALPHA;
+
+    /* Multiplicative hash, using the most significant bits of the product */
+    unsigned int hash = (uint32_t) (color * 2654435761u)
+                      >> (32 - GUAC_IMAGE_ANALYSIS_TABLE_BITS);
+
+    for (;;) {
+
+        uint32_t* entry = &state->table[hash];
+
+        /* Color is already present */
+        if (*entry == key)
+            return;
+
+        /* Color is new */
+        if (*entry == 0) {
+
+            if (analysis->palette_size == GUAC_IMAGE_MAX_PALETTE_SIZE) {
+                state->overflow = 1;
+                return;
+            }
+
+            *entry = key;
+            analysis->palette[analysis->palette_size++] = color;
+            return;
+
+        }
+
+        /* Collision - try next entry */
+        hash = (hash + 1) & (GUAC_IMAGE_ANALYSIS_TABLE_SIZE - 1);
+
+    }
+
+}
+
+void guac_image_analyze(const unsigned char* data, int width, int height,
+        int stride, guac_image_analysis* analysis) {
+
+    guac_image_analysis_state state;
+
+    int x, y;
+
+    analysis->opaque = 1;
+    analysis->solid = 0;
+    analysis->color = 0;
+    analysis->num_same = 0;
+    analysis->num_different = 0;
+    analysis->palette_size = 0;
+
+    /* Nothing to analyze within empty images */
+    if (width < 1 || height < 1)
+        return;
+
+    memset(state.table, 0, sizeof(state.table));
+    state.analysis = analysis;
+    state.overflow = 0;
+
+    uint32_t first = *((const uint32_t*) data);
+
+    /* Bitwise AND of all pixels, the alpha of which will be 0xFF only if all
+     * pixels are opaque */
+    uint32_t all = GUAC_IMAGE_ANALYSIS_ALPHA;
+
+    /* Whether all pixels are identical to the first */
+    int solid = 1;
+
+#ifdef GUAC_IMAGE_ANALYSIS_VECTOR_SIZE
+    const guac_image_analysis_vector valpha =
+        GUAC_IMAGE_ANALYSIS_SPLAT(GUAC_IMAGE_ANALYSIS_ALPHA);
+    const guac_image_analysis_vector vfirst =
+        GUAC_IMAGE_ANALYSIS_SPLAT(first);
+    guac_image_analysis_vector vall = valpha;
+    guac_image_analysis_vector vsolid = GUAC_IMAGE_ANALYSIS_SPLAT(0xFFFFFFFF);
+#endif
+
+    for (y = 0; y < height; y++) {
+
+        const uint32_t* row = (const uint32_t*) data;
+
+        /* The first pixel of each row is compared against nothing, but must
+         * still be accounted for */
+        uint32_t last = row[0];
+        all &= last;
+        solid &= (last == first);
+        guac_image_analysis_add_color(&state, last);
+
+        x = 1;
+
+#ifdef GUAC_IMAGE_ANALYSIS_VECTOR_SIZE
+        /* Compare each group of pixels against the pixels to their immediate
+         * left, looking up the colors of only those pixels which differ */
+        for (; x + GUAC_IMAGE_ANALYSIS_VECTOR_SIZE <= width;
+                x += GUAC_IMAGE_ANALYSIS_VECTOR_SIZE) {
+
+            guac_image_analysis_vector current =
+                GUAC_IMAGE_ANALYSIS_LOAD(row + x);
+            guac_image_analysis_vector previous =
+                GUAC_IMAGE_ANALYSIS_LOAD(row + x - 1);
+
+            vall = GUAC_IMAGE_ANALYSIS_AND(vall, current);
+            vsolid = GUAC_IMAGE_ANALYSIS_AND(vsolid,
+                    GUAC_IMAGE_ANALYSIS_EQ(current, vfirst));
+
+            int same = GUAC_IMAGE_ANALYSIS_MASK(GUAC_IMAGE_ANALYSIS_EQ(
+                        GUAC_IMAGE_ANALYSIS_OR(current, valpha),
+                        GUAC_IMAGE_ANALYSIS_OR(previous, valpha)));
+
+            /* Pixels identical to their neighbors have already been added
+             * to the palette */
+            if (same == GUAC_IMAGE_ANALYSIS_ALL_LANES) {
+                analysis->num_same += GUAC_IMAGE_ANALYSIS_VECTOR_SIZE;
+                continue;
+            }
+
+            for (int i = 0; i < GUAC_IMAGE_ANALYSIS_VECTOR_SIZE; i++) {
+                if (same & (1 << i))
+                    analysis->num_same++;
+                else {
+                    analysis->num_different++;
+                    if (!state.overflow)
+                        guac_image_analysis_add_color(&state, row[x + i]);
+                }
+            }
+
+        }
+
+        last = row[x - 1];
+#endif
+
+        /* Analyze any remaining pixels individually */
+        for (; x < width; x++) {
+
+            uint32_t current = row[x];
+
+            all &= current;
+            solid &= (current == first);
+
+            if ((current | GUAC_IMAGE_ANALYSIS_ALPHA)
+                    == (last | GUAC_IMAGE_ANALYSIS_ALPHA))
+                analysis->num_same++;
+            else {
+                analysis->num_different++;
+                if (!state.overflow)
+                    guac_image_analysis_add_color(&state, current);
+            }
+
+            last = current;
+
+        }
+
+        /* Next row */
+        data += stride;
+
+    }
+
+#ifdef GUAC_IMAGE_ANALYSIS_VECTOR_SIZE
+    /* Fold vector results into overall results */
+    uint32_t lanes[GUAC_IMAGE_ANALYSIS_VECTOR_SIZE];
+
+    GUAC_IMAGE_ANALYSIS_STORE(lanes, vall);
+    for (x = 0; x < GUAC_IMAGE_ANALYSIS_VECTOR_SIZE; x++)
+        all &= lanes[x];
+
+    if (GUAC_IMAGE_ANALYSIS_MASK(vsolid) != GUAC_IMAGE_ANALYSIS_ALL_LANES)
+        solid = 0;
+#endif
+
+    analysis->opaque = (all & GUAC_IMAGE_ANALYSIS_ALPHA)
+                    == GUAC_IMAGE_ANALYSIS_ALPHA;
+    analysis->solid = solid;
+    analysis->color = first;
+
+    /* There is no palette if there are too many colors */
+    if (state.overflow)
+        analysis->palette_size = 0;
+
+}
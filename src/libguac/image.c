@@ -0,0 +1,58 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "config.h"
+
+#include "encode-jpeg.h"
+#include "encode-png.h"
+#include "guacamole/error.h"
+#include "guacamole/image.h"
+#include "guacamole/socket.h"
+#include "guacamole/stream.h"
+
+#ifdef ENABLE_WEBP
+#include "encode-webp.h"
+#endif
+
+#include <cairo/cairo.h>
+
+int guac_image_write_png(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, const guac_image_analysis* analysis) {
+    return guac_png_write(socket, stream, surface, analysis);
+}
+
+int guac_image_write_jpeg(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality) {
+    return guac_jpeg_write(socket, stream, surface, quality);
+}
+
+int guac_image_write_webp(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, int lossless, int method) {
+
+#ifdef ENABLE_WEBP
+    return guac_webp_write(socket, stream, surface, quality, lossless,
+            method);
+#else
+    guac_error = GUAC_STATUS_NOT_SUPPORTED;
+    guac_error_message = "libguac was built without WebP support";
+    return -1;
+#endif
+
+}
+
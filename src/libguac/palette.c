@@ -21,80 +21,64 @@
 
 #include "palette.h"
 
-#include <cairo/cairo.h>
-
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
+guac_palette* guac_palette_alloc(const uint32_t* colors, int size) {
 
-    int x, y;
+    int i;
 
-    int width = cairo_image_surface_get_width(surface);
-    int height = cairo_image_surface_get_height(surface);
-    int stride = cairo_image_surface_get_stride(surface);
-    unsigned char* data = cairo_image_surface_get_data(surface);
+    /* PNG palettes are limited to 256 colors */
+    if (size > 256)
+        return NULL;
 
     /* Allocate palette */
     guac_palette* palette = (guac_palette*) malloc(sizeof(guac_palette));
     memset(palette, 0, sizeof(guac_palette));
 
-    for (y=0; y<height; y++) {
-        for (x=0; x<width; x++) {
-
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
+    for (i=0; i<size; i++) {
 
-            /* Calculate hash code */
-            int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
+        /* Get color */
+        int color = colors[i] & 0xFFFFFF;
 
-            guac_palette_entry* entry;
+        /* Calculate hash code */
+        int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
 
-            /* Search for open palette entry */
-            for (;;) {
-                
-                entry = &(palette->entries[hash]);
+        guac_palette_entry* entry;
 
-                /* If we've found a free space, use it */
-                if (entry->index == 0) {
+        /* Search for open palette entry */
+        for (;;) {
 
-                    png_color* c;
+            entry = &(palette->entries[hash]);
 
-                    /* Stop if already at capacity */
-                    if (palette->size == 256) {
-                        guac_palette_free(palette);
-                        return NULL;
-                    }
+            /* If we've found a free space, use it */
+            if (entry->index == 0) {
 
-                    /* Store in palette */
-                    c = &(palette->colors[palette->size]);
-                    c->blue  = (color      ) & 0xFF;
-                    c->green = (color >> 8 ) & 0xFF;
-                    c->red   = (color >> 16) & 0xFF;
+                /* Store in palette */
+                png_color* c = &(palette->colors[palette->size]);
+                c->blue  = (color      ) & 0xFF;
+                c->green = (color >> 8 ) & 0xFF;
+                c->red   = (color >> 16) & 0xFF;
 
-                    /* Add color to map */
-                    entry->index = ++palette->size;
-                    entry->color = color;
+                /* Add color to map */
+                entry->index = ++palette->size;
+                entry->color = color;
 
-                    break;
+                break;
 
-                }
+            }
 
-                /* Otherwise, if already stored here, done */
-                if (entry->color == color)
-                    break;
+            /* Otherwise, if already stored here, done */
+            if (entry->color == color)
+                break;
 
-                /* Otherwise, collision. Move on to another bucket */
-                hash = (hash+1) & 0xFFF;
+            /* Otherwise, collision. Move on to another bucket */
+            hash = (hash+1) & 0xFFF;
 
-            }
         }
 
-        /* Advance to next data row */
-        data += stride;
-
     }
 
     return palette;
@@ -21,8 +21,8 @@
 #ifndef __GUAC_PALETTE_H
 #define __GUAC_PALETTE_H
 
-#include <cairo/cairo.h>
 #include <png.h>
+#include <stdint.h>
 
 typedef struct guac_palette_entry {
 
@@ -39,7 +39,7 @@ typedef struct guac_palette {
 
 } guac_palette;
 
-guac_palette* guac_palette_alloc(cairo_surface_t* surface);
+guac_palette* guac_palette_alloc(const uint32_t* colors, int size);
 int guac_palette_find(guac_palette* palette, int color);
 void guac_palette_free(guac_palette* palette);
 
@@ -24,10 +24,193 @@
 #include "guacamole/socket.h"
 #include "guacamole/unicode.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GUAC_PARSER_BLOCK_SIZE 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GUAC_PARSER_BLOCK_SIZE 16
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define GUAC_PARSER_BLOCK_SIZE 16
+#endif
+
+#ifdef GUAC_PARSER_BLOCK_SIZE
+
+/**
+ * Classifies each byte within the block of GUAC_PARSER_BLOCK_SIZE bytes at
+ * the given location, producing bitmasks in which bit N corresponds to the
+ * Nth byte of the block. The classifications match the behavior of
+ * guac_utf8_charsize().
+ *
+ * @param buffer
+ *     The block of bytes to classify.
+ *
+ * @param continuation
+ *     Pointer to a bitmask which should receive the bytes which are UTF-8
+ *     continuation bytes (10xxxxxx).
+ *
+ * @param lead2
+ *     Pointer to a bitmask which should receive the bytes which begin UTF-8
+ *     sequences of at least two bytes.
+ *
+ * @param lead3
+ *     Pointer to a bitmask which should receive the bytes which begin UTF-8
+ *     sequences of at least three bytes.
+ *
+ * @param lead4
+ *     Pointer to a bitmask which should receive the bytes which begin UTF-8
+ *     sequences of four bytes.
+ *
+ * @return
+ *     Zero if all bytes within the block are ASCII, in which case the
+ *     bitmasks are not set, non-zero otherwise.
+ */
+static int __guac_parser_classify(const char* buffer, uint64_t* continuation,
+        uint64_t* lead2, uint64_t* lead3, uint64_t* lead4) {
+
+#if defined(__AVX2__)
+
+    /* Bytes are compared as signed values, such that 0x80 is -128 and 0xF7
+     * is -9 */
+    __m256i block = _mm256_loadu_si256((const __m256i*) buffer);
+    if (_mm256_movemask_epi8(block) == 0)
+        return 0;
+
+    __m256i below_f8 = _mm256_cmpgt_epi8(_mm256_set1_epi8(-8), block);
+
+    *continuation = (uint32_t) _mm256_movemask_epi8(
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(-64), block));
+
+    *lead2 = (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(below_f8,
+            _mm256_cmpgt_epi8(block, _mm256_set1_epi8(-65))));
+
+    *lead3 = (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(below_f8,
+            _mm256_cmpgt_epi8(block, _mm256_set1_epi8(-33))));
+
+    *lead4 = (uint32_t) _mm256_movemask_epi8(_mm256_and_si256(below_f8,
+            _mm256_cmpgt_epi8(block, _mm256_set1_epi8(-17))));
+
+#elif defined(__SSE2__)
+
+    /* Bytes are compared as signed values, such that 0x80 is -128 and 0xF7
+     * is -9 */
+    __m128i block = _mm_loadu_si128((const __m128i*) buffer);
+    if (_mm_movemask_epi8(block) == 0)
+        return 0;
+
+    __m128i below_f8 = _mm_cmplt_epi8(block, _mm_set1_epi8(-8));
+
+    *continuation = (uint32_t) _mm_movemask_epi8(
+            _mm_cmplt_epi8(block, _mm_set1_epi8(-64)));
+
+    *lead2 = (uint32_t) _mm_movemask_epi8(_mm_and_si128(below_f8,
+            _mm_cmpgt_epi8(block, _mm_set1_epi8(-65))));
+
+    *lead3 = (uint32_t) _mm_movemask_epi8(_mm_and_si128(below_f8,
+            _mm_cmpgt_epi8(block, _mm_set1_epi8(-33))));
+
+    *lead4 = (uint32_t) _mm_movemask_epi8(_mm_and_si128(below_f8,
+            _mm_cmpgt_epi8(block, _mm_set1_epi8(-17))));
+
+#else
+
+    /* The value of the bit corresponding to each byte within each half of
+     * the block */
+    static const uint8_t bits[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128,
+        1, 2, 4, 8, 16, 32, 64, 128
+    };
+
+    uint8x16_t block = vld1q_u8((const uint8_t*) buffer);
+    if (vmaxvq_u8(block) < 0x80)
+        return 0;
+
+    uint8x16_t weights = vld1q_u8(bits);
+    uint8x16_t below_f8 = vcltq_u8(block, vdupq_n_u8(0xF8));
+    uint8x16_t masks[4] = {
+        vandq_u8(vcltq_u8(block, vdupq_n_u8(0xC0)),
+                 vcgeq_u8(block, vdupq_n_u8(0x80))),
+        vandq_u8(below_f8, vcgeq_u8(block, vdupq_n_u8(0xC0))),
+        vandq_u8(below_f8, vcgeq_u8(block, vdupq_n_u8(0xE0))),
+        vandq_u8(below_f8, vcgeq_u8(block, vdupq_n_u8(0xF0)))
+    };
+
+    /* Reduce each comparison result to a bitmask */
+    uint64_t* results[4] = { continuation, lead2, lead3, lead4 };
+    for (int i = 0; i < 4; i++) {
+        uint8x16_t weighted = vandq_u8(masks[i], weights);
+        *results[i] = vaddv_u8(vget_low_u8(weighted))
+                   | (vaddv_u8(vget_high_u8(weighted)) << 8);
+    }
+
+#endif
+
+    return 1;
+
+}
+
+/**
+ * Skips past as many complete UTF-8 characters as possible within the block
+ * of GUAC_PARSER_BLOCK_SIZE bytes at the given location, counting the
+ * characters skipped. Characters are counted exactly as guac_parser_append()
+ * would count them one at a time using guac_utf8_charsize(). If the block
+ * contains anything other than well-formed UTF-8 sequences, nothing is
+ * skipped, and the characters must instead be counted one at a time.
+ *
+ * @param buffer
+ *     The block of bytes to skip, which must begin at the start of a
+ *     character.
+ *
+ * @param chars
+ *     Pointer to an int which should receive the number of characters
+ *     skipped.
+ *
+ * @return
+ *     The number of bytes skipped, which may be zero.
+ */
+static int __guac_parser_skip_block(const char* buffer, int* chars) {
+
+    uint64_t continuation, lead2, lead3, lead4;
+    uint64_t block_mask = (((uint64_t) 1) << GUAC_PARSER_BLOCK_SIZE) - 1;
+
+    /* Blocks consisting only of ASCII characters are trivial */
+    if (!__guac_parser_classify(buffer, &continuation,
+                &lead2, &lead3, &lead4)) {
+        *chars = GUAC_PARSER_BLOCK_SIZE;
+        return GUAC_PARSER_BLOCK_SIZE;
+    }
+
+    /* Determine which bytes must be continuation bytes to complete the
+     * sequences begun within this block */
+    uint64_t expected = (lead2 << 1) | (lead3 << 2) | (lead4 << 3);
+
+    /* Defer to guac_utf8_charsize() if any sequence is malformed */
+    if ((expected & block_mask) != continuation)
+        return 0;
+
+    /* Every byte which is not a continuation byte begins a character */
+    uint64_t starts = ~continuation & block_mask;
+
+    /* Skip entire block if its last character is complete */
+    if ((expected & ~block_mask) == 0) {
+        *chars = __builtin_popcountll(starts);
+        return GUAC_PARSER_BLOCK_SIZE;
+    }
+
+    /* Otherwise, skip everything prior to the last character */
+    *chars = __builtin_popcountll(starts) - 1;
+    return 63 - __builtin_clzll(starts);
+
+}
+
+#endif
+
 static void guac_parser_reset(guac_parser* parser) {
     parser->opcode = NULL;
     parser->argc = 0;
@@ -46,6 +229,18 @@ guac_parser* guac_parser_alloc() {
         return NULL;
     }
 
+    /* Allocate initial instruction buffer */
+    parser->__instructionbuf = malloc(GUAC_PARSER_BUFFER_SIZE);
+    if (parser->__instructionbuf == NULL) {
+        free(parser);
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Insufficient memory to allocate parser buffer";
+        return NULL;
+    }
+
+    parser->__instructionbuf_size = GUAC_PARSER_BUFFER_SIZE;
+    parser->__max_element_length = GUAC_INSTRUCTION_MAX_LENGTH;
+
     /* Init parse start/end markers */
     parser->__instructionbuf_unparsed_start = parser->__instructionbuf;
     parser->__instructionbuf_unparsed_end = parser->__instructionbuf;
@@ -55,6 +250,101 @@ guac_parser* guac_parser_alloc() {
 
 }
 
+int guac_parser_set_max_element_length(guac_parser* parser, int length) {
+
+    /* Reject lengths for which the buffer could not be sized */
+    if (length < GUAC_INSTRUCTION_MAX_LENGTH
+            || length > GUAC_PARSER_MAX_ELEMENT_LENGTH) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Maximum element length out of range";
+        return 1;
+    }
+
+    parser->__max_element_length = length;
+    return 0;
+
+}
+
+/**
+ * Returns the largest size that the instruction buffer of the given parser
+ * may grow to, in bytes. This size scales with the maximum element length,
+ * such that the ratio between the two is the same as that between
+ * GUAC_PARSER_BUFFER_SIZE and GUAC_INSTRUCTION_MAX_LENGTH.
+ *
+ * @param parser
+ *     The parser to determine the maximum buffer size of.
+ *
+ * @return
+ *     The maximum size of the instruction buffer of the given parser, in
+ *     bytes.
+ */
+static int guac_parser_max_buffer_size(guac_parser* parser) {
+    return GUAC_PARSER_BUFFER_SIZE
+        / GUAC_INSTRUCTION_MAX_LENGTH * parser->__max_element_length;
+}
+
+/**
+ * Grows the instruction buffer of the given parser, moving the in-progress
+ * instruction to the beginning of the new buffer and updating all pointers
+ * into that buffer accordingly.
+ *
+ * @param parser
+ *     The parser whose instruction buffer should be grown.
+ *
+ * @param instr_start
+ *     Pointer to the pointer to the start of the in-progress instruction
+ *     within the instruction buffer.
+ *
+ * @param unparsed_start
+ *     Pointer to the pointer to the first unparsed byte within the
+ *     instruction buffer.
+ *
+ * @param unparsed_end
+ *     Pointer to the pointer to the first unused byte within the instruction
+ *     buffer.
+ *
+ * @return
+ *     Zero if the buffer was successfully grown, non-zero if the buffer is
+ *     already at its maximum size or memory cannot be allocated.
+ */
+static int guac_parser_grow(guac_parser* parser, char** instr_start,
+        char** unparsed_start, char** unparsed_end) {
+
+    int max_size = guac_parser_max_buffer_size(parser);
+    if (parser->__instructionbuf_size >= max_size)
+        return 1;
+
+    /* Double size of buffer, up to the maximum */
+    int size = max_size;
+    if (parser->__instructionbuf_size < max_size / 2)
+        size = parser->__instructionbuf_size * 2;
+
+    char* buffer = malloc(size);
+    if (buffer == NULL)
+        return 1;
+
+    int i;
+
+    /* Copy in-progress instruction to beginning of new buffer */
+    char* old_start = *instr_start;
+    memcpy(buffer, old_start, *unparsed_end - old_start);
+
+    /* Update tracking pointers */
+    *instr_start    = buffer;
+    *unparsed_start = buffer + (*unparsed_start - old_start);
+    *unparsed_end   = buffer + (*unparsed_end   - old_start);
+
+    /* Update parsed elements, if any */
+    for (i=0; i < parser->__elementc; i++)
+        parser->__elementv[i] = buffer + (parser->__elementv[i] - old_start);
+
+    free(parser->__instructionbuf);
+    parser->__instructionbuf = buffer;
+    parser->__instructionbuf_size = size;
+    return 0;
+
+}
+
 int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
     char* char_buffer = (char*) buffer;
@@ -78,9 +368,19 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
             bytes_parsed++;
 
             /* If digit, add to length */
-            if (c >= '0' && c <= '9')
+            if (c >= '0' && c <= '9') {
+
+                /* If too long, parse error */
+                if (parsed_length > (parser->__max_element_length
+                            - (c - '0')) / 10) {
+                    parser->state = GUAC_PARSE_ERROR;
+                    return 0;
+                }
+
                 parsed_length = parsed_length*10 + c - '0';
 
+            }
+
             /* If period, switch to parsing content */
             else if (c == '.') {
                 parser->__elementv[parser->__elementc++] = char_buffer;
@@ -96,12 +396,6 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
         }
 
-        /* If too long, parse error */
-        if (parsed_length > GUAC_INSTRUCTION_MAX_LENGTH) {
-            parser->state = GUAC_PARSE_ERROR;
-            return 0;
-        }
-
         /* Save length */
         parser->__element_length = parsed_length;
 
@@ -112,6 +406,25 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
         while (bytes_parsed < length && parser->__element_length >= 0) {
 
+#ifdef GUAC_PARSER_BLOCK_SIZE
+            /* Skip entire blocks of characters where possible, so long as
+             * the end of the element cannot be within the block */
+            if (parser->__element_length >= GUAC_PARSER_BLOCK_SIZE
+                    && length - bytes_parsed >= GUAC_PARSER_BLOCK_SIZE) {
+
+                int chars;
+                int skipped = __guac_parser_skip_block(char_buffer, &chars);
+
+                if (skipped > 0) {
+                    parser->__element_length -= chars;
+                    bytes_parsed += skipped;
+                    char_buffer += skipped;
+                    continue;
+                }
+
+            }
+#endif
+
             /* Get length of current character */
             char c = *char_buffer;
             int char_length = guac_utf8_charsize((unsigned char) c);
@@ -168,12 +481,26 @@ int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout)
     char* unparsed_end   = parser->__instructionbuf_unparsed_end;
     char* unparsed_start = parser->__instructionbuf_unparsed_start;
     char* instr_start    = parser->__instructionbuf_unparsed_start;
-    char* buffer_end     = parser->__instructionbuf + sizeof(parser->__instructionbuf);
+    char* buffer_end     = parser->__instructionbuf + parser->__instructionbuf_size;
 
     /* Begin next instruction if previous was ended */
-    if (parser->state == GUAC_PARSE_COMPLETE)
+    if (parser->state == GUAC_PARSE_COMPLETE) {
+
         guac_parser_reset(parser);
 
+        /* Reuse the beginning of the buffer if no unparsed data remains,
+         * such that compaction is rarely needed */
+        if (unparsed_start == unparsed_end)
+            instr_start = unparsed_start = unparsed_end =
+                parser->__instructionbuf;
+
+    }
+
+    /* If resuming an instruction which was interrupted by a timeout, only
+     * the elements already parsed need be retained */
+    else if (parser->__elementc > 0)
+        instr_start = parser->__elementv[0];
+
     while (parser->state != GUAC_PARSE_COMPLETE
         && parser->state != GUAC_PARSE_ERROR) {
 
@@ -185,11 +512,21 @@ int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout)
 
             int retval;
 
-            /* If no space left to read, fail */
+            /* If no space left to read, make room */
             if (unparsed_end == buffer_end) {
 
-                /* Shift backward if possible */
-                if (instr_start != parser->__instructionbuf) {
+                /* Grow buffer if the in-progress instruction occupies most of
+                 * the buffer */
+                if (instr_start - parser->__instructionbuf
+                            < parser->__instructionbuf_size / 2
+                        && guac_parser_grow(parser, &instr_start,
+                            &unparsed_start, &unparsed_end) == 0) {
+                    buffer_end = parser->__instructionbuf
+                        + parser->__instructionbuf_size;
+                }
+
+                /* Otherwise, shift backward if possible */
+                else if (instr_start != parser->__instructionbuf) {
 
                     int i;
 
@@ -220,8 +557,15 @@ int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout)
 
             /* No instruction yet? Get more data ... */
             retval = guac_socket_select(socket, usec_timeout);
-            if (retval <= 0)
+            if (retval <= 0) {
+
+                /* Retain any partially-read instruction such that reading
+                 * may be resumed by a later call */
+                parser->__instructionbuf_unparsed_start = unparsed_start;
+                parser->__instructionbuf_unparsed_end = unparsed_end;
                 return -1;
+
+            }
            
             /* Attempt to fill buffer */
             retval = guac_socket_read(socket, unparsed_end,
@@ -313,6 +657,7 @@ int guac_parser_shift(guac_parser* parser, void* buffer, int length) {
 }
 
 void guac_parser_free(guac_parser* parser) {
+    free(parser->__instructionbuf);
     free(parser);
 }
 
@@ -19,9 +19,11 @@
 
 #include "config.h"
 
+#include "base64.h"
 #include "guacamole/error.h"
 #include "guacamole/layer.h"
 #include "guacamole/object.h"
+#include "guacamole/parser-constants.h"
 #include "guacamole/protocol.h"
 #include "guacamole/protocol-types.h"
 #include "guacamole/socket.h"
@@ -68,132 +70,420 @@ guac_protocol_version_mapping guac_protocol_version_table[] = {
     { GUAC_PROTOCOL_VERSION_UNKNOWN, NULL }
 };
 
+/**
+ * The size of the buffer used to format each instruction before it is
+ * written to the socket, in bytes. Any instruction which fits within the
+ * maximum instruction length accepted by the Guacamole parser, including a
+ * blob containing GUAC_PROTOCOL_BLOB_MAX_LENGTH bytes of data, is written
+ * with a single call to guac_socket_write().
+ */
+#define GUAC_PROTOCOL_INSTRUCTION_BUFFER_SIZE GUAC_INSTRUCTION_MAX_LENGTH
+
+/**
+ * The maximum number of characters required to represent any 64-bit
+ * integer in decimal, including the sign.
+ */
+#define GUAC_PROTOCOL_INT_MAX_DIGITS 20
+
+/**
+ * An instruction being formatted for writing to a guac_socket. Elements
+ * are appended to an internal buffer, which is written to the socket only
+ * when the instruction is complete or the buffer is full.
+ */
+typedef struct guac_protocol_instruction {
+
+    /**
+     * The socket that the instruction will be written to.
+     */
+    guac_socket* socket;
+
+    /**
+     * Whether guac_socket_instruction_begin() has been invoked on the socket
+     * for this instruction. This occurs only once the first portion of the
+     * instruction is actually written.
+     */
+    int begun;
+
+    /**
+     * Non-zero if an error has occurred while writing any portion of the
+     * instruction, in which case all further appends are ignored.
+     */
+    int error;
+
+    /**
+     * The number of bytes currently stored within the buffer.
+     */
+    int length;
+
+    /**
+     * The formatted, but not yet written, portion of the instruction.
+     */
+    char buffer[GUAC_PROTOCOL_INSTRUCTION_BUFFER_SIZE];
+
+} guac_protocol_instruction;
+
 /* Output formatting functions */
 
-ssize_t __guac_socket_write_length_string(guac_socket* socket, const char* str) {
+/**
+ * Writes the decimal representation of the given integer to the given
+ * buffer. No null terminator is written.
+ *
+ * @param buffer
+ *     The buffer to write to, which must have space for at least
+ *     GUAC_PROTOCOL_INT_MAX_DIGITS characters.
+ *
+ * @param value
+ *     The integer to format.
+ *
+ * @return
+ *     The number of characters written.
+ */
+static int __guac_protocol_format_int(char* buffer, int64_t value) {
+
+    char digits[GUAC_PROTOCOL_INT_MAX_DIGITS];
+    char* current = digits + sizeof(digits);
+
+    /* Work with the magnitude as unsigned such that INT64_MIN is handled */
+    uint64_t magnitude = (value < 0) ? -((uint64_t) value) : (uint64_t) value;
+
+    /* Produce digits in reverse */
+    do {
+        *(--current) = '0' + (magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
 
-    return
-           guac_socket_write_int(socket, guac_utf8_strlen(str))
-        || guac_socket_write_string(socket, ".")
-        || guac_socket_write_string(socket, str);
+    if (value < 0)
+        *(--current) = '-';
+
+    int length = digits + sizeof(digits) - current;
+    memcpy(buffer, current, length);
+    return length;
 
 }
 
-ssize_t __guac_socket_write_length_int(guac_socket* socket, int64_t i) {
+/**
+ * Writes any data within the buffer of the given instruction to its socket,
+ * beginning the instruction on that socket if this has not yet been done.
+ *
+ * @param instruction
+ *     The instruction to flush.
+ */
+static void __guac_protocol_instruction_flush(
+        guac_protocol_instruction* instruction) {
 
-    char buffer[128];
-    snprintf(buffer, sizeof(buffer), "%"PRIi64, i);
-    return __guac_socket_write_length_string(socket, buffer);
+    if (!instruction->begun) {
+        guac_socket_instruction_begin(instruction->socket);
+        instruction->begun = 1;
+    }
+
+    if (instruction->length > 0 && !instruction->error) {
+        if (guac_socket_write(instruction->socket, instruction->buffer,
+                    instruction->length))
+            instruction->error = 1;
+    }
+
+    instruction->length = 0;
 
 }
 
-ssize_t __guac_socket_write_length_double(guac_socket* socket, double d) {
+/**
+ * Appends arbitrary data to the given instruction. The data is written to
+ * the socket directly if it is too large to be buffered.
+ *
+ * @param instruction
+ *     The instruction to append data to.
+ *
+ * @param data
+ *     The data to append.
+ *
+ * @param length
+ *     The number of bytes of data to append.
+ */
+static void __guac_protocol_instruction_append_raw(
+        guac_protocol_instruction* instruction, const char* data,
+        size_t length) {
 
-    char buffer[128];
-    snprintf(buffer, sizeof(buffer), "%.16g", d);
-    return __guac_socket_write_length_string(socket, buffer);
+    /* Make room for the data if the buffer cannot contain it */
+    if (length > sizeof(instruction->buffer) - instruction->length) {
+
+        __guac_protocol_instruction_flush(instruction);
+
+        /* Write the data directly if it cannot be buffered at all */
+        if (length > sizeof(instruction->buffer)) {
+            if (!instruction->error
+                    && guac_socket_write(instruction->socket, data, length))
+                instruction->error = 1;
+            return;
+        }
+
+    }
+
+    memcpy(instruction->buffer + instruction->length, data, length);
+    instruction->length += length;
 
 }
 
 /**
- * Loop through the provided NULL-terminated array, writing the values in the
- * array to the given socket. Values are written as a series of Guacamole
- * protocol elements, including the leading comma and the value length in
- * addition to the value itself. Returns zero on success, non-zero on error.
+ * Begins a new instruction having the given opcode. The instruction is not
+ * written to the socket until __guac_protocol_instruction_end() is invoked,
+ * unless the instruction is too large to be buffered.
+ *
+ * @param instruction
+ *     The instruction to initialize.
  *
  * @param socket
- *     The socket to which the data should be written.
+ *     The socket that the instruction will be written to.
+ *
+ * @param opcode
+ *     The opcode of the instruction, including its length prefix, such as
+ *     "4.sync".
+ */
+static void __guac_protocol_instruction_begin(
+        guac_protocol_instruction* instruction, guac_socket* socket,
+        const char* opcode) {
+
+    instruction->socket = socket;
+    instruction->begun = 0;
+    instruction->error = 0;
+    instruction->length = 0;
+
+    __guac_protocol_instruction_append_raw(instruction, opcode,
+            strlen(opcode));
+
+}
+
+/**
+ * Appends a string element, including its leading comma and length prefix,
+ * to the given instruction.
+ *
+ * @param instruction
+ *     The instruction to append the element to.
+ *
+ * @param str
+ *     The null-terminated value of the element.
+ */
+static void __guac_protocol_instruction_append_string(
+        guac_protocol_instruction* instruction, const char* str) {
+
+    char prefix[GUAC_PROTOCOL_INT_MAX_DIGITS + 2];
+    int prefix_length = 0;
+
+    /* Leading comma and length prefix */
+    prefix[prefix_length++] = ',';
+    prefix_length += __guac_protocol_format_int(prefix + prefix_length,
+            guac_utf8_strlen(str));
+    prefix[prefix_length++] = '.';
+
+    __guac_protocol_instruction_append_raw(instruction, prefix, prefix_length);
+    __guac_protocol_instruction_append_raw(instruction, str, strlen(str));
+
+}
+
+/**
+ * Appends an integer element, including its leading comma and length prefix,
+ * to the given instruction.
+ *
+ * @param instruction
+ *     The instruction to append the element to.
+ *
+ * @param value
+ *     The value of the element.
+ */
+static void __guac_protocol_instruction_append_int(
+        guac_protocol_instruction* instruction, int64_t value) {
+
+    char element[GUAC_PROTOCOL_INT_MAX_DIGITS * 2 + 2];
+
+    /* Format the value at its final position (its length prefix requires
+     * at most two digits) */
+    char* digits = element + 4;
+    int length = __guac_protocol_format_int(digits, value);
+
+    /* Prepend length prefix and leading comma */
+    *(--digits) = '.';
+    *(--digits) = '0' + (length % 10);
+    if (length >= 10)
+        *(--digits) = '0' + (length / 10);
+    *(--digits) = ',';
+
+    __guac_protocol_instruction_append_raw(instruction, digits,
+            element + 4 + length - digits);
+
+}
+
+/**
+ * Appends a floating-point element, including its leading comma and length
+ * prefix, to the given instruction.
+ *
+ * @param instruction
+ *     The instruction to append the element to.
+ *
+ * @param value
+ *     The value of the element.
+ */
+static void __guac_protocol_instruction_append_double(
+        guac_protocol_instruction* instruction, double value) {
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "%.16g", value);
+    __guac_protocol_instruction_append_string(instruction, buffer);
+
+}
+
+/**
+ * Appends each value within the given NULL-terminated array as a string
+ * element, including the leading comma and length prefix, to the given
+ * instruction.
+ *
+ * @param instruction
+ *     The instruction to append the elements to.
  *
  * @param array
- *     The NULL-terminated array of values to write.
+ *     The NULL-terminated array of values to append.
+ */
+static void __guac_protocol_instruction_append_array(
+        guac_protocol_instruction* instruction, const char** array) {
+
+    for (int i = 0; array[i] != NULL; i++)
+        __guac_protocol_instruction_append_string(instruction, array[i]);
+
+}
+
+/**
+ * Appends a blob element containing the given data as base64, including the
+ * leading comma and length prefix, to the given instruction. The base64 is
+ * encoded directly into the instruction buffer if it will fit.
  *
- * @return
- *     Zero on success, non-zero on error.
+ * @param instruction
+ *     The instruction to append the element to.
+ *
+ * @param data
+ *     The data to encode.
+ *
+ * @param count
+ *     The number of bytes of data to encode.
  */
-static int guac_socket_write_array(guac_socket* socket, const char** array) {
+static void __guac_protocol_instruction_append_base64(
+        guac_protocol_instruction* instruction, const void* data, int count) {
+
+    char prefix[GUAC_PROTOCOL_INT_MAX_DIGITS + 2];
+    int prefix_length = 0;
+
+    int base64_length = (count + 2) / 3 * 4;
+
+    /* Leading comma and length prefix */
+    prefix[prefix_length++] = ',';
+    prefix_length += __guac_protocol_format_int(prefix + prefix_length,
+            base64_length);
+    prefix[prefix_length++] = '.';
 
-    /* Loop through array, writing provided values to the socket. */
-    for (int i=0; array[i] != NULL; i++) {
+    __guac_protocol_instruction_append_raw(instruction, prefix, prefix_length);
 
-        if (guac_socket_write_string(socket, ","))
-            return -1;
+    /* Write base64 through the socket if it cannot be buffered */
+    if (base64_length > GUAC_PROTOCOL_INSTRUCTION_BUFFER_SIZE
+            - instruction->length) {
 
-        if (__guac_socket_write_length_string(socket, array[i]))
-            return -1;
+        __guac_protocol_instruction_flush(instruction);
+
+        if (!instruction->error
+                && (guac_socket_write_base64(instruction->socket, data, count)
+                    || guac_socket_flush_base64(instruction->socket)))
+            instruction->error = 1;
+
+        return;
 
     }
 
-    return 0;
+    const unsigned char* bytes = (const unsigned char*) data;
+    char* output = instruction->buffer + instruction->length;
 
-}
+    /* Encode all complete triplets */
+    int whole = count - count % 3;
+    output += guac_base64_encode(bytes, whole, output);
 
-/* Protocol functions */
+    /* Encode any remaining bytes, padded with "=" */
+    if (whole < count) {
 
-int guac_protocol_send_ack(guac_socket* socket, guac_stream* stream,
-        const char* error, guac_protocol_status status) {
+        unsigned char triplet[3] = { bytes[whole], 0, 0 };
+        if (whole + 1 < count)
+            triplet[1] = bytes[whole + 1];
 
-    int ret_val;
+        guac_base64_encode(triplet, 3, output);
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.ack,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, error)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, status)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+        output[3] = '=';
+        if (whole + 1 == count)
+            output[2] = '=';
+
+    }
+
+    instruction->length += base64_length;
 
 }
 
-static int __guac_protocol_send_args(guac_socket* socket, const char** args) {
+/**
+ * Completes the given instruction, writing any remaining portion to the
+ * socket.
+ *
+ * @param instruction
+ *     The instruction to complete.
+ *
+ * @return
+ *     Zero if the entire instruction was written successfully, non-zero
+ *     otherwise.
+ */
+static int __guac_protocol_instruction_end(
+        guac_protocol_instruction* instruction) {
 
-    if (guac_socket_write_string(socket, "4.args")) return -1;
-    
-    /* Send protocol version ahead of other args. */
-    if (guac_socket_write_string(socket, ",")
-            || __guac_socket_write_length_string(socket, GUACAMOLE_PROTOCOL_VERSION))
-        return -1;
+    __guac_protocol_instruction_append_raw(instruction, ";", 1);
+    __guac_protocol_instruction_flush(instruction);
+    guac_socket_instruction_end(instruction->socket);
 
-    if (guac_socket_write_array(socket, args))
-        return -1;
+    return instruction->error;
 
-    return guac_socket_write_string(socket, ";");
+}
+
+/* Protocol functions */
+
+int guac_protocol_send_ack(guac_socket* socket, guac_stream* stream,
+        const char* error, guac_protocol_status status) {
+
+    guac_protocol_instruction instruction;
+
+    __guac_protocol_instruction_begin(&instruction, socket, "3.ack");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_string(&instruction, error);
+    __guac_protocol_instruction_append_int(&instruction, status);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_args(guac_socket* socket, const char** args) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = __guac_protocol_send_args(socket, args);
-    guac_socket_instruction_end(socket);
+    __guac_protocol_instruction_begin(&instruction, socket, "4.args");
 
-    return ret_val;
+    /* Send protocol version ahead of other args. */
+    __guac_protocol_instruction_append_string(&instruction,
+            GUACAMOLE_PROTOCOL_VERSION);
+    __guac_protocol_instruction_append_array(&instruction, args);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_argv(guac_socket* socket, guac_stream* stream,
         const char* mimetype, const char* name) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.argv,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.argv");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_string(&instruction, mimetype);
+    __guac_protocol_instruction_append_string(&instruction, name);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -201,69 +491,44 @@ int guac_protocol_send_arc(guac_socket* socket, const guac_layer* layer,
         int x, int y, int radius, double startAngle, double endAngle,
         int negative) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.arc,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, radius)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, startAngle)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, endAngle)
-        || guac_socket_write_string(socket, ",")
-        || guac_socket_write_string(socket, negative ? "1.1" : "1.0")
-        || guac_socket_write_string(socket, ";");
-    guac_socket_instruction_end(socket);
+    __guac_protocol_instruction_begin(&instruction, socket, "3.arc");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, x);
+    __guac_protocol_instruction_append_int(&instruction, y);
+    __guac_protocol_instruction_append_int(&instruction, radius);
+    __guac_protocol_instruction_append_double(&instruction, startAngle);
+    __guac_protocol_instruction_append_double(&instruction, endAngle);
+    __guac_protocol_instruction_append_int(&instruction, negative ? 1 : 0);
 
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_audio(guac_socket* socket, const guac_stream* stream,
         const char* mimetype) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "5.audio,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ";");
-    guac_socket_instruction_end(socket);
+    __guac_protocol_instruction_begin(&instruction, socket, "5.audio");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_string(&instruction, mimetype);
 
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_blob(guac_socket* socket, const guac_stream* stream,
         const void* data, int count) {
 
-    int base64_length = (count + 2) / 3 * 4;
+    guac_protocol_instruction instruction;
 
-    int ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.blob");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_base64(&instruction, data, count);
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.blob,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || guac_socket_write_int(socket, base64_length)
-        || guac_socket_write_string(socket, ".")
-        || guac_socket_write_base64(socket, data, count)
-        || guac_socket_flush_base64(socket)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -297,22 +562,15 @@ int guac_protocol_send_blobs(guac_socket* socket, const guac_stream* stream,
 int guac_protocol_send_body(guac_socket* socket, const guac_object* object,
         const guac_stream* stream, const char* mimetype, const char* name) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.body,")
-        || __guac_socket_write_length_int(socket, object->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.body");
+    __guac_protocol_instruction_append_int(&instruction, object->index);
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_string(&instruction, mimetype);
+    __guac_protocol_instruction_append_string(&instruction, name);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -320,98 +578,63 @@ int guac_protocol_send_cfill(guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer,
         int r, int g, int b, int a) {
 
-    int ret_val;
-
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.cfill,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, r)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, g)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_instruction instruction;
 
-}
+    __guac_protocol_instruction_begin(&instruction, socket, "5.cfill");
+    __guac_protocol_instruction_append_int(&instruction, mode);
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, r);
+    __guac_protocol_instruction_append_int(&instruction, g);
+    __guac_protocol_instruction_append_int(&instruction, b);
+    __guac_protocol_instruction_append_int(&instruction, a);
 
-int guac_protocol_send_close(guac_socket* socket, const guac_layer* layer) {
-
-    int ret_val;
-
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.close,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
-static int __guac_protocol_send_connect(guac_socket* socket, const char** args) {
+int guac_protocol_send_close(guac_socket* socket, const guac_layer* layer) {
 
-    if (guac_socket_write_string(socket, "7.connect"))
-        return -1;
+    guac_protocol_instruction instruction;
 
-    if (guac_socket_write_array(socket, args))
-        return -1;
+    __guac_protocol_instruction_begin(&instruction, socket, "5.close");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
 
-    return guac_socket_write_string(socket, ";");
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_connect(guac_socket* socket, const char** args) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = __guac_protocol_send_connect(socket, args);
-    guac_socket_instruction_end(socket);
+    __guac_protocol_instruction_begin(&instruction, socket, "7.connect");
+    __guac_protocol_instruction_append_array(&instruction, args);
 
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_clip(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.clip,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "4.clip");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_clipboard(guac_socket* socket, const guac_stream* stream,
         const char* mimetype) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "9.clipboard,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "9.clipboard");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_string(&instruction, mimetype);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -419,32 +642,20 @@ int guac_protocol_send_copy(guac_socket* socket,
         const guac_layer* srcl, int srcx, int srcy, int w, int h,
         guac_composite_mode mode, const guac_layer* dstl, int dstx, int dsty) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.copy,")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.copy");
+    __guac_protocol_instruction_append_int(&instruction, srcl->index);
+    __guac_protocol_instruction_append_int(&instruction, srcx);
+    __guac_protocol_instruction_append_int(&instruction, srcy);
+    __guac_protocol_instruction_append_int(&instruction, w);
+    __guac_protocol_instruction_append_int(&instruction, h);
+    __guac_protocol_instruction_append_int(&instruction, mode);
+    __guac_protocol_instruction_append_int(&instruction, dstl->index);
+    __guac_protocol_instruction_append_int(&instruction, dstx);
+    __guac_protocol_instruction_append_int(&instruction, dsty);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -453,112 +664,75 @@ int guac_protocol_send_cstroke(guac_socket* socket,
         guac_line_cap_style cap, guac_line_join_style join, int thickness,
         int r, int g, int b, int a) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "7.cstroke,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cap)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, join)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, thickness)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, r)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, g)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "7.cstroke");
+    __guac_protocol_instruction_append_int(&instruction, mode);
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, cap);
+    __guac_protocol_instruction_append_int(&instruction, join);
+    __guac_protocol_instruction_append_int(&instruction, thickness);
+    __guac_protocol_instruction_append_int(&instruction, r);
+    __guac_protocol_instruction_append_int(&instruction, g);
+    __guac_protocol_instruction_append_int(&instruction, b);
+    __guac_protocol_instruction_append_int(&instruction, a);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_cursor(guac_socket* socket, int x, int y,
         const guac_layer* srcl, int srcx, int srcy, int w, int h) {
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "6.cursor,")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "6.cursor");
+    __guac_protocol_instruction_append_int(&instruction, x);
+    __guac_protocol_instruction_append_int(&instruction, y);
+    __guac_protocol_instruction_append_int(&instruction, srcl->index);
+    __guac_protocol_instruction_append_int(&instruction, srcx);
+    __guac_protocol_instruction_append_int(&instruction, srcy);
+    __guac_protocol_instruction_append_int(&instruction, w);
+    __guac_protocol_instruction_append_int(&instruction, h);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_curve(guac_socket* socket, const guac_layer* layer,
         int cp1x, int cp1y, int cp2x, int cp2y, int x, int y) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.curve,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp1x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp1y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp2x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cp2y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "5.curve");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, cp1x);
+    __guac_protocol_instruction_append_int(&instruction, cp1y);
+    __guac_protocol_instruction_append_int(&instruction, cp2x);
+    __guac_protocol_instruction_append_int(&instruction, cp2y);
+    __guac_protocol_instruction_append_int(&instruction, x);
+    __guac_protocol_instruction_append_int(&instruction, y);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_disconnect(guac_socket* socket) {
-    int ret_val;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = guac_socket_write_string(socket, "10.disconnect;");
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    guac_protocol_instruction instruction;
+
+    __guac_protocol_instruction_begin(&instruction, socket, "10.disconnect");
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_dispose(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "7.dispose,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "7.dispose");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -566,82 +740,59 @@ int guac_protocol_send_distort(guac_socket* socket, const guac_layer* layer,
         double a, double b, double c,
         double d, double e, double f) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "7.distort,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, a)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, c)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, d)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, e)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, f)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "7.distort");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_double(&instruction, a);
+    __guac_protocol_instruction_append_double(&instruction, b);
+    __guac_protocol_instruction_append_double(&instruction, c);
+    __guac_protocol_instruction_append_double(&instruction, d);
+    __guac_protocol_instruction_append_double(&instruction, e);
+    __guac_protocol_instruction_append_double(&instruction, f);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_end(guac_socket* socket, const guac_stream* stream) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.end,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "3.end");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_error(guac_socket* socket, const char* error,
         guac_protocol_status status) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.error,")
-        || __guac_socket_write_length_string(socket, error)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, status)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "5.error");
+    __guac_protocol_instruction_append_string(&instruction, error);
+    __guac_protocol_instruction_append_int(&instruction, status);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int vguac_protocol_send_log(guac_socket* socket, const char* format,
         va_list args) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
     /* Copy log message into buffer */
     char message[4096];
     vsnprintf(message, sizeof(message), format, args);
 
     /* Log to instruction */
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.log,")
-        || __guac_socket_write_length_string(socket, message)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "3.log");
+    __guac_protocol_instruction_append_string(&instruction, message);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -661,71 +812,52 @@ int guac_protocol_send_log(guac_socket* socket, const char* format, ...) {
 int guac_protocol_send_file(guac_socket* socket, const guac_stream* stream,
         const char* mimetype, const char* name) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.file,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.file");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_string(&instruction, mimetype);
+    __guac_protocol_instruction_append_string(&instruction, name);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_filesystem(guac_socket* socket,
         const guac_object* object, const char* name) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "10.filesystem,")
-        || __guac_socket_write_length_int(socket, object->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "10.filesystem");
+    __guac_protocol_instruction_append_int(&instruction, object->index);
+    __guac_protocol_instruction_append_string(&instruction, name);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_identity(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "8.identity,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "8.identity");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_key(guac_socket* socket, int keysym, int pressed,
         guac_timestamp timestamp) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.key,")
-        || __guac_socket_write_length_int(socket, keysym)
-        || guac_socket_write_string(socket, pressed ? ",1.1," : ",1.0,")
-        || __guac_socket_write_length_int(socket, timestamp)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "3.key");
+    __guac_protocol_instruction_append_int(&instruction, keysym);
+    __guac_protocol_instruction_append_int(&instruction, pressed ? 1 : 0);
+    __guac_protocol_instruction_append_int(&instruction, timestamp);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -733,40 +865,28 @@ int guac_protocol_send_lfill(guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer,
         const guac_layer* srcl) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.lfill,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "5.lfill");
+    __guac_protocol_instruction_append_int(&instruction, mode);
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, srcl->index);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_line(guac_socket* socket, const guac_layer* layer,
         int x, int y) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.line,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.line");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, x);
+    __guac_protocol_instruction_append_int(&instruction, y);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -775,137 +895,95 @@ int guac_protocol_send_lstroke(guac_socket* socket,
         guac_line_cap_style cap, guac_line_join_style join, int thickness,
         const guac_layer* srcl) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "7.lstroke,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, cap)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, join)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, thickness)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "7.lstroke");
+    __guac_protocol_instruction_append_int(&instruction, mode);
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, cap);
+    __guac_protocol_instruction_append_int(&instruction, join);
+    __guac_protocol_instruction_append_int(&instruction, thickness);
+    __guac_protocol_instruction_append_int(&instruction, srcl->index);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_mouse(guac_socket* socket, int x, int y,
         int button_mask, guac_timestamp timestamp) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.mouse,")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, button_mask)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, timestamp)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "5.mouse");
+    __guac_protocol_instruction_append_int(&instruction, x);
+    __guac_protocol_instruction_append_int(&instruction, y);
+    __guac_protocol_instruction_append_int(&instruction, button_mask);
+    __guac_protocol_instruction_append_int(&instruction, timestamp);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_move(guac_socket* socket, const guac_layer* layer,
         const guac_layer* parent, int x, int y, int z) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.move,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, parent->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, z)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.move");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, parent->index);
+    __guac_protocol_instruction_append_int(&instruction, x);
+    __guac_protocol_instruction_append_int(&instruction, y);
+    __guac_protocol_instruction_append_int(&instruction, z);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_name(guac_socket* socket, const char* name) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.name,")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "4.name");
+    __guac_protocol_instruction_append_string(&instruction, name);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_nest(guac_socket* socket, int index,
         const char* data) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.nest,")
-        || __guac_socket_write_length_int(socket, index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, data)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "4.nest");
+    __guac_protocol_instruction_append_int(&instruction, index);
+    __guac_protocol_instruction_append_string(&instruction, data);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_nop(guac_socket* socket) {
 
-    int ret_val;
-
-    guac_socket_instruction_begin(socket);
-    ret_val = guac_socket_write_string(socket, "3.nop;");
-    guac_socket_instruction_end(socket);
+    guac_protocol_instruction instruction;
 
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "3.nop");
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_pipe(guac_socket* socket, const guac_stream* stream,
         const char* mimetype, const char* name) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.pipe,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.pipe");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_string(&instruction, mimetype);
+    __guac_protocol_instruction_append_string(&instruction, name);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -913,235 +991,166 @@ int guac_protocol_send_img(guac_socket* socket, const guac_stream* stream,
         guac_composite_mode mode, const guac_layer* layer,
         const char* mimetype, int x, int y) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.img,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "3.img");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_int(&instruction, mode);
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_string(&instruction, mimetype);
+    __guac_protocol_instruction_append_int(&instruction, x);
+    __guac_protocol_instruction_append_int(&instruction, y);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_pop(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.pop,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "3.pop");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_push(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.push,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "4.push");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_ready(guac_socket* socket, const char* id) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.ready,")
-        || __guac_socket_write_length_string(socket, id)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "5.ready");
+    __guac_protocol_instruction_append_string(&instruction, id);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_rect(guac_socket* socket,
         const guac_layer* layer, int x, int y, int width, int height) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.rect,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, width)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, height)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.rect");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, x);
+    __guac_protocol_instruction_append_int(&instruction, y);
+    __guac_protocol_instruction_append_int(&instruction, width);
+    __guac_protocol_instruction_append_int(&instruction, height);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_required(guac_socket* socket, const char** required) {
-    
-    int ret_val;
-    
-    guac_socket_instruction_begin(socket);
 
-    ret_val = guac_socket_write_string(socket, "8.required")
-        || guac_socket_write_array(socket, required)
-        || guac_socket_write_string(socket, ";")
+    guac_protocol_instruction instruction;
+
+    __guac_protocol_instruction_begin(&instruction, socket, "8.required");
+    __guac_protocol_instruction_append_array(&instruction, required);
+
+    return __guac_protocol_instruction_end(&instruction)
         || guac_socket_flush(socket);
-    
-    guac_socket_instruction_end(socket);
 
-    return ret_val;
-    
 }
 
 int guac_protocol_send_reset(guac_socket* socket, const guac_layer* layer) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.reset,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "5.reset");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_set(guac_socket* socket, const guac_layer* layer,
         const char* name, const char* value) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "3.set,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, name)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, value)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "3.set");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_string(&instruction, name);
+    __guac_protocol_instruction_append_string(&instruction, value);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_select(guac_socket* socket, const char* protocol) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "6.select,")
-        || __guac_socket_write_length_string(socket, protocol)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "6.select");
+    __guac_protocol_instruction_append_string(&instruction, protocol);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_shade(guac_socket* socket, const guac_layer* layer,
         int a) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.shade,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "5.shade");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, a);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_size(guac_socket* socket, const guac_layer* layer,
         int w, int h) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.size,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "4.size");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, w);
+    __guac_protocol_instruction_append_int(&instruction, h);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_start(guac_socket* socket, const guac_layer* layer,
         int x, int y) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.start,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "5.start");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_int(&instruction, x);
+    __guac_protocol_instruction_append_int(&instruction, y);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_sync(guac_socket* socket, guac_timestamp timestamp) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "4.sync,")
-        || __guac_socket_write_length_int(socket, timestamp)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "4.sync");
+    __guac_protocol_instruction_append_int(&instruction, timestamp);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -1149,32 +1158,20 @@ int guac_protocol_send_transfer(guac_socket* socket,
         const guac_layer* srcl, int srcx, int srcy, int w, int h,
         guac_transfer_function fn, const guac_layer* dstl, int dstx, int dsty) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "8.transfer,")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, fn)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "8.transfer");
+    __guac_protocol_instruction_append_int(&instruction, srcl->index);
+    __guac_protocol_instruction_append_int(&instruction, srcx);
+    __guac_protocol_instruction_append_int(&instruction, srcy);
+    __guac_protocol_instruction_append_int(&instruction, w);
+    __guac_protocol_instruction_append_int(&instruction, h);
+    __guac_protocol_instruction_append_int(&instruction, fn);
+    __guac_protocol_instruction_append_int(&instruction, dstl->index);
+    __guac_protocol_instruction_append_int(&instruction, dstx);
+    __guac_protocol_instruction_append_int(&instruction, dsty);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
@@ -1182,124 +1179,49 @@ int guac_protocol_send_transform(guac_socket* socket, const guac_layer* layer,
         double a, double b, double c,
         double d, double e, double f) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "9.transform,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, a)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, c)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, d)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, e)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_double(socket, f)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    __guac_protocol_instruction_begin(&instruction, socket, "9.transform");
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_double(&instruction, a);
+    __guac_protocol_instruction_append_double(&instruction, b);
+    __guac_protocol_instruction_append_double(&instruction, c);
+    __guac_protocol_instruction_append_double(&instruction, d);
+    __guac_protocol_instruction_append_double(&instruction, e);
+    __guac_protocol_instruction_append_double(&instruction, f);
+
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_undefine(guac_socket* socket,
         const guac_object* object) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "8.undefine,")
-        || __guac_socket_write_length_int(socket, object->index)
-        || guac_socket_write_string(socket, ";");
+    __guac_protocol_instruction_begin(&instruction, socket, "8.undefine");
+    __guac_protocol_instruction_append_int(&instruction, object->index);
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_send_video(guac_socket* socket, const guac_stream* stream,
         const guac_layer* layer, const char* mimetype) {
 
-    int ret_val;
+    guac_protocol_instruction instruction;
 
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "5.video,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ";");
-    guac_socket_instruction_end(socket);
+    __guac_protocol_instruction_begin(&instruction, socket, "5.video");
+    __guac_protocol_instruction_append_int(&instruction, stream->index);
+    __guac_protocol_instruction_append_int(&instruction, layer->index);
+    __guac_protocol_instruction_append_string(&instruction, mimetype);
 
-    return ret_val;
-
-}
-
-/**
- * Returns the value of a single base64 character.
- */
-static int __guac_base64_value(char c) {
-
-    if (c >= 'A' && c <= 'Z')
-        return c - 'A';
-
-    if (c >= 'a' && c <= 'z')
-        return c - 'a' + 26;
-
-    if (c >= '0' && c <= '9')
-        return c - '0' + 52;
-
-    if (c == '+')
-        return 62;
-
-    if (c == '/')
-        return 63;
-
-    return 0;
+    return __guac_protocol_instruction_end(&instruction);
 
 }
 
 int guac_protocol_decode_base64(char* base64) {
-
-    char* input = base64;
-    char* output = base64;
-
-    int length = 0;
-    int bits_read = 0;
-    int value = 0;
-    char current;
-
-    /* For all characters in string */
-    while ((current = *(input++)) != 0) {
-
-        /* If we've reached padding, then we're done */
-        if (current == '=')
-            break;
-
-        /* Otherwise, shift on the latest 6 bits */
-        value = (value << 6) | __guac_base64_value(current);
-        bits_read += 6;
-
-        /* If we have at least one byte, write out the latest whole byte */
-        if (bits_read >= 8) {
-            *(output++) = (value >> (bits_read % 8)) & 0xFF;
-            bits_read -= 8;
-            length++;
-        }
-
-    }
-
-    /* Return number of bytes written */
-    return length;
-
+    return guac_base64_decode(base64, strlen(base64));
 }
 
 guac_protocol_version guac_protocol_string_to_version(const char* version_string) {
@@ -23,9 +23,18 @@
 #include "guacamole/error.h"
 #include "guacamole/socket.h"
 #include "guacamole/user.h"
+#include "socket-queue.h"
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+
+/**
+ * The number of bytes of data which may be stored within each segment
+ * allocated by the broadcast socket. Individual writes which are larger than
+ * this will be stored within dedicated segments of the required size.
+ */
+#define GUAC_SOCKET_BROADCAST_SEGMENT_SIZE 65536
 
 /**
  * Data associated with an open socket which writes to all connected users of
@@ -45,20 +54,45 @@ typedef struct guac_socket_broadcast_data {
      */
     pthread_mutex_t socket_lock;
 
+    /**
+     * The segment into which all data written to this socket is currently
+     * being stored, or NULL if no segment has yet been allocated. Data within
+     * this segment is shared by all users, and is never copied for any
+     * individual user.
+     */
+    guac_socket_segment* segment;
+
+    /**
+     * The number of bytes at the beginning of the current segment which have
+     * already been written to the sockets of all users. Data beyond this
+     * point has not yet been written to any user.
+     */
+    size_t published;
+
+    /**
+     * Lock which protects access to the current segment.
+     */
+    pthread_mutex_t buffer_lock;
+
 } guac_socket_broadcast_data;
 
 /**
- * Single chunk of data, to be broadcast to all users.
+ * Range of data within a segment, to be broadcast to all users.
  */
 typedef struct __write_chunk {
 
     /**
-     * The buffer to write.
+     * The segment containing the data to write.
      */
-    const void* buffer;
+    guac_socket_segment* segment;
 
     /**
-     * The number of bytes in the buffer.
+     * The offset of the first byte of data within the segment.
+     */
+    size_t offset;
+
+    /**
+     * The number of bytes of data to write.
      */
     size_t length;
 
@@ -91,9 +125,10 @@ static ssize_t __guac_socket_broadcast_read_handler(guac_socket* socket,
 }
 
 /**
- * Callback invoked by guac_client_foreach_user() which write a given chunk of
- * data to that user's socket. If the write attempt fails, the user is
- * signalled to stop with guac_user_stop().
+ * Callback invoked by guac_client_foreach_user() which writes a given chunk
+ * of data to that user's socket. The data is not copied if the user's socket
+ * is a queued socket. If the write attempt fails, the user is signalled to
+ * stop with guac_user_stop().
  *
  * @param user
  *     The user that the chunk of data should be written to.
@@ -109,7 +144,8 @@ static void* __write_chunk_callback(guac_user* user, void* data) {
     __write_chunk* chunk = (__write_chunk*) data;
 
     /* Attempt write, disconnect on failure */
-    if (guac_socket_write(user->socket, chunk->buffer, chunk->length))
+    if (guac_socket_write_segment(user->socket, chunk->segment,
+                chunk->offset, chunk->length))
         guac_user_stop(user);
 
     return NULL;
@@ -117,8 +153,43 @@ static void* __write_chunk_callback(guac_user* user, void* data) {
 }
 
 /**
- * Socket write handler which operates on each of the sockets of all connected
- * users. This write handler will always succeed, but any failing user-specific
+ * Writes all data within the current segment which has not yet been written
+ * to the sockets of all connected users. Any failing user-specific writes will
+ * invoke guac_user_stop() on the failing user. The buffer lock must already
+ * be held.
+ *
+ * @param data
+ *     The data associated with the broadcast socket whose pending data should
+ *     be written.
+ */
+static void __guac_socket_broadcast_publish(guac_socket_broadcast_data* data) {
+
+    guac_socket_segment* segment = data->segment;
+
+    /* Skip if there is no pending data */
+    if (segment == NULL || data->published == segment->length)
+        return;
+
+    /* Build chunk */
+    __write_chunk chunk;
+    chunk.segment = segment;
+    chunk.offset = data->published;
+    chunk.length = segment->length - data->published;
+
+    /* Broadcast chunk to all users */
+    guac_client_foreach_user(data->client, __write_chunk_callback, &chunk);
+
+    data->published = segment->length;
+
+}
+
+/**
+ * Socket write handler which stores the given data within the current
+ * segment, such that the data is serialized only once regardless of the
+ * number of connected users. Stored data is written to the sockets of all
+ * connected users when the current instruction ends, when the socket is
+ * flushed, or when the current segment is full. This write handler will
+ * succeed unless memory cannot be allocated, and any failing user-specific
  * writes will invoke guac_user_stop() on the failing user.
  *
  * @param socket
@@ -141,14 +212,44 @@ static ssize_t __guac_socket_broadcast_write_handler(guac_socket* socket,
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
-    /* Build chunk */
-    __write_chunk chunk;
-    chunk.buffer = buf;
-    chunk.length = count;
+    pthread_mutex_lock(&(data->buffer_lock));
 
-    /* Broadcast chunk to all users */
-    guac_client_foreach_user(data->client, __write_chunk_callback, &chunk);
+    guac_socket_segment* segment = data->segment;
 
+    /* Replace current segment if it cannot hold the given data. Data already
+     * written to the current segment must not be modified, thus a new segment
+     * is always allocated. */
+    if (segment == NULL || segment->size - segment->length < count) {
+
+        /* Write out any pending data before releasing the current segment */
+        __guac_socket_broadcast_publish(data);
+
+        size_t size = GUAC_SOCKET_BROADCAST_SEGMENT_SIZE;
+        if (size < count)
+            size = count;
+
+        guac_socket_segment* new_segment = guac_socket_segment_alloc(size);
+        if (new_segment == NULL) {
+            pthread_mutex_unlock(&(data->buffer_lock));
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Unable to allocate broadcast buffer";
+            return -1;
+        }
+
+        /* The segment remains allocated for as long as any user has data
+         * from that segment pending */
+        if (segment != NULL)
+            guac_socket_segment_unref(segment);
+
+        data->segment = segment = new_segment;
+        data->published = 0;
+
+    }
+
+    memcpy(segment->data + segment->length, buf, count);
+    segment->length += count;
+
+    pthread_mutex_unlock(&(data->buffer_lock));
     return count;
 
 }
@@ -195,6 +296,11 @@ static ssize_t __guac_socket_broadcast_flush_handler(guac_socket* socket) {
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
+    /* Write out any pending data */
+    pthread_mutex_lock(&(data->buffer_lock));
+    __guac_socket_broadcast_publish(data);
+    pthread_mutex_unlock(&(data->buffer_lock));
+
     /* Flush all users */
     guac_client_foreach_user(data->client, __flush_callback, NULL);
 
@@ -284,6 +390,12 @@ static void __guac_socket_broadcast_unlock_handler(guac_socket* socket) {
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
+    /* Write out the instruction before other data may be written to any
+     * user */
+    pthread_mutex_lock(&(data->buffer_lock));
+    __guac_socket_broadcast_publish(data);
+    pthread_mutex_unlock(&(data->buffer_lock));
+
     /* Unlock sockets of all users */
     guac_client_foreach_user(data->client, __unlock_callback, NULL);
 
@@ -335,8 +447,13 @@ static int __guac_socket_broadcast_free_handler(guac_socket* socket) {
     guac_socket_broadcast_data* data =
         (guac_socket_broadcast_data*) socket->data;
 
+    /* Release current segment */
+    if (data->segment != NULL)
+        guac_socket_segment_unref(data->segment);
+
     /* Destroy locks */
     pthread_mutex_destroy(&(data->socket_lock));
+    pthread_mutex_destroy(&(data->buffer_lock));
 
     free(data);
     return 0;
@@ -354,13 +471,16 @@ guac_socket* guac_socket_broadcast(guac_client* client) {
 
     /* Store client as socket data */
     data->client = client;
+    data->segment = NULL;
+    data->published = 0;
     socket->data = data;
 
     pthread_mutexattr_init(&lock_attributes);
     pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
 
-    /* Init lock */
+    /* Init locks */
     pthread_mutex_init(&(data->socket_lock), &lock_attributes);
+    pthread_mutex_init(&(data->buffer_lock), &lock_attributes);
     
     /* Set read/write handlers */
     socket->read_handler   = __guac_socket_broadcast_read_handler;
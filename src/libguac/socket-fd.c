@@ -23,18 +23,32 @@
 #include "guacamole/socket.h"
 #include "wait-fd.h"
 
+#include <errno.h>
 #include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #ifdef ENABLE_WINSOCK
 #include <winsock2.h>
+#else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 #endif
 
+/**
+ * The maximum size that the output buffer of a file descriptor socket may
+ * grow to, in bytes. The output buffer starts at
+ * GUAC_SOCKET_OUTPUT_BUFFER_SIZE bytes, doubling in size each time it fills
+ * before being explicitly flushed, until this size is reached.
+ */
+#define GUAC_SOCKET_FD_MAX_OUTPUT_BUFFER_SIZE 65536
+
 /**
  * Data associated with an open socket which writes to a file descriptor.
  */
@@ -54,7 +68,29 @@ typedef struct guac_socket_fd_data {
      * The main write buffer. Bytes written go here before being flushed
      * to the open file descriptor.
      */
-    char out_buf[GUAC_SOCKET_OUTPUT_BUFFER_SIZE];
+    char* out_buf;
+
+    /**
+     * The current size of the main write buffer, in bytes. This will be at
+     * least GUAC_SOCKET_OUTPUT_BUFFER_SIZE and at most
+     * GUAC_SOCKET_FD_MAX_OUTPUT_BUFFER_SIZE.
+     */
+    int out_buf_size;
+
+    /**
+     * Non-zero if the file descriptor may be a network socket, in which case
+     * writes which do not complete a flush are sent with MSG_MORE, allowing
+     * the kernel to coalesce them into full packets. This is cleared the
+     * first time the file descriptor is found not to be a socket.
+     */
+    int corkable;
+
+    /**
+     * Non-zero if the most recent write was sent with MSG_MORE, in which case
+     * the kernel may still be holding back the end of that write, and the
+     * next flush must explicitly release it.
+     */
+    int corked;
 
     /**
      * Lock which is acquired when an instruction is being written, and
@@ -71,41 +107,79 @@ typedef struct guac_socket_fd_data {
 } guac_socket_fd_data;
 
 /**
- * Writes the entire contents of the given buffer to the file descriptor
- * associated with the given socket, retrying as necessary until the whole
- * buffer is written, and aborting if an error occurs.
+ * Writes the entire contents of the given buffers, in order, to the file
+ * descriptor associated with the given socket, retrying as necessary until
+ * all buffers are written, and aborting if an error occurs. Where possible,
+ * all buffers are written with a single system call.
  *
  * @param socket
  *     The guac_socket associated with the file descriptor to which the given
- *     buffer should be written.
+ *     buffers should be written.
  *
- * @param buf
- *     The buffer of data to write to the given guac_socket.
+ * @param iov
+ *     The buffers of data to write to the given guac_socket. The contents of
+ *     this array are modified to track partial writes.
  *
- * @param count
- *     The number of bytes within the given buffer.
+ * @param iovcnt
+ *     The number of buffers within the given array.
+ *
+ * @param more
+ *     Non-zero if more data will be written before the socket is flushed, in
+ *     which case the kernel may delay sending the data until that data is
+ *     also written, zero otherwise.
  *
  * @return
- *     The number of bytes written, which will be exactly the size of the given
- *     buffer, or a negative value if an error occurs.
+ *     Zero if all buffers were written, or a negative value if an error
+ *     occurs.
  */
-ssize_t guac_socket_fd_write(guac_socket* socket,
-        const void* buf, size_t count) {
+static ssize_t guac_socket_fd_write_vector(guac_socket* socket,
+        struct iovec* iov, int iovcnt, int more) {
 
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
-    const char* buffer = buf;
 
     /* Write until completely written */
-    while (count > 0) {
+    while (iovcnt > 0) {
 
-        int retval;
+        ssize_t retval;
+
+        /* Skip any empty buffers */
+        if (iov->iov_len == 0) {
+            iov++;
+            iovcnt--;
+            continue;
+        }
 
 #ifdef ENABLE_WINSOCK
         /* WSA only works with send() */
-        retval = send(data->fd, buffer, count, 0);
+        retval = send(data->fd, iov->iov_base, iov->iov_len, 0);
 #else
-        /* Use write() for all other platforms */
-        retval = write(data->fd, buffer, count);
+
+#ifdef MSG_MORE
+        /* Hint that further data follows if the descriptor is a socket */
+        if (data->corkable) {
+
+            struct msghdr message = {
+                .msg_iov    = iov,
+                .msg_iovlen = iovcnt
+            };
+
+            retval = sendmsg(data->fd, &message, more ? MSG_MORE : 0);
+
+            /* Fall back to writev() for descriptors that are not sockets */
+            if (retval < 0 && errno == ENOTSOCK) {
+                data->corkable = 0;
+                continue;
+            }
+
+            /* Data sent with MSG_MORE may be held back until released */
+            if (retval >= 0)
+                data->corked = more;
+
+        }
+
+        else
+#endif
+            retval = writev(data->fd, iov, iovcnt);
 #endif
 
         /* Record errors in guac_error */
@@ -115,9 +189,18 @@ ssize_t guac_socket_fd_write(guac_socket* socket,
             return retval;
         }
 
-        /* Advance buffer to next chunk */
-        buffer += retval;
-        count  -= retval;
+        /* Advance past all buffers which were completely written */
+        while (iovcnt > 0 && (size_t) retval >= iov->iov_len) {
+            retval -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        /* Advance within any partially-written buffer */
+        if (iovcnt > 0) {
+            iov->iov_base = (char*) iov->iov_base + retval;
+            iov->iov_len -= retval;
+        }
 
     }
 
@@ -166,6 +249,32 @@ static ssize_t guac_socket_fd_read_handler(guac_socket* socket,
 
 }
 
+/**
+ * Releases any data which the kernel is holding back due to a previous write
+ * sent with MSG_MORE. The kernel releases such data only once a later write
+ * is sent without MSG_MORE, or once the socket is explicitly uncorked, which
+ * is done here by briefly enabling and disabling TCP_CORK.
+ *
+ * @param socket
+ *     The guac_socket to release held data of.
+ */
+static void guac_socket_fd_uncork(guac_socket* socket) {
+
+    guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
+
+#if defined(MSG_MORE) && defined(TCP_CORK)
+    /* Disabling TCP_CORK pushes all pending data. Failures are ignored, as
+     * sockets which do not support TCP_CORK do not hold data back. */
+    int value = 1;
+    setsockopt(data->fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+    value = 0;
+    setsockopt(data->fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#endif
+
+    data->corked = 0;
+
+}
+
 /**
  * Flushes the contents of the output buffer of the given socket immediately,
  * without first locking access to the output buffer. This function must ONLY
@@ -184,13 +293,22 @@ static ssize_t guac_socket_fd_flush(guac_socket* socket) {
     /* Flush remaining bytes in buffer */
     if (data->written > 0) {
 
+        struct iovec iov = {
+            .iov_base = data->out_buf,
+            .iov_len  = data->written
+        };
+
         /* Write ALL bytes in buffer immediately */
-        if (guac_socket_fd_write(socket, data->out_buf, data->written))
+        if (guac_socket_fd_write_vector(socket, &iov, 1, 0))
             return 1;
 
         data->written = 0;
     }
 
+    /* Release the end of any previous write which bypassed the buffer */
+    else if (data->corked)
+        guac_socket_fd_uncork(socket);
+
     return 0;
 
 }
@@ -225,9 +343,12 @@ static ssize_t guac_socket_fd_flush_handler(guac_socket* socket) {
 
 /**
  * Writes the contents of the buffer to the output buffer of the given socket,
- * flushing the output buffer as necessary, without first locking access to the
- * output buffer. This function must ONLY be called if the buffer lock has
- * already been acquired.
+ * without first locking access to the output buffer. This function must ONLY
+ * be called if the buffer lock has already been acquired. If the data does
+ * not fit within the output buffer, the output buffer is first grown, up to
+ * GUAC_SOCKET_FD_MAX_OUTPUT_BUFFER_SIZE. If the data still does not fit, the
+ * contents of the output buffer and the provided data are written together
+ * with a single vectored write, without copying the provided data.
  *
  * @param socket
  *     The guac_socket to write the given buffer to.
@@ -245,45 +366,44 @@ static ssize_t guac_socket_fd_flush_handler(guac_socket* socket) {
 static ssize_t guac_socket_fd_write_buffered(guac_socket* socket,
         const void* buf, size_t count) {
 
-    size_t original_count = count;
-    const char* current = buf;
     guac_socket_fd_data* data = (guac_socket_fd_data*) socket->data;
 
-    /* Append to buffer, flush if necessary */
-    while (count > 0) {
-
-        int chunk_size;
-        int remaining = sizeof(data->out_buf) - data->written;
-
-        /* If no space left in buffer, flush and retry */
-        if (remaining == 0) {
+    /* Grow buffer if the data will not fit, up to the maximum size */
+    if (count > (size_t) (data->out_buf_size - data->written)
+            && data->out_buf_size < GUAC_SOCKET_FD_MAX_OUTPUT_BUFFER_SIZE) {
 
-            /* Abort if error occurs during flush */
-            if (guac_socket_fd_flush(socket))
-                return -1;
-
-            /* Retry buffer append */
-            continue;
+        int new_size = data->out_buf_size;
+        while (count > (size_t) (new_size - data->written)
+                && new_size < GUAC_SOCKET_FD_MAX_OUTPUT_BUFFER_SIZE)
+            new_size *= 2;
 
+        /* Continue with the current buffer if it cannot be grown */
+        char* new_buf = realloc(data->out_buf, new_size);
+        if (new_buf != NULL) {
+            data->out_buf = new_buf;
+            data->out_buf_size = new_size;
         }
 
-        /* Calculate size of chunk to be written to buffer */
-        chunk_size = count;
-        if (chunk_size > remaining)
-            chunk_size = remaining;
+    }
 
-        /* Update output buffer */
-        memcpy(data->out_buf + data->written, current, chunk_size);
-        data->written += chunk_size;
+    /* Append to buffer if the data fits */
+    if (count <= (size_t) (data->out_buf_size - data->written)) {
+        memcpy(data->out_buf + data->written, buf, count);
+        data->written += count;
+        return count;
+    }
 
-        /* Update provided buffer */
-        current += chunk_size;
-        count   -= chunk_size;
+    /* Otherwise, write the buffer and the provided data together */
+    struct iovec iov[2] = {
+        { .iov_base = data->out_buf,  .iov_len = data->written },
+        { .iov_base = (void*) buf,    .iov_len = count         }
+    };
 
-    }
+    if (guac_socket_fd_write_vector(socket, iov, 2, 1))
+        return -1;
 
-    /* All bytes have been written, possibly some to the internal buffer */
-    return original_count;
+    data->written = 0;
+    return count;
 
 }
 
@@ -382,6 +502,7 @@ static int guac_socket_fd_free_handler(guac_socket* socket) {
     /* Close file descriptor */
     close(data->fd);
 
+    free(data->out_buf);
     free(data);
     return 0;
 
@@ -428,8 +549,14 @@ guac_socket* guac_socket_open(int fd) {
     /* Store file descriptor as socket data */
     data->fd = fd;
     data->written = 0;
+    data->corkable = 1;
+    data->corked = 0;
     socket->data = data;
 
+    /* Allocate output buffer at its initial size */
+    data->out_buf_size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+    data->out_buf = malloc(data->out_buf_size);
+
     pthread_mutexattr_init(&lock_attributes);
     pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
 
@@ -0,0 +1,856 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacamole/error.h"
+#include "guacamole/socket.h"
+#include "guacamole/timestamp.h"
+#include "socket-queue.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+/**
+ * The number of bytes of data which may be stored within each chunk of a
+ * queued socket.
+ */
+#define GUAC_SOCKET_QUEUE_CHUNK_SIZE 16384
+
+/**
+ * A contiguous block of data which has been written to a queued socket but
+ * has not yet been written to the underlying socket.
+ */
+typedef struct guac_socket_queue_chunk {
+
+    /**
+     * The number of bytes of data currently stored within this chunk.
+     */
+    size_t length;
+
+    /**
+     * The segment containing the data of this chunk, or NULL if the data is
+     * stored within the chunk itself. A chunk which refers to a segment holds
+     * a reference to that segment until the chunk is freed.
+     */
+    guac_socket_segment* segment;
+
+    /**
+     * The offset of the first byte of this chunk's data within its segment.
+     * This value is only meaningful if segment is non-NULL.
+     */
+    size_t offset;
+
+    /**
+     * Non-zero if this chunk is complete and may be written to the
+     * underlying socket even though it is not full. No further data may be
+     * added to a complete chunk.
+     */
+    int complete;
+
+    /**
+     * Non-zero if the underlying socket should be flushed after this chunk
+     * has been written. A chunk which requires a flush is always complete.
+     */
+    int flush;
+
+    /**
+     * The next chunk in the queue, or NULL if this is the last chunk.
+     */
+    struct guac_socket_queue_chunk* next;
+
+    /**
+     * The data stored within this chunk, if the chunk does not refer to a
+     * segment. Chunks which store their own data have room for exactly
+     * GUAC_SOCKET_QUEUE_CHUNK_SIZE bytes.
+     */
+    char data[];
+
+} guac_socket_queue_chunk;
+
+/**
+ * Data specific to the queued implementation of guac_socket.
+ */
+typedef struct guac_socket_queue_data {
+
+    /**
+     * The guac_socket to which all queued data is written, and to which all
+     * read operations are delegated.
+     */
+    guac_socket* socket;
+
+    /**
+     * The maximum number of bytes which may be queued before the configured
+     * policy takes effect.
+     */
+    size_t max_length;
+
+    /**
+     * The action to take if writing data would exceed max_length.
+     */
+    guac_socket_queue_policy policy;
+
+    /**
+     * The first chunk in the queue, or NULL if the queue is empty.
+     */
+    guac_socket_queue_chunk* head;
+
+    /**
+     * The last chunk in the queue, or NULL if the queue is empty.
+     */
+    guac_socket_queue_chunk* tail;
+
+    /**
+     * The total number of bytes currently queued.
+     */
+    size_t length;
+
+    /**
+     * Non-zero if data can no longer be written, either because writing to
+     * the underlying socket has failed or because the queue overflowed under
+     * the GUAC_SOCKET_QUEUE_CLOSE policy.
+     */
+    int failed;
+
+    /**
+     * Non-zero if the queued socket is being freed, in which case the writer
+     * thread must write all remaining data and then terminate.
+     */
+    int closing;
+
+    /**
+     * Non-zero if the writer thread has terminated, zero otherwise.
+     */
+    int stopped;
+
+    /**
+     * Non-zero if the queued socket was freed before the writer thread
+     * terminated, in which case the writer thread is responsible for freeing
+     * the underlying socket and all other remaining resources once it
+     * terminates.
+     */
+    int abandoned;
+
+    /**
+     * The thread which writes queued data to the underlying socket.
+     */
+    pthread_t writer_thread;
+
+    /**
+     * Lock which protects access to the queue and all associated state.
+     */
+    pthread_mutex_t queue_lock;
+
+    /**
+     * Condition which is signalled when a chunk within the queue becomes
+     * complete, or when the queued socket is being freed.
+     */
+    pthread_cond_t data_available;
+
+    /**
+     * Condition which is signalled whenever queued data is removed.
+     */
+    pthread_cond_t space_available;
+
+    /**
+     * Condition which is signalled when the writer thread terminates.
+     */
+    pthread_cond_t writer_stopped;
+
+    /**
+     * Lock which is acquired when an instruction is being written, and
+     * released when the instruction is finished being written.
+     */
+    pthread_mutex_t socket_lock;
+
+} guac_socket_queue_data;
+
+guac_socket_segment* guac_socket_segment_alloc(size_t size) {
+
+    guac_socket_segment* segment = malloc(sizeof(guac_socket_segment) + size);
+    if (segment == NULL)
+        return NULL;
+
+    segment->refcount = 1;
+    segment->length = 0;
+    segment->size = size;
+    pthread_mutex_init(&(segment->refcount_lock), NULL);
+
+    return segment;
+
+}
+
+void guac_socket_segment_ref(guac_socket_segment* segment) {
+    pthread_mutex_lock(&(segment->refcount_lock));
+    segment->refcount++;
+    pthread_mutex_unlock(&(segment->refcount_lock));
+}
+
+void guac_socket_segment_unref(guac_socket_segment* segment) {
+
+    pthread_mutex_lock(&(segment->refcount_lock));
+    int refcount = --segment->refcount;
+    pthread_mutex_unlock(&(segment->refcount_lock));
+
+    /* Free segment once the last reference is released */
+    if (refcount == 0) {
+        pthread_mutex_destroy(&(segment->refcount_lock));
+        free(segment);
+    }
+
+}
+
+/**
+ * Frees the given chunk, releasing its reference to the segment containing
+ * its data, if any.
+ *
+ * @param chunk
+ *     The chunk to free.
+ */
+static void guac_socket_queue_chunk_free(guac_socket_queue_chunk* chunk) {
+
+    if (chunk->segment != NULL)
+        guac_socket_segment_unref(chunk->segment);
+
+    free(chunk);
+
+}
+
+/**
+ * Frees all chunks within the queue of the given queued socket, discarding
+ * their data. The queue lock must already be held.
+ *
+ * @param data
+ *     The data associated with the queued socket whose queue should be
+ *     emptied.
+ */
+static void guac_socket_queue_discard(guac_socket_queue_data* data) {
+
+    guac_socket_queue_chunk* current = data->head;
+    while (current != NULL) {
+        guac_socket_queue_chunk* next = current->next;
+        guac_socket_queue_chunk_free(current);
+        current = next;
+    }
+
+    data->head = NULL;
+    data->tail = NULL;
+    data->length = 0;
+
+    /* Wake any writers waiting for space */
+    pthread_cond_broadcast(&(data->space_available));
+
+}
+
+/**
+ * Frees the given data associated with a queued socket, along with the
+ * underlying socket and any data which remains queued. The writer thread must
+ * already have terminated.
+ *
+ * @param data
+ *     The data associated with the queued socket to free.
+ */
+static void guac_socket_queue_data_free(guac_socket_queue_data* data) {
+
+    /* Discard anything which could not be written */
+    guac_socket_queue_discard(data);
+
+    pthread_cond_destroy(&(data->data_available));
+    pthread_cond_destroy(&(data->space_available));
+    pthread_cond_destroy(&(data->writer_stopped));
+    pthread_mutex_destroy(&(data->queue_lock));
+    pthread_mutex_destroy(&(data->socket_lock));
+
+    guac_socket_free(data->socket);
+
+    free(data);
+
+}
+
+/**
+ * Thread which writes each complete chunk within the queue of a queued socket
+ * to the underlying socket, in order, until the queued socket is freed. If
+ * the queued socket is freed before all data can be written, this thread
+ * frees the underlying socket itself once it terminates.
+ *
+ * @param arg
+ *     The guac_socket_queue_data associated with the queued socket.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* guac_socket_queue_writer_thread(void* arg) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) arg;
+
+    pthread_mutex_lock(&(data->queue_lock));
+
+    for (;;) {
+
+        guac_socket_queue_chunk* chunk = data->head;
+
+        /* Wait for a complete chunk, writing any remaining partial chunk only
+         * once the queued socket is being freed */
+        if (chunk == NULL || (chunk->next == NULL && !chunk->complete
+                    && !data->closing)) {
+
+            if (data->closing)
+                break;
+
+            pthread_cond_wait(&(data->data_available), &(data->queue_lock));
+            continue;
+
+        }
+
+        /* Remove chunk from queue */
+        data->head = chunk->next;
+        if (data->head == NULL)
+            data->tail = NULL;
+
+        /* Write chunk without blocking further writes to the queue */
+        pthread_mutex_unlock(&(data->queue_lock));
+
+        const char* buffer = chunk->data;
+        if (chunk->segment != NULL)
+            buffer = chunk->segment->data + chunk->offset;
+
+        int failed = guac_socket_write(data->socket, buffer, chunk->length);
+
+        if (!failed && chunk->flush)
+            failed = guac_socket_flush(data->socket);
+
+        pthread_mutex_lock(&(data->queue_lock));
+
+        data->length -= chunk->length;
+        guac_socket_queue_chunk_free(chunk);
+
+        /* Once the underlying socket fails, nothing further can be written */
+        if (failed) {
+            data->failed = 1;
+            guac_socket_queue_discard(data);
+        }
+
+        pthread_cond_broadcast(&(data->space_available));
+
+    }
+
+    /* Notify the free handler, unless it has given up waiting */
+    data->stopped = 1;
+    pthread_cond_signal(&(data->writer_stopped));
+    int abandoned = data->abandoned;
+
+    pthread_mutex_unlock(&(data->queue_lock));
+
+    /* Clean up on behalf of the free handler if it gave up waiting */
+    if (abandoned)
+        guac_socket_queue_data_free(data);
+
+    return NULL;
+
+}
+
+/**
+ * Callback function which reads only from the underlying socket.
+ *
+ * @param socket
+ *     The queued socket to read from.
+ *
+ * @param buf
+ *     The buffer to read data into.
+ *
+ * @param count
+ *     The maximum number of bytes to read into the given buffer.
+ *
+ * @return
+ *     The value returned by guac_socket_read() when invoked on the
+ *     underlying socket with the given parameters.
+ */
+static ssize_t guac_socket_queue_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Delegate read to wrapped socket */
+    return guac_socket_read(data->socket, buf, count);
+
+}
+
+/**
+ * Waits until the given number of bytes may be added to the queue of the
+ * given queued socket, applying the configured policy if the queue would
+ * exceed its maximum length. The queue lock must already be held.
+ *
+ * @param data
+ *     The data associated with the queued socket that data will be added to.
+ *
+ * @param count
+ *     The number of bytes which will be added to the queue.
+ *
+ * @return
+ *     Zero if the given number of bytes may now be added to the queue,
+ *     non-zero if data can no longer be written to the queued socket, in
+ *     which case guac_error and guac_error_message are set appropriately.
+ */
+static int guac_socket_queue_reserve(guac_socket_queue_data* data,
+        size_t count) {
+
+    /* Apply policy if the queue would exceed its maximum length */
+    while (!data->failed && data->length > 0
+            && data->length + count > data->max_length) {
+
+        /* Fail permanently if lagging is not tolerated */
+        if (data->policy == GUAC_SOCKET_QUEUE_CLOSE) {
+            data->failed = 1;
+            guac_socket_queue_discard(data);
+            break;
+        }
+
+        /* Otherwise, allow any partial chunk to be written, and wait for the
+         * writer thread to make room */
+        if (data->tail != NULL && !data->tail->complete) {
+            data->tail->complete = 1;
+            pthread_cond_signal(&(data->data_available));
+        }
+
+        pthread_cond_wait(&(data->space_available), &(data->queue_lock));
+
+    }
+
+    if (data->failed) {
+        guac_error = GUAC_STATUS_CLOSED;
+        guac_error_message = "Queued socket is closed, or was unable to "
+            "keep up with written data";
+        return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Adds the given chunk to the end of the queue of the given queued socket,
+ * allowing the chunk previously at the end of the queue, if any, to be
+ * written. The queue lock must already be held.
+ *
+ * @param data
+ *     The data associated with the queued socket that the chunk should be
+ *     added to.
+ *
+ * @param chunk
+ *     The chunk to add.
+ */
+static void guac_socket_queue_append(guac_socket_queue_data* data,
+        guac_socket_queue_chunk* chunk) {
+
+    chunk->complete = 0;
+    chunk->flush = 0;
+    chunk->next = NULL;
+
+    if (data->tail != NULL) {
+        data->tail->next = chunk;
+
+        /* The previous chunk is now complete */
+        pthread_cond_signal(&(data->data_available));
+    }
+    else
+        data->head = chunk;
+
+    data->tail = chunk;
+
+}
+
+/**
+ * Callback function which appends the given data to the queue, to be written
+ * to the underlying socket by the writer thread. If the queue would exceed
+ * its maximum length, the configured policy determines whether this function
+ * waits for space or fails.
+ *
+ * @param socket
+ *     The queued socket to write through.
+ *
+ * @param buf
+ *     The buffer of data to write.
+ *
+ * @param count
+ *     The number of bytes in the buffer to be written.
+ *
+ * @return
+ *     The number of bytes written if the write was successful, or -1 if an
+ *     error occurs.
+ */
+static ssize_t guac_socket_queue_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+    const char* current = buf;
+    size_t remaining = count;
+
+    pthread_mutex_lock(&(data->queue_lock));
+
+    if (guac_socket_queue_reserve(data, count)) {
+        pthread_mutex_unlock(&(data->queue_lock));
+        return -1;
+    }
+
+    while (remaining > 0) {
+
+        guac_socket_queue_chunk* tail = data->tail;
+
+        /* Start a new chunk if the current chunk is full, complete, or does
+         * not store its own data */
+        if (tail == NULL || tail->complete || tail->segment != NULL
+                || tail->length == GUAC_SOCKET_QUEUE_CHUNK_SIZE) {
+
+            tail = malloc(sizeof(guac_socket_queue_chunk)
+                    + GUAC_SOCKET_QUEUE_CHUNK_SIZE);
+
+            if (tail == NULL) {
+                pthread_mutex_unlock(&(data->queue_lock));
+                guac_error = GUAC_STATUS_NO_MEMORY;
+                guac_error_message = "Unable to allocate queued data";
+                return -1;
+            }
+
+            tail->length = 0;
+            tail->segment = NULL;
+            tail->offset = 0;
+            guac_socket_queue_append(data, tail);
+
+        }
+
+        /* Copy as much as possible into the current chunk */
+        size_t chunk_size = GUAC_SOCKET_QUEUE_CHUNK_SIZE - tail->length;
+        if (chunk_size > remaining)
+            chunk_size = remaining;
+
+        memcpy(tail->data + tail->length, current, chunk_size);
+        tail->length += chunk_size;
+        data->length += chunk_size;
+
+        current += chunk_size;
+        remaining -= chunk_size;
+
+    }
+
+    pthread_mutex_unlock(&(data->queue_lock));
+    return count;
+
+}
+
+/**
+ * Appends a reference to the given range of data within the given segment to
+ * the queue, to be written to the underlying socket by the writer thread
+ * directly from that segment. If the range immediately follows the data
+ * referenced by the last chunk in the queue, that chunk is extended rather
+ * than a new chunk being added. If the queue would exceed its maximum
+ * length, the configured policy determines whether this function waits for
+ * space or fails.
+ *
+ * @param socket
+ *     The queued socket to write through.
+ *
+ * @param segment
+ *     The segment containing the data to write.
+ *
+ * @param offset
+ *     The offset of the first byte of data within the segment.
+ *
+ * @param length
+ *     The number of bytes of data to write.
+ *
+ * @return
+ *     Zero on success, non-zero if an error occurs.
+ */
+static int guac_socket_queue_write_segment(guac_socket* socket,
+        guac_socket_segment* segment, size_t offset, size_t length) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    pthread_mutex_lock(&(data->queue_lock));
+
+    if (guac_socket_queue_reserve(data, length)) {
+        pthread_mutex_unlock(&(data->queue_lock));
+        return 1;
+    }
+
+    guac_socket_queue_chunk* tail = data->tail;
+
+    /* Start a new chunk unless the range continues the current chunk */
+    if (tail == NULL || tail->complete || tail->segment != segment
+            || tail->offset + tail->length != offset) {
+
+        tail = malloc(sizeof(guac_socket_queue_chunk));
+        if (tail == NULL) {
+            pthread_mutex_unlock(&(data->queue_lock));
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Unable to allocate queued data";
+            return 1;
+        }
+
+        /* Chunk holds its own reference to the segment */
+        guac_socket_segment_ref(segment);
+
+        tail->length = 0;
+        tail->segment = segment;
+        tail->offset = offset;
+        guac_socket_queue_append(data, tail);
+
+    }
+
+    tail->length += length;
+    data->length += length;
+
+    pthread_mutex_unlock(&(data->queue_lock));
+    return 0;
+
+}
+
+int guac_socket_write_segment(guac_socket* socket,
+        guac_socket_segment* segment, size_t offset, size_t length) {
+
+    /* Data which is not queued must be written immediately */
+    if (socket->write_handler != guac_socket_queue_write_handler)
+        return guac_socket_write(socket, segment->data + offset, length);
+
+    /* Update timestamp of last write */
+    socket->last_write_timestamp = guac_timestamp_current();
+
+    return guac_socket_queue_write_segment(socket, segment, offset, length);
+
+}
+
+/**
+ * Callback function which marks all data currently within the queue as
+ * ready to be written, requesting that the underlying socket be flushed
+ * once that data has been written. This function does not wait for the
+ * data to actually be written.
+ *
+ * @param socket
+ *     The queued socket to flush.
+ *
+ * @return
+ *     Zero if the flush was requested successfully, non-zero if data can no
+ *     longer be written to the queued socket.
+ */
+static ssize_t guac_socket_queue_flush_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    pthread_mutex_lock(&(data->queue_lock));
+
+    int failed = data->failed;
+
+    /* Complete the last chunk, if any, flushing after it is written */
+    if (data->tail != NULL && !data->tail->flush) {
+        data->tail->complete = 1;
+        data->tail->flush = 1;
+        pthread_cond_signal(&(data->data_available));
+    }
+
+    pthread_mutex_unlock(&(data->queue_lock));
+    return failed;
+
+}
+
+/**
+ * Callback function which acquires exclusive access to the queued socket,
+ * such that instructions written by different threads are never
+ * interleaved within the queue.
+ *
+ * @param socket
+ *     The queued socket on which guac_socket_instruction_begin() was invoked.
+ */
+static void guac_socket_queue_lock_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Acquire exclusive access to socket */
+    pthread_mutex_lock(&(data->socket_lock));
+
+}
+
+/**
+ * Callback function which relinquishes exclusive access to the queued
+ * socket.
+ *
+ * @param socket
+ *     The queued socket on which guac_socket_instruction_end() was invoked.
+ */
+static void guac_socket_queue_unlock_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Relinquish exclusive access to socket */
+    pthread_mutex_unlock(&(data->socket_lock));
+
+}
+
+/**
+ * Callback function which waits on the underlying socket.
+ *
+ * @param socket
+ *     The queued socket to wait for.
+ *
+ * @param usec_timeout
+ *     The maximum amount of time to wait for data, in microseconds, or -1 to
+ *     potentially wait forever.
+ *
+ * @return
+ *     The value returned by guac_socket_select() when invoked on the
+ *     underlying socket with the given parameters.
+ */
+static int guac_socket_queue_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Delegate select to wrapped socket */
+    return guac_socket_select(data->socket, usec_timeout);
+
+}
+
+/**
+ * Callback function which waits for all queued data to be written, stops
+ * the writer thread, and frees the underlying socket. If the queued data
+ * cannot be written within GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT milliseconds, that
+ * data is discarded, and the writer thread is left to free the underlying
+ * socket once any write already in progress completes.
+ *
+ * @param socket
+ *     The queued socket to free.
+ *
+ * @return
+ *     Zero if the socket was freed successfully, non-zero otherwise. This
+ *     implementation always succeeds, and will always return zero.
+ */
+static int guac_socket_queue_free_handler(guac_socket* socket) {
+
+    guac_socket_queue_data* data = (guac_socket_queue_data*) socket->data;
+
+    /* Calculate the time after which queued data is no longer written */
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    uint64_t usec = now.tv_usec
+        + (uint64_t) GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT * 1000;
+    struct timespec deadline = {
+        .tv_sec  = now.tv_sec + usec / 1000000,
+        .tv_nsec = (usec % 1000000) * 1000
+    };
+
+    /* Signal writer thread to write remaining data and terminate */
+    pthread_mutex_lock(&(data->queue_lock));
+    data->closing = 1;
+    pthread_cond_signal(&(data->data_available));
+
+    /* Wait a finite amount of time for remaining data to be written */
+    while (!data->stopped) {
+        if (pthread_cond_timedwait(&(data->writer_stopped),
+                    &(data->queue_lock), &deadline))
+            break;
+    }
+
+    /* If the writer thread is still writing, discard everything not yet
+     * being written and leave the writer thread to clean up once the current
+     * write completes */
+    if (!data->stopped) {
+        data->failed = 1;
+        data->abandoned = 1;
+        guac_socket_queue_discard(data);
+        pthread_detach(data->writer_thread);
+        pthread_mutex_unlock(&(data->queue_lock));
+        return 0;
+    }
+
+    pthread_mutex_unlock(&(data->queue_lock));
+
+    pthread_join(data->writer_thread, NULL);
+    guac_socket_queue_data_free(data);
+
+    return 0;
+
+}
+
+guac_socket* guac_socket_queue(guac_socket* socket, size_t max_length,
+        guac_socket_queue_policy policy) {
+
+    guac_socket_queue_data* data = malloc(sizeof(guac_socket_queue_data));
+    if (data == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Unable to allocate queued socket";
+        return NULL;
+    }
+
+    data->socket = socket;
+    data->max_length = max_length;
+    data->policy = policy;
+    data->head = NULL;
+    data->tail = NULL;
+    data->length = 0;
+    data->failed = 0;
+    data->closing = 0;
+    data->stopped = 0;
+    data->abandoned = 0;
+
+    pthread_mutex_init(&(data->queue_lock), NULL);
+    pthread_mutex_init(&(data->socket_lock), NULL);
+    pthread_cond_init(&(data->data_available), NULL);
+    pthread_cond_init(&(data->space_available), NULL);
+    pthread_cond_init(&(data->writer_stopped), NULL);
+
+    /* Start writing queued data to the underlying socket */
+    if (pthread_create(&(data->writer_thread), NULL,
+                guac_socket_queue_writer_thread, data)) {
+
+        pthread_cond_destroy(&(data->data_available));
+        pthread_cond_destroy(&(data->space_available));
+        pthread_cond_destroy(&(data->writer_stopped));
+        pthread_mutex_destroy(&(data->queue_lock));
+        pthread_mutex_destroy(&(data->socket_lock));
+        free(data);
+
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to start writer thread of queued socket";
+        return NULL;
+
+    }
+
+    /* Associate queue with new socket */
+    guac_socket* queued = guac_socket_alloc();
+    queued->data = data;
+
+    /* Set read/write handlers */
+    queued->read_handler   = guac_socket_queue_read_handler;
+    queued->write_handler  = guac_socket_queue_write_handler;
+    queued->select_handler = guac_socket_queue_select_handler;
+    queued->flush_handler  = guac_socket_queue_flush_handler;
+    queued->lock_handler   = guac_socket_queue_lock_handler;
+    queued->unlock_handler = guac_socket_queue_unlock_handler;
+    queued->free_handler   = guac_socket_queue_free_handler;
+
+    return queued;
+
+}
+
@@ -0,0 +1,123 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef GUAC_SOCKET_QUEUE_H
+#define GUAC_SOCKET_QUEUE_H
+
+#include "guacamole/socket.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * An immutable, reference-counted block of data which may be queued for
+ * writing to any number of queued sockets (see guac_socket_queue()) without
+ * being copied. Data may be appended to a segment only by the holder of the
+ * segment's original reference, and only beyond any portion of the segment
+ * which has already been queued.
+ */
+typedef struct guac_socket_segment {
+
+    /**
+     * The number of references to this segment. The segment is freed when
+     * this reaches zero.
+     */
+    int refcount;
+
+    /**
+     * Lock which protects access to the reference count of this segment.
+     */
+    pthread_mutex_t refcount_lock;
+
+    /**
+     * The number of bytes of data currently stored within this segment.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes of data that this segment can store.
+     */
+    size_t size;
+
+    /**
+     * The data stored within this segment.
+     */
+    char data[];
+
+} guac_socket_segment;
+
+/**
+ * Allocates a new, empty segment which can store the given number of bytes.
+ * The returned segment has a single reference, which must eventually be
+ * released with guac_socket_segment_unref().
+ *
+ * @param size
+ *     The number of bytes of data that the segment should be able to store.
+ *
+ * @return
+ *     A newly-allocated segment, or NULL if the segment cannot be allocated.
+ */
+guac_socket_segment* guac_socket_segment_alloc(size_t size);
+
+/**
+ * Acquires an additional reference to the given segment.
+ *
+ * @param segment
+ *     The segment to acquire a reference to.
+ */
+void guac_socket_segment_ref(guac_socket_segment* segment);
+
+/**
+ * Releases a reference to the given segment, freeing the segment if no
+ * references remain.
+ *
+ * @param segment
+ *     The segment to release a reference to.
+ */
+void guac_socket_segment_unref(guac_socket_segment* segment);
+
+/**
+ * Writes a range of data from the given segment to the given socket. If the
+ * socket is a queued socket, a reference to the range is queued, and the
+ * data itself is not copied until it is written to the underlying socket.
+ * Otherwise, the data is simply written with guac_socket_write(). The range
+ * of data within the segment must not be modified after this function is
+ * invoked.
+ *
+ * @param socket
+ *     The socket to write to.
+ *
+ * @param segment
+ *     The segment containing the data to write.
+ *
+ * @param offset
+ *     The offset of the first byte of data within the segment.
+ *
+ * @param length
+ *     The number of bytes of data to write.
+ *
+ * @return
+ *     Zero on success, non-zero if an error occurs.
+ */
+int guac_socket_write_segment(guac_socket* socket,
+        guac_socket_segment* segment, size_t offset, size_t length);
+
+#endif
+
@@ -24,10 +24,65 @@
 #include "guacamole/socket.h"
 #include "wait-fd.h"
 
+#include <errno.h>
 #include <stdlib.h>
+#include <unistd.h>
 
+#include <openssl/bio.h>
 #include <openssl/ssl.h>
 
+/**
+ * Returns whether the given value, returned by SSL_read() or SSL_write(),
+ * indicates only that the operation could not complete without blocking, as
+ * is possible if the underlying file descriptor is non-blocking. If so,
+ * guac_error is set to GUAC_STATUS_WOULD_BLOCK, and the operation should be
+ * retried with the same arguments once the file descriptor is ready.
+ *
+ * @param ssl
+ *     The SSL connection on which the operation was attempted.
+ *
+ * @param retval
+ *     The value returned by SSL_read() or SSL_write().
+ *
+ * @return
+ *     Non-zero if the operation would have blocked, zero otherwise.
+ */
+static int __guac_socket_ssl_would_block(SSL* ssl, int retval) {
+
+    int error = SSL_get_error(ssl, retval);
+    if (error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+        return 0;
+
+    guac_error = GUAC_STATUS_WOULD_BLOCK;
+    guac_error_message = "Secure socket is not ready";
+    return 1;
+
+}
+
+/**
+ * Returns whether the given value, returned by read() or write() on a
+ * descriptor whose encryption is handled by the kernel, indicates only that
+ * the operation could not complete without blocking. If so, guac_error is set
+ * to GUAC_STATUS_WOULD_BLOCK, and the operation should be retried with the
+ * same arguments once the file descriptor is ready.
+ *
+ * @param retval
+ *     The value returned by read() or write().
+ *
+ * @return
+ *     Non-zero if the operation would have blocked, zero otherwise.
+ */
+static int __guac_socket_ssl_kernel_would_block(ssize_t retval) {
+
+    if (retval >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        return 0;
+
+    guac_error = GUAC_STATUS_WOULD_BLOCK;
+    guac_error_message = "Secure socket is not ready";
+    return 1;
+
+}
+
 static ssize_t __guac_socket_ssl_read_handler(guac_socket* socket,
         void* buf, size_t count) {
 
@@ -35,8 +90,38 @@ static ssize_t __guac_socket_ssl_read_handler(guac_socket* socket,
     guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
     int retval;
 
+    /* Read directly if decryption is handled by the kernel */
+    if (data->kernel_tls) {
+
+        retval = read(data->fd, buf, count);
+
+        /* Operations on non-blocking sockets may need to be retried */
+        if (__guac_socket_ssl_kernel_would_block(retval))
+            return -1;
+
+        /* The kernel refuses to read TLS records which do not contain
+         * application data, such as alerts or key updates, which must
+         * instead be handled by OpenSSL */
+        if (retval >= 0 || errno != EIO) {
+
+            /* Record errors in guac_error */
+            if (retval < 0) {
+                guac_error = GUAC_STATUS_SEE_ERRNO;
+                guac_error_message = "Error reading data from secure socket";
+            }
+
+            return retval;
+
+        }
+
+    }
+
     retval = SSL_read(data->ssl, buf, count);
 
+    /* Operations on non-blocking sockets may need to be retried */
+    if (retval <= 0 && __guac_socket_ssl_would_block(data->ssl, retval))
+        return -1;
+
     /* Record errors in guac_error */
     if (retval <= 0) {
         guac_error = GUAC_STATUS_SEE_ERRNO;
@@ -54,7 +139,26 @@ static ssize_t __guac_socket_ssl_write_handler(guac_socket* socket,
     guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
     int retval;
 
-    retval = SSL_write(data->ssl, buf, count);
+    /* Write directly if encryption is handled by the kernel */
+    if (data->kernel_tls) {
+
+        retval = write(data->fd, buf, count);
+
+        /* Operations on non-blocking sockets may need to be retried */
+        if (__guac_socket_ssl_kernel_would_block(retval))
+            return -1;
+
+    }
+
+    else {
+
+        retval = SSL_write(data->ssl, buf, count);
+
+        /* Operations on non-blocking sockets may need to be retried */
+        if (retval <= 0 && __guac_socket_ssl_would_block(data->ssl, retval))
+            return -1;
+
+    }
 
     /* Record errors in guac_error */
     if (retval <= 0) {
@@ -114,8 +218,14 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd) {
     /* Init SSL */
     data->context = context;
     data->ssl = ssl;
+    data->kernel_tls = 0;
     SSL_set_fd(data->ssl, fd);
 
+#ifdef SSL_OP_ENABLE_KTLS
+    /* Offload encryption to the kernel where possible */
+    SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+#endif
+
     /* Accept SSL connection, handle errors */
     if (SSL_accept(ssl) <= 0) {
 
@@ -128,6 +238,15 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd) {
         return NULL;
     }
 
+#ifdef SSL_OP_ENABLE_KTLS
+    /* Bypass OpenSSL entirely if the kernel now handles both directions and
+     * OpenSSL holds no data which has yet to be read */
+    if (BIO_get_ktls_send(SSL_get_wbio(ssl))
+            && BIO_get_ktls_recv(SSL_get_rbio(ssl))
+            && !SSL_has_pending(ssl))
+        data->kernel_tls = 1;
+#endif
+
     /* Store file descriptor as socket data */
     data->fd = fd;
     socket->data = data;
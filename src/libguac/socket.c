@@ -19,9 +19,11 @@
 
 #include "config.h"
 
+#include "base64.h"
 #include "guacamole/error.h"
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
+#include "guacamole/timer.h"
 #include "guacamole/timestamp.h"
 
 #include <inttypes.h>
@@ -34,6 +36,13 @@
 #include <time.h>
 #include <unistd.h>
 
+/**
+ * The number of base64 characters encoded at a time by
+ * guac_socket_write_base64() before being written to the socket. This must
+ * be a multiple of 4.
+ */
+#define GUAC_SOCKET_BASE64_CHUNK_SIZE 8192
+
 char __guac_socket_BASE64_CHARACTERS[64] = {
     'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O',
     'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', 'a', 'b', 'c', 'd',
@@ -42,40 +51,97 @@ char __guac_socket_BASE64_CHARACTERS[64] = {
     '8', '9', '+', '/'
 };
 
+/**
+ * Sends a single "nop" instruction over the given socket, recording whether
+ * the ping succeeded. Writing to a socket may block indefinitely, thus each
+ * ping is sent by its own thread rather than by the timer thread shared by
+ * the entire process.
+ *
+ * @param data
+ *     The guac_socket requiring a keep-alive ping.
+ *
+ * @return
+ *     Always NULL.
+ */
 static void* __guac_socket_keep_alive_thread(void* data) {
 
-    int old_cancelstate;
+    guac_socket* socket = (guac_socket*) data;
+
+    /* Send NOP */
+    int result = guac_protocol_send_nop(socket)
+        || guac_socket_flush(socket);
 
-    /* Calculate sleep interval */
-    struct timespec interval;
-    interval.tv_sec  =  GUAC_SOCKET_KEEP_ALIVE_INTERVAL / 1000;
-    interval.tv_nsec = (GUAC_SOCKET_KEEP_ALIVE_INTERVAL % 1000) * 1000000L;
+    pthread_mutex_lock(&(socket->__keep_alive_lock));
+    socket->__keep_alive_result = result;
+    pthread_mutex_unlock(&(socket->__keep_alive_lock));
+
+    return NULL;
+
+}
+
+/**
+ * Timer callback which starts sending a "nop" instruction over the given
+ * socket if nothing has been written to that socket for
+ * GUAC_SOCKET_KEEP_ALIVE_INTERVAL milliseconds. The callback itself never
+ * blocks, and no further ping is started while a previous ping is still being
+ * sent.
+ *
+ * @param timer
+ *     The keep-alive timer of the socket.
+ *
+ * @param data
+ *     The guac_socket requiring keep-alive pings.
+ *
+ * @return
+ *     The number of milliseconds until the socket should next be checked, or
+ *     zero if the socket is closed.
+ */
+static int __guac_socket_keep_alive_callback(guac_timer* timer, void* data) {
 
-    /* Socket keep-alive loop */
     guac_socket* socket = (guac_socket*) data;
-    while (socket->state == GUAC_SOCKET_OPEN) {
+    if (socket->state != GUAC_SOCKET_OPEN)
+        return 0;
 
-        /* Send NOP keep-alive if it's been a while since the last output */
-        guac_timestamp timestamp = guac_timestamp_current();
-        if (timestamp - socket->last_write_timestamp >
-                GUAC_SOCKET_KEEP_ALIVE_INTERVAL) {
+    /* Collect the result of any previous ping */
+    if (socket->__keep_alive_pinging) {
 
-            /* Send NOP */
-            if (guac_protocol_send_nop(socket)
-                || guac_socket_flush(socket))
-                break;
+        pthread_mutex_lock(&(socket->__keep_alive_lock));
+        int result = socket->__keep_alive_result;
+        pthread_mutex_unlock(&(socket->__keep_alive_lock));
 
-        }
+        /* Wait for the previous ping to finish before sending another */
+        if (result < 0)
+            return GUAC_SOCKET_KEEP_ALIVE_INTERVAL;
 
-        /* Sleep until next keep-alive check, but allow thread cancellation
-         * during that sleep */
-        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_cancelstate);
-        nanosleep(&interval, NULL);
-        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &old_cancelstate);
+        pthread_join(socket->__keep_alive_thread, NULL);
+        socket->__keep_alive_pinging = 0;
+
+        /* Stop pinging once the socket can no longer be written */
+        if (result > 0)
+            return 0;
 
     }
 
-    return NULL;
+    /* Send NOP keep-alive if it's been a while since the last output */
+    guac_timestamp idle = guac_timestamp_current()
+        - socket->last_write_timestamp;
+
+    if (idle >= GUAC_SOCKET_KEEP_ALIVE_INTERVAL) {
+
+        socket->__keep_alive_result = -1;
+
+        /* Retry later if the ping cannot be started */
+        if (!pthread_create(&(socket->__keep_alive_thread), NULL,
+                    __guac_socket_keep_alive_thread, (void*) socket))
+            socket->__keep_alive_pinging = 1;
+
+        return GUAC_SOCKET_KEEP_ALIVE_INTERVAL;
+
+    }
+
+    /* Check again once the socket would have been idle for the full
+     * interval */
+    return GUAC_SOCKET_KEEP_ALIVE_INTERVAL - idle;
 
 }
 
@@ -157,6 +223,9 @@ guac_socket* guac_socket_alloc() {
 
     /* No keep alive ping by default */
     socket->__keep_alive_enabled = 0;
+    socket->__keep_alive_pinging = 0;
+    socket->__keep_alive_result = 0;
+    pthread_mutex_init(&(socket->__keep_alive_lock), NULL);
 
     /* No handlers yet */
     socket->read_handler   = NULL;
@@ -173,10 +242,23 @@ guac_socket* guac_socket_alloc() {
 
 void guac_socket_require_keep_alive(guac_socket* socket) {
 
-    /* Start keep-alive thread */
+    /* Keep-alive need only be started once */
+    if (socket->__keep_alive_enabled)
+        return;
+
+    guac_timer* timer = guac_timer_alloc(__guac_socket_keep_alive_callback,
+            socket);
+    if (timer == NULL)
+        return;
+
+    /* Check for inactivity using the shared timer thread */
+    if (guac_timer_schedule(timer, GUAC_SOCKET_KEEP_ALIVE_INTERVAL)) {
+        guac_timer_free(timer);
+        return;
+    }
+
+    socket->__keep_alive_timer = timer;
     socket->__keep_alive_enabled = 1;
-    pthread_create(&(socket->__keep_alive_thread), NULL,
-                __guac_socket_keep_alive_thread, (void*) socket);
 
 }
 
@@ -198,6 +280,13 @@ void guac_socket_instruction_end(guac_socket* socket) {
 
 void guac_socket_free(guac_socket* socket) {
 
+    /* Stop keep-alive, waiting for any in-progress ping to complete */
+    if (socket->__keep_alive_enabled)
+        guac_timer_free(socket->__keep_alive_timer);
+
+    if (socket->__keep_alive_pinging)
+        pthread_join(socket->__keep_alive_thread, NULL);
+
     guac_socket_flush(socket);
 
     /* Call free handler if defined */
@@ -207,12 +296,7 @@ void guac_socket_free(guac_socket* socket) {
     /* Mark as closed */
     socket->state = GUAC_SOCKET_CLOSED;
 
-    /* Stop keep-alive thread, if enabled */
-    if (socket->__keep_alive_enabled) {
-        pthread_cancel(socket->__keep_alive_thread);
-        pthread_join(socket->__keep_alive_thread, NULL);
-    }
-
+    pthread_mutex_destroy(&(socket->__keep_alive_lock));
     free(socket);
 }
 
@@ -330,6 +414,36 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
     const unsigned char* char_buf = (const unsigned char*) buf;
     const unsigned char* end = char_buf + count;
 
+    char output[GUAC_SOCKET_BASE64_CHUNK_SIZE];
+
+    /* Complete any triplet begun by a previous call */
+    while (socket->__ready > 0 && char_buf < end) {
+
+        retval = __guac_socket_write_base64_byte(socket, *(char_buf++));
+        if (retval < 0)
+            return retval;
+
+    }
+
+    /* Encode all remaining complete triplets in bulk, one chunk at a time */
+    while (end - char_buf >= 3) {
+
+        size_t length = end - char_buf;
+        if (length > GUAC_SOCKET_BASE64_CHUNK_SIZE / 4 * 3)
+            length = GUAC_SOCKET_BASE64_CHUNK_SIZE / 4 * 3;
+
+        /* Encode only whole triplets */
+        length -= length % 3;
+
+        size_t encoded = guac_base64_encode(char_buf, length, output);
+        if (guac_socket_write(socket, output, encoded))
+            return -1;
+
+        char_buf += length;
+
+    }
+
+    /* Store any remaining bytes until the next call or flush */
     while (char_buf < end) {
 
         retval = __guac_socket_write_base64_byte(socket, *(char_buf++));
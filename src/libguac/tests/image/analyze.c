@@ -0,0 +1,182 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/image.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * The width of each test image, in pixels. This is deliberately not a
+ * multiple of any vector size such that both vectorized and non-vectorized
+ * portions of the analysis are exercised.
+ */
+#define TEST_IMAGE_WIDTH 37
+
+/**
+ * The height of each test image, in pixels.
+ */
+#define TEST_IMAGE_HEIGHT 8
+
+/**
+ * The number of bytes in each row of each test image, including padding.
+ */
+#define TEST_IMAGE_STRIDE ((TEST_IMAGE_WIDTH + 3) * 4)
+
+/**
+ * Test image data, sized for a TEST_IMAGE_WIDTH by TEST_IMAGE_HEIGHT image
+ * having a stride of TEST_IMAGE_STRIDE bytes.
+ */
+static uint32_t test_image[TEST_IMAGE_STRIDE / 4 * TEST_IMAGE_HEIGHT];
+
+/**
+ * Fills every pixel of the test image with the given color, including the
+ * padding at the end of each row.
+ *
+ * @param color
+ *     The 32-bit ARGB color to fill the test image with.
+ */
+static void fill_test_image(uint32_t color) {
+    for (size_t i = 0; i < sizeof(test_image) / sizeof(uint32_t); i++)
+        test_image[i] = color;
+}
+
+/**
+ * Returns a pointer to the pixel at the given coordinates within the test
+ * image.
+ *
+ * @param x
+ *     The X coordinate of the pixel.
+ *
+ * @param y
+ *     The Y coordinate of the pixel.
+ *
+ * @return
+ *     A pointer to the pixel at the given coordinates.
+ */
+static uint32_t* test_pixel(int x, int y) {
+    return &test_image[y * TEST_IMAGE_STRIDE / 4 + x];
+}
+
+/**
+ * Test which verifies that guac_image_analyze() correctly analyzes an image
+ * consisting of a single, opaque color.
+ */
+void test_image__analyze_solid() {
+
+    guac_image_analysis analysis;
+
+    fill_test_image(0xFF123456);
+    guac_image_analyze((unsigned char*) test_image, TEST_IMAGE_WIDTH,
+            TEST_IMAGE_HEIGHT, TEST_IMAGE_STRIDE, &analysis);
+
+    CU_ASSERT_TRUE(analysis.opaque);
+    CU_ASSERT_TRUE(analysis.solid);
+    CU_ASSERT_EQUAL(analysis.color, 0xFF123456);
+    CU_ASSERT_EQUAL(analysis.num_same,
+            (TEST_IMAGE_WIDTH - 1) * TEST_IMAGE_HEIGHT);
+    CU_ASSERT_EQUAL(analysis.num_different, 0);
+    CU_ASSERT_EQUAL_FATAL(analysis.palette_size, 1);
+    CU_ASSERT_EQUAL(analysis.palette[0], 0x123456);
+
+}
+
+/**
+ * Test which verifies that guac_image_analyze() detects non-opaque pixels,
+ * and that images differing only in alpha are not considered solid even
+ * though their palette contains only one color.
+ */
+void test_image__analyze_alpha() {
+
+    guac_image_analysis analysis;
+
+    fill_test_image(0xFF123456);
+    *test_pixel(TEST_IMAGE_WIDTH - 1, TEST_IMAGE_HEIGHT - 1) = 0x80123456;
+
+    guac_image_analyze((unsigned char*) test_image, TEST_IMAGE_WIDTH,
+            TEST_IMAGE_HEIGHT, TEST_IMAGE_STRIDE, &analysis);
+
+    CU_ASSERT_FALSE(analysis.opaque);
+    CU_ASSERT_FALSE(analysis.solid);
+    CU_ASSERT_EQUAL(analysis.num_different, 0);
+    CU_ASSERT_EQUAL(analysis.palette_size, 1);
+
+}
+
+/**
+ * Test which verifies that guac_image_analyze() counts adjacent pixels which
+ * differ in color, and records each distinct color in the order in which it
+ * first occurs.
+ */
+void test_image__analyze_palette() {
+
+    guac_image_analysis analysis;
+
+    fill_test_image(0xFF000000);
+    *test_pixel(10, 1) = 0xFF0000FF;
+    *test_pixel(11, 1) = 0xFF0000FF;
+    *test_pixel(0, 3) = 0xFF00FF00;
+    *test_pixel(TEST_IMAGE_WIDTH - 1, 4) = 0xFFFF0000;
+
+    guac_image_analyze((unsigned char*) test_image, TEST_IMAGE_WIDTH,
+            TEST_IMAGE_HEIGHT, TEST_IMAGE_STRIDE, &analysis);
+
+    CU_ASSERT_TRUE(analysis.opaque);
+    CU_ASSERT_FALSE(analysis.solid);
+
+    /* Two changes around the blue run, one after the green pixel (which
+     * begins its row), and one before the red pixel */
+    CU_ASSERT_EQUAL(analysis.num_different, 4);
+    CU_ASSERT_EQUAL(analysis.num_same + analysis.num_different,
+            (TEST_IMAGE_WIDTH - 1) * TEST_IMAGE_HEIGHT);
+
+    CU_ASSERT_EQUAL_FATAL(analysis.palette_size, 4);
+    CU_ASSERT_EQUAL(analysis.palette[0], 0x000000);
+    CU_ASSERT_EQUAL(analysis.palette[1], 0x0000FF);
+    CU_ASSERT_EQUAL(analysis.palette[2], 0x00FF00);
+    CU_ASSERT_EQUAL(analysis.palette[3], 0xFF0000);
+
+}
+
+/**
+ * Test which verifies that guac_image_analyze() reports that an image has no
+ * palette if it contains more than GUAC_IMAGE_MAX_PALETTE_SIZE colors.
+ */
+void test_image__analyze_palette_overflow() {
+
+    guac_image_analysis analysis;
+
+    /* Give every pixel a different color */
+    for (int y = 0; y < TEST_IMAGE_HEIGHT; y++) {
+        for (int x = 0; x < TEST_IMAGE_WIDTH; x++)
+            *test_pixel(x, y) = 0xFF000000 | (y * TEST_IMAGE_WIDTH + x);
+    }
+
+    guac_image_analyze((unsigned char*) test_image, TEST_IMAGE_WIDTH,
+            TEST_IMAGE_HEIGHT, TEST_IMAGE_STRIDE, &analysis);
+
+    CU_ASSERT_TRUE(analysis.opaque);
+    CU_ASSERT_FALSE(analysis.solid);
+    CU_ASSERT_EQUAL(analysis.num_same, 0);
+    CU_ASSERT_EQUAL(analysis.num_different,
+            (TEST_IMAGE_WIDTH - 1) * TEST_IMAGE_HEIGHT);
+    CU_ASSERT_EQUAL(analysis.palette_size, 0);
+
+}
@@ -0,0 +1,122 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/parser.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The number of times the characters of TEST_CHARACTERS are repeated within
+ * the element content tested by test_parser__append_utf8().
+ */
+#define TEST_REPEAT 40
+
+/**
+ * A sequence of 11 UTF-8 characters of varying lengths, including characters
+ * which are one, two, three, and four bytes long.
+ */
+#define TEST_CHARACTERS "a\xC3\xA9" "b\xE2\x82\xAC" "c\xF0\x9F\x98\x80" \
+                        "d;,." "e"
+
+/**
+ * The number of characters within TEST_CHARACTERS.
+ */
+#define TEST_CHARACTER_COUNT 11
+
+/**
+ * Passes the given data to guac_parser_append() repeatedly until no further
+ * data can be parsed.
+ *
+ * @param parser
+ *     The parser to pass data to.
+ *
+ * @param buffer
+ *     The data to parse.
+ *
+ * @param length
+ *     The number of bytes of data available within the buffer.
+ *
+ * @return
+ *     The total number of bytes parsed.
+ */
+static int append_all(guac_parser* parser, char* buffer, int length) {
+
+    int total = 0;
+    int parsed;
+
+    while ((parsed = guac_parser_append(parser, buffer + total,
+                    length - total)) > 0)
+        total += parsed;
+
+    return total;
+
+}
+
+/**
+ * Test which verifies that guac_parser correctly counts the characters of
+ * long elements containing multibyte UTF-8 characters, regardless of where
+ * those characters fall relative to the blocks of data passed to
+ * guac_parser_append().
+ */
+void test_parser__append_utf8() {
+
+    char content[sizeof(TEST_CHARACTERS) * TEST_REPEAT];
+    char buffer[sizeof(content) + 64];
+    char instruction[sizeof(buffer)];
+
+    /* Build long element containing many multibyte characters */
+    content[0] = '\0';
+    for (int i = 0; i < TEST_REPEAT; i++)
+        strcat(content, TEST_CHARACTERS);
+
+    int length = snprintf(buffer, sizeof(buffer), "4.test,%i.%s,1.x;",
+            TEST_CHARACTER_COUNT * TEST_REPEAT, content);
+
+    /* Parse the same instruction split at every possible point */
+    for (int split = 0; split <= length; split++) {
+
+        memcpy(instruction, buffer, length);
+
+        guac_parser* parser = guac_parser_alloc();
+        CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+        /* Parse data before split, then everything remaining */
+        int parsed = append_all(parser, instruction, split);
+        parsed += append_all(parser, instruction + parsed, length - parsed);
+
+        /* Entire instruction should have been parsed */
+        CU_ASSERT_EQUAL(parsed, length);
+        CU_ASSERT_EQUAL(parser->state, GUAC_PARSE_COMPLETE);
+
+        /* Validate resulting content */
+        CU_ASSERT_EQUAL(parser->argc, 2);
+        CU_ASSERT_STRING_EQUAL(parser->opcode, "test");
+        CU_ASSERT_STRING_EQUAL(parser->argv[0], content);
+        CU_ASSERT_STRING_EQUAL(parser->argv[1], "x");
+
+        guac_parser_free(parser);
+
+    }
+
+}
+
@@ -0,0 +1,108 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/error.h>
+#include <guacamole/parser.h>
+
+#include <limits.h>
+#include <stdio.h>
+
+/**
+ * Verifies that appending the given length prefix to a newly-allocated
+ * parser having the given maximum element length results in the given
+ * parser state.
+ *
+ * @param max_length
+ *     The maximum element length to set.
+ *
+ * @param prefix
+ *     The length prefix to append, including the terminating period.
+ *
+ * @param expected
+ *     The expected state of the parser after the prefix has been appended.
+ */
+static void verify_prefix(int max_length, const char* prefix,
+        guac_parse_state expected) {
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    CU_ASSERT_EQUAL(guac_parser_set_max_element_length(parser, max_length), 0);
+
+    char buffer[64];
+    int length = snprintf(buffer, sizeof(buffer), "%s", prefix);
+    guac_parser_append(parser, buffer, length);
+    CU_ASSERT_EQUAL(parser->state, expected);
+
+    guac_parser_free(parser);
+
+}
+
+/**
+ * Test which verifies that guac_parser_set_max_element_length() accepts only
+ * lengths between GUAC_INSTRUCTION_MAX_LENGTH and
+ * GUAC_PARSER_MAX_ELEMENT_LENGTH inclusive, leaving the maximum unchanged
+ * otherwise.
+ */
+void test_parser__max_element_length() {
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    /* Out-of-range lengths are rejected */
+    int invalid[] = {
+        INT_MIN, -1, 0,
+        GUAC_INSTRUCTION_MAX_LENGTH - 1,
+        GUAC_PARSER_MAX_ELEMENT_LENGTH + 1,
+        INT_MAX
+    };
+
+    for (int i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        guac_error = GUAC_STATUS_SUCCESS;
+        CU_ASSERT_NOT_EQUAL(guac_parser_set_max_element_length(parser,
+                    invalid[i]), 0);
+        CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_INVALID_ARGUMENT);
+    }
+
+    /* The default maximum remains in effect */
+    char buffer[64];
+    int length = snprintf(buffer, sizeof(buffer), "%d.",
+            GUAC_INSTRUCTION_MAX_LENGTH + 1);
+    guac_parser_append(parser, buffer, length);
+    CU_ASSERT_EQUAL(parser->state, GUAC_PARSE_ERROR);
+
+    guac_parser_free(parser);
+
+    /* Lengths at either end of the range are accepted and enforced */
+    snprintf(buffer, sizeof(buffer), "%d.", GUAC_INSTRUCTION_MAX_LENGTH);
+    verify_prefix(GUAC_INSTRUCTION_MAX_LENGTH, buffer, GUAC_PARSE_CONTENT);
+
+    snprintf(buffer, sizeof(buffer), "%d.", GUAC_PARSER_MAX_ELEMENT_LENGTH);
+    verify_prefix(GUAC_PARSER_MAX_ELEMENT_LENGTH, buffer, GUAC_PARSE_CONTENT);
+
+    snprintf(buffer, sizeof(buffer), "%d.",
+            GUAC_PARSER_MAX_ELEMENT_LENGTH + 1);
+    verify_prefix(GUAC_PARSER_MAX_ELEMENT_LENGTH, buffer, GUAC_PARSE_ERROR);
+
+    /* Lengths which would overflow an int are rejected */
+    verify_prefix(GUAC_PARSER_MAX_ELEMENT_LENGTH, "99999999999999999999.",
+            GUAC_PARSE_ERROR);
+
+}
+
@@ -0,0 +1,179 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The length of the large element within each "blob" instruction written by
+ * write_large_instructions(). This is intentionally larger than
+ * GUAC_INSTRUCTION_MAX_LENGTH.
+ */
+#define TEST_ELEMENT_LENGTH 60000
+
+/**
+ * The maximum element length to set on the parser used by
+ * test_parser__read_large().
+ */
+#define TEST_MAX_ELEMENT_LENGTH 65536
+
+/**
+ * The number of "blob" instructions written by write_large_instructions().
+ */
+#define TEST_BLOB_COUNT 8
+
+/**
+ * Fills the given buffer with the test content expected within each "blob"
+ * instruction, null-terminating the result.
+ *
+ * @param buffer
+ *     The buffer to fill, which must be at least TEST_ELEMENT_LENGTH + 1
+ *     bytes long.
+ *
+ * @param index
+ *     The index of the "blob" instruction whose content should be generated.
+ */
+static void generate_content(char* buffer, int index) {
+
+    int i;
+    for (i = 0; i < TEST_ELEMENT_LENGTH; i++)
+        buffer[i] = 'A' + (i + index) % 26;
+
+    buffer[TEST_ELEMENT_LENGTH] = '\0';
+
+}
+
+/**
+ * Writes a series of Guacamole instructions, each large "blob" instruction
+ * being preceded by a small "sync" instruction, to the given file
+ * descriptor. The given file descriptor is automatically closed as a result
+ * of calling this function.
+ *
+ * @param fd
+ *     The file descriptor to write instructions to.
+ */
+static void write_large_instructions(int fd) {
+
+    char content[TEST_ELEMENT_LENGTH + 1];
+    char buffer[TEST_ELEMENT_LENGTH + 64];
+
+    int i;
+    for (i = 0; i < TEST_BLOB_COUNT; i++) {
+
+        generate_content(content, i);
+
+        int length = snprintf(buffer, sizeof(buffer),
+                "4.sync,1.%i;4.blob,1.%i,%i.%s;", i, i,
+                TEST_ELEMENT_LENGTH, content);
+
+        /* Bail out immediately if write fails (test will fail in parent
+         * process due to failure to read) */
+        char* current = buffer;
+        while (length > 0) {
+
+            int written = write(fd, current, length);
+            if (written <= 0)
+                break;
+
+            current += written;
+            length -= written;
+
+        }
+
+    }
+
+    /* Done writing */
+    close(fd);
+
+}
+
+/**
+ * Tests that guac_parser_read() correctly reads instructions containing
+ * elements larger than GUAC_INSTRUCTION_MAX_LENGTH once the parser has been
+ * configured to accept such elements. A child process is forked to write a
+ * series of instructions which are read and verified by the parent process.
+ */
+void test_parser__read_large() {
+
+    char expected[TEST_ELEMENT_LENGTH + 1];
+    char index[16];
+    int fd[2];
+    int i;
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    /* Fork into writer process (child) and reader process (parent) */
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Attempt to write a series of instructions within the child process */
+    if (childpid == 0) {
+        close(read_fd);
+        write_large_instructions(write_fd);
+        exit(0);
+    }
+
+    close(write_fd);
+
+    /* Open guac socket */
+    guac_socket* socket = guac_socket_open(read_fd);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Allocate parser which accepts large elements */
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    CU_ASSERT_EQUAL_FATAL(guac_parser_set_max_element_length(parser,
+                TEST_MAX_ELEMENT_LENGTH), 0);
+
+    /* Read and validate all instructions */
+    for (i = 0; i < TEST_BLOB_COUNT; i++) {
+
+        snprintf(index, sizeof(index), "%i", i);
+        generate_content(expected, i);
+
+        CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, socket, 1000000), 0);
+        CU_ASSERT_STRING_EQUAL(parser->opcode, "sync");
+        CU_ASSERT_EQUAL_FATAL(parser->argc, 1);
+        CU_ASSERT_STRING_EQUAL(parser->argv[0], index);
+
+        CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, socket, 1000000), 0);
+        CU_ASSERT_STRING_EQUAL(parser->opcode, "blob");
+        CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+        CU_ASSERT_STRING_EQUAL(parser->argv[0], index);
+        CU_ASSERT_STRING_EQUAL(parser->argv[1], expected);
+
+    }
+
+    /* Done */
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+
+}
+
@@ -0,0 +1,122 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/error.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The number of microseconds to wait for each partially-written instruction
+ * before giving up.
+ */
+#define TEST_TIMEOUT 10000
+
+/**
+ * The length of the large element within the "blob" instruction, which is
+ * intentionally long enough that the parser must grow its buffer while that
+ * instruction is only partially written.
+ */
+#define TEST_ELEMENT_LENGTH 40000
+
+/**
+ * The number of bytes of the large element which are written before the
+ * first attempt to read the "blob" instruction.
+ */
+#define TEST_PARTIAL_LENGTH 30000
+
+/**
+ * Writes the given null-terminated string to the given file descriptor in
+ * its entirety, failing the current test if this is not possible.
+ *
+ * @param fd
+ *     The file descriptor to write to.
+ *
+ * @param str
+ *     The string to write.
+ */
+static void write_string(int fd, const char* str) {
+    size_t length = strlen(str);
+    CU_ASSERT_EQUAL_FATAL(write(fd, str, length), length);
+}
+
+/**
+ * Tests that a call to guac_parser_read() which times out while an
+ * instruction is only partially received can be resumed by a later call,
+ * without losing any of the data already read, including when the parser
+ * buffer had to be grown before the timeout elapsed.
+ */
+void test_parser__read_timeout() {
+
+    static char content[TEST_ELEMENT_LENGTH + 1];
+    memset(content, 'x', TEST_ELEMENT_LENGTH);
+
+    int fd[2];
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    guac_socket* socket = guac_socket_open(read_fd);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    CU_ASSERT_EQUAL_FATAL(guac_parser_set_max_element_length(parser,
+                65536), 0);
+
+    /* Nothing can be read if only part of an instruction is available */
+    write_string(write_fd, "4.test,5.hel");
+    CU_ASSERT_NOT_EQUAL(guac_parser_read(parser, socket, TEST_TIMEOUT), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_TIMEOUT);
+
+    /* Reading resumes from where the timed-out read stopped */
+    write_string(write_fd, "lo,5.world;");
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, socket, TEST_TIMEOUT), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "test");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 2);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "hello");
+    CU_ASSERT_STRING_EQUAL(parser->argv[1], "world");
+
+    /* Write only part of an instruction too large for the initial buffer */
+    write_string(write_fd, "4.blob,40000.");
+    content[TEST_PARTIAL_LENGTH] = '\0';
+    write_string(write_fd, content);
+    CU_ASSERT_NOT_EQUAL(guac_parser_read(parser, socket, TEST_TIMEOUT), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_TIMEOUT);
+
+    /* The remainder must complete the instruction within the grown buffer */
+    content[TEST_PARTIAL_LENGTH] = 'x';
+    write_string(write_fd, content + TEST_PARTIAL_LENGTH);
+    write_string(write_fd, ";");
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, socket, TEST_TIMEOUT), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "blob");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 1);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], content);
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+    close(write_fd);
+
+}
+
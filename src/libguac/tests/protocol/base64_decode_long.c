@@ -0,0 +1,174 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "base64.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/protocol.h>
+
+#include <string.h>
+
+/**
+ * The maximum number of bytes to encode within each test string. This is
+ * deliberately larger than any vector size and not a multiple of any vector
+ * size such that both vectorized and non-vectorized portions of the decoding
+ * process are exercised.
+ */
+#define TEST_DATA_LENGTH 301
+
+/**
+ * The 64 characters of the base64 alphabet, in order of value.
+ */
+static const char test_base64_characters[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Test data containing every possible byte value, populated by
+ * fill_test_data().
+ */
+static unsigned char test_data[TEST_DATA_LENGTH];
+
+/**
+ * Every instruction set which guac_base64_decode() may use, regardless of
+ * whether that instruction set is supported by the current CPU.
+ */
+static const guac_base64_isa test_isas[] = {
+    GUAC_BASE64_ISA_SCALAR,
+    GUAC_BASE64_ISA_SSSE3,
+    GUAC_BASE64_ISA_AVX2,
+    GUAC_BASE64_ISA_NEON
+};
+
+/**
+ * The number of instruction sets within test_isas.
+ */
+#define TEST_ISA_COUNT (sizeof(test_isas) / sizeof(test_isas[0]))
+
+/**
+ * Fills the test data with a repeating sequence covering every possible byte
+ * value.
+ */
+static void fill_test_data() {
+    for (int i = 0; i < TEST_DATA_LENGTH; i++)
+        test_data[i] = (i * 157 + 11) & 0xFF;
+}
+
+/**
+ * Encodes the first bytes of the test data as a null-terminated base64
+ * string, including padding.
+ *
+ * @param length
+ *     The number of bytes of test data to encode.
+ *
+ * @param base64
+ *     The buffer which should receive the base64 string. This buffer must be
+ *     large enough to contain ((length + 2) / 3) * 4 characters, plus a null
+ *     terminator.
+ */
+static void encode_test_data(int length, char* base64) {
+
+    for (int i = 0; i < length; i += 3) {
+
+        int a = test_data[i];
+        int b = (i + 1 < length) ? test_data[i + 1] : 0;
+        int c = (i + 2 < length) ? test_data[i + 2] : 0;
+
+        *(base64++) = test_base64_characters[a >> 2];
+        *(base64++) = test_base64_characters[((a & 0x03) << 4) | (b >> 4)];
+        *(base64++) = (i + 1 < length)
+            ? test_base64_characters[((b & 0x0F) << 2) | (c >> 6)] : '=';
+        *(base64++) = (i + 2 < length)
+            ? test_base64_characters[c & 0x3F] : '=';
+
+    }
+
+    *base64 = '\0';
+
+}
+
+/**
+ * Tests that libguac's in-place base64 decoding function properly decodes
+ * base64 strings of every length up to TEST_DATA_LENGTH bytes, with and
+ * without padding, using each instruction set supported by the current CPU.
+ */
+void test_protocol__decode_base64_long() {
+
+    char base64[(TEST_DATA_LENGTH + 2) / 3 * 4 + 1];
+    fill_test_data();
+
+    for (int i = 0; i < (int) TEST_ISA_COUNT; i++) {
+
+        /* Skip instruction sets which cannot be used here */
+        if (guac_base64_set_isa(test_isas[i]))
+            continue;
+
+        for (int length = 0; length <= TEST_DATA_LENGTH; length++) {
+            encode_test_data(length, base64);
+            CU_ASSERT_EQUAL_FATAL(guac_protocol_decode_base64(base64), length);
+            CU_ASSERT_FATAL(memcmp(base64, test_data, length) == 0);
+        }
+
+    }
+
+    guac_base64_set_isa(GUAC_BASE64_ISA_AUTO);
+
+}
+
+/**
+ * Tests that libguac's in-place base64 decoding function stops at the first
+ * character which is not part of the base64 alphabet, regardless of where
+ * that character appears, while retaining all bytes decoded prior to that
+ * character, using each instruction set supported by the current CPU.
+ */
+void test_protocol__decode_base64_invalid() {
+
+    char base64[(TEST_DATA_LENGTH + 2) / 3 * 4 + 1];
+    fill_test_data();
+
+    const char invalid[] = { '=', '-', '_', ' ', '\n', '\x80', '\xFF' };
+
+    for (int j = 0; j < (int) TEST_ISA_COUNT; j++) {
+
+        /* Skip instruction sets which cannot be used here */
+        if (guac_base64_set_isa(test_isas[j]))
+            continue;
+
+        for (int i = 0; i < (int) sizeof(invalid); i++) {
+            for (int position = 0; position < 200; position += 7) {
+
+                encode_test_data(TEST_DATA_LENGTH, base64);
+                base64[position] = invalid[i];
+
+                /* Only the whole bytes preceding the invalid character
+                 * should be decoded */
+                int length = position * 6 / 8;
+                CU_ASSERT_EQUAL_FATAL(guac_protocol_decode_base64(base64),
+                        length);
+                CU_ASSERT_FATAL(memcmp(base64, test_data, length) == 0);
+
+            }
+        }
+
+    }
+
+    guac_base64_set_isa(GUAC_BASE64_ISA_AUTO);
+
+}
+
@@ -0,0 +1,238 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * The number of different sizes of large write to perform. Whether the end of
+ * a write is held back by the kernel depends on how that write splits into TCP
+ * segments, so several sizes are tested.
+ */
+#define TEST_SIZES 16
+
+/**
+ * The number of times each size of large write is performed.
+ */
+#define TEST_PASSES 3
+
+/**
+ * The total number of large writes to perform.
+ */
+#define TEST_ROUNDS (TEST_SIZES * TEST_PASSES)
+
+/**
+ * The size of the smallest large write, in bytes. This is larger than the
+ * output buffer of the file descriptor implementation of guac_socket, such
+ * that each write bypasses that buffer.
+ */
+#define TEST_MIN_SIZE 66000
+
+/**
+ * The number of bytes by which each successive large write grows.
+ */
+#define TEST_SIZE_STEP 7919
+
+/**
+ * The maximum total amount of time that may be spent waiting for data across
+ * all rounds, in milliseconds. This is generous enough to tolerate occasional
+ * scheduling delays, while the delay of roughly 40ms which results whenever
+ * the end of a write is held back until the peer's delayed ACK affects enough
+ * rounds to exceed it several times over.
+ */
+#define TEST_TIMEOUT 250
+
+/**
+ * Returns the size of the large write performed during the given round.
+ *
+ * @param round
+ *     The zero-based index of the round.
+ *
+ * @return
+ *     The size of the large write performed during the given round, in bytes.
+ */
+static int write_size(int round) {
+    return TEST_MIN_SIZE + (round % TEST_SIZES) * TEST_SIZE_STEP;
+}
+
+/**
+ * Performs a series of large writes using a normal guac_socket wrapping the
+ * given file descriptor, flushing after each write and waiting for a single
+ * byte of acknowledgement from the reader before continuing. The file
+ * descriptor is only closed once all writes have been acknowledged, such that
+ * closing the connection cannot itself release any data held back by the
+ * kernel. The given file descriptor is automatically closed as a result of
+ * calling this function.
+ *
+ * @param fd
+ *     The file descriptor of the connected TCP socket to write data to.
+ */
+static void write_large(int fd) {
+
+    /* Open guac socket */
+    guac_socket* socket = guac_socket_open(fd);
+
+    /* Write nothing if socket cannot be allocated (test will fail in parent
+     * process due to failure to read) */
+    if (socket == NULL) {
+        close(fd);
+        return;
+    }
+
+    char* data = malloc(write_size(TEST_SIZES - 1));
+    memset(data, 'x', write_size(TEST_SIZES - 1));
+
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+
+        /* Write a small amount of buffered data followed by a large write
+         * which exceeds the output buffer */
+        guac_socket_write(socket, "abc", 3);
+        guac_socket_write(socket, data, write_size(round));
+        guac_socket_flush(socket);
+
+        /* Wait for reader to receive everything */
+        char ack;
+        if (read(fd, &ack, 1) != 1)
+            break;
+
+    }
+
+    free(data);
+
+    /* Close and free socket */
+    guac_socket_free(socket);
+
+}
+
+/**
+ * Reads the data written by write_large() from the given file descriptor,
+ * verifying that each large write arrives in full without the total time
+ * spent waiting for data exceeding TEST_TIMEOUT. The given file descriptor is
+ * automatically closed as a result of calling this function.
+ *
+ * @param fd
+ *     The file descriptor of the connected TCP socket to read data from.
+ */
+static void read_large(int fd) {
+
+    char buffer[65536];
+    int remaining = TEST_TIMEOUT;
+
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+
+        int expected = write_size(round) + 3;
+        int received = 0;
+
+        /* Read until the entire write is received or data stops arriving */
+        while (received < expected) {
+
+            struct pollfd fds[] = {{
+                .fd     = fd,
+                .events = POLLIN
+            }};
+
+            /* Wait only for whatever remains of the total time allowed */
+            guac_timestamp start = guac_timestamp_current();
+            int result = poll(fds, 1, remaining);
+            remaining -= guac_timestamp_current() - start;
+
+            if (result <= 0 || remaining < 0)
+                break;
+
+            int numread = read(fd, buffer, sizeof(buffer));
+            if (numread <= 0)
+                break;
+
+            received += numread;
+
+        }
+
+        /* All data must have arrived promptly after the flush */
+        CU_ASSERT_EQUAL(received, expected);
+        if (received != expected)
+            break;
+
+        /* Allow writer to continue with the next round */
+        CU_ASSERT_EQUAL_FATAL(write(fd, "", 1), 1);
+
+    }
+
+    /* File descriptor is no longer needed */
+    close(fd);
+
+}
+
+/**
+ * Tests that the file descriptor implementation of guac_socket delivers all
+ * data promptly when flushed after a write which is too large for its output
+ * buffer, rather than leaving the end of that write held back by the kernel.
+ * A child process is forked to perform the writes over a loopback TCP
+ * connection while the parent process reads and verifies the received data.
+ */
+void test_socket__fd_flush_large() {
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+
+    socklen_t addr_len = sizeof(addr);
+
+    /* Listen on an arbitrary loopback port */
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    CU_ASSERT_NOT_EQUAL_FATAL(listen_fd, -1);
+    CU_ASSERT_EQUAL_FATAL(bind(listen_fd, (struct sockaddr*) &addr, addr_len), 0);
+    CU_ASSERT_EQUAL_FATAL(listen(listen_fd, 1), 0);
+    CU_ASSERT_EQUAL_FATAL(getsockname(listen_fd, (struct sockaddr*) &addr, &addr_len), 0);
+
+    /* Connect to that port */
+    int write_fd = socket(AF_INET, SOCK_STREAM, 0);
+    CU_ASSERT_NOT_EQUAL_FATAL(write_fd, -1);
+    CU_ASSERT_EQUAL_FATAL(connect(write_fd, (struct sockaddr*) &addr, addr_len), 0);
+
+    int read_fd = accept(listen_fd, NULL, NULL);
+    CU_ASSERT_NOT_EQUAL_FATAL(read_fd, -1);
+    close(listen_fd);
+
+    /* Fork into writer process (child) and reader process (parent) */
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Attempt to perform the large writes within the child process */
+    if (childpid == 0) {
+        close(read_fd);
+        write_large(write_fd);
+        exit(0);
+    }
+
+    /* Read and verify the received data within the parent process */
+    close(write_fd);
+    read_large(read_fd);
+
+}
+
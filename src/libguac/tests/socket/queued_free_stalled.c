@@ -0,0 +1,107 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * The number of bytes to write to the queued socket under test. This is
+ * larger than the capacity of a pipe, such that writing this data to a pipe
+ * which is never read will block.
+ */
+#define TEST_DATA_LENGTH 262144
+
+/**
+ * The maximum number of bytes which may be queued by the queued socket under
+ * test. This is large enough that the data written by the test never reaches
+ * the limit.
+ */
+#define TEST_QUEUE_LENGTH 1048576
+
+/**
+ * The maximum amount of time that freeing the queued socket may take beyond
+ * GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT, in milliseconds.
+ */
+#define TEST_FREE_MARGIN 1000
+
+/**
+ * Tests that freeing a queued guac_socket whose underlying socket cannot be
+ * written does not block indefinitely, and that the underlying socket is
+ * still freed once its in-progress write completes.
+ */
+void test_socket__queued_free_stalled() {
+
+    int fd[2];
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    int read_fd = fd[0];
+    int write_fd = fd[1];
+
+    guac_socket* socket = guac_socket_open(write_fd);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_socket* queued = guac_socket_queue(socket, TEST_QUEUE_LENGTH,
+            GUAC_SOCKET_QUEUE_BLOCK);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(queued);
+
+    /* Queue more data than the pipe can hold, which is never read */
+    char* data = malloc(TEST_DATA_LENGTH);
+    memset(data, 'x', TEST_DATA_LENGTH);
+
+    CU_ASSERT_EQUAL(guac_socket_write(queued, data, TEST_DATA_LENGTH), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(queued), 0);
+
+    free(data);
+
+    /* Freeing must give up on the queued data within the drain timeout */
+    guac_timestamp start = guac_timestamp_current();
+    guac_socket_free(queued);
+    guac_timestamp elapsed = guac_timestamp_current() - start;
+
+    CU_ASSERT(elapsed < GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT + TEST_FREE_MARGIN);
+
+    /* Read from the pipe until the underlying socket is freed and the write
+     * end of the pipe is closed */
+    int closed = 0;
+    char buffer[8192];
+    struct pollfd fds[] = {{
+        .fd     = read_fd,
+        .events = POLLIN
+    }};
+
+    while (poll(fds, 1, GUAC_SOCKET_QUEUE_DRAIN_TIMEOUT) > 0) {
+        if (read(read_fd, buffer, sizeof(buffer)) <= 0) {
+            closed = 1;
+            break;
+        }
+    }
+
+    CU_ASSERT_TRUE(closed);
+    close(read_fd);
+
+}
+
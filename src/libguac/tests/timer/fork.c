@@ -0,0 +1,104 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <CUnit/CUnit.h>
+#include <guacamole/timer.h>
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * The number of times test_timer_fork_callback() has been invoked.
+ */
+static int test_timer_fork_count = 0;
+
+/**
+ * Lock which guards test_timer_fork_count.
+ */
+static pthread_mutex_t test_timer_fork_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Records the invocation of a timer by incrementing test_timer_fork_count.
+ */
+static int test_timer_fork_callback(guac_timer* timer, void* data) {
+
+    pthread_mutex_lock(&test_timer_fork_lock);
+    test_timer_fork_count++;
+    pthread_mutex_unlock(&test_timer_fork_lock);
+
+    return 0;
+
+}
+
+/**
+ * Schedules the given timer, waiting well beyond its delay, and returns the
+ * number of times test_timer_fork_callback() was invoked as a result.
+ */
+static int test_timer_fork_run(guac_timer* timer) {
+
+    pthread_mutex_lock(&test_timer_fork_lock);
+    test_timer_fork_count = 0;
+    pthread_mutex_unlock(&test_timer_fork_lock);
+
+    if (guac_timer_schedule(timer, 20))
+        return 0;
+
+    guac_timestamp_msleep(300);
+
+    pthread_mutex_lock(&test_timer_fork_lock);
+    int count = test_timer_fork_count;
+    pthread_mutex_unlock(&test_timer_fork_lock);
+
+    return count;
+
+}
+
+/**
+ * Test which verifies that timers continue to be invoked within a child
+ * process forked after the shared timer thread has started, despite that
+ * thread not existing within the child.
+ */
+void test_timer__fork() {
+
+    guac_timer* timer = guac_timer_alloc(test_timer_fork_callback, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(timer);
+
+    /* Ensure the shared timer thread is running prior to fork() */
+    CU_ASSERT_EQUAL_FATAL(test_timer_fork_run(timer), 1);
+
+    int childpid;
+    CU_ASSERT_NOT_EQUAL_FATAL((childpid = fork()), -1);
+
+    /* Report within exit status of child whether the timer was invoked */
+    if (childpid == 0)
+        exit(test_timer_fork_run(timer) == 1 ? 0 : 1);
+
+    int status;
+    CU_ASSERT_EQUAL_FATAL(waitpid(childpid, &status, 0), childpid);
+    CU_ASSERT_TRUE(WIFEXITED(status));
+    CU_ASSERT_EQUAL(WEXITSTATUS(status), 0);
+
+    guac_timer_free(timer);
+
+}
+
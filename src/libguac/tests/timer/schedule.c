@@ -0,0 +1,162 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <CUnit/CUnit.h>
+#include <guacamole/timer.h>
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+
+/**
+ * The number of times the periodic timer should be invoked before it stops
+ * rescheduling itself.
+ */
+#define TEST_PERIODIC_COUNT 4
+
+/**
+ * The interval of the periodic timer, in milliseconds.
+ */
+#define TEST_PERIODIC_INTERVAL 30
+
+/**
+ * The state of a timer under test.
+ */
+typedef struct test_timer_state {
+
+    /**
+     * The earliest timestamp at which the timer may next be invoked.
+     */
+    guac_timestamp due;
+
+    /**
+     * The number of times the timer has been invoked.
+     */
+    int count;
+
+    /**
+     * The number of times the timer was invoked earlier than it was due.
+     */
+    int early;
+
+    /**
+     * The number of times the callback should be invoked before it stops
+     * rescheduling itself.
+     */
+    int limit;
+
+    /**
+     * The interval to request upon each invocation, in milliseconds.
+     */
+    int interval;
+
+} test_timer_state;
+
+/**
+ * Lock which guards all test_timer_state structures.
+ */
+static pthread_mutex_t test_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Records the invocation of a timer within its test_timer_state, requesting
+ * that the timer be rescheduled until it has been invoked as many times as
+ * its state allows.
+ */
+static int test_timer_callback(guac_timer* timer, void* data) {
+
+    test_timer_state* state = (test_timer_state*) data;
+    guac_timestamp now = guac_timestamp_current();
+
+    pthread_mutex_lock(&test_timer_lock);
+
+    if (now < state->due)
+        state->early++;
+
+    int interval = 0;
+    if (++state->count < state->limit) {
+        interval = state->interval;
+        state->due = now + interval;
+    }
+
+    pthread_mutex_unlock(&test_timer_lock);
+    return interval;
+
+}
+
+/**
+ * Schedules the given timer, recording within the given state when the timer
+ * is due.
+ */
+static void test_timer_schedule(guac_timer* timer, test_timer_state* state,
+        int delay) {
+
+    pthread_mutex_lock(&test_timer_lock);
+    state->due = guac_timestamp_current() + delay;
+    pthread_mutex_unlock(&test_timer_lock);
+
+    CU_ASSERT_EQUAL_FATAL(guac_timer_schedule(timer, delay), 0);
+
+}
+
+/**
+ * Test which verifies that timers are invoked no sooner than requested, that
+ * timers are rescheduled at the interval returned by their callbacks, and
+ * that cancelled timers are not invoked.
+ */
+void test_timer__schedule() {
+
+    test_timer_state once = { .limit = 1 };
+    test_timer_state periodic = { .limit = TEST_PERIODIC_COUNT,
+        .interval = TEST_PERIODIC_INTERVAL };
+    test_timer_state cancelled = { .limit = 1 };
+
+    guac_timer* once_timer = guac_timer_alloc(test_timer_callback, &once);
+    guac_timer* periodic_timer = guac_timer_alloc(test_timer_callback, &periodic);
+    guac_timer* cancelled_timer = guac_timer_alloc(test_timer_callback, &cancelled);
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(once_timer);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(periodic_timer);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cancelled_timer);
+
+    test_timer_schedule(once_timer, &once, 50);
+    test_timer_schedule(periodic_timer, &periodic, TEST_PERIODIC_INTERVAL);
+    test_timer_schedule(cancelled_timer, &cancelled, 100);
+    guac_timer_cancel(cancelled_timer);
+
+    /* Wait well beyond the point that all timers should have finished */
+    guac_timestamp_msleep(500);
+
+    pthread_mutex_lock(&test_timer_lock);
+
+    CU_ASSERT_EQUAL(once.count, 1);
+    CU_ASSERT_EQUAL(once.early, 0);
+
+    CU_ASSERT_EQUAL(periodic.count, TEST_PERIODIC_COUNT);
+    CU_ASSERT_EQUAL(periodic.early, 0);
+
+    CU_ASSERT_EQUAL(cancelled.count, 0);
+
+    pthread_mutex_unlock(&test_timer_lock);
+
+    guac_timer_free(once_timer);
+    guac_timer_free(periodic_timer);
+    guac_timer_free(cancelled_timer);
+
+}
+
@@ -0,0 +1,273 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "user-handlers.h"
+
+#include <CUnit/CUnit.h>
+#include <guacamole/error.h>
+#include <guacamole/user.h>
+
+#include <stdio.h>
+
+/**
+ * Opcodes which share the same first character, last character and length,
+ * and thus hash to the same slot. That slot is the final slot of the table,
+ * such that probing must wrap around to the first slot.
+ */
+static const char* colliding_opcodes[] = { "ax8", "ay8", "az8" };
+
+/**
+ * An opcode which hashes to the first slot of the table, which will already
+ * be occupied by the second of the colliding opcodes.
+ */
+static const char* displaced_opcode = "ax9";
+
+/**
+ * The number of times that counting_handler() has been invoked.
+ */
+static int counting_handler_calls = 0;
+
+/**
+ * Instruction handler which does nothing, returning 1.
+ */
+static int handler_a(guac_user* user, int argc, char** argv) {
+    return 1;
+}
+
+/**
+ * Instruction handler which does nothing, returning 2.
+ */
+static int handler_b(guac_user* user, int argc, char** argv) {
+    return 2;
+}
+
+/**
+ * Instruction handler which does nothing, returning 3.
+ */
+static int handler_c(guac_user* user, int argc, char** argv) {
+    return 3;
+}
+
+/**
+ * Instruction handler which counts the number of times it has been invoked,
+ * returning 4.
+ */
+static int counting_handler(guac_user* user, int argc, char** argv) {
+    counting_handler_calls++;
+    return 4;
+}
+
+/**
+ * Test which verifies that every opcode handled by libguac itself maps to
+ * its handler within the corresponding lookup table, and that unknown
+ * opcodes have no handler.
+ */
+void test_user__handler_table_builtin() {
+
+    __guac_instruction_handler_mapping* current;
+
+    for (current = __guac_instruction_handler_map; current->opcode != NULL;
+            current++)
+        CU_ASSERT(__guac_instruction_handler_table_get(
+                    &__guac_instruction_handlers, current->opcode) ==
+                current->handler);
+
+    for (current = __guac_handshake_handler_map; current->opcode != NULL;
+            current++)
+        CU_ASSERT(__guac_instruction_handler_table_get(
+                    &__guac_handshake_handlers, current->opcode) ==
+                current->handler);
+
+    CU_ASSERT_PTR_NULL(__guac_instruction_handler_table_get(
+                &__guac_instruction_handlers, "unknown"));
+    CU_ASSERT_PTR_NULL(__guac_instruction_handler_table_get(
+                &__guac_instruction_handlers, "syn"));
+    CU_ASSERT_PTR_NULL(__guac_instruction_handler_table_get(
+                &__guac_instruction_handlers, "syncs"));
+    CU_ASSERT_PTR_NULL(__guac_instruction_handler_table_get(
+                &__guac_instruction_handlers, ""));
+
+}
+
+/**
+ * Test which verifies that opcodes which hash to the same slot are stored in
+ * the following slots, wrapping around the end of the table, and that each
+ * can still be found.
+ */
+void test_user__handler_table_collision() {
+
+    __guac_instruction_handler_table table = { 0 };
+
+    CU_ASSERT_EQUAL(__guac_instruction_handler_table_add(&table,
+                colliding_opcodes[0], handler_a), 0);
+    CU_ASSERT_EQUAL(__guac_instruction_handler_table_add(&table,
+                colliding_opcodes[1], handler_b), 0);
+    CU_ASSERT_EQUAL(__guac_instruction_handler_table_add(&table,
+                colliding_opcodes[2], handler_c), 0);
+    CU_ASSERT_EQUAL(__guac_instruction_handler_table_add(&table,
+                displaced_opcode, counting_handler), 0);
+    CU_ASSERT_EQUAL(table.count, 4);
+
+    /* Colliding opcodes occupy consecutive slots, wrapping around */
+    int last = GUAC_INSTRUCTION_HANDLER_TABLE_SIZE - 1;
+    CU_ASSERT_PTR_EQUAL(table.slots[last].opcode, colliding_opcodes[0]);
+    CU_ASSERT_PTR_EQUAL(table.slots[0].opcode, colliding_opcodes[1]);
+    CU_ASSERT_PTR_EQUAL(table.slots[1].opcode, colliding_opcodes[2]);
+    CU_ASSERT_PTR_EQUAL(table.slots[2].opcode, displaced_opcode);
+
+    /* Each opcode is still found */
+    CU_ASSERT(__guac_instruction_handler_table_get(&table,
+                colliding_opcodes[0]) == handler_a);
+    CU_ASSERT(__guac_instruction_handler_table_get(&table,
+                colliding_opcodes[1]) == handler_b);
+    CU_ASSERT(__guac_instruction_handler_table_get(&table,
+                colliding_opcodes[2]) == handler_c);
+    CU_ASSERT(__guac_instruction_handler_table_get(&table,
+                displaced_opcode) == counting_handler);
+
+    /* Absent opcodes which collide are not found */
+    CU_ASSERT_PTR_NULL(__guac_instruction_handler_table_get(&table, "aw8"));
+    CU_ASSERT_PTR_NULL(__guac_instruction_handler_table_get(&table, "aw9"));
+
+}
+
+/**
+ * Test which verifies that an opcode which already has a handler cannot be
+ * given another, leaving the original handler in place.
+ */
+void test_user__handler_table_duplicate() {
+
+    __guac_instruction_handler_table table = { 0 };
+
+    CU_ASSERT_EQUAL(__guac_instruction_handler_table_add(&table,
+                colliding_opcodes[0], handler_a), 0);
+    CU_ASSERT_EQUAL(__guac_instruction_handler_table_add(&table,
+                colliding_opcodes[1], handler_b), 0);
+
+    /* Duplicates are rejected, even if stored after a collision */
+    guac_error = GUAC_STATUS_SUCCESS;
+    CU_ASSERT_NOT_EQUAL(__guac_instruction_handler_table_add(&table,
+                colliding_opcodes[1], handler_c), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_INVALID_ARGUMENT);
+
+    /* A different string with the same content is still a duplicate */
+    char copy[] = "ax8";
+    guac_error = GUAC_STATUS_SUCCESS;
+    CU_ASSERT_NOT_EQUAL(__guac_instruction_handler_table_add(&table,
+                copy, handler_c), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_INVALID_ARGUMENT);
+
+    CU_ASSERT_EQUAL(table.count, 2);
+    CU_ASSERT(__guac_instruction_handler_table_get(&table,
+                colliding_opcodes[0]) == handler_a);
+    CU_ASSERT(__guac_instruction_handler_table_get(&table,
+                colliding_opcodes[1]) == handler_b);
+
+    /* Built-in handlers cannot be replaced */
+    guac_error = GUAC_STATUS_SUCCESS;
+    CU_ASSERT_NOT_EQUAL(guac_user_register_instruction_handler("sync",
+                handler_a), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_INVALID_ARGUMENT);
+    CU_ASSERT(__guac_instruction_handler_table_get(
+                &__guac_instruction_handlers, "sync") == __guac_handle_sync);
+
+}
+
+/**
+ * Test which verifies that no handlers may be added to a table which is
+ * already holding its maximum number of handlers, and that every handler
+ * remains available.
+ */
+void test_user__handler_table_full() {
+
+    static char opcodes[GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES + 1][8];
+    __guac_instruction_handler_table table = { 0 };
+
+    for (int i = 0; i <= GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES; i++)
+        snprintf(opcodes[i], sizeof(opcodes[i]), "op%02d", i);
+
+    /* Fill table */
+    for (int i = 0; i < GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES; i++)
+        CU_ASSERT_EQUAL(__guac_instruction_handler_table_add(&table,
+                    opcodes[i], handler_a), 0);
+
+    CU_ASSERT_EQUAL(table.count, GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES);
+
+    /* No further handlers may be added */
+    guac_error = GUAC_STATUS_SUCCESS;
+    CU_ASSERT_NOT_EQUAL(__guac_instruction_handler_table_add(&table,
+                opcodes[GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES],
+                handler_b), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_NO_SPACE);
+    CU_ASSERT_EQUAL(table.count, GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES);
+
+    /* All stored handlers are still found, and lookups of absent opcodes
+     * still terminate */
+    for (int i = 0; i < GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES; i++)
+        CU_ASSERT(__guac_instruction_handler_table_get(&table,
+                    opcodes[i]) == handler_a);
+
+    CU_ASSERT_PTR_NULL(__guac_instruction_handler_table_get(&table,
+                opcodes[GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES]));
+
+}
+
+/**
+ * Test which verifies that handlers may be registered until the first
+ * instruction is handled, after which all lookup tables are sealed. As
+ * sealing affects the entire process, this test must remain the last test
+ * to add any handlers.
+ */
+void test_user__handler_table_sealed() {
+
+    __guac_instruction_handler_table table = { 0 };
+
+    /* Handlers may be registered before any instruction is handled */
+    CU_ASSERT_EQUAL(__guac_instruction_handler_table_add(&table,
+                "counted", counting_handler), 0);
+    CU_ASSERT_EQUAL(guac_user_register_instruction_handler("registered",
+                handler_a), 0);
+    CU_ASSERT(__guac_instruction_handler_table_get(
+                &__guac_instruction_handlers, "registered") == handler_a);
+
+    /* Handle an instruction */
+    CU_ASSERT_EQUAL(__guac_user_call_opcode_handler(&table, NULL, "counted",
+                0, NULL), 4);
+    CU_ASSERT_EQUAL(counting_handler_calls, 1);
+
+    /* No handlers may be added once instructions have been handled */
+    guac_error = GUAC_STATUS_SUCCESS;
+    CU_ASSERT_NOT_EQUAL(__guac_instruction_handler_table_add(&table,
+                "late", handler_b), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_REFUSED);
+
+    guac_error = GUAC_STATUS_SUCCESS;
+    CU_ASSERT_NOT_EQUAL(guac_user_register_instruction_handler("late",
+                handler_b), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_REFUSED);
+
+    /* Existing handlers remain available */
+    CU_ASSERT_PTR_NULL(__guac_instruction_handler_table_get(&table, "late"));
+    CU_ASSERT(__guac_instruction_handler_table_get(&table,
+                "counted") == counting_handler);
+    CU_ASSERT(__guac_instruction_handler_table_get(
+                &__guac_instruction_handlers, "registered") == handler_a);
+
+}
+
@@ -0,0 +1,508 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include "config.h"
+
+#include "guacamole/error.h"
+#include "guacamole/timer.h"
+#include "guacamole/timestamp.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+
+/**
+ * The mask which extracts the slot index of a single level of the timer
+ * wheel from a tick.
+ */
+#define GUAC_TIMER_WHEEL_MASK (GUAC_TIMER_WHEEL_SLOTS - 1)
+
+/**
+ * The number of ticks covered by the entire timer wheel. Timers which expire
+ * further in the future are stored within the last slot that the wheel can
+ * represent, and are moved closer as the wheel turns.
+ */
+#define GUAC_TIMER_WHEEL_SPAN \
+    ((uint64_t) 1 << (GUAC_TIMER_WHEEL_BITS * GUAC_TIMER_WHEEL_LEVELS))
+
+/**
+ * All slots of the hierarchical timer wheel. Each slot of level N covers
+ * 2^(GUAC_TIMER_WHEEL_BITS * N) ticks.
+ */
+static guac_timer* __guac_timer_wheel[GUAC_TIMER_WHEEL_LEVELS][GUAC_TIMER_WHEEL_SLOTS];
+
+/**
+ * The last tick processed by the shared timer thread.
+ */
+static uint64_t __guac_timer_tick = 0;
+
+/**
+ * The timestamp corresponding to tick zero.
+ */
+static guac_timestamp __guac_timer_base;
+
+/**
+ * The number of timers which are currently scheduled.
+ */
+static int __guac_timer_count = 0;
+
+/**
+ * Lock which guards access to the timer wheel and to the state of all timers.
+ */
+static pthread_mutex_t __guac_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition which is signalled whenever a timer is scheduled, such that the
+ * shared timer thread can recalculate how long it should sleep.
+ */
+static pthread_cond_t __guac_timer_scheduled = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Condition which is signalled whenever the shared timer thread finishes
+ * invoking a callback.
+ */
+static pthread_cond_t __guac_timer_finished = PTHREAD_COND_INITIALIZER;
+
+/**
+ * The shared timer thread.
+ */
+static pthread_t __guac_timer_thread;
+
+/**
+ * Non-zero if the shared timer thread is running, zero otherwise.
+ */
+static int __guac_timer_started = 0;
+
+/**
+ * Non-zero if the timer wheel has been initialized, zero otherwise. Unlike
+ * __guac_timer_started, this remains set within forked child processes, which
+ * inherit the timer wheel and all timers within it.
+ */
+static int __guac_timer_initialized = 0;
+
+/**
+ * The timer whose callback is currently being invoked by the shared timer
+ * thread, or NULL if no callback is currently being invoked.
+ */
+static guac_timer* __guac_timer_current = NULL;
+
+/**
+ * Returns the tick corresponding to the current time.
+ *
+ * @return
+ *     The tick corresponding to the current time.
+ */
+static uint64_t __guac_timer_current_tick() {
+    return (guac_timestamp_current() - __guac_timer_base)
+        / GUAC_TIMER_RESOLUTION;
+}
+
+/**
+ * Returns the first tick which begins no sooner than the given number of
+ * milliseconds from now, and which is after the last tick processed. The
+ * timer lock must already be held.
+ *
+ * @param delay
+ *     The number of milliseconds from now.
+ *
+ * @return
+ *     The tick at which a timer having the given delay should expire.
+ */
+static uint64_t __guac_timer_expiry(int delay) {
+
+    guac_timestamp elapsed = guac_timestamp_current() - __guac_timer_base;
+    if (delay > 0)
+        elapsed += delay;
+
+    /* Round up to the start of the next tick */
+    uint64_t tick = (elapsed + GUAC_TIMER_RESOLUTION - 1)
+        / GUAC_TIMER_RESOLUTION;
+
+    /* Never expire within a tick which may already be in the process of
+     * being handled */
+    if (tick <= __guac_timer_tick)
+        tick = __guac_timer_tick + 1;
+
+    return tick;
+
+}
+
+/**
+ * Adds the given timer to the slot of the timer wheel corresponding to its
+ * expiration tick. The timer lock must already be held, and the timer must
+ * expire after the last tick processed.
+ *
+ * @param timer
+ *     The timer to add.
+ */
+static void __guac_timer_insert(guac_timer* timer) {
+
+    uint64_t expires = timer->__expires;
+    uint64_t delta = expires - __guac_timer_tick;
+
+    /* Timers beyond the range of the wheel wait within its last slot */
+    if (delta >= GUAC_TIMER_WHEEL_SPAN)
+        expires = __guac_timer_tick + GUAC_TIMER_WHEEL_SPAN - 1;
+
+    /* Choose the lowest level whose range covers the delay */
+    int level = 0;
+    while (level < GUAC_TIMER_WHEEL_LEVELS - 1
+            && delta >= (uint64_t) 1 << (GUAC_TIMER_WHEEL_BITS * (level + 1)))
+        level++;
+
+    int index = (expires >> (GUAC_TIMER_WHEEL_BITS * level))
+        & GUAC_TIMER_WHEEL_MASK;
+
+    /* Add to head of slot */
+    guac_timer** slot = &__guac_timer_wheel[level][index];
+    timer->__next = *slot;
+    timer->__ptr = slot;
+    if (*slot != NULL)
+        (*slot)->__ptr = &timer->__next;
+    *slot = timer;
+
+}
+
+/**
+ * Removes the given timer from its slot of the timer wheel. The timer lock
+ * must already be held.
+ *
+ * @param timer
+ *     The timer to remove.
+ */
+static void __guac_timer_remove(guac_timer* timer) {
+
+    *(timer->__ptr) = timer->__next;
+    if (timer->__next != NULL)
+        timer->__next->__ptr = timer->__ptr;
+
+}
+
+/**
+ * Moves all timers within the given slot of the given level of the timer
+ * wheel to the slots corresponding to their remaining delay. The timer lock
+ * must already be held.
+ *
+ * @param level
+ *     The level of the slot to cascade.
+ *
+ * @param index
+ *     The index of the slot to cascade.
+ */
+static void __guac_timer_cascade(int level, int index) {
+
+    guac_timer* timer = __guac_timer_wheel[level][index];
+    __guac_timer_wheel[level][index] = NULL;
+
+    while (timer != NULL) {
+        guac_timer* next = timer->__next;
+        __guac_timer_insert(timer);
+        timer = next;
+    }
+
+}
+
+/**
+ * Returns the tick at which the shared timer thread must next process the
+ * timer wheel, which is either the next tick having a timer within the first
+ * level of the wheel or the next tick at which higher levels will cascade.
+ * The timer lock must already be held.
+ *
+ * @return
+ *     The tick at which the timer wheel must next be processed.
+ */
+static uint64_t __guac_timer_next_tick() {
+
+    uint64_t tick = __guac_timer_tick + 1;
+
+    /* Stop at the first non-empty slot prior to the next cascade */
+    while ((tick & GUAC_TIMER_WHEEL_MASK) != 0) {
+        if (__guac_timer_wheel[0][tick & GUAC_TIMER_WHEEL_MASK] != NULL)
+            break;
+        tick++;
+    }
+
+    return tick;
+
+}
+
+/**
+ * Advances the timer wheel by a single tick, invoking the callbacks of all
+ * timers which expire at that tick. The timer lock must already be held, and
+ * is released while each callback is invoked.
+ */
+static void __guac_timer_advance() {
+
+    uint64_t tick = ++__guac_timer_tick;
+    int index = tick & GUAC_TIMER_WHEEL_MASK;
+
+    /* Move timers down from higher levels each time a level wraps */
+    int level = 1;
+    uint64_t level_tick = tick;
+    while (level < GUAC_TIMER_WHEEL_LEVELS
+            && (level_tick & GUAC_TIMER_WHEEL_MASK) == 0) {
+        level_tick >>= GUAC_TIMER_WHEEL_BITS;
+        __guac_timer_cascade(level, level_tick & GUAC_TIMER_WHEEL_MASK);
+        level++;
+    }
+
+    guac_timer* timer;
+    while ((timer = __guac_timer_wheel[0][index]) != NULL) {
+
+        __guac_timer_remove(timer);
+
+        /* Timers beyond the range of the wheel may not yet have expired */
+        if (timer->__expires > tick) {
+            __guac_timer_insert(timer);
+            continue;
+        }
+
+        timer->__scheduled = 0;
+        timer->__running = 1;
+        timer->__rearm = 1;
+        __guac_timer_count--;
+
+        /* Invoke callback without holding the lock, such that the callback
+         * may itself schedule or cancel timers */
+        __guac_timer_current = timer;
+        pthread_mutex_unlock(&__guac_timer_lock);
+        int interval = timer->__callback(timer, timer->__data);
+        pthread_mutex_lock(&__guac_timer_lock);
+        __guac_timer_current = NULL;
+
+        timer->__running = 0;
+
+        /* Reschedule at requested interval unless rescheduled or cancelled
+         * by someone else in the meantime */
+        if (timer->__rearm && interval > 0) {
+            timer->__expires = __guac_timer_expiry(interval);
+            timer->__scheduled = 1;
+            __guac_timer_count++;
+            __guac_timer_insert(timer);
+        }
+
+        pthread_cond_broadcast(&__guac_timer_finished);
+
+    }
+
+}
+
+/**
+ * Processes the timer wheel for as long as the process is running, sleeping
+ * until the next tick which requires processing.
+ *
+ * @param data
+ *     Unused.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* __guac_timer_thread_run(void* data) {
+
+    pthread_mutex_lock(&__guac_timer_lock);
+
+    for (;;) {
+
+        /* Process all ticks which have elapsed */
+        uint64_t current = __guac_timer_current_tick();
+        while (__guac_timer_tick < current)
+            __guac_timer_advance();
+
+        /* Sleep indefinitely if there is nothing to do */
+        if (__guac_timer_count == 0) {
+            pthread_cond_wait(&__guac_timer_scheduled, &__guac_timer_lock);
+            continue;
+        }
+
+        /* Otherwise, sleep only until the timer wheel next needs attention */
+        guac_timestamp wake = __guac_timer_base
+            + __guac_timer_next_tick() * GUAC_TIMER_RESOLUTION;
+        guac_timestamp delay = wake - guac_timestamp_current();
+        if (delay <= 0)
+            continue;
+
+        /* Convert delay to the absolute time expected by
+         * pthread_cond_timedwait() */
+        struct timeval now;
+        gettimeofday(&now, NULL);
+
+        uint64_t usec = now.tv_usec + (uint64_t) delay * 1000;
+        struct timespec deadline = {
+            .tv_sec  = now.tv_sec + usec / 1000000,
+            .tv_nsec = (usec % 1000000) * 1000
+        };
+
+        pthread_cond_timedwait(&__guac_timer_scheduled, &__guac_timer_lock,
+                &deadline);
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Acquires the timer lock prior to fork(), such that the timer wheel is in a
+ * consistent state within the child process.
+ */
+static void __guac_timer_atfork_prepare() {
+    pthread_mutex_lock(&__guac_timer_lock);
+}
+
+/**
+ * Releases the timer lock within the parent process after fork().
+ */
+static void __guac_timer_atfork_parent() {
+    pthread_mutex_unlock(&__guac_timer_lock);
+}
+
+/**
+ * Restores the state of the timer wheel within a child process after fork().
+ * Only the thread which called fork() exists within the child, thus the
+ * shared timer thread must be started again upon next use, and any callback
+ * which that thread was invoking will never complete.
+ */
+static void __guac_timer_atfork_child() {
+
+    __guac_timer_started = 0;
+
+    if (__guac_timer_current != NULL) {
+        __guac_timer_current->__running = 0;
+        __guac_timer_current = NULL;
+    }
+
+    pthread_mutex_unlock(&__guac_timer_lock);
+
+}
+
+guac_timer* guac_timer_alloc(guac_timer_callback* callback, void* data) {
+
+    guac_timer* timer = malloc(sizeof(guac_timer));
+    if (timer == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for timer";
+        return NULL;
+    }
+
+    timer->__callback = callback;
+    timer->__data = data;
+    timer->__expires = 0;
+    timer->__scheduled = 0;
+    timer->__running = 0;
+    timer->__rearm = 0;
+    timer->__next = NULL;
+    timer->__ptr = NULL;
+
+    return timer;
+
+}
+
+int guac_timer_schedule(guac_timer* timer, int delay) {
+
+    pthread_mutex_lock(&__guac_timer_lock);
+
+    /* Start shared timer thread upon first use */
+    if (!__guac_timer_started) {
+
+        /* Initialize timer wheel only once, such that timers inherited by
+         * forked child processes keep their schedule */
+        if (!__guac_timer_initialized) {
+
+            /* Restart the timer thread within forked child processes */
+            if (pthread_atfork(__guac_timer_atfork_prepare,
+                        __guac_timer_atfork_parent,
+                        __guac_timer_atfork_child)) {
+                pthread_mutex_unlock(&__guac_timer_lock);
+                guac_error = GUAC_STATUS_NO_MEMORY;
+                guac_error_message = "Unable to register fork handlers "
+                    "for timer thread";
+                return 1;
+            }
+
+            __guac_timer_base = guac_timestamp_current();
+            __guac_timer_tick = 0;
+            __guac_timer_initialized = 1;
+
+        }
+
+        if (pthread_create(&__guac_timer_thread, NULL,
+                    __guac_timer_thread_run, NULL)) {
+            pthread_mutex_unlock(&__guac_timer_lock);
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Unable to start timer thread";
+            return 1;
+        }
+
+        pthread_detach(__guac_timer_thread);
+        __guac_timer_started = 1;
+
+    }
+
+    /* Replace any previous schedule */
+    if (timer->__scheduled) {
+        __guac_timer_remove(timer);
+        __guac_timer_count--;
+    }
+
+    timer->__expires = __guac_timer_expiry(delay);
+    timer->__scheduled = 1;
+    timer->__rearm = 0;
+    __guac_timer_count++;
+    __guac_timer_insert(timer);
+
+    /* Allow timer thread to recalculate its sleep */
+    pthread_cond_signal(&__guac_timer_scheduled);
+    pthread_mutex_unlock(&__guac_timer_lock);
+
+    return 0;
+
+}
+
+void guac_timer_cancel(guac_timer* timer) {
+
+    pthread_mutex_lock(&__guac_timer_lock);
+
+    if (timer->__scheduled) {
+        __guac_timer_remove(timer);
+        timer->__scheduled = 0;
+        __guac_timer_count--;
+    }
+
+    timer->__rearm = 0;
+
+    /* Wait for any in-progress invocation, unless that invocation is the
+     * caller */
+    if (!__guac_timer_started
+            || !pthread_equal(pthread_self(), __guac_timer_thread)) {
+        while (timer->__running)
+            pthread_cond_wait(&__guac_timer_finished, &__guac_timer_lock);
+    }
+
+    pthread_mutex_unlock(&__guac_timer_lock);
+
+}
+
+void guac_timer_free(guac_timer* timer) {
+    guac_timer_cancel(timer);
+    free(timer);
+}
+
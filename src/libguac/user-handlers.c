@@ -20,6 +20,7 @@
 #include "config.h"
 
 #include "guacamole/client.h"
+#include "guacamole/error.h"
 #include "guacamole/object.h"
 #include "guacamole/protocol.h"
 #include "guacamole/stream.h"
@@ -28,6 +29,7 @@
 #include "user-handlers.h"
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -66,6 +68,213 @@ __guac_instruction_handler_mapping __guac_handshake_handler_map[] = {
     {NULL,       NULL}
 };
 
+/* Lookup tables populated from the above maps */
+
+__guac_instruction_handler_table __guac_instruction_handlers;
+__guac_instruction_handler_table __guac_handshake_handlers;
+
+/**
+ * Guard which ensures the lookup tables are populated only once.
+ */
+static pthread_once_t __guac_instruction_handler_tables_once =
+    PTHREAD_ONCE_INIT;
+
+/**
+ * Guard which ensures the lookup tables are sealed only once, when the first
+ * instruction is handled.
+ */
+static pthread_once_t __guac_instruction_handler_tables_seal_once =
+    PTHREAD_ONCE_INIT;
+
+/**
+ * Lock which is acquired while handlers are added to any lookup table after
+ * that table has been populated, and while the lookup tables are sealed.
+ */
+static pthread_mutex_t __guac_instruction_handler_tables_lock =
+    PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Non-zero if the lookup tables have been sealed, and thus may no longer be
+ * modified, zero otherwise. Lookups are performed without locking, and are
+ * safe only because no handlers may be added once this is set.
+ */
+static int __guac_instruction_handler_tables_sealed = 0;
+
+/**
+ * Returns the slot at which lookups of the given opcode should begin within
+ * a __guac_instruction_handler_table.
+ *
+ * @param opcode
+ *     The opcode to hash.
+ *
+ * @param length
+ *     The length of the opcode, in bytes.
+ *
+ * @return
+ *     The index of the first slot to check for the given opcode.
+ */
+static size_t __guac_instruction_handler_hash(const char* opcode,
+        size_t length) {
+
+    if (length == 0)
+        return 0;
+
+    return (length + ((unsigned char) opcode[0] << 2)
+            + (unsigned char) opcode[length - 1])
+        & (GUAC_INSTRUCTION_HANDLER_TABLE_SIZE - 1);
+
+}
+
+/**
+ * Stores the given handler within the given lookup table, without acquiring
+ * any locks.
+ *
+ * @param table
+ *     The lookup table to store the handler within.
+ *
+ * @param opcode
+ *     The opcode of the instructions to be handled.
+ *
+ * @param handler
+ *     The handler to invoke for all instructions having the given opcode.
+ *
+ * @return
+ *     Zero if the handler was stored successfully, non-zero if the opcode
+ *     already has a handler or the table is full, in which case guac_error
+ *     and guac_error_message are set appropriately.
+ */
+static int __guac_instruction_handler_table_store(
+        __guac_instruction_handler_table* table, const char* opcode,
+        __guac_instruction_handler* handler) {
+
+    if (table->count >= GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES) {
+        guac_error = GUAC_STATUS_NO_SPACE;
+        guac_error_message = "No space for additional instruction handlers";
+        return 1;
+    }
+
+    size_t length = strlen(opcode);
+    size_t index = __guac_instruction_handler_hash(opcode, length);
+
+    /* Find first empty slot, refusing to replace any existing handler */
+    __guac_instruction_handler_slot* slot;
+    while ((slot = &(table->slots[index]))->opcode != NULL) {
+
+        if (slot->length == length && strcmp(slot->opcode, opcode) == 0) {
+            guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+            guac_error_message = "Opcode already has an instruction handler";
+            return 1;
+        }
+
+        index = (index + 1) & (GUAC_INSTRUCTION_HANDLER_TABLE_SIZE - 1);
+
+    }
+
+    slot->length = length;
+    slot->handler = handler;
+    slot->opcode = opcode;
+
+    table->count++;
+    return 0;
+
+}
+
+/**
+ * Populates the given lookup table with all handlers within the given map.
+ *
+ * @param table
+ *     The lookup table to populate.
+ *
+ * @param map
+ *     The NULL-terminated array of opcode to handler mappings to store within
+ *     the table.
+ */
+static void __guac_instruction_handler_table_load(
+        __guac_instruction_handler_table* table,
+        __guac_instruction_handler_mapping* map) {
+
+    __guac_instruction_handler_mapping* current;
+    for (current = map; current->opcode != NULL; current++)
+        __guac_instruction_handler_table_store(table, current->opcode,
+                current->handler);
+
+}
+
+/**
+ * Populates all lookup tables from their corresponding maps. This function
+ * is invoked only once, through pthread_once().
+ */
+static void __guac_instruction_handler_tables_init() {
+    __guac_instruction_handler_table_load(&__guac_instruction_handlers,
+            __guac_instruction_handler_map);
+    __guac_instruction_handler_table_load(&__guac_handshake_handlers,
+            __guac_handshake_handler_map);
+}
+
+/**
+ * Seals all lookup tables, such that no further handlers may be added. As
+ * the lock is acquired while sealing, all handlers added prior to sealing
+ * are visible to any thread which has sealed the tables or waited for them
+ * to be sealed. This function is invoked only once, through pthread_once().
+ */
+static void __guac_instruction_handler_tables_seal() {
+    pthread_mutex_lock(&__guac_instruction_handler_tables_lock);
+    __guac_instruction_handler_tables_sealed = 1;
+    pthread_mutex_unlock(&__guac_instruction_handler_tables_lock);
+}
+
+__guac_instruction_handler* __guac_instruction_handler_table_get(
+        __guac_instruction_handler_table* table, const char* opcode) {
+
+    pthread_once(&__guac_instruction_handler_tables_once,
+            __guac_instruction_handler_tables_init);
+
+    size_t length = strlen(opcode);
+    size_t index = __guac_instruction_handler_hash(opcode, length);
+
+    /* Search from hashed slot until an empty slot is reached */
+    __guac_instruction_handler_slot* slot;
+    while ((slot = &(table->slots[index]))->opcode != NULL) {
+
+        if (slot->length == length && memcmp(slot->opcode, opcode, length) == 0)
+            return slot->handler;
+
+        index = (index + 1) & (GUAC_INSTRUCTION_HANDLER_TABLE_SIZE - 1);
+
+    }
+
+    return NULL;
+
+}
+
+int __guac_instruction_handler_table_add(
+        __guac_instruction_handler_table* table, const char* opcode,
+        __guac_instruction_handler* handler) {
+
+    pthread_once(&__guac_instruction_handler_tables_once,
+            __guac_instruction_handler_tables_init);
+
+    pthread_mutex_lock(&__guac_instruction_handler_tables_lock);
+
+    /* Refuse to modify tables which may be read concurrently */
+    int retval;
+    if (__guac_instruction_handler_tables_sealed) {
+        guac_error = GUAC_STATUS_REFUSED;
+        guac_error_message = "Instruction handlers may not be added after "
+            "instructions have been handled";
+        retval = 1;
+    }
+
+    else
+        retval = __guac_instruction_handler_table_store(table, opcode,
+                handler);
+
+    pthread_mutex_unlock(&__guac_instruction_handler_tables_lock);
+
+    return retval;
+
+}
+
 /**
  * Parses a 64-bit integer from the given string. It is assumed that the string
  * will contain only decimal digits, with an optional leading minus sign.
@@ -712,19 +921,20 @@ void guac_free_mimetypes(char** mimetypes) {
 
 }
 
-int __guac_user_call_opcode_handler(__guac_instruction_handler_mapping* map,
+int __guac_user_call_opcode_handler(__guac_instruction_handler_table* table,
         guac_user* user, const char* opcode, int argc, char** argv) {
 
-    /* For each defined instruction */
-    __guac_instruction_handler_mapping* current = map;
-    while (current->opcode != NULL) {
+    /* Lookup tables are read without locking, and thus must no longer be
+     * modified once instructions are being handled */
+    pthread_once(&__guac_instruction_handler_tables_seal_once,
+            __guac_instruction_handler_tables_seal);
 
-        /* If recognized, call handler */
-        if (strcmp(opcode, current->opcode) == 0)
-            return current->handler(user, argc, argv);
+    /* If recognized, call handler */
+    __guac_instruction_handler* handler =
+        __guac_instruction_handler_table_get(table, opcode);
 
-        current++;
-    }
+    if (handler != NULL)
+        return handler(user, argc, argv);
 
     /* If unrecognized, log and ignore */
     guac_user_log(user, GUAC_LOG_DEBUG, "Handler not found for \"%s\"",
@@ -71,6 +71,63 @@ typedef struct __guac_instruction_handler_mapping {
 
 } __guac_instruction_handler_mapping;
 
+/**
+ * The number of slots within each __guac_instruction_handler_table. This MUST
+ * be a power of two.
+ */
+#define GUAC_INSTRUCTION_HANDLER_TABLE_SIZE 64
+
+/**
+ * The maximum number of handlers which may be stored within each
+ * __guac_instruction_handler_table. This is intentionally smaller than
+ * GUAC_INSTRUCTION_HANDLER_TABLE_SIZE such that empty slots always remain.
+ */
+#define GUAC_INSTRUCTION_HANDLER_TABLE_MAX_ENTRIES 48
+
+/**
+ * A single slot within a __guac_instruction_handler_table.
+ */
+typedef struct __guac_instruction_handler_slot {
+
+    /**
+     * The instruction opcode which maps to a specific handler, or NULL if
+     * this slot is empty.
+     */
+    const char* opcode;
+
+    /**
+     * The length of the opcode, in bytes.
+     */
+    size_t length;
+
+    /**
+     * The handler which maps to a specific opcode.
+     */
+    __guac_instruction_handler* handler;
+
+} __guac_instruction_handler_slot;
+
+/**
+ * Hash table mapping instruction opcodes to instruction handlers. Each opcode
+ * is hashed by its length and its first and last characters, which is
+ * sufficient to assign a unique slot to each opcode handled by libguac
+ * itself. Additional opcodes which collide are stored in the next available
+ * slot.
+ */
+typedef struct __guac_instruction_handler_table {
+
+    /**
+     * The number of handlers currently stored within this table.
+     */
+    int count;
+
+    /**
+     * All slots within this table.
+     */
+    __guac_instruction_handler_slot slots[GUAC_INSTRUCTION_HANDLER_TABLE_SIZE];
+
+} __guac_instruction_handler_table;
+
 /**
  * Internal initial handler for the sync instruction. When a sync instruction
  * is received, this handler will be called. Sync instructions are automatically
@@ -236,6 +293,62 @@ extern __guac_instruction_handler_mapping __guac_instruction_handler_map[];
  */
 extern __guac_instruction_handler_mapping __guac_handshake_handler_map[];
 
+/**
+ * Lookup table containing the handlers of __guac_instruction_handler_map, as
+ * well as any handlers registered with
+ * guac_user_register_instruction_handler().
+ */
+extern __guac_instruction_handler_table __guac_instruction_handlers;
+
+/**
+ * Lookup table containing the handlers of __guac_handshake_handler_map.
+ */
+extern __guac_instruction_handler_table __guac_handshake_handlers;
+
+/**
+ * Adds the given handler to the given lookup table, such that it will be
+ * invoked by __guac_user_call_opcode_handler() for all instructions having
+ * the given opcode.
+ *
+ * @param table
+ *     The lookup table to add the handler to.
+ *
+ * @param opcode
+ *     The opcode of the instructions to be handled. This string must remain
+ *     valid for the life of the process.
+ *
+ * @param handler
+ *     The handler to invoke for all instructions having the given opcode.
+ *
+ * @return
+ *     Zero if the handler was added successfully, non-zero if the opcode
+ *     already has a handler, the table is full, or instructions have already
+ *     been handled by __guac_user_call_opcode_handler(), in which case
+ *     guac_error and guac_error_message are set appropriately.
+ */
+int __guac_instruction_handler_table_add(
+        __guac_instruction_handler_table* table, const char* opcode,
+        __guac_instruction_handler* handler);
+
+/**
+ * Returns the handler stored within the given lookup table for the given
+ * opcode. The table is searched without locking, and thus this function
+ * must not be invoked while handlers may still be added to the table by
+ * other threads. __guac_user_call_opcode_handler() ensures this by refusing
+ * to add further handlers once any instruction has been handled.
+ *
+ * @param table
+ *     The lookup table to search.
+ *
+ * @param opcode
+ *     The opcode of the instruction to be handled.
+ *
+ * @return
+ *     The handler for the given opcode, or NULL if there is no such handler.
+ */
+__guac_instruction_handler* __guac_instruction_handler_table_get(
+        __guac_instruction_handler_table* table, const char* opcode);
+
 /**
  * Frees the given array of mimetypes, including the space allocated to each
  * mimetype string within the array. The provided array of mimetypes MUST have
@@ -267,14 +380,13 @@ char** guac_copy_mimetypes(char** mimetypes, int count);
 
 /**
  * Call the appropriate handler defined by the given user for the given
- * instruction. A comparison is made between the instruction opcode and the
- * initial handler lookup table defined in the map that is provided to this
- * function. If an entry for the instruction is found in the provided map,
- * the handler defined in that map will be called and the value returned.  If
- * no match is found, it is silently ignored.
+ * instruction. The instruction opcode is looked up within the lookup table
+ * that is provided to this function. If an entry for the instruction is found
+ * in the provided table, the handler defined in that table will be called and
+ * the value returned.  If no match is found, it is silently ignored.
  *
- * @param map
- *     The array that holds the opcode to handler mappings.
+ * @param table
+ *     The lookup table that holds the opcode to handler mappings.
  * 
  * @param user
  *     The user whose handlers should be called.
@@ -292,7 +404,7 @@ char** guac_copy_mimetypes(char** mimetypes, int count);
  * @return
  *     Zero if the instruction was handled successfully, or non-zero otherwise.
  */
-int __guac_user_call_opcode_handler(__guac_instruction_handler_mapping* map,
+int __guac_user_call_opcode_handler(__guac_instruction_handler_table* table,
         guac_user* user, const char* opcode, int argc, char** argv);
 
 #endif
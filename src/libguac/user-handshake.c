@@ -24,6 +24,7 @@
 #include "guacamole/parser.h"
 #include "guacamole/protocol.h"
 #include "guacamole/socket.h"
+#include "guacamole/timestamp.h"
 #include "guacamole/user.h"
 #include "user-handlers.h"
 
@@ -54,6 +55,58 @@ typedef struct guac_user_input_thread_params {
 
 } guac_user_input_thread_params;
 
+/**
+ * A mouse event which has been received from a user but has not yet been
+ * passed to that user's mouse handler. Consecutive mouse events which move
+ * the mouse without changing the button state are coalesced while further
+ * input is already waiting to be handled, such that only the most recent
+ * position is handled. Events which change the button state are never
+ * coalesced, and no event is held back for longer than allowed by
+ * GUAC_USER_MOUSE_MAX_COALESCED and GUAC_USER_MOUSE_MAX_DELAY.
+ */
+typedef struct guac_user_pending_mouse {
+
+    /**
+     * Non-zero if a mouse event is pending, zero otherwise.
+     */
+    int pending;
+
+    /**
+     * The X coordinate of the pending mouse event.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the pending mouse event.
+     */
+    int y;
+
+    /**
+     * The button mask of the pending mouse event.
+     */
+    int mask;
+
+    /**
+     * The button mask of the last mouse event passed to the mouse handler.
+     */
+    int handled_mask;
+
+    /**
+     * The number of times the pending mouse event has replaced an older
+     * pending mouse event since a mouse event was last passed to the mouse
+     * handler.
+     */
+    int coalesced;
+
+    /**
+     * The time at which the oldest mouse event replaced by the pending mouse
+     * event was received, or at which the pending mouse event itself was
+     * received if it has replaced no other event.
+     */
+    guac_timestamp received;
+
+} guac_user_pending_mouse;
+
 /**
  * Prints an error message using the logging facilities of the given user,
  * automatically including any information present in guac_error.
@@ -114,9 +167,133 @@ static void guac_user_log_handshake_failure(guac_user* user) {
 
 }
 
+/**
+ * Returns whether further input from the given user can be handled without
+ * blocking, either because unparsed data containing the end of an
+ * instruction is already buffered by the parser, or because data is waiting
+ * to be read from the user's socket.
+ *
+ * @param parser
+ *     The parser being used to handle all input from the user.
+ *
+ * @param socket
+ *     The socket of the user.
+ *
+ * @return
+ *     Non-zero if further input is likely available without blocking, zero
+ *     otherwise.
+ */
+static int guac_user_input_available(guac_parser* parser,
+        guac_socket* socket) {
+
+    char* unparsed_start = parser->__instructionbuf_unparsed_start;
+    char* unparsed_end = parser->__instructionbuf_unparsed_end;
+
+    /* Check for instructions already buffered */
+    if (memchr(unparsed_start, ';', unparsed_end - unparsed_start) != NULL)
+        return 1;
+
+    /* Check for data not yet read */
+    return guac_socket_select(socket, 0) > 0;
+
+}
+
+/**
+ * Returns whether the given pending mouse event has been held back for as long
+ * as allowed, and must be passed to the mouse handler regardless of whether
+ * further input is available.
+ *
+ * @param mouse
+ *     The pending mouse event to check.
+ *
+ * @return
+ *     Non-zero if a mouse event is pending and must be handled immediately,
+ *     zero otherwise.
+ */
+static int guac_user_mouse_overdue(guac_user_pending_mouse* mouse) {
+
+    if (!mouse->pending)
+        return 0;
+
+    return mouse->coalesced >= GUAC_USER_MOUSE_MAX_COALESCED
+        || guac_timestamp_current() - mouse->received
+            >= GUAC_USER_MOUSE_MAX_DELAY;
+
+}
+
+/**
+ * Returns the number of microseconds that the given pending mouse event may
+ * continue to be held back before it must be passed to the mouse handler.
+ *
+ * @param mouse
+ *     The pending mouse event to check.
+ *
+ * @return
+ *     The number of microseconds remaining before the pending mouse event
+ *     must be handled, or zero if it must be handled immediately.
+ */
+static int guac_user_mouse_remaining(guac_user_pending_mouse* mouse) {
+
+    guac_timestamp elapsed = guac_timestamp_current() - mouse->received;
+    if (elapsed >= GUAC_USER_MOUSE_MAX_DELAY)
+        return 0;
+
+    return (GUAC_USER_MOUSE_MAX_DELAY - elapsed) * 1000;
+
+}
+
+/**
+ * Passes the given pending mouse event, if any, to the mouse handler of the
+ * given user, clearing the pending event. If the mouse handler fails, the
+ * user is stopped.
+ *
+ * @param user
+ *     The user that sent the mouse event.
+ *
+ * @param mouse
+ *     The pending mouse event to handle.
+ *
+ * @return
+ *     Zero if no mouse event was pending or the mouse event was handled
+ *     successfully, non-zero if the mouse handler failed.
+ */
+static int guac_user_flush_mouse(guac_user* user,
+        guac_user_pending_mouse* mouse) {
+
+    if (!mouse->pending)
+        return 0;
+
+    mouse->pending = 0;
+    mouse->handled_mask = mouse->mask;
+
+    /* Reset guac_error and guac_error_message (user/client handlers are not
+     * guaranteed to set these) */
+    guac_error = GUAC_STATUS_SUCCESS;
+    guac_error_message = NULL;
+
+    if (user->mouse_handler != NULL
+            && user->mouse_handler(user, mouse->x, mouse->y, mouse->mask)) {
+
+        /* Log error */
+        guac_user_log_guac_error(user, GUAC_LOG_WARNING,
+                "User connection aborted");
+
+        /* Log handler details */
+        guac_user_log(user, GUAC_LOG_DEBUG, "Failing instruction handler in user was \"mouse\"");
+
+        guac_user_stop(user);
+        return 1;
+    }
+
+    return 0;
+
+}
+
 /**
  * The thread which handles all user input, calling event handlers for received
- * instructions.
+ * instructions. Mouse events are coalesced while the user's handlers are
+ * unable to keep up with received input, with all other instructions being
+ * handled strictly in order.
  *
  * @param data
  *     A pointer to a guac_user_input_thread_params structure describing the
@@ -137,11 +314,36 @@ static void* guac_user_input_thread(void* data) {
     guac_client* client = user->client;
     guac_socket* socket = user->socket;
 
+    guac_user_pending_mouse mouse = { .pending = 0, .handled_mask = 0 };
+
     /* Guacamole user input loop */
     while (client->state == GUAC_CLIENT_RUNNING && user->active) {
 
+        /* Handle any pending mouse event before waiting for further input,
+         * or if that event has already been held back for too long */
+        if (mouse.pending && (!guac_user_input_available(parser, socket)
+                    || guac_user_mouse_overdue(&mouse))
+                && guac_user_flush_mouse(user, &mouse))
+            return NULL;
+
+        /* Wait no longer than the pending mouse event may be held back */
+        int read_timeout = usec_timeout;
+        if (mouse.pending) {
+            int remaining = guac_user_mouse_remaining(&mouse);
+            if (read_timeout < 0 || remaining < read_timeout)
+                read_timeout = remaining;
+        }
+
         /* Read instruction, stop on error */
-        if (guac_parser_read(parser, socket, usec_timeout)) {
+        if (guac_parser_read(parser, socket, read_timeout)) {
+
+            /* Handle the pending mouse event if it could not be held back
+             * any longer, resuming the read afterwards */
+            if (guac_error == GUAC_STATUS_TIMEOUT && mouse.pending) {
+                if (guac_user_flush_mouse(user, &mouse))
+                    return NULL;
+                continue;
+            }
 
             if (guac_error == GUAC_STATUS_TIMEOUT)
                 guac_user_abort(user, GUAC_PROTOCOL_STATUS_CLIENT_TIMEOUT, "User is not responding.");
@@ -156,13 +358,47 @@ static void* guac_user_input_thread(void* data) {
             return NULL;
         }
 
+        /* Defer mouse events, replacing any pending event having the same
+         * button state */
+        if (parser->argc >= 3 && strcmp(parser->opcode, "mouse") == 0) {
+
+            int mask = atoi(parser->argv[2]);
+
+            /* Handle pending event first unless both events are simple
+             * moves having the same button state */
+            if (mouse.pending && (mouse.mask != mask
+                        || mouse.mask != mouse.handled_mask)
+                    && guac_user_flush_mouse(user, &mouse))
+                return NULL;
+
+            /* Track how long the position has been held back, starting
+             * from the first event since the mouse was last handled */
+            if (mouse.pending)
+                mouse.coalesced++;
+            else {
+                mouse.coalesced = 0;
+                mouse.received = guac_timestamp_current();
+            }
+
+            mouse.pending = 1;
+            mouse.x = atoi(parser->argv[0]);
+            mouse.y = atoi(parser->argv[1]);
+            mouse.mask = mask;
+            continue;
+
+        }
+
+        /* All other instructions are handled in order */
+        if (guac_user_flush_mouse(user, &mouse))
+            return NULL;
+
         /* Reset guac_error and guac_error_message (user/client handlers are not
          * guaranteed to set these) */
         guac_error = GUAC_STATUS_SUCCESS;
         guac_error_message = NULL;
 
         /* Call handler, stop on error */
-        if (__guac_user_call_opcode_handler(__guac_instruction_handler_map, 
+        if (__guac_user_call_opcode_handler(&__guac_instruction_handlers,
                 user, parser->opcode, parser->argc, parser->argv)) {
 
             /* Log error */
@@ -266,7 +502,7 @@ static int __guac_user_handshake(guac_user* user, guac_parser* parser,
                 parser->opcode);
         
         /* Run instruction handler for opcode with arguments. */
-        if (__guac_user_call_opcode_handler(__guac_handshake_handler_map, user,
+        if (__guac_user_call_opcode_handler(&__guac_handshake_handlers, user,
                 parser->opcode, parser->argc, parser->argv)) {
             
             guac_user_log_handshake_failure(user);
@@ -315,6 +551,20 @@ int guac_user_handle_connection(guac_user* user, int usec_timeout) {
     }
 
     guac_parser* parser = guac_parser_alloc();
+    if (parser == NULL) {
+        guac_user_log_guac_error(user, GUAC_LOG_DEBUG,
+                "Error allocating parser for new user");
+        return 1;
+    }
+
+    /* Allow users to send data using fewer, larger blobs */
+    if (guac_parser_set_max_element_length(parser,
+                GUAC_USER_MAX_ELEMENT_LENGTH)) {
+        guac_user_log_guac_error(user, GUAC_LOG_DEBUG,
+                "Error configuring parser for new user");
+        guac_parser_free(parser);
+        return 1;
+    }
 
     /* Perform the handshake with the client. */
     if (__guac_user_handshake(user, parser, usec_timeout)) {
@@ -169,11 +169,19 @@ void guac_user_free_object(guac_user* user, guac_object* object) {
 
 int guac_user_handle_instruction(guac_user* user, const char* opcode, int argc, char** argv) {
 
-    return __guac_user_call_opcode_handler(__guac_instruction_handler_map,
+    return __guac_user_call_opcode_handler(&__guac_instruction_handlers,
             user, opcode, argc, argv);
 
 }
 
+int guac_user_register_instruction_handler(const char* opcode,
+        guac_user_instruction_handler* handler) {
+
+    return __guac_instruction_handler_table_add(&__guac_instruction_handlers,
+            opcode, handler);
+
+}
+
 void guac_user_stop(guac_user* user) {
     user->active = 0;
 }
@@ -260,7 +268,7 @@ void guac_user_stream_png(guac_user* user, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/png", x, y);
 
     /* Write PNG data */
-    guac_png_write(socket, stream, surface);
+    guac_png_write(socket, stream, surface, NULL);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);
@@ -303,7 +311,8 @@ void guac_user_stream_webp(guac_user* user, guac_socket* socket,
     guac_protocol_send_img(socket, stream, mode, layer, "image/webp", x, y);
 
     /* Write WebP data */
-    guac_webp_write(socket, stream, surface, quality, lossless);
+    guac_webp_write(socket, stream, surface, quality, lossless,
+            GUAC_IMAGE_WEBP_DEFAULT_METHOD);
 
     /* Terminate stream */
     guac_protocol_send_end(socket, stream);